@@ -0,0 +1,288 @@
+#include "demosaic.hpp"
+#include "experiment_common.hpp"
+#include "parallel.hpp"
+#include "raw_converter.hpp"
+#include <algorithm>
+#include <boost/log/trivial.hpp>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cxxopts.hpp>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr double pi = 3.14159265358979323846;
+
+/**
+ * @brief Best time of one demosaic method on one input.
+ */
+struct Result {
+  std::string method;
+  double ms = 0;
+  // Against the ground truth of a synthetic input; NaN for files.
+  double psnr = std::numeric_limits<double>::quiet_NaN();
+};
+
+// Fastest of repeat runs of fn in milliseconds.
+double best_ms(const std::size_t repeat, const std::function<void()> &fn) {
+  double res = std::numeric_limits<double>::infinity();
+  for (std::size_t run = 0; run < repeat; run++) {
+    const auto start = std::chrono::steady_clock::now();
+    fn();
+    res = std::min(res, std::chrono::duration<double, std::milli>(
+                            std::chrono::steady_clock::now() - start)
+                            .count());
+  }
+  return res;
+}
+
+// PSNR in dB of a planar (3, n) image against an interleaved 4-channel one
+// (LibRaw's imgdata.image) or another planar one.
+double psnr(const std::vector<ushort> &truth, const ushort *image,
+            const std::size_t n, const bool interleaved) {
+  double sse = 0;
+  for (std::size_t ch = 0; ch < 3; ch++) {
+    for (std::size_t i = 0; i < n; i++) {
+      const double v = interleaved ? image[4 * i + ch] : image[ch * n + i];
+      const double d = v - truth[ch * n + i];
+      sse += d * d;
+    }
+  }
+  const double mse = sse / (3 * n);
+  return 0 < mse ? 10 * std::log10(65535. * 65535. / mse)
+                 : std::numeric_limits<double>::infinity();
+}
+
+// Deterministic 16-bit scene of shape (3, width * height): flat patches of
+// hashed colors with sharp borders on the left, a gray zone plate on the
+// right, so both edges and fine detail are measured.
+std::vector<ushort> make_scene(const std::size_t width,
+                               const std::size_t height) {
+  const std::size_t n = width * height;
+  std::vector<ushort> res(3 * n);
+  const double cx = 0.75 * width, cy = 0.5 * height;
+  const double k = pi / (2. * std::max(width, height));
+  yk::parallel_for(height, [&](std::size_t begin, std::size_t end,
+                               std::size_t) {
+    for (std::size_t y = begin; y < end; y++) {
+      for (std::size_t x = 0; x < width; x++) {
+        const std::size_t i = y * width + x;
+        if (2 * x < width) {
+          const std::uint32_t patch = std::uint32_t(
+              (y * 6 / height) * 8 + x * 16 / width);
+          const std::uint32_t hash = patch * 2654435761u;
+          for (std::size_t ch = 0; ch < 3; ch++) {
+            res[ch * n + i] = ushort(4000 + (hash >> (8 * ch) & 0xff) * 200);
+          }
+        } else {
+          const double r2 = (x - cx) * (x - cx) + (y - cy) * (y - cy);
+          const auto v = ushort(32768 + 24000 * std::cos(k * r2));
+          for (std::size_t ch = 0; ch < 3; ch++) {
+            res[ch * n + i] = v;
+          }
+        }
+      }
+    }
+  });
+  return res;
+}
+
+// Sample a planar scene through an RGGB CFA.
+std::vector<ushort> mosaic(const std::vector<ushort> &scene,
+                           const std::size_t width,
+                           const std::size_t height) {
+  const std::size_t n = width * height;
+  std::vector<ushort> res(n);
+  for (std::size_t y = 0; y < height; y++) {
+    for (std::size_t x = 0; x < width; x++) {
+      const std::size_t ch = (y & 1) + (x & 1);
+      res[y * width + x] = scene[ch * n + y * width + x];
+    }
+  }
+  return res;
+}
+
+// dcraw_process() with AHD and nothing else that changes the values: raw
+// color, no white balance, linear output of the 16-bit range.
+void set_ahd_params(LibRaw &raw) {
+  auto &params = raw.imgdata.params;
+  params.user_qual = 3;
+  params.output_color = 0;
+  params.output_bps = 16;
+  params.user_flip = 0;
+  params.half_size = 0;
+  params.use_auto_wb = 0;
+  params.use_camera_wb = 0;
+  params.no_auto_bright = 1;
+  params.highlight = 0;
+  for (int c = 0; c < 4; c++) {
+    params.user_mul[c] = 1.f;
+  }
+}
+
+void run_ahd(LibRaw &raw) {
+  if (raw.dcraw_process() != LIBRAW_SUCCESS) {
+    throw std::runtime_error("LibRaw failed in dcraw_process().");
+  }
+}
+
+const yk::DemosaicMethod methods[] = {yk::DemosaicMethod::bilinear,
+                                      yk::DemosaicMethod::edge_aware};
+const char *method_names[] = {"bilinear", "edge"};
+
+std::vector<Result> run_synthetic(const std::size_t width,
+                                  const std::size_t height,
+                                  const std::size_t repeat) {
+  const std::size_t n = width * height;
+  const auto scene = make_scene(width, height);
+  const auto raw_data = mosaic(scene, width, height);
+  const auto cfa = yk::parse_cfa_pattern("RGGB");
+  std::vector<Result> res;
+  std::vector<ushort> image(3 * n);
+  for (std::size_t m = 0; m < 2; m++) {
+    Result r;
+    r.method = method_names[m];
+    r.ms = best_ms(repeat, [&] {
+      yk::demosaic(raw_data.data(), width, height, width, cfa, image.data(),
+                   methods[m]);
+    });
+    r.psnr = psnr(scene, image.data(), n, false);
+    res.push_back(r);
+  }
+
+  auto raw = std::make_unique<LibRaw>();
+  if (raw->open_bayer(
+          reinterpret_cast<const unsigned char *>(raw_data.data()),
+          unsigned(n * sizeof(ushort)), ushort(width), ushort(height), 0, 0,
+          0, 0, 0, LIBRAW_OPENBAYER_RGGB, 0, 0, 0) != LIBRAW_SUCCESS ||
+      raw->unpack() != LIBRAW_SUCCESS) {
+    throw std::runtime_error("LibRaw failed to open the synthetic mosaic.");
+  }
+  set_ahd_params(*raw);
+  Result r;
+  r.method = "libraw_ahd";
+  r.ms = best_ms(repeat, [&] { run_ahd(*raw); });
+  if ((std::size_t)raw->imgdata.sizes.iwidth * raw->imgdata.sizes.iheight ==
+      n) {
+    r.psnr = psnr(scene, &raw->imgdata.image[0][0], n, true);
+  }
+  res.push_back(r);
+  return res;
+}
+
+std::vector<Result> run_file(const std::string &filename,
+                             const std::size_t repeat, std::size_t &width,
+                             std::size_t &height) {
+  auto raw = std::make_unique<LibRaw>();
+  if (raw->open_file(filename.c_str()) != LIBRAW_SUCCESS ||
+      raw->unpack() != LIBRAW_SUCCESS) {
+    throw std::runtime_error("LibRaw failed to read file: " + filename);
+  }
+  width = raw->imgdata.sizes.width;
+  height = raw->imgdata.sizes.height;
+  const yk::RawConverter rc{};
+  const auto cfa = yk::RawConverter::cfa_pattern(*raw);
+  std::vector<Result> res;
+  for (std::size_t m = 0; m < 2; m++) {
+    Result r;
+    r.method = method_names[m];
+    r.ms = best_ms(repeat, [&] {
+      rc.demosaic(raw->imgdata.rawdata, raw->imgdata.sizes, cfa, methods[m]);
+    });
+    res.push_back(r);
+  }
+  set_ahd_params(*raw);
+  Result r;
+  r.method = "libraw_ahd";
+  r.ms = best_ms(repeat, [&] { run_ahd(*raw); });
+  res.push_back(r);
+  return res;
+}
+
+void print(const std::string &input, const std::size_t width,
+           const std::size_t height, const std::vector<Result> &results) {
+  const double megapixels = double(width) * height / 1e6;
+  std::cout << input << " (" << width << "x" << height << ")" << std::endl;
+  for (const auto &r : results) {
+    std::cout << " -- " << std::setw(10) << std::left << r.method
+              << std::right << std::fixed << std::setprecision(2)
+              << std::setw(9) << r.ms << " ms " << std::setw(9)
+              << megapixels / r.ms * 1e3 << " MP/s";
+    if (!std::isnan(r.psnr)) {
+      std::cout << std::setw(8) << r.psnr << " dB";
+    }
+    std::cout << std::defaultfloat << std::endl;
+  }
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  try {
+    cxxopts::Options options(
+        "Demosaic Benchmark",
+        "The program times the bilinear and edge-aware demosaic of "
+        "RawConverter against the AHD interpolation of LibRaw "
+        "dcraw_process() on the same Bayer input. With -s, a synthetic "
+        "scene is mosaiced and each result is also compared with it (PSNR). "
+        "The LibRaw time includes its scaling passes and uses its own "
+        "threading (OpenMP builds only).");
+
+    options.add_options()("f,files", "Bayer raw file paths",
+                          cxxopts::value<std::vector<std::string>>())(
+        "s,synthetic", "Benchmark a synthetic scene",
+        cxxopts::value<bool>())(
+        "width", "Width of the synthetic scene",
+        cxxopts::value<std::uint32_t>()->default_value("4032"))(
+        "height", "Height of the synthetic scene",
+        cxxopts::value<std::uint32_t>()->default_value("3024"))(
+        "r,repeat", "Runs per method; the fastest run is reported",
+        cxxopts::value<std::size_t>()->default_value("3"))(
+        "j,threads", "Kernel threads. 0 uses all hardware threads.",
+        cxxopts::value<std::size_t>()->default_value("0"))(
+        "d,debug", "Enable debugging. Log file is output to ../logs/.",
+        cxxopts::value<bool>())("h,help", "Print usage");
+    options.parse_positional({"files"});
+    options.positional_help("RawFilePath...");
+
+    auto args = options.parse(argc, argv);
+    const bool synthetic = args["synthetic"].as<bool>();
+    if (args.count("help") || (!args.count("files") && !synthetic)) {
+      std::cout << options.help() << std::endl;
+      return 0;
+    }
+
+    yk::log_init(args["debug"].as<bool>(), "demosaicbenchmark-");
+    yk::set_num_threads(args["threads"].as<std::size_t>());
+    const std::size_t repeat =
+        std::max<std::size_t>(1, args["repeat"].as<std::size_t>());
+
+    if (synthetic) {
+      const std::size_t width = args["width"].as<std::uint32_t>();
+      const std::size_t height = args["height"].as<std::uint32_t>();
+      print("synthetic", width, height,
+            run_synthetic(width, height, repeat));
+    }
+    if (args.count("files")) {
+      for (const auto &filename :
+           args["files"].as<std::vector<std::string>>()) {
+        std::size_t width, height;
+        const auto results = run_file(filename, repeat, width, height);
+        print(filename, width, height, results);
+      }
+    }
+    return 0;
+  } catch (std::exception &e) {
+    std::cerr << e.what() << std::endl;
+    BOOST_LOG_TRIVIAL(fatal) << e.what();
+    return 1;
+  }
+}
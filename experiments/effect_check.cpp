@@ -128,9 +128,9 @@ int main(int argc, char *argv[]) {
     // Convert raw image to sRGB.
     {
       double total_elapsed = 0;
-      BOOST_LOG_TRIVIAL(trace)
-          << "Original image[:, " << image.shape()[1] / 2
-          << "]: " << xt::view(image, xt::all(), image.shape()[1] / 2);
+      YK_LOG_TRACE("Original image[:, "
+                   << image.shape()[1] / 2 << "]: "
+                   << xt::view(image, xt::all(), image.shape()[1] / 2));
 
       xt::xtensor<float, 2> result({3, image.shape()[1]});
       result = image;
@@ -145,9 +145,9 @@ int main(int argc, char *argv[]) {
         double elapsed =
             std::chrono::duration_cast<std::chrono::milliseconds>(end - start)
                 .count();
-        BOOST_LOG_TRIVIAL(trace)
-            << "After cam-to-sRGB' image[:, " << image.shape()[1] / 2
-            << "]: " << xt::view(srgb_, xt::all(), image.shape()[1] / 2);
+        YK_LOG_TRACE("After cam-to-sRGB' image[:, "
+                     << image.shape()[1] / 2 << "]: "
+                     << xt::view(srgb_, xt::all(), image.shape()[1] / 2));
 
         BOOST_LOG_TRIVIAL(debug)
             << "Done conversion from camera native color space "
@@ -172,11 +172,9 @@ int main(int argc, char *argv[]) {
         double elapsed =
             std::chrono::duration_cast<std::chrono::milliseconds>(end - start)
                 .count();
-        BOOST_LOG_TRIVIAL(trace) << rc.debug_message.str();
-        rc.debug_message.str("");
-        BOOST_LOG_TRIVIAL(trace)
-            << "After adjustment image[:, " << image.shape()[1] / 2
-            << "]: " << xt::view(srgb_adj, xt::all(), image.shape()[1] / 2);
+        YK_LOG_TRACE("After adjustment image[:, "
+                     << image.shape()[1] / 2 << "]: "
+                     << xt::view(srgb_adj, xt::all(), image.shape()[1] / 2));
         BOOST_LOG_TRIVIAL(debug)
             << "Done adjusting the brightness and contrast. "
             << "Run time (ms): " << std::to_string(elapsed);
@@ -207,9 +205,9 @@ int main(int argc, char *argv[]) {
                     << std::endl;
         }
         total_elapsed += elapsed;
-        BOOST_LOG_TRIVIAL(trace)
-            << "After gamma correction image[:, " << image.shape()[1] / 2
-            << "]: " << xt::view(sRGB, xt::all(), image.shape()[1] / 2);
+        YK_LOG_TRACE("After gamma correction image[:, "
+                     << image.shape()[1] / 2 << "]: "
+                     << xt::view(sRGB, xt::all(), image.shape()[1] / 2));
         result = sRGB;
       }
 
@@ -1,16 +1,25 @@
 #pragma ones
 
+#include "async_log.hpp"
+#include "logging.hpp"
+#include "memory_tracker.hpp"
+#include <algorithm>
 #include <boost/log/trivial.hpp>
 #include <boost/log/utility/setup/common_attributes.hpp>
 #include <boost/log/utility/setup/file.hpp>
 #include <filesystem>
 #include <iostream>
+#include <libraw.h>
 #include <opencv2/opencv.hpp>
+#include <stdexcept>
 #include <xtensor/xtensor.hpp>
 
 namespace yk {
 // Set up logger
-static void log_init(const bool is_debug, const std::string file_prefix = "") {
+// With async, records of the logging facade are queued per thread and
+// written to the file by a single background thread (see AsyncLogger).
+static void log_init(const bool is_debug, const std::string file_prefix = "",
+                     const bool async = false) {
   if (is_debug) {
     boost::log::core::get()->set_filter(boost::log::trivial::severity >=
                                         boost::log::trivial::trace);
@@ -28,6 +37,53 @@ static void log_init(const bool is_debug, const std::string file_prefix = "") {
       boost::log::keywords::format =
           "[%TimeStamp%] [%ThreadID%] [%Severity%] %Message%");
   boost::log::add_common_attributes();
+
+  // Records of the converter's logging facade go to the same file.
+  yk::set_log_level(is_debug ? yk::LogLevel::trace : yk::LogLevel::info);
+  yk::LogSink file_sink = [](const yk::LogLevel level,
+                             const std::string &message) {
+    BOOST_LOG_SEV(boost::log::trivial::logger::get(),
+                  static_cast<boost::log::trivial::severity_level>(level))
+        << message;
+  };
+  if (async) {
+    // Installs the logger and uninstalls it before it is destroyed at exit,
+    // so that records logged after that are discarded rather than pushed
+    // into a destroyed logger.
+    struct InstalledLogger {
+      yk::AsyncLogger logger;
+      explicit InstalledLogger(yk::LogSink sink) : logger(std::move(sink)) {
+        yk::set_log_sink(logger.sink());
+      }
+      ~InstalledLogger() { yk::set_log_sink(nullptr); }
+    };
+    static InstalledLogger installed(std::move(file_sink));
+  } else {
+    yk::set_log_sink(std::move(file_sink));
+  }
+}
+
+/**
+ * @brief Open and unpack a raw file with LibRaw and copy the first three
+ * channels of its (already demosaiced) color4_image into a (3, N) tensor.
+ */
+static xt::xtensor<ushort, 2> load_raw_image(LibRaw &raw,
+                                             const std::string &filename) {
+  if (raw.open_file(filename.c_str()) != LIBRAW_SUCCESS) {
+    throw std::runtime_error("LibRaw failed to read file: " + filename);
+  }
+  if (raw.unpack() != LIBRAW_SUCCESS) {
+    throw std::runtime_error("LibRaw failed to unpack. file: " + filename);
+  }
+  const std::size_t n =
+      (std::size_t)raw.imgdata.sizes.iheight * raw.imgdata.sizes.iwidth;
+  xt::xtensor<ushort, 2> image({3, n});
+  for (std::size_t i = 0; i < n; i++) {
+    for (int ch = 0; ch < 3; ch++) {
+      image(ch, i) = raw.imgdata.rawdata.color4_image[i][ch];
+    }
+  }
+  return image;
 }
 
 auto ToCvMat3b(const xt::xtensor<ushort, 2> &src, const std::size_t rows,
@@ -48,4 +104,25 @@ auto ToCvMat3b(const xt::xtensor<ushort, 2> &src, const std::size_t rows,
   }
   return dst;
 }
+
+/**
+ * @brief 16-bit BGR image of encoded float data. Values are clipped to
+ * [0, 1] here, at the final quantisation.
+ */
+auto ToCvMat3w(const xt::xtensor<float, 2> &src, const std::size_t rows,
+               const std::size_t cols) noexcept {
+  cv::Mat dst(rows, cols, CV_16UC3);
+  auto quantize = [](const float v) {
+    return static_cast<ushort>(std::clamp(v, 0.f, 1.f) * USHRT_MAX + 0.5f);
+  };
+  for (int r = 0, i = 0; r < rows; r++) {
+    for (int c = 0; c < cols; c++, i++) {
+      auto &pixel = dst.at<cv::Vec3w>(r, c);
+      pixel[0] = quantize(src(2, i));
+      pixel[1] = quantize(src(1, i));
+      pixel[2] = quantize(src(0, i));
+    }
+  }
+  return dst;
+}
 } // namespace yk
\ No newline at end of file
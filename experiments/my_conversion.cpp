@@ -1,6 +1,11 @@
+#include "autotune.hpp"
+#include "dng_opcodes.hpp"
+#include "gain_table_map.hpp"
 #include "experiment_common.hpp"
+#include "perf_counters.hpp"
 #include "raw_converter.hpp"
 #include <boost/log/trivial.hpp>
+#include <cmath>
 #include <cxxopts.hpp>
 #include <iostream>
 #include <opencv2/opencv.hpp>
@@ -35,8 +40,62 @@ int main(int argc, char *argv[]) {
         "means "
         "converting to a completely black image.",
         cxxopts::value<float>()->default_value("0."))(
+        "l,local",
+        "Apply tiled local contrast equalisation (CLAHE) with the given "
+        "clip limit after the global adjustment. 0 disables it.",
+        cxxopts::value<float>()->default_value("0."))(
         "m,measure", "Measure execution speed",
-        cxxopts::value<bool>())("h,help", "Print usage");
+        cxxopts::value<bool>())(
+        "p,perf",
+        "Report hardware counters (IPC, bytes per cycle, LLC and branch "
+        "misses) and memory use of each stage. Counters require "
+        "perf_event_open access.",
+        cxxopts::value<bool>())(
+        "t,tune",
+        "Apply the tuned kernel parameters of this host, calibrating them on "
+        "first use. The profile is kept in ~/.cache/rawconverter/ unless "
+        "RAWCONVERTER_TUNING_PROFILE is set.",
+        cxxopts::value<bool>())(
+        "retune", "Recalibrate the kernel parameters of this host",
+        cxxopts::value<bool>())(
+        "half",
+        "Store the sRGB' intermediate as fp16 instead of float. With -m the "
+        "fp16 error against the float path is printed.",
+        cxxopts::value<bool>())(
+        "transfer",
+        "Convert in scene-linear fp32 without clipping and encode with a "
+        "transfer function (srgb, rec709, prophoto, pq or hlg) into a 16-bit "
+        "PNG. -a and -l are ignored.",
+        cxxopts::value<std::string>())(
+        "exposure", "Exposure of the scene-linear path in stops",
+        cxxopts::value<float>()->default_value("0"))(
+        "space",
+        "Output color space: srgb, display-p3, rec2020, prophoto or acescg. "
+        "Its matrix is composed into the color pass and its curve replaces "
+        "the sRGB gamma.",
+        cxxopts::value<std::string>()->default_value("srgb"))(
+        "wb",
+        "White balance applied with the black level: none, as-shot, auto "
+        "(gray world) or multipliers such as 2.1,1,1.6",
+        cxxopts::value<std::string>()->default_value("none"))(
+        "no-gain-map",
+        "Do not apply the GainMap opcodes (lens shading) of the DNG",
+        cxxopts::value<bool>())(
+        "profile",
+        "Render with the HueSatMap, LookTable and ProfileToneCurve of the "
+        "DNG's camera profile, fused into the color pass",
+        cxxopts::value<bool>())(
+        "dcp", "Render with the tables of this DCP camera profile instead",
+        cxxopts::value<std::string>())(
+        "demosaic",
+        "Demosaic method of Bayer DNGs: bilinear or edge (edge-aware). "
+        "Linear DNGs such as ProRaw are already demosaiced.",
+        cxxopts::value<std::string>()->default_value("bilinear"))(
+        "no-gain-table",
+        "Do not apply the ProfileGainTableMap (local tone mapping) of the "
+        "DNG",
+        cxxopts::value<bool>())(
+        "h,help", "Print usage");
     options.parse_positional({"file"});
     options.positional_help("ProRawFilePath");
 
@@ -51,15 +110,48 @@ int main(int argc, char *argv[]) {
     const bool is_debug = args["debug"].as<bool>();
     const bool save_raw = args["raw"].as<bool>();
     const bool measure_speed = args["measure"].as<bool>();
+    const bool measure_perf = args["perf"].as<bool>();
+    const bool retune = args["retune"].as<bool>();
+    const bool tune = args["tune"].as<bool>() || retune;
+    const bool use_half = args["half"].as<bool>();
+    const auto white_balance =
+        yk::parse_white_balance(args["wb"].as<std::string>());
+    const bool use_gain_map = !args["no-gain-map"].as<bool>();
+    const bool use_gain_table = !args["no-gain-table"].as<bool>();
+    const bool use_profile = args["profile"].as<bool>() || args.count("dcp");
+    if (use_profile && use_half) {
+      throw std::invalid_argument("--profile and --dcp cannot be combined "
+                                  "with --half");
+    }
+    const auto demosaic_method =
+        yk::parse_demosaic_method(args["demosaic"].as<std::string>());
     const float alpha = args["alpha"].as<float>();
+    const float local_clip_limit = args["local"].as<float>();
+    const auto space = yk::parse_color_space(args["space"].as<std::string>());
 
     yk::log_init(is_debug, "myconversion-");
     BOOST_LOG_TRIVIAL(debug) << "Threshold: " << std::to_string(alpha);
 
+    if (tune) {
+      const auto profile = yk::autotune(yk::default_profile_path(), retune);
+      BOOST_LOG_TRIVIAL(info)
+          << "Tuning profile: threads=" << profile.threads
+          << ", grain_size=" << profile.grain_size
+          << ", color_block=" << profile.color_block;
+    }
+
+    yk::StageProfiler profiler(measure_perf);
+    if (measure_perf && !profiler.counters_available()) {
+      std::cerr << "Hardware counters are not available; reporting wall time "
+                   "only."
+                << std::endl;
+    }
+
     LibRaw raw;
 
     // Open a ProRaw file through LibRaw
-    {
+    // LibRaw allocates with malloc, so its memory shows as heap growth.
+    profiler.measure("libraw_unpack", 0, [&] {
       int res = raw.open_file(input_filename.c_str());
       if (res == LIBRAW_SUCCESS) {
         BOOST_LOG_TRIVIAL(debug) << "LibRaw successfully reads the raw file."
@@ -75,16 +167,76 @@ int main(int argc, char *argv[]) {
         throw std::runtime_error("LibRaw failed to unpack. file: " +
                                  input_filename);
       }
+    });
+
+    yk::RawConverter rc{};
+
+    const bool is_bayer = raw.imgdata.idata.filters != 0;
+
+    // DNG tags LibRaw does not expose: the GainMap opcodes and the
+    // ProfileGainTableMap.
+    std::vector<yk::GainMap> gain_maps, mosaic_gain_maps;
+    yk::GainTableMap gain_table;
+    bool has_gain_table = false;
+    if (use_gain_map || use_gain_table) {
+      try {
+        const auto tiff = yk::TiffReader::open(input_filename);
+        if (use_gain_map) {
+          std::vector<std::string> skipped;
+          // OpcodeList2 maps of a Bayer DNG address CFA sites, so they are
+          // applied to the mosaic before demosaicing.
+          auto list2 = yk::read_gain_maps(tiff, yk::opcode_list2_tag, &skipped);
+          gain_maps = yk::read_gain_maps(tiff, yk::opcode_list3_tag, &skipped);
+          if (is_bayer) {
+            mosaic_gain_maps = std::move(list2);
+          } else {
+            gain_maps.insert(gain_maps.begin(), list2.begin(), list2.end());
+          }
+          for (const auto &name : skipped) {
+            BOOST_LOG_TRIVIAL(debug) << "Skipped DNG opcode: " << name;
+          }
+        }
+        if (use_gain_table) {
+          has_gain_table = yk::read_gain_table_map(tiff, gain_table);
+        }
+      } catch (const std::exception &e) {
+        BOOST_LOG_TRIVIAL(warning) << "Failed to read DNG tags: " << e.what();
+      }
     }
 
-    // From LibRaw raw file to xtensor
-    xt::xtensor<ushort, 2> image({4, (std::size_t)(raw.imgdata.sizes.iheight *
-                                                   raw.imgdata.sizes.iwidth)});
-    for (int i = 0; i < image.shape()[1]; i++) {
-      xt::view(image, xt::all(), i) =
-          xt::adapt(raw.imgdata.rawdata.color4_image[i], {4});
+    // From LibRaw raw file to xtensor. Bayer files are demosaiced from
+    // raw_image; LibRaw has already interpolated linear DNGs.
+    xt::xtensor<ushort, 2> image;
+    if (is_bayer) {
+      // Reads one sample and writes three per pixel.
+      const std::size_t n =
+          (std::size_t)raw.imgdata.sizes.height * raw.imgdata.sizes.width;
+      const auto cfa = yk::RawConverter::cfa_pattern(raw);
+      if (!mosaic_gain_maps.empty()) {
+        BOOST_LOG_TRIVIAL(debug)
+            << "Mosaic gain maps: " << mosaic_gain_maps.size();
+        profiler.measure("mosaic_gain_maps", 2 * n * sizeof(ushort), [&] {
+          rc.apply_mosaic_gain_maps(raw.imgdata.rawdata, raw.imgdata.sizes,
+                                    raw.imgdata.color, cfa, mosaic_gain_maps);
+        });
+      }
+      image = profiler.measure("demosaic", 4 * n * sizeof(ushort), [&] {
+        return rc.demosaic(raw.imgdata.rawdata, raw.imgdata.sizes, cfa,
+                           demosaic_method);
+      });
+    } else {
+      image = profiler.measure("to_tensor", 0, [&] {
+        xt::xtensor<ushort, 2> rgbg(
+            {4, (std::size_t)(raw.imgdata.sizes.iheight *
+                              raw.imgdata.sizes.iwidth)});
+        for (int i = 0; i < rgbg.shape()[1]; i++) {
+          xt::view(rgbg, xt::all(), i) =
+              xt::adapt(raw.imgdata.rawdata.color4_image[i], {4});
+        }
+        return xt::xtensor<ushort, 2>(
+            xt::view(rgbg, xt::range(0, 3), xt::all()));
+      });
     }
-    image = xt::view(image, xt::range(0, 3), xt::all());
     {
       std::stringstream ss;
       ss << "Raw image shape: ";
@@ -106,11 +258,22 @@ int main(int argc, char *argv[]) {
       BOOST_LOG_TRIVIAL(trace) << "Saved image: " << ss.str();
     }
 
-    yk::RawConverter rc{};
-    rc.raw_adjust(image);
+    // Bytes read and written by a pass over n pixels of 3 channels.
+    const std::size_t n_pixels = image.shape()[1];
+    auto pass_bytes = [n_pixels](std::size_t in_size, std::size_t out_size) {
+      return 3 * n_pixels * (in_size + out_size);
+    };
 
-    // Subtract Black Level
-    // The black level is stored in DNG metadata.
+    if (has_gain_table) {
+      BOOST_LOG_TRIVIAL(debug)
+          << "ProfileGainTableMap: " << gain_table.points_v << "x"
+          << gain_table.points_h << "x" << gain_table.points_n;
+    }
+
+    // Scale to 16 bits, subtract the black level, white balance and apply
+    // the gain maps of the DNG in one pass. The black level is stored in DNG
+    // metadata.
+    std::array<float, 3> wb_gains = {1.f, 1.f, 1.f};
     {
       BOOST_LOG_TRIVIAL(debug)
           << "Black Level: " << raw.imgdata.color.black << std::endl;
@@ -122,30 +285,144 @@ int main(int argc, char *argv[]) {
       }
       BOOST_LOG_TRIVIAL(debug) << ss.str();
 
-      BOOST_LOG_TRIVIAL(trace) << "Subtract black level.";
-      rc.subtract_black(image, raw.imgdata.color.black,
-                        raw.imgdata.color.cblack);
+      BOOST_LOG_TRIVIAL(debug) << "Gain maps: " << gain_maps.size();
+
+      BOOST_LOG_TRIVIAL(trace) << "Normalize levels.";
+      auto params = is_bayer
+                        ? yk::RawConverter::cfa_level_params(raw.imgdata.color)
+                        : yk::RawConverter::level_params(raw.imgdata.color);
+      params.gains = profiler.measure("white_balance", 0, [&] {
+        return yk::white_balance_gains(
+            white_balance, image.data(), n_pixels, params,
+            yk::RawConverter::as_shot_neutral(raw.imgdata.color));
+      });
+      wb_gains = params.gains;
+      BOOST_LOG_TRIVIAL(debug) << "White balance gains: " << params.gains[0]
+                               << ", " << params.gains[1] << ", "
+                               << params.gains[2];
+      profiler.measure(
+          "normalize_levels", pass_bytes(sizeof(ushort), sizeof(ushort)), [&] {
+            rc.normalize_levels(image, raw.imgdata.sizes.iwidth,
+                                raw.imgdata.sizes.iheight, params, gain_maps);
+          });
+    }
+
+    // Rendering tables of the camera profile, with the HueSatMaps
+    // interpolated for the white point of the white balance (as-shot with
+    // --wb none). The profile renders from the color matrices of the DNG
+    // solved for that white point rather than from LibRaw's rgb_cam, which
+    // expects data balanced with pre_mul.
+    yk::ProfileTables profile_tables;
+    yk::Matrix3 profile_xyz{};
+    if (use_profile) {
+      yk::CameraProfile profile;
+      const std::string path =
+          args.count("dcp") ? args["dcp"].as<std::string>() : input_filename;
+      if (!yk::read_camera_profile(yk::TiffReader::open(path), profile)) {
+        throw std::runtime_error("No camera profile tables in " + path);
+      }
+      yk::WhitePointSolution solution;
+      profile_xyz = yk::xyz_from_balanced_camera(
+          yk::RawConverter::dng_color_profile(raw.imgdata.color),
+          yk::RawConverter::as_shot_neutral(raw.imgdata.color), wb_gains,
+          &solution);
+      profile_tables = yk::ProfileTables::prepare(profile, solution.weight);
+      BOOST_LOG_TRIVIAL(debug)
+          << "Camera profile: HueSatMap " << profile_tables.hue_sat.hues << "x"
+          << profile_tables.hue_sat.sats << "x" << profile_tables.hue_sat.vals
+          << ", LookTable " << profile_tables.look.hues << "x"
+          << profile_tables.look.sats << "x" << profile_tables.look.vals
+          << ", tone curve " << profile.tone_curve.size() << " points";
+    }
+
+    auto print_perf = [&] {
+      if (measure_perf) {
+        std::cout << "Per-stage measurements:" << std::endl;
+        for (const auto &report : profiler.reports()) {
+          std::cout << " -- " << report << std::endl;
+        }
+        std::cout << " -- Peak RSS (MiB): " << yk::peak_rss() / double(1 << 20)
+                  << std::endl;
+      }
+    };
+
+    // Scene-linear path: white is 1.0 and nothing is clipped before the
+    // transfer function.
+    if (args.count("transfer")) {
+      const auto tf =
+          yk::parse_transfer_function(args["transfer"].as<std::string>());
+      const float exposure = std::exp2(args["exposure"].as<float>());
+      auto &&linear = profiler.measure(
+          "scene_linear", pass_bytes(sizeof(ushort), sizeof(float)), [&] {
+            return rc.scene_linear(image, raw.imgdata.color.rgb_cam,
+                                   exposure, space);
+          });
+      auto &&encoded = profiler.measure(
+          "encode", pass_bytes(sizeof(float), sizeof(float)),
+          [&] { return rc.encode(linear, tf); });
+      print_perf();
+      std::string filename = input_filename + ".cv_";
+      if (space != yk::ColorSpace::sRGB) {
+        filename += std::string(yk::to_string(space)) + "_";
+      }
+      filename += std::string(yk::to_string(tf)) + ".png";
+      cv::imwrite(filename, yk::ToCvMat3w(encoded, raw.imgdata.sizes.iheight,
+                                          raw.imgdata.sizes.iwidth));
+      BOOST_LOG_TRIVIAL(trace) << "Saved image: " << filename;
+      return 0;
     }
 
     // Convert raw image to sRGB.
     {
       double total_elapsed = 0;
-      BOOST_LOG_TRIVIAL(trace)
-          << "Original image[:, " << image.shape()[1] / 2
-          << "]: " << xt::view(image, xt::all(), image.shape()[1] / 2);
+      YK_LOG_TRACE("Original image[:, "
+                   << image.shape()[1] / 2 << "]: "
+                   << xt::view(image, xt::all(), image.shape()[1] / 2));
 
       BOOST_LOG_TRIVIAL(trace)
           << "Converting raw from camera native color space to sRGB' (16-bit).";
       auto &&start = std::chrono::system_clock::now();
       // Camera native color space to sRGB'
-      auto &&srgb_ = rc.camera_to_sRGB(image, raw.imgdata.color.rgb_cam);
+      // The luminance histogram is built in the same pass and drives the
+      // brightness adjustment below.
+      // With --half the intermediate is stored as fp16 instead of float.
+      yk::Histogram luminance;
+      xt::xtensor<float, 2> srgb_;
+      xt::xtensor<yk::Half, 2> srgb_half;
+      const std::size_t srgb_size = use_half ? sizeof(yk::Half) : sizeof(float);
+      profiler.measure(
+          "camera_to_sRGB", pass_bytes(sizeof(ushort), srgb_size), [&] {
+            if (use_profile) {
+              srgb_ = rc.camera_to_rgb(image, profile_xyz, profile_tables,
+                                       space, &luminance);
+            } else if (use_half) {
+              srgb_half = rc.camera_to_rgb<yk::Half>(
+                  image, raw.imgdata.color.rgb_cam, space, &luminance);
+            } else {
+              srgb_ = rc.camera_to_rgb(image, raw.imgdata.color.rgb_cam,
+                                       space, &luminance);
+            }
+          });
+      if (has_gain_table && use_half) {
+        BOOST_LOG_TRIVIAL(warning)
+            << "The ProfileGainTableMap is not applied with --half.";
+      } else if (has_gain_table) {
+        profiler.measure(
+            "gain_table_map", pass_bytes(sizeof(float), sizeof(float)), [&] {
+              rc.apply_gain_table_map(srgb_, raw.imgdata.sizes.iwidth,
+                                      raw.imgdata.sizes.iheight, gain_table,
+                                      &luminance, space);
+            });
+      }
       auto &&end = std::chrono::system_clock::now();
       double elapsed =
           std::chrono::duration_cast<std::chrono::milliseconds>(end - start)
               .count();
-      BOOST_LOG_TRIVIAL(trace)
-          << "After cam-to-sRGB' image[:, " << image.shape()[1] / 2
-          << "]: " << xt::view(srgb_, xt::all(), image.shape()[1] / 2);
+      if (!use_half) {
+        YK_LOG_TRACE("After cam-to-sRGB' image[:, "
+                     << image.shape()[1] / 2 << "]: "
+                     << xt::view(srgb_, xt::all(), image.shape()[1] / 2));
+      }
 
       BOOST_LOG_TRIVIAL(debug)
           << "Done conversion from camera native color space "
@@ -159,6 +436,14 @@ int main(int argc, char *argv[]) {
                   << std::endl;
       }
       total_elapsed += elapsed;
+      if (use_half && measure_speed) {
+        // Reference float pass, outside the measured time.
+        const auto reference =
+            rc.camera_to_rgb(image, raw.imgdata.color.rgb_cam, space);
+        std::cout << " -- "
+                  << yk::half_error(reference.data(), reference.size())
+                  << std::endl;
+      }
 
       BOOST_LOG_TRIVIAL(trace) << "Adjusting the brightness and contrast.";
       if (is_debug && alpha == 0.f) {
@@ -166,16 +451,31 @@ int main(int argc, char *argv[]) {
                                     "the data is not stretched.";
       }
       start = std::chrono::system_clock::now();
-      auto &&srgb_adj = rc.adjust_brightness(srgb_, alpha, is_debug);
+      auto &&srgb_adj = profiler.measure(
+          "adjust_brightness", pass_bytes(srgb_size, sizeof(ushort)), [&] {
+            return use_half ? rc.adjust_brightness(srgb_half, alpha, is_debug,
+                                                   &luminance)
+                            : rc.adjust_brightness(srgb_, alpha, is_debug,
+                                                   &luminance);
+          });
+      if (0.f < local_clip_limit) {
+        yk::LocalToneMapParams params;
+        params.clip_limit = local_clip_limit;
+        srgb_adj = profiler.measure(
+            "local_contrast", pass_bytes(sizeof(ushort), sizeof(ushort)),
+            [&] {
+              return rc.adjust_local_contrast(
+                  srgb_adj, raw.imgdata.sizes.iwidth,
+                  raw.imgdata.sizes.iheight, params);
+            });
+      }
       end = std::chrono::system_clock::now();
       elapsed =
           std::chrono::duration_cast<std::chrono::milliseconds>(end - start)
               .count();
-      BOOST_LOG_TRIVIAL(trace) << rc.debug_message.str();
-      rc.debug_message.str("");
-      BOOST_LOG_TRIVIAL(trace)
-          << "After adjustment image[:, " << image.shape()[1] / 2
-          << "]: " << xt::view(srgb_adj, xt::all(), image.shape()[1] / 2);
+      YK_LOG_TRACE("After adjustment image[:, "
+                   << image.shape()[1] / 2 << "]: "
+                   << xt::view(srgb_adj, xt::all(), image.shape()[1] / 2));
       BOOST_LOG_TRIVIAL(debug) << "Done adjusting the brightness and contrast. "
                                << "Run time (ms): " << std::to_string(elapsed);
       if (measure_speed) {
@@ -187,7 +487,9 @@ int main(int argc, char *argv[]) {
 
       // Gamma Correction
       start = std::chrono::system_clock::now();
-      auto &&sRGB = rc.gamma_correction(srgb_adj);
+      auto &&sRGB = profiler.measure(
+          "gamma_correction", pass_bytes(sizeof(ushort), sizeof(ushort)),
+          [&] { return rc.gamma_correction(srgb_adj, space); });
       end = std::chrono::system_clock::now();
       elapsed =
           std::chrono::duration_cast<std::chrono::milliseconds>(end - start)
@@ -200,9 +502,9 @@ int main(int argc, char *argv[]) {
                   << std::endl;
       }
       total_elapsed += elapsed;
-      BOOST_LOG_TRIVIAL(trace)
-          << "After gamma correction image[:, " << image.shape()[1] / 2
-          << "]: " << xt::view(sRGB, xt::all(), image.shape()[1] / 2);
+      YK_LOG_TRACE("After gamma correction image[:, "
+                   << image.shape()[1] / 2 << "]: "
+                   << xt::view(sRGB, xt::all(), image.shape()[1] / 2));
 
       BOOST_LOG_TRIVIAL(debug)
           << "Done conversion from ProRaw to sRGB with the brightness and "
@@ -213,6 +515,7 @@ int main(int argc, char *argv[]) {
         std::cout << " -- Total run time (ms): "
                   << std::to_string(total_elapsed) << std::endl;
       }
+      print_perf();
       {
         BOOST_LOG_TRIVIAL(trace)
             << "Saving a conversion result through OpenCV.";
@@ -220,9 +523,11 @@ int main(int argc, char *argv[]) {
                                             raw.imgdata.sizes.iwidth);
         std::stringstream ss;
         if (alpha == 0.f) {
-          ss << input_filename << ".cv_srgb_no_adj.png";
+          ss << input_filename << ".cv_" << yk::to_string(space)
+             << "_no_adj.png";
         } else {
-          ss << input_filename << ".cv_srgb_adj_" << std::to_string(alpha)
+          ss << input_filename << ".cv_" << yk::to_string(space) << "_adj_"
+             << std::to_string(alpha)
              << ".png";
         }
         cv::imwrite(ss.str(), rgb_image);
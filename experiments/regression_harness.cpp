@@ -0,0 +1,420 @@
+#include "dng_opcodes.hpp"
+#include "experiment_common.hpp"
+#include "levels.hpp"
+#include "parallel.hpp"
+#include "perf_counters.hpp"
+#include "raw_converter.hpp"
+#include "synthetic_dng.hpp"
+#include <algorithm>
+#include <boost/log/trivial.hpp>
+#include <cmath>
+#include <cstdint>
+#include <cxxopts.hpp>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+/**
+ * @brief Difference between the outputs of the two pipelines.
+ */
+struct ImageDiff {
+  // False if the outputs differ in size and were not compared.
+  bool comparable = false;
+  // Peak signal-to-noise ratio in dB for 16-bit data; infinite if identical.
+  double psnr = 0;
+  double max_abs = 0;
+  double mean_abs = 0;
+};
+
+struct PipelineResult {
+  std::vector<yk::StageReport> stages;
+  double total_ms = 0;
+};
+
+struct FileResult {
+  std::string path;
+  std::size_t width = 0;
+  std::size_t height = 0;
+  PipelineResult rawconverter;
+  PipelineResult libraw;
+  ImageDiff diff;
+};
+
+double total_ms(const std::vector<yk::StageReport> &stages) {
+  double res = 0;
+  for (const auto &s : stages) {
+    res += s.sample.ms;
+  }
+  return res;
+}
+
+void open_raw(LibRaw &raw, const std::string &filename) {
+  if (raw.open_file(filename.c_str()) != LIBRAW_SUCCESS) {
+    throw std::runtime_error("LibRaw failed to read file: " + filename);
+  }
+  if (raw.unpack() != LIBRAW_SUCCESS) {
+    throw std::runtime_error("LibRaw failed to unpack. file: " + filename);
+  }
+}
+
+// RawConverter path of my_conversion with its defaults except the white
+// balance, which is as-shot like the LibRaw reference. Returns the 16-bit
+// sRGB output of shape (3, N).
+xt::xtensor<ushort, 2> run_rawconverter(const std::string &filename,
+                                        const float alpha,
+                                        yk::StageProfiler &profiler) {
+  auto raw = std::make_unique<LibRaw>();
+  profiler.measure("libraw_unpack", 0, [&] { open_raw(*raw, filename); });
+  const std::size_t n =
+      (std::size_t)raw->imgdata.sizes.iheight * raw->imgdata.sizes.iwidth;
+  auto bytes = [n](std::size_t in_size, std::size_t out_size) {
+    return 3 * n * (in_size + out_size);
+  };
+  const yk::RawConverter rc{};
+  const bool is_bayer = raw->imgdata.idata.filters != 0;
+  std::vector<yk::GainMap> gain_maps, mosaic_gain_maps;
+  profiler.measure("read_gain_maps", 0, [&] {
+    try {
+      const auto tiff = yk::TiffReader::open(filename);
+      gain_maps = yk::read_gain_maps(tiff, yk::opcode_list3_tag);
+      auto list2 = yk::read_gain_maps(tiff, yk::opcode_list2_tag);
+      if (is_bayer) {
+        mosaic_gain_maps = std::move(list2);
+      } else {
+        gain_maps.insert(gain_maps.begin(), list2.begin(), list2.end());
+      }
+    } catch (const std::exception &e) {
+      BOOST_LOG_TRIVIAL(warning) << "Failed to read DNG tags: " << e.what();
+    }
+  });
+  xt::xtensor<ushort, 2> image;
+  if (is_bayer) {
+    const auto cfa = yk::RawConverter::cfa_pattern(*raw);
+    if (!mosaic_gain_maps.empty()) {
+      profiler.measure("mosaic_gain_maps", 2 * n * sizeof(ushort), [&] {
+        rc.apply_mosaic_gain_maps(raw->imgdata.rawdata, raw->imgdata.sizes,
+                                  raw->imgdata.color, cfa, mosaic_gain_maps);
+      });
+    }
+    image = profiler.measure("demosaic", 4 * n * sizeof(ushort), [&] {
+      return rc.demosaic(raw->imgdata.rawdata, raw->imgdata.sizes, cfa);
+    });
+  } else {
+    image = profiler.measure("to_tensor", bytes(8, sizeof(ushort)), [&] {
+      xt::xtensor<ushort, 2> res({3, n});
+      for (std::size_t i = 0; i < n; i++) {
+        for (int ch = 0; ch < 3; ch++) {
+          res(ch, i) = raw->imgdata.rawdata.color4_image[i][ch];
+        }
+      }
+      return res;
+    });
+  }
+  auto params = is_bayer
+                    ? yk::RawConverter::cfa_level_params(raw->imgdata.color)
+                    : yk::RawConverter::level_params(raw->imgdata.color);
+  params.gains = profiler.measure("white_balance", 0, [&] {
+    yk::WhiteBalance wb;
+    wb.mode = yk::WhiteBalance::Mode::as_shot;
+    return yk::white_balance_gains(
+        wb, image.data(), n, params,
+        yk::RawConverter::as_shot_neutral(raw->imgdata.color));
+  });
+  profiler.measure(
+      "normalize_levels", bytes(sizeof(ushort), sizeof(ushort)), [&] {
+        rc.normalize_levels(image, raw->imgdata.sizes.iwidth,
+                            raw->imgdata.sizes.iheight, params, gain_maps);
+      });
+  yk::Histogram luminance;
+  auto srgb_ = profiler.measure(
+      "camera_to_sRGB", bytes(sizeof(ushort), sizeof(float)), [&] {
+        return rc.camera_to_sRGB(image, raw->imgdata.color.rgb_cam,
+                                 &luminance);
+      });
+  auto srgb_adj = profiler.measure(
+      "adjust_brightness", bytes(sizeof(float), sizeof(ushort)), [&] {
+        return rc.adjust_brightness(srgb_, alpha, false, &luminance);
+      });
+  return profiler.measure("gamma_correction",
+                          bytes(sizeof(ushort), sizeof(ushort)),
+                          [&] { return rc.gamma_correction(srgb_adj); });
+}
+
+// LibRaw dcraw_process() with the parameters of libraw_conversion that are
+// closest to RawConverter. Returns interleaved 16-bit RGB.
+std::vector<ushort> run_libraw(const std::string &filename,
+                               yk::StageProfiler &profiler,
+                               std::size_t &width, std::size_t &height) {
+  auto raw = std::make_unique<LibRaw>();
+  profiler.measure("libraw_unpack", 0, [&] { open_raw(*raw, filename); });
+  auto &params = raw->imgdata.params;
+  params.output_bps = 16;
+  params.user_flip = 0;
+  params.no_auto_bright = 1;
+  params.half_size = 0;
+  params.use_auto_wb = 0;
+  params.no_auto_scale = 1;
+  params.use_camera_wb = 1;
+  params.use_camera_matrix = 1;
+  params.gamm[0] = 1 / 2.4f;
+  params.gamm[1] = 12.92;
+  const std::size_t n =
+      (std::size_t)raw->imgdata.sizes.iheight * raw->imgdata.sizes.iwidth;
+  profiler.measure("dcraw_process", 3 * n * 2 * sizeof(ushort), [&] {
+    if (raw->dcraw_process() != LIBRAW_SUCCESS) {
+      throw std::runtime_error("LibRaw failed in dcraw_process().");
+    }
+  });
+  return profiler.measure(
+      "dcraw_make_mem_image", 3 * n * 2 * sizeof(ushort), [&] {
+        int err = 0;
+        libraw_processed_image_t *image = raw->dcraw_make_mem_image(&err);
+        if (!image) {
+          throw std::runtime_error("LibRaw failed in dcraw_make_mem_image().");
+        }
+        width = image->width;
+        height = image->height;
+        const auto *data = reinterpret_cast<const ushort *>(image->data);
+        std::vector<ushort> res(data, data + 3 * width * height);
+        LibRaw::dcraw_clear_mem(image);
+        return res;
+      });
+}
+
+ImageDiff compare(const xt::xtensor<ushort, 2> &planar,
+                  const std::vector<ushort> &interleaved) {
+  ImageDiff res;
+  const std::size_t n = planar.shape()[1];
+  if (interleaved.size() != 3 * n || n == 0) {
+    return res;
+  }
+  res.comparable = true;
+  double sse = 0, sae = 0;
+  for (std::size_t i = 0; i < n; i++) {
+    for (int ch = 0; ch < 3; ch++) {
+      const double d =
+          std::abs(double(planar(ch, i)) - double(interleaved[3 * i + ch]));
+      sse += d * d;
+      sae += d;
+      res.max_abs = std::max(res.max_abs, d);
+    }
+  }
+  const double mse = sse / (3 * n);
+  res.mean_abs = sae / (3 * n);
+  res.psnr = 0 < mse ? 10 * std::log10(65535. * 65535. / mse)
+                     : std::numeric_limits<double>::infinity();
+  return res;
+}
+
+std::string json_string(const std::string &s) {
+  std::string res = "\"";
+  for (char c : s) {
+    if (c == '"' || c == '\\') {
+      res += '\\';
+    }
+    res += c;
+  }
+  return res + "\"";
+}
+
+// JSON has no infinity; identical images report a PSNR of null.
+std::string json_number(const double v) {
+  if (!std::isfinite(v)) {
+    return "null";
+  }
+  std::ostringstream os;
+  os << std::setprecision(6) << v;
+  return os.str();
+}
+
+void write_pipeline(std::ostream &os, const PipelineResult &p,
+                    const std::size_t pixels) {
+  os << "{\"total_ms\": " << json_number(p.total_ms)
+     << ", \"mpix_per_s\": " << json_number(pixels / (p.total_ms * 1e3))
+     << ", \"stages\": [";
+  for (std::size_t i = 0; i < p.stages.size(); i++) {
+    const auto &s = p.stages[i];
+    os << (i ? ", " : "") << "{\"name\": " << json_string(s.name)
+       << ", \"ms\": " << json_number(s.sample.ms);
+    if (s.sample.valid) {
+      os << ", \"ipc\": " << json_number(s.sample.ipc())
+         << ", \"llc_misses\": " << s.sample.llc_misses
+         << ", \"branch_misses\": " << s.sample.branch_misses;
+    }
+    os << ", \"heap_delta\": " << s.memory.heap_delta << "}";
+  }
+  os << "]}";
+}
+
+/**
+ * @brief Write the report. Keys are in a fixed order and each file is on its
+ * own lines, so reports of two builds can be compared with diff or jq.
+ */
+void write_report(std::ostream &os, const std::vector<FileResult> &results,
+                  const std::size_t repeat) {
+  double rc_ms = 0, libraw_ms = 0, min_psnr = -1, max_abs = 0;
+  std::size_t pixels = 0;
+  for (const auto &r : results) {
+    rc_ms += r.rawconverter.total_ms;
+    libraw_ms += r.libraw.total_ms;
+    pixels += r.width * r.height;
+    if (r.diff.comparable) {
+      min_psnr = min_psnr < 0 ? r.diff.psnr : std::min(min_psnr, r.diff.psnr);
+      max_abs = std::max(max_abs, r.diff.max_abs);
+    }
+  }
+  os << "{\n  \"version\": 1,\n  \"threads\": " << yk::num_threads()
+     << ",\n  \"repeat\": " << repeat << ",\n  \"files\": [\n";
+  for (std::size_t i = 0; i < results.size(); i++) {
+    const auto &r = results[i];
+    const std::size_t n = r.width * r.height;
+    os << "    {\"path\": " << json_string(r.path) << ", \"width\": " << r.width
+       << ", \"height\": " << r.height << ",\n     \"rawconverter\": ";
+    write_pipeline(os, r.rawconverter, n);
+    os << ",\n     \"libraw\": ";
+    write_pipeline(os, r.libraw, n);
+    os << ",\n     \"diff\": ";
+    if (r.diff.comparable) {
+      os << "{\"psnr\": " << json_number(r.diff.psnr)
+         << ", \"max_abs\": " << json_number(r.diff.max_abs)
+         << ", \"mean_abs\": " << json_number(r.diff.mean_abs) << "}";
+    } else {
+      os << "null";
+    }
+    os << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+  }
+  os << "  ],\n  \"summary\": {\"rawconverter_ms\": " << json_number(rc_ms)
+     << ", \"libraw_ms\": " << json_number(libraw_ms)
+     << ", \"rawconverter_mpix_per_s\": "
+     << json_number(pixels / (rc_ms * 1e3))
+     << ", \"libraw_mpix_per_s\": " << json_number(pixels / (libraw_ms * 1e3))
+     << ", \"min_psnr\": " << (min_psnr < 0 ? "null" : json_number(min_psnr))
+     << ", \"max_abs\": " << json_number(max_abs) << "}\n}\n";
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  try {
+    cxxopts::Options options(
+        "Pipeline Regression Harness",
+        "The program runs the RawConverter pipeline and LibRaw "
+        "dcraw_process() on a corpus of ProRaw/DNG files, measures the time "
+        "of every stage and the difference of the outputs, and writes a JSON "
+        "report that can be compared between builds.");
+
+    options.add_options()("f,files", "ProRaw file paths",
+                          cxxopts::value<std::vector<std::string>>())(
+        "s,synthetic", "Generate this many synthetic DNG files as the corpus",
+        cxxopts::value<std::size_t>()->default_value("0"))(
+        "width", "Width of the synthetic files",
+        cxxopts::value<std::uint32_t>()->default_value("4032"))(
+        "height", "Height of the synthetic files",
+        cxxopts::value<std::uint32_t>()->default_value("3024"))(
+        "synthetic-dir", "Directory of the synthetic files",
+        cxxopts::value<std::string>()->default_value(
+            std::filesystem::temp_directory_path().string()))(
+        "a,alpha", "Persentage of histogram stretching in the range [0, 1].",
+        cxxopts::value<float>()->default_value("0."))(
+        "r,repeat", "Runs per file; the fastest run is reported",
+        cxxopts::value<std::size_t>()->default_value("3"))(
+        "j,threads", "Kernel threads. 0 uses all hardware threads.",
+        cxxopts::value<std::size_t>()->default_value("0"))(
+        "o,output", "Report path. The report is printed if omitted.",
+        cxxopts::value<std::string>())(
+        "d,debug", "Enable debugging. Log file is output to ../logs/.",
+        cxxopts::value<bool>())("h,help", "Print usage");
+    options.parse_positional({"files"});
+    options.positional_help("ProRawFilePath...");
+
+    auto args = options.parse(argc, argv);
+    const std::size_t synthetic = args["synthetic"].as<std::size_t>();
+    if (args.count("help") || (!args.count("files") && synthetic == 0)) {
+      std::cout << options.help() << std::endl;
+      return 0;
+    }
+
+    const bool is_debug = args["debug"].as<bool>();
+    const float alpha = args["alpha"].as<float>();
+    const std::size_t repeat =
+        std::max<std::size_t>(1, args["repeat"].as<std::size_t>());
+    yk::log_init(is_debug, "regressionharness-");
+    yk::set_num_threads(args["threads"].as<std::size_t>());
+
+    std::vector<std::string> filenames;
+    if (args.count("files")) {
+      filenames = args["files"].as<std::vector<std::string>>();
+    }
+    for (std::size_t i = 0; i < synthetic; i++) {
+      yk::SyntheticDngParams params;
+      params.width = args["width"].as<std::uint32_t>();
+      params.height = args["height"].as<std::uint32_t>();
+      params.seed = i;
+      const auto path =
+          std::filesystem::path(args["synthetic-dir"].as<std::string>()) /
+          ("rawconverter_synthetic_" + std::to_string(i) + ".dng");
+      yk::write_synthetic_dng(path.string(), params);
+      BOOST_LOG_TRIVIAL(debug) << "Wrote synthetic DNG: " << path;
+      filenames.push_back(path.string());
+    }
+
+    std::vector<FileResult> results;
+    for (const auto &filename : filenames) {
+      FileResult result;
+      result.path = filename;
+      xt::xtensor<ushort, 2> rc_out;
+      std::vector<ushort> libraw_out;
+      for (std::size_t run = 0; run < repeat; run++) {
+        yk::StageProfiler rc_profiler, libraw_profiler;
+        auto out = run_rawconverter(filename, alpha, rc_profiler);
+        std::size_t width, height;
+        auto ref = run_libraw(filename, libraw_profiler, width, height);
+        const double rc_ms = total_ms(rc_profiler.reports());
+        const double libraw_ms = total_ms(libraw_profiler.reports());
+        if (run == 0 || rc_ms < result.rawconverter.total_ms) {
+          result.rawconverter = {rc_profiler.reports(), rc_ms};
+          rc_out = std::move(out);
+        }
+        if (run == 0 || libraw_ms < result.libraw.total_ms) {
+          result.libraw = {libraw_profiler.reports(), libraw_ms};
+          result.width = width;
+          result.height = height;
+          libraw_out = std::move(ref);
+        }
+      }
+      result.diff = compare(rc_out, libraw_out);
+      // Progress goes to stderr so that a report printed to stdout stays
+      // valid JSON.
+      std::cerr << filename << ": RawConverter "
+                << result.rawconverter.total_ms << " ms, LibRaw "
+                << result.libraw.total_ms << " ms, PSNR "
+                << result.diff.psnr << " dB" << std::endl;
+      results.push_back(std::move(result));
+    }
+
+    if (args.count("output")) {
+      const auto path = args["output"].as<std::string>();
+      std::ofstream os(path);
+      write_report(os, results, repeat);
+      if (!os) {
+        throw std::runtime_error("Cannot write " + path);
+      }
+    } else {
+      write_report(std::cout, results, repeat);
+    }
+    return 0;
+  } catch (std::exception &e) {
+    std::cerr << e.what() << std::endl;
+    BOOST_LOG_TRIVIAL(fatal) << e.what();
+    return 1;
+  }
+}
@@ -0,0 +1,389 @@
+#include "gain_table_map.hpp"
+#include "parallel.hpp"
+#include "perf_counters.hpp"
+#include "raw_converter.hpp"
+#include "sequence_converter.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cxxopts.hpp>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+namespace {
+
+/**
+ * @brief Best time of one stage for one configuration of the sweep.
+ */
+struct Row {
+  std::string variant;
+  double megapixels = 0;
+  std::size_t width = 0;
+  std::size_t height = 0;
+  std::size_t threads = 0;
+  std::string stage;
+  double ms = 0;
+  // Filled in after the sweep, relative to the fewest threads measured.
+  double speedup = 0;
+  double efficiency = 0;
+  // Frames converted in the measured time.
+  std::size_t frames = 1;
+};
+
+// Camera native equals sRGB', as with the synthetic DNGs.
+constexpr float identity_cam[3][4] = {
+    {1.f, 0.f, 0.f, 0.f}, {0.f, 1.f, 0.f, 0.f}, {0.f, 0.f, 1.f, 0.f}};
+
+// Deterministic 13-bit test frame of shape (3, width * height): a ramp with
+// a little hashed noise, so the histogram is not degenerate.
+xt::xtensor<ushort, 2> make_frame(const std::size_t width,
+                                  const std::size_t height) {
+  const std::size_t n = width * height;
+  xt::xtensor<ushort, 2> res({3, n});
+  yk::parallel_for(n, [&](std::size_t begin, std::size_t end, std::size_t) {
+    for (std::size_t i = begin; i < end; i++) {
+      const std::uint32_t hash = std::uint32_t(i) * 2654435761u;
+      const float u = float(i % width) / width;
+      const float v = float(i / width) / height;
+      res(0, i) = ushort(8000 * u * u + (hash >> 28));
+      res(1, i) = ushort(8000 * u * (0.5f + 0.5f * v) + (hash >> 29));
+      res(2, i) = ushort(8000 * u * (1.f - 0.5f * v) + (hash >> 30));
+    }
+  });
+  return res;
+}
+
+// my_conversion's stages: raw_adjust, camera_to_sRGB with float output,
+// adjust_brightness, gamma_correction.
+std::vector<yk::StageReport> run_staged(const xt::xtensor<ushort, 2> &frame,
+                                        const float alpha) {
+  const yk::RawConverter rc{};
+  xt::xtensor<ushort, 2> image = frame;
+  yk::StageProfiler profiler;
+  profiler.measure("raw_adjust", 0, [&] { rc.raw_adjust(image); });
+  yk::Histogram luminance;
+  auto srgb_ = profiler.measure("camera_to_sRGB", 0, [&] {
+    return rc.camera_to_sRGB(image, identity_cam, &luminance);
+  });
+  auto srgb_adj = profiler.measure("adjust_brightness", 0, [&] {
+    return rc.adjust_brightness(srgb_, alpha, false, &luminance);
+  });
+  profiler.measure("gamma_correction", 0,
+                   [&] { return rc.gamma_correction(srgb_adj); });
+  return profiler.reports();
+}
+
+// The fused path of SequenceConverter and the C API: one color pass to
+// 16-bit with the histogram, then one LUT pass.
+std::vector<yk::StageReport> run_fused(const xt::xtensor<ushort, 2> &frame,
+                                       const float alpha) {
+  yk::SequenceParams params;
+  params.tone_params = {{"stretch_rate", alpha}};
+  params.smoothing = 0;
+  params.sample_stride = 1;
+  yk::SequenceConverter sequence(params);
+  yk::Matrix3 m;
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 3; j++) {
+      m[i][j] = identity_cam[i][j];
+    }
+  }
+  sequence.process(frame, m);
+  const auto &r = sequence.reports().back();
+  std::vector<yk::StageReport> res(3);
+  res[0].name = "color";
+  res[0].sample.ms = r.color_ms;
+  res[1].name = "curve";
+  res[1].sample.ms = r.curve_ms;
+  res[2].name = "apply";
+  res[2].sample.ms = r.apply_ms;
+  return res;
+}
+
+// Synthetic ProfileGainTableMap of the size ProRaw uses, brightening the
+// shadows towards the centre of the frame.
+yk::GainTableMap make_gain_table() {
+  yk::GainTableMap map;
+  map.points_v = 48;
+  map.points_h = 64;
+  map.points_n = 32;
+  map.spacing_v = 1. / (map.points_v - 1);
+  map.spacing_h = 1. / (map.points_h - 1);
+  map.input_weights = {0.f, 0.f, 0.f, 0.f, 1.f};
+  for (std::uint32_t v = 0; v < map.points_v; v++) {
+    for (std::uint32_t h = 0; h < map.points_h; h++) {
+      const float dv = float(v) / (map.points_v - 1) - 0.5f;
+      const float dh = float(h) / (map.points_h - 1) - 0.5f;
+      const float centre = 1.f - dv * dv - dh * dh;
+      for (std::uint32_t n = 0; n < map.points_n; n++) {
+        const float t = float(n) / (map.points_n - 1);
+        map.gains.push_back(1.f + centre * (1.f - t));
+      }
+    }
+  }
+  return map;
+}
+
+// The ProfileGainTableMap stage alone on the float output of the color
+// pass, with the luminance histogram rebuilt as in my_conversion.
+std::vector<yk::StageReport>
+run_gain_table(const xt::xtensor<ushort, 2> &frame, const std::size_t width,
+               const std::size_t height, const yk::GainTableMap &map) {
+  const yk::RawConverter rc{};
+  auto srgb_ = rc.camera_to_sRGB(frame, identity_cam);
+  yk::Histogram luminance;
+  yk::StageProfiler profiler;
+  profiler.measure("gain_table_map", 0, [&] {
+    rc.apply_gain_table_map(srgb_, width, height, map, &luminance);
+  });
+  return profiler.reports();
+}
+
+// The tiled local histogram equalisation (adjust_local_contrast) alone on
+// the gamma-corrected 16-bit output of the color pass.
+std::vector<yk::StageReport>
+run_local_contrast(const xt::xtensor<ushort, 2> &frame,
+                   const std::size_t width, const std::size_t height) {
+  const yk::RawConverter rc{};
+  xt::xtensor<ushort, 2> image = frame;
+  rc.raw_adjust(image);
+  const auto srgb =
+      rc.gamma_correction(rc.camera_to_sRGB(image, identity_cam));
+  yk::StageProfiler profiler;
+  profiler.measure("local_contrast", 0, [&] {
+    return rc.adjust_local_contrast(srgb, width, height);
+  });
+  return profiler.reports();
+}
+
+// Batch mode: frames are distributed over `threads` workers that each run
+// the fused path with single-threaded kernels.
+std::vector<yk::StageReport> run_batch(const xt::xtensor<ushort, 2> &frame,
+                                       const float alpha,
+                                       const std::size_t frames,
+                                       const std::size_t threads) {
+  std::atomic<std::size_t> next{0};
+  auto work = [&] {
+    const yk::ScopedNumThreads single(1);
+    while (next.fetch_add(1) < frames) {
+      run_fused(frame, alpha);
+    }
+  };
+  const auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> workers;
+  for (std::size_t j = 1; j < std::min(threads, frames); j++) {
+    workers.emplace_back(work);
+  }
+  work();
+  for (auto &w : workers) {
+    w.join();
+  }
+  std::vector<yk::StageReport> res(1);
+  res[0].name = "batch_of_" + std::to_string(frames);
+  res[0].sample.ms = std::chrono::duration<double, std::milli>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+  return res;
+}
+
+// Speedup and efficiency against the fewest threads measured for the same
+// variant, size and stage.
+void add_speedup(std::vector<Row> &rows) {
+  std::map<std::tuple<std::string, double, std::string>, const Row *> base;
+  for (const auto &r : rows) {
+    auto &b = base[{r.variant, r.megapixels, r.stage}];
+    if (!b || r.threads < b->threads) {
+      b = &r;
+    }
+  }
+  for (auto &r : rows) {
+    const Row *b = base[{r.variant, r.megapixels, r.stage}];
+    r.speedup = 0 < r.ms ? b->ms / r.ms : 0;
+    r.efficiency = r.speedup * b->threads / r.threads;
+  }
+}
+
+double mpix_per_s(const Row &r) {
+  return 0 < r.ms ? r.frames * r.width * r.height / (r.ms * 1e3) : 0;
+}
+
+void write_csv(std::ostream &os, const std::vector<Row> &rows) {
+  os << "variant,megapixels,width,height,frames,threads,stage,ms,mpix_per_s,"
+        "speedup,efficiency\n";
+  for (const auto &r : rows) {
+    os << r.variant << "," << r.megapixels << "," << r.width << ","
+       << r.height << "," << r.frames << "," << r.threads << "," << r.stage
+       << "," << r.ms << "," << mpix_per_s(r) << "," << r.speedup << ","
+       << r.efficiency << "\n";
+  }
+}
+
+void write_json(std::ostream &os, const std::vector<Row> &rows) {
+  os << "{\n  \"hardware_threads\": " << std::thread::hardware_concurrency()
+     << ",\n  \"rows\": [\n";
+  for (std::size_t i = 0; i < rows.size(); i++) {
+    const auto &r = rows[i];
+    os << "    {\"variant\": \"" << r.variant
+       << "\", \"megapixels\": " << r.megapixels << ", \"width\": " << r.width
+       << ", \"height\": " << r.height << ", \"frames\": " << r.frames
+       << ", \"threads\": " << r.threads
+       << ", \"stage\": \"" << r.stage << "\", \"ms\": " << r.ms
+       << ", \"mpix_per_s\": " << mpix_per_s(r)
+       << ", \"speedup\": " << r.speedup
+       << ", \"efficiency\": " << r.efficiency << "}"
+       << (i + 1 < rows.size() ? "," : "") << "\n";
+  }
+  os << "  ]\n}\n";
+}
+
+std::vector<std::size_t> default_threads() {
+  const std::size_t hw =
+      std::max<std::size_t>(1, std::thread::hardware_concurrency());
+  std::vector<std::size_t> res;
+  for (std::size_t t = 1; t < hw && t <= 64; t *= 2) {
+    res.push_back(t);
+  }
+  res.push_back(hw);
+  return res;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  try {
+    cxxopts::Options options(
+        "Scaling Benchmark",
+        "The program measures how the RawConverter stages scale with the "
+        "number of threads and the frame size. Synthetic frames are "
+        "converted with each pipeline variant (staged: my_conversion, fused: "
+        "sequence conversion and the C API, batch: concurrent frames with "
+        "single-threaded kernels) and the best time of every stage is "
+        "reported with its speedup and parallel efficiency.");
+
+    options.add_options()(
+        "s,sizes", "Frame sizes in megapixels (4:3)",
+        cxxopts::value<std::vector<double>>()->default_value("12,24,48"))(
+        "t,threads", "Thread counts. Defaults to powers of two up to the "
+                     "hardware concurrency.",
+        cxxopts::value<std::vector<std::size_t>>())(
+        "v,variants",
+        "Pipeline variants: staged, fused, batch, gain_table (the "
+        "ProfileGainTableMap stage alone), local_contrast (the local "
+        "histogram equalisation alone). The last two are not in the default "
+        "set.",
+        cxxopts::value<std::vector<std::string>>()->default_value(
+            "staged,fused,batch"))(
+        "b,batch", "Frames per batch in the batch variant",
+        cxxopts::value<std::size_t>()->default_value("8"))(
+        "a,alpha", "Persentage of histogram stretching in the range [0, 1].",
+        cxxopts::value<float>()->default_value("0.01"))(
+        "r,repeat", "Runs per configuration; the fastest run is reported",
+        cxxopts::value<std::size_t>()->default_value("3"))(
+        "o,output", "Report path. The report is printed if omitted.",
+        cxxopts::value<std::string>())(
+        "json", "Write JSON instead of CSV", cxxopts::value<bool>())(
+        "h,help", "Print usage");
+
+    auto args = options.parse(argc, argv);
+    if (args.count("help")) {
+      std::cout << options.help() << std::endl;
+      return 0;
+    }
+
+    const auto sizes = args["sizes"].as<std::vector<double>>();
+    const auto threads = args.count("threads")
+                             ? args["threads"].as<std::vector<std::size_t>>()
+                             : default_threads();
+    const auto variants = args["variants"].as<std::vector<std::string>>();
+    const std::size_t batch = args["batch"].as<std::size_t>();
+    const float alpha = args["alpha"].as<float>();
+    const std::size_t repeat =
+        std::max<std::size_t>(1, args["repeat"].as<std::size_t>());
+    for (const auto &v : variants) {
+      if (v != "staged" && v != "fused" && v != "batch" &&
+          v != "gain_table" && v != "local_contrast") {
+        throw std::runtime_error("Unknown variant: " + v);
+      }
+    }
+
+    const auto gain_table = make_gain_table();
+    std::vector<Row> rows;
+    for (const double mp : sizes) {
+      const auto width = static_cast<std::size_t>(std::sqrt(mp * 1e6 * 4 / 3));
+      const auto height = static_cast<std::size_t>(mp * 1e6 / width);
+      yk::set_num_threads(0);
+      const auto frame = make_frame(width, height);
+      for (const auto &variant : variants) {
+        for (const std::size_t t : threads) {
+          if (t == 0) {
+            continue;
+          }
+          yk::set_num_threads(t);
+          std::map<std::string, std::size_t> index;
+          for (std::size_t run = 0; run < repeat; run++) {
+            std::vector<yk::StageReport> stages;
+            if (variant == "staged") {
+              stages = run_staged(frame, alpha);
+            } else if (variant == "fused") {
+              stages = run_fused(frame, alpha);
+            } else if (variant == "gain_table") {
+              stages = run_gain_table(frame, width, height, gain_table);
+            } else if (variant == "local_contrast") {
+              stages = run_local_contrast(frame, width, height);
+            } else {
+              stages = run_batch(frame, alpha, batch, t);
+            }
+            if (1 < stages.size()) {
+              yk::StageReport total;
+              total.name = "total";
+              for (const auto &s : stages) {
+                total.sample.ms += s.sample.ms;
+              }
+              stages.push_back(total);
+            }
+            for (const auto &s : stages) {
+              auto it = index.find(s.name);
+              if (it == index.end()) {
+                index[s.name] = rows.size();
+                rows.push_back({variant, mp, width, height, t, s.name,
+                                s.sample.ms});
+                rows.back().frames = variant == "batch" ? batch : 1;
+              } else {
+                rows[it->second].ms =
+                    std::min(rows[it->second].ms, s.sample.ms);
+              }
+            }
+          }
+          std::cerr << variant << " " << mp << " MP, " << t << " threads done"
+                    << std::endl;
+        }
+      }
+    }
+    yk::set_num_threads(0);
+    add_speedup(rows);
+
+    const bool json = args["json"].as<bool>();
+    if (args.count("output")) {
+      const auto path = args["output"].as<std::string>();
+      std::ofstream os(path);
+      json ? write_json(os, rows) : write_csv(os, rows);
+      if (!os) {
+        throw std::runtime_error("Cannot write " + path);
+      }
+    } else {
+      json ? write_json(std::cout, rows) : write_csv(std::cout, rows);
+    }
+    return 0;
+  } catch (std::exception &e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
+}
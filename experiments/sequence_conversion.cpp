@@ -0,0 +1,126 @@
+#include "dng_opcodes.hpp"
+#include "experiment_common.hpp"
+#include "levels.hpp"
+#include "raw_converter.hpp"
+#include "sequence_converter.hpp"
+#include <boost/log/trivial.hpp>
+#include <cxxopts.hpp>
+#include <iostream>
+#include <opencv2/opencv.hpp>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+int main(int argc, char *argv[]) {
+  try {
+    cxxopts::Options options(
+        "ProRaw Sequence Converter",
+        "The program converts a burst or timelapse of ProRaw images from the "
+        "same device to sRGB PNGs. Color matrices are cached across frames "
+        "and the brightness adjustment is computed from a sparse sample of "
+        "each frame and smoothed over time.");
+
+    options.add_options()("f,files", "ProRaw file paths",
+                          cxxopts::value<std::vector<std::string>>())(
+        "d,debug", "Enable debugging. Log file is output to ../logs/.",
+        cxxopts::value<bool>())(
+        "a,alpha", "Persentage of histogram stretching in the range [0, 1].",
+        cxxopts::value<float>()->default_value("0.01"))(
+        "s,smoothing",
+        "Weight of the previous frames in the temporal smoothing [0, 1).",
+        cxxopts::value<float>()->default_value("0.8"))(
+        "stride", "Sampling stride of the brightness statistics.",
+        cxxopts::value<std::size_t>()->default_value("16"))(
+        "space",
+        "Output color space: srgb, display-p3, rec2020, prophoto or acescg.",
+        cxxopts::value<std::string>()->default_value("srgb"))(
+        "wb",
+        "White balance applied with the black level: none, as-shot, auto "
+        "(gray world) or multipliers such as 2.1,1,1.6",
+        cxxopts::value<std::string>()->default_value("none"))(
+        "no-gain-map",
+        "Do not apply the GainMap opcodes (lens shading) of the DNG",
+        cxxopts::value<bool>())(
+        "n,no-save", "Do not write PNG files", cxxopts::value<bool>())(
+        "h,help", "Print usage");
+    options.parse_positional({"files"});
+    options.positional_help("ProRawFilePath...");
+
+    auto args = options.parse(argc, argv);
+    if (args.count("help") || !args.count("files")) {
+      std::cout << options.help() << std::endl;
+      return 0;
+    }
+
+    const auto input_filenames = args["files"].as<std::vector<std::string>>();
+    const bool is_debug = args["debug"].as<bool>();
+    const bool save = !args["no-save"].as<bool>();
+    const auto white_balance =
+        yk::parse_white_balance(args["wb"].as<std::string>());
+    const bool use_gain_map = !args["no-gain-map"].as<bool>();
+
+    yk::log_init(is_debug, "sequenceconversion-", true);
+
+    yk::SequenceParams params;
+    params.tone_params = {{"stretch_rate", args["alpha"].as<float>()}};
+    params.smoothing = args["smoothing"].as<float>();
+    params.sample_stride = args["stride"].as<std::size_t>();
+    params.output = yk::parse_color_space(args["space"].as<std::string>());
+    yk::SequenceConverter sequence(params);
+    yk::RawConverter rc{};
+
+    double total_elapsed = 0;
+    for (auto &input_filename : input_filenames) {
+      LibRaw raw;
+      auto &&image = yk::load_raw_image(raw, input_filename);
+
+      // The level pass of my_conversion: scale, black level, white balance
+      // and the GainMap opcodes of the DNG.
+      std::vector<yk::GainMap> gain_maps;
+      if (use_gain_map) {
+        try {
+          gain_maps =
+              yk::read_gain_maps(yk::TiffReader::open(input_filename));
+        } catch (const std::exception &e) {
+          BOOST_LOG_TRIVIAL(warning)
+              << "Failed to read DNG tags: " << e.what();
+        }
+      }
+      const auto neutral = yk::RawConverter::as_shot_neutral(raw.imgdata.color);
+      auto levels = yk::RawConverter::level_params(raw.imgdata.color);
+      levels.gains = yk::white_balance_gains(white_balance, image.data(),
+                                             image.shape()[1], levels, neutral);
+      rc.normalize_levels(image, raw.imgdata.sizes.iwidth,
+                          raw.imgdata.sizes.iheight, levels, gain_maps);
+
+      auto &matrix = sequence.color_matrix(
+          yk::RawConverter::dng_color_profile(raw.imgdata.color), neutral,
+          levels.gains);
+      auto &&sRGB = sequence.process(image, matrix);
+
+      const auto &report = sequence.reports().back();
+      total_elapsed += report.total_ms;
+      std::cout << input_filename << " " << report << std::endl;
+      YK_LOG_DEBUG(input_filename << " " << report);
+
+      if (save) {
+        cv::Mat &&rgb_image = yk::ToCvMat3b(sRGB, raw.imgdata.sizes.iheight,
+                                            raw.imgdata.sizes.iwidth);
+        std::stringstream ss;
+        ss << input_filename << ".cv_seq.png";
+        cv::imwrite(ss.str(), rgb_image);
+        YK_LOG_TRACE("Saved image: " << ss.str());
+      }
+    }
+    std::cout << "Done " << input_filenames.size() << " frames." << std::endl;
+    std::cout << " -- Mean run time per frame (ms): "
+              << std::to_string(total_elapsed / input_filenames.size())
+              << std::endl;
+    return 0;
+  } catch (std::exception &e) {
+    std::cerr << e.what() << std::endl;
+    BOOST_LOG_TRIVIAL(fatal) << e.what();
+    return 1;
+  }
+}
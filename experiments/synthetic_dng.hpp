@@ -0,0 +1,251 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace yk {
+
+/**
+ * @brief Parameters of write_synthetic_dng().
+ */
+struct SyntheticDngParams {
+  std::uint32_t width = 4032;
+  std::uint32_t height = 3024;
+  std::uint32_t seed = 0;
+  // Levels of the 13-bit linear data, as expected by RawConverter::raw_adjust.
+  std::uint32_t black_level = 64;
+  std::uint32_t white_level = 8191;
+  // Standard deviation of the Gaussian noise in raw units.
+  float noise = 4.f;
+  // Write an RGGB Bayer mosaic of the scene instead of linear RGB.
+  bool cfa = false;
+};
+
+namespace detail {
+// Little-endian TIFF writer for the handful of tag types a DNG needs.
+class TiffWriter {
+public:
+  enum Type : std::uint16_t {
+    byte = 1,
+    ascii = 2,
+    short_ = 3,
+    long_ = 4,
+    rational = 5,
+    srational = 10
+  };
+
+  void add(const std::uint16_t tag, const Type type, const std::uint32_t count,
+           std::vector<std::uint8_t> data) {
+    entries_.push_back({tag, type, count, std::move(data)});
+  }
+  void add_short(const std::uint16_t tag, std::vector<std::uint16_t> values) {
+    std::vector<std::uint8_t> data;
+    for (auto v : values) {
+      put16(data, v);
+    }
+    add(tag, short_, values.size(), std::move(data));
+  }
+  void add_long(const std::uint16_t tag, std::vector<std::uint32_t> values) {
+    std::vector<std::uint8_t> data;
+    for (auto v : values) {
+      put32(data, v);
+    }
+    add(tag, long_, values.size(), std::move(data));
+  }
+  void add_ascii(const std::uint16_t tag, const std::string &value) {
+    std::vector<std::uint8_t> data(value.begin(), value.end());
+    data.push_back(0);
+    const auto count = static_cast<std::uint32_t>(data.size());
+    add(tag, ascii, count, std::move(data));
+  }
+  // Rationals with a fixed denominator of 10000.
+  void add_rational(const std::uint16_t tag, const std::vector<double> &values,
+                    const bool is_signed) {
+    std::vector<std::uint8_t> data;
+    for (auto v : values) {
+      put32(data, static_cast<std::uint32_t>(
+                      static_cast<std::int32_t>(std::lround(v * 10000))));
+      put32(data, 10000);
+    }
+    add(tag, is_signed ? srational : rational, values.size(),
+        std::move(data));
+  }
+
+  /**
+   * @brief Write a single-IFD file whose only strip holds pixels. The
+   * StripOffsets and StripByteCounts tags are added here.
+   */
+  void write(const std::string &path, const std::vector<std::uint8_t> &pixels) {
+    add_long(273, {0});
+    add_long(279, {static_cast<std::uint32_t>(pixels.size())});
+    std::sort(entries_.begin(), entries_.end(),
+              [](const Entry &a, const Entry &b) { return a.tag < b.tag; });
+
+    const std::uint32_t ifd_offset = 8;
+    const std::uint32_t ifd_size = 2 + 12 * entries_.size() + 4;
+    const std::uint32_t data_offset = ifd_offset + ifd_size;
+    std::vector<std::uint8_t> ifd, extra;
+    put16(ifd, entries_.size());
+    for (auto &e : entries_) {
+      put16(ifd, e.tag);
+      put16(ifd, e.type);
+      put32(ifd, e.count);
+      if (e.data.size() <= 4) {
+        e.data.resize(4, 0);
+        ifd.insert(ifd.end(), e.data.begin(), e.data.end());
+      } else {
+        put32(ifd, data_offset + extra.size());
+        extra.insert(extra.end(), e.data.begin(), e.data.end());
+        if (extra.size() % 2) {
+          extra.push_back(0);
+        }
+      }
+    }
+    put32(ifd, 0);
+    // Patch StripOffsets, which precedes the pixel data.
+    const std::uint32_t pixel_offset = data_offset + extra.size();
+    for (std::size_t i = 0; i < entries_.size(); i++) {
+      if (entries_[i].tag == 273) {
+        std::vector<std::uint8_t> v;
+        put32(v, pixel_offset);
+        std::copy(v.begin(), v.end(), ifd.begin() + 2 + 12 * i + 8);
+      }
+    }
+
+    std::ofstream os(path, std::ios::binary);
+    if (!os) {
+      throw std::runtime_error("Cannot write " + path);
+    }
+    const std::uint8_t header[8] = {'I', 'I', 42, 0, ifd_offset, 0, 0, 0};
+    os.write(reinterpret_cast<const char *>(header), sizeof(header));
+    os.write(reinterpret_cast<const char *>(ifd.data()), ifd.size());
+    os.write(reinterpret_cast<const char *>(extra.data()), extra.size());
+    os.write(reinterpret_cast<const char *>(pixels.data()), pixels.size());
+    if (!os) {
+      throw std::runtime_error("Cannot write " + path);
+    }
+  }
+
+  static void put16(std::vector<std::uint8_t> &v, const std::uint32_t x) {
+    v.push_back(x & 0xff);
+    v.push_back((x >> 8) & 0xff);
+  }
+  static void put32(std::vector<std::uint8_t> &v, const std::uint32_t x) {
+    put16(v, x & 0xffff);
+    put16(v, x >> 16);
+  }
+
+private:
+  struct Entry {
+    std::uint16_t tag;
+    Type type;
+    std::uint32_t count;
+    std::vector<std::uint8_t> data;
+  };
+  std::vector<Entry> entries_;
+};
+} // namespace detail
+
+/**
+ * @brief Write a linear (demosaiced) DNG like the ProRaw files, or a Bayer
+ * DNG with params.cfa, with a
+ * deterministic synthetic scene: a luminance ramp with varying hue, a row of
+ * saturated patches and Gaussian noise. The camera space equals linear sRGB
+ * (ColorMatrix1 is XYZ to sRGB under D65) and AsShotNeutral is neutral, so
+ * the expected result is known.
+ * @param path output path
+ * @param params size, seed and levels of the image
+ */
+inline void write_synthetic_dng(const std::string &path,
+                                const SyntheticDngParams &params = {}) {
+  const std::uint32_t w = params.width, h = params.height;
+  if (w == 0 || h == 0) {
+    throw std::runtime_error("Synthetic DNG size must be positive.");
+  }
+  std::mt19937 rng(params.seed);
+  std::normal_distribution<float> noise(0.f, params.noise);
+  const float range = float(params.white_level - params.black_level);
+  constexpr float patches[6][3] = {{0.8f, 0.1f, 0.1f}, {0.1f, 0.7f, 0.1f},
+                                   {0.1f, 0.1f, 0.8f}, {0.8f, 0.8f, 0.1f},
+                                   {0.1f, 0.7f, 0.8f}, {0.9f, 0.9f, 0.9f}};
+
+  std::vector<std::uint8_t> pixels;
+  pixels.reserve(std::size_t(w) * h * (params.cfa ? 2 : 6));
+  for (std::uint32_t y = 0; y < h; y++) {
+    const float v = float(y) / h;
+    const bool patch_row = 0.4f < v && v < 0.6f;
+    for (std::uint32_t x = 0; x < w; x++) {
+      const float u = float(x) / w;
+      float rgb[3];
+      if (patch_row) {
+        const auto *p = patches[std::min<std::uint32_t>(x * 6 / w, 5)];
+        std::copy(p, p + 3, rgb);
+      } else {
+        // Ramp in luminance along x with a smooth hue change along y.
+        const float l = u * u;
+        rgb[0] = l * (0.6f + 0.4f * std::cos(6.2832f * v));
+        rgb[1] = l * (0.6f + 0.4f * std::cos(6.2832f * (v - 0.333f)));
+        rgb[2] = l * (0.6f + 0.4f * std::cos(6.2832f * (v - 0.667f)));
+      }
+      for (int ch = 0; ch < 3; ch++) {
+        // RGGB: red at even rows and columns, blue at odd ones.
+        if (params.cfa && std::uint32_t(ch) != (y & 1) + (x & 1)) {
+          continue;
+        }
+        const float value = params.black_level + rgb[ch] * range + noise(rng);
+        detail::TiffWriter::put16(
+            pixels, static_cast<std::uint16_t>(std::clamp(
+                        std::lround(value), 0L, long(params.white_level))));
+      }
+    }
+  }
+
+  detail::TiffWriter tiff;
+  const std::uint32_t black = params.black_level, white = params.white_level;
+  tiff.add_long(254, {0});                       // NewSubFileType: main image
+  tiff.add_long(256, {w});                       // ImageWidth
+  tiff.add_long(257, {h});                       // ImageLength
+  tiff.add_short(259, {1});                      // Compression: none
+  tiff.add_ascii(271, "Synthetic");              // Make
+  tiff.add_ascii(272, "RawConverter");           // Model
+  tiff.add_short(274, {1});                      // Orientation
+  tiff.add_long(278, {h});                       // RowsPerStrip
+  tiff.add_short(284, {1});                      // PlanarConfiguration
+  if (params.cfa) {
+    tiff.add_short(258, {16});                   // BitsPerSample
+    tiff.add_short(262, {32803});                // Photometric: CFA
+    tiff.add_short(277, {1});                    // SamplesPerPixel
+    tiff.add_short(33421, {2, 2});               // CFARepeatPatternDim
+    tiff.add(33422, tiff.byte, 4, {0, 1, 1, 2}); // CFAPattern: RGGB
+    tiff.add(50710, tiff.byte, 3, {0, 1, 2});    // CFAPlaneColor
+    tiff.add_short(50711, {1});                  // CFALayout: rectangular
+    tiff.add_long(50714, {black});               // BlackLevel
+    tiff.add_long(50717, {white});               // WhiteLevel
+  } else {
+    tiff.add_short(258, {16, 16, 16});           // BitsPerSample
+    tiff.add_short(262, {34892});                // Photometric: LinearRaw
+    tiff.add_short(277, {3});                    // SamplesPerPixel
+    tiff.add_long(50714, {black, black, black}); // BlackLevel
+    tiff.add_long(50717, {white, white, white}); // WhiteLevel
+  }
+  tiff.add(50706, tiff.byte, 4, {1, 4, 0, 0});   // DNGVersion
+  tiff.add_ascii(50708, "Synthetic RawConverter"); // UniqueCameraModel
+  tiff.add_short(50778, {21});                   // CalibrationIlluminant1: D65
+  // ColorMatrix1: XYZ (D65) to linear sRGB.
+  tiff.add_rational(50721,
+                    {3.2406, -1.5372, -0.4986, -0.9689, 1.8758, 0.0415,
+                     0.0557, -0.2040, 1.0570},
+                    true);
+  // AsShotNeutral
+  tiff.add_rational(50728, {1., 1., 1.}, false);
+  tiff.write(path, pixels);
+}
+
+} // namespace yk
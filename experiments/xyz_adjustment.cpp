@@ -135,21 +135,22 @@ int main(int argc, char *argv[]) {
       BOOST_LOG_TRIVIAL(trace)
           << "Converting from camera native color space to CIE-XYZ color "
              "space (16-bit).";
-      BOOST_LOG_TRIVIAL(trace)
-          << "Before camera-to-xyz image[:, " << image.shape()[1] / 2
-          << "]: " << xt::view(image, xt::all(), image.shape()[1] / 2);
+      YK_LOG_TRACE("Before camera-to-xyz image[:, "
+                   << image.shape()[1] / 2 << "]: "
+                   << xt::view(image, xt::all(), image.shape()[1] / 2));
       auto &&start = std::chrono::system_clock::now();
-      auto &&xyz =
-          rc.camera_to_xyz(image, raw.imgdata.color.dng_color[1].colormatrix,
-                           raw.imgdata.color.dng_levels.analogbalance);
+      yk::Histogram luminance;
+      auto &&xyz = rc.camera_to_xyz(
+          image, yk::RawConverter::dng_color_profile(raw.imgdata.color),
+          yk::RawConverter::as_shot_neutral(raw.imgdata.color), &luminance);
       auto &&end = std::chrono::system_clock::now();
       double elapsed =
           std::chrono::duration_cast<std::chrono::milliseconds>(end - start)
               .count();
 
-      BOOST_LOG_TRIVIAL(trace)
-          << "After camera-to-xyz image[:, " << image.shape()[1] / 2
-          << "]: " << xt::view(xyz, xt::all(), image.shape()[1] / 2);
+      YK_LOG_TRACE("After camera-to-xyz image[:, "
+                   << image.shape()[1] / 2 << "]: "
+                   << xt::view(xyz, xt::all(), image.shape()[1] / 2));
 
       BOOST_LOG_TRIVIAL(debug) << "Done conversion camera native color space "
                                   "to CIE-XYZ color space. "
@@ -165,16 +166,15 @@ int main(int argc, char *argv[]) {
 
       BOOST_LOG_TRIVIAL(trace) << "Adjusting the brightness and contrast.";
       start = std::chrono::system_clock::now();
-      auto &&xyz_adj = rc.adjust_brightness(xyz, threshold, is_debug);
+      auto &&xyz_adj =
+          rc.adjust_brightness(xyz, threshold, is_debug, &luminance);
       end = std::chrono::system_clock::now();
       elapsed =
           std::chrono::duration_cast<std::chrono::milliseconds>(end - start)
               .count();
-      BOOST_LOG_TRIVIAL(trace) << rc.debug_message.str();
-      rc.debug_message.str("");
-      BOOST_LOG_TRIVIAL(trace)
-          << "After adjustment image[:, " << image.shape()[1] / 2
-          << "]: " << xt::view(xyz_adj, xt::all(), image.shape()[1] / 2);
+      YK_LOG_TRACE("After adjustment image[:, "
+                   << image.shape()[1] / 2 << "]: "
+                   << xt::view(xyz_adj, xt::all(), image.shape()[1] / 2));
       BOOST_LOG_TRIVIAL(debug) << "Done adjusting the brightness and contrast. "
                                << "Run time (ms): " << std::to_string(elapsed);
       if (measure_speed) {
@@ -192,9 +192,9 @@ int main(int argc, char *argv[]) {
           std::chrono::duration_cast<std::chrono::milliseconds>(end - start)
               .count();
 
-      BOOST_LOG_TRIVIAL(trace)
-          << "After xyz-to-sRGB' image[:, " << image.shape()[1] / 2
-          << "]: " << xt::view(srgb_, xt::all(), image.shape()[1] / 2);
+      YK_LOG_TRACE("After xyz-to-sRGB' image[:, "
+                   << image.shape()[1] / 2 << "]: "
+                   << xt::view(srgb_, xt::all(), image.shape()[1] / 2));
       BOOST_LOG_TRIVIAL(debug)
           << "Done conversion from CIE-XYZ color space to sRGB'. "
           << "Run time (ms): " << std::to_string(elapsed);
@@ -215,9 +215,9 @@ int main(int argc, char *argv[]) {
           std::chrono::duration_cast<std::chrono::milliseconds>(end - start)
               .count();
 
-      BOOST_LOG_TRIVIAL(trace)
-          << "After gamma correction image[:, " << image.shape()[1] / 2
-          << "]: " << xt::view(srgb, xt::all(), image.shape()[1] / 2);
+      YK_LOG_TRACE("After gamma correction image[:, "
+                   << image.shape()[1] / 2 << "]: "
+                   << xt::view(srgb, xt::all(), image.shape()[1] / 2));
       BOOST_LOG_TRIVIAL(debug) << "Done gamma correction. "
                                << "Run time (ms): " << std::to_string(elapsed);
       if (measure_speed) {
@@ -0,0 +1,242 @@
+#include "raw_converter_c.h"
+#include <pybind11/numpy.h>
+#include <pybind11/pybind11.h>
+#include <pybind11/stl.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace py = pybind11;
+
+namespace {
+
+struct ImageCloser {
+  void operator()(rc_image *image) const noexcept { rc_close(image); }
+};
+using ImageHandle = std::unique_ptr<rc_image, ImageCloser>;
+
+/**
+ * @brief Conversion parameters as seen from Python. tone_mapper is owned
+ * here so that rc_params can point into it.
+ */
+struct Options {
+  std::string tone_mapper = "stretch";
+  float stretch_rate = 0.01f;
+  float local_clip_limit = 0.f;
+  bool gamma = true;
+  bool interleaved = false;
+
+  rc_params params() const noexcept {
+    rc_params p;
+    rc_default_params(&p);
+    p.tone_mapper = tone_mapper.c_str();
+    p.stretch_rate = stretch_rate;
+    p.local_clip_limit = local_clip_limit;
+    p.gamma = gamma;
+    p.layout = interleaved ? RC_LAYOUT_INTERLEAVED : RC_LAYOUT_PLANAR;
+    return p;
+  }
+};
+
+[[noreturn]] void raise(const rc_status status, const std::string &path) {
+  const std::string msg = path + ": " + rc_status_string(status);
+  if (status == RC_ERROR_INVALID_ARGUMENT) {
+    throw py::value_error(msg);
+  }
+  throw std::runtime_error(msg);
+}
+
+ImageHandle open_image(const std::string &path, rc_status &status) {
+  rc_image *image = nullptr;
+  status = rc_open(path.c_str(), &image);
+  return ImageHandle(image);
+}
+
+// Allocate the output array. Requires the GIL.
+py::array_t<std::uint16_t> allocate(const rc_image *image,
+                                    const Options &options) {
+  rc_info info;
+  rc_get_info(image, &info);
+  const py::ssize_t h = info.height, w = info.width, c = 3;
+  return options.interleaved ? py::array_t<std::uint16_t>({h, w, c})
+                             : py::array_t<std::uint16_t>({c, h, w});
+}
+
+/**
+ * @brief Decode and convert one file. LibRaw decoding and the conversion run
+ * without the GIL and the result is written straight into the NumPy buffer.
+ */
+py::array_t<std::uint16_t> convert(const std::string &path,
+                                   const Options &options) {
+  rc_status status;
+  ImageHandle image;
+  {
+    py::gil_scoped_release release;
+    image = open_image(path, status);
+  }
+  if (status != RC_OK) {
+    raise(status, path);
+  }
+  auto res = allocate(image.get(), options);
+  std::uint16_t *dst = res.mutable_data();
+  const std::size_t size = res.size();
+  {
+    py::gil_scoped_release release;
+    const rc_params params = options.params();
+    status = rc_convert_into(image.get(), &params, dst, size);
+  }
+  if (status != RC_OK) {
+    raise(status, path);
+  }
+  return res;
+}
+
+// rc_set_thread_num_threads() for the lifetime of the object.
+class ThreadNumThreads {
+public:
+  explicit ThreadNumThreads(const std::size_t n) {
+    rc_set_thread_num_threads(n);
+  }
+  ThreadNumThreads(const ThreadNumThreads &) = delete;
+  ThreadNumThreads &operator=(const ThreadNumThreads &) = delete;
+  ~ThreadNumThreads() { rc_set_thread_num_threads(0); }
+};
+
+/**
+ * @brief Convert several files with jobs worker threads. Each job gets an
+ * equal share of the kernel threads for the calls of its own thread, so the
+ * process-wide count, which concurrent calls may read, is left alone.
+ */
+py::list convert_batch(const std::vector<std::string> &paths,
+                       const Options &options, std::size_t jobs) {
+  const std::size_t hw =
+      std::max<std::size_t>(1, std::thread::hardware_concurrency());
+  jobs = std::clamp<std::size_t>(jobs ? jobs : hw, 1,
+                                 std::max<std::size_t>(1, paths.size()));
+  std::vector<py::object> results(paths.size());
+  std::vector<rc_status> statuses(paths.size(), RC_OK);
+  std::atomic<std::size_t> next{0};
+
+  const std::size_t threads_per_job =
+      std::max<std::size_t>(1, rc_num_threads() / jobs);
+  auto work = [&] {
+    // Every call of the job, opening and demosaicing the file included,
+    // runs on its share of the threads.
+    const ThreadNumThreads threads(threads_per_job);
+    const rc_params params = options.params();
+    for (std::size_t i; (i = next.fetch_add(1)) < paths.size();) {
+      ImageHandle image = open_image(paths[i], statuses[i]);
+      if (statuses[i] != RC_OK) {
+        continue;
+      }
+      std::uint16_t *dst;
+      std::size_t size;
+      {
+        py::gil_scoped_acquire acquire;
+        try {
+          auto array = allocate(image.get(), options);
+          dst = array.mutable_data();
+          size = array.size();
+          results[i] = std::move(array);
+        } catch (...) {
+          statuses[i] = RC_ERROR_OUT_OF_MEMORY;
+          continue;
+        }
+      }
+      statuses[i] = rc_convert_into(image.get(), &params, dst, size);
+    }
+  };
+
+  {
+    py::gil_scoped_release release;
+    std::vector<std::thread> workers;
+    for (std::size_t j = 1; j < jobs; j++) {
+      workers.emplace_back(work);
+    }
+    work();
+    for (auto &w : workers) {
+      w.join();
+    }
+  }
+
+  py::list res;
+  for (std::size_t i = 0; i < paths.size(); i++) {
+    if (statuses[i] != RC_OK) {
+      raise(statuses[i], paths[i]);
+    }
+    res.append(std::move(results[i]));
+  }
+  return res;
+}
+
+Options make_options(std::string tone_mapper, float stretch_rate,
+                     float local_clip_limit, bool gamma, bool interleaved) {
+  return {std::move(tone_mapper), stretch_rate, local_clip_limit, gamma,
+          interleaved};
+}
+
+} // namespace
+
+PYBIND11_MODULE(pyrawconverter, m) {
+  m.doc() = "Python bindings of the ProRaw converter. Results are uint16 "
+            "NumPy arrays of shape (3, height, width), or (height, width, 3) "
+            "with interleaved=True.";
+
+  m.def(
+      "convert",
+      [](const std::string &path, std::string tone_mapper, float stretch_rate,
+         float local_clip_limit, bool gamma, bool interleaved) {
+        return convert(path, make_options(std::move(tone_mapper), stretch_rate,
+                                          local_clip_limit, gamma,
+                                          interleaved));
+      },
+      "Convert a ProRaw/DNG file to sRGB.", py::arg("path"),
+      py::arg("tone_mapper") = "stretch", py::arg("stretch_rate") = 0.01f,
+      py::arg("local_clip_limit") = 0.f, py::arg("gamma") = true,
+      py::arg("interleaved") = false);
+
+  m.def(
+      "convert_batch",
+      [](const std::vector<std::string> &paths, std::string tone_mapper,
+         float stretch_rate, float local_clip_limit, bool gamma,
+         bool interleaved, std::size_t jobs) {
+        return convert_batch(paths,
+                             make_options(std::move(tone_mapper), stretch_rate,
+                                          local_clip_limit, gamma,
+                                          interleaved),
+                             jobs);
+      },
+      "Convert several files in parallel. jobs=0 uses one worker per "
+      "hardware thread.",
+      py::arg("paths"), py::arg("tone_mapper") = "stretch",
+      py::arg("stretch_rate") = 0.01f, py::arg("local_clip_limit") = 0.f,
+      py::arg("gamma") = true, py::arg("interleaved") = false,
+      py::arg("jobs") = 0);
+
+  m.def("set_num_threads", &rc_set_num_threads,
+        "Set the number of threads of the conversion kernels. 0 restores the "
+        "hardware default.",
+        py::arg("n"));
+  m.def("num_threads", &rc_num_threads);
+  m.def(
+      "autotune",
+      [](const std::string &path, const bool recalibrate) {
+        rc_status status;
+        {
+          py::gil_scoped_release release;
+          status = rc_autotune(path.empty() ? nullptr : path.c_str(),
+                               recalibrate);
+        }
+        if (status != RC_OK) {
+          raise(status, path);
+        }
+      },
+      "Apply the tuned kernel parameters of this host, calibrating them on "
+      "first use. An empty path uses the default per-host profile.",
+      py::arg("path") = "", py::arg("recalibrate") = false);
+}
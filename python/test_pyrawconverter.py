@@ -0,0 +1,133 @@
+"""Tests of the pyrawconverter module on small synthetic linear DNGs.
+
+Run with the built module on PYTHONPATH, e.g. through ctest.
+"""
+
+import os
+import struct
+import tempfile
+import threading
+import unittest
+
+import numpy as np
+import pyrawconverter as rc
+
+
+def write_linear_dng(path, width, height, seed):
+    """Write a linear DNG like experiments/synthetic_dng.hpp: a 13-bit
+    luminance ramp with a hue depending on the row and seed."""
+    black, white = 64, 8191
+    pixels = bytearray()
+    for y in range(height):
+        for x in range(width):
+            level = (x / width) ** 2
+            for ch in range(3):
+                tint = 0.6 + 0.4 * ((y + 7 * seed + 5 * ch) % height) / height
+                value = black + level * tint * (white - black)
+                pixels += struct.pack("<H", int(round(value)))
+
+    def short(tag, *values):
+        data = struct.pack("<%dH" % len(values), *values)
+        return (tag, 3, len(values), data)
+
+    def long_(tag, *values):
+        data = struct.pack("<%dI" % len(values), *values)
+        return (tag, 4, len(values), data)
+
+    def ascii(tag, value):
+        data = value.encode() + b"\0"
+        return (tag, 2, len(data), data)
+
+    def rational(tag, values, signed):
+        data = b"".join(
+            struct.pack("<iI" if signed else "<II", round(v * 10000), 10000)
+            for v in values)
+        return (tag, 10 if signed else 5, len(values), data)
+
+    entries = [
+        long_(254, 0), long_(256, width), long_(257, height),
+        short(258, 16, 16, 16), short(259, 1), short(262, 34892),
+        ascii(271, "Synthetic"), ascii(272, "RawConverter"), short(274, 1),
+        long_(273, 0), short(277, 3), long_(278, height),
+        long_(279, len(pixels)), short(284, 1),
+        (50706, 1, 4, bytes([1, 4, 0, 0])),
+        ascii(50708, "Synthetic RawConverter"),
+        long_(50714, black, black, black), long_(50717, white, white, white),
+        rational(50721, [3.2406, -1.5372, -0.4986, -0.9689, 1.8758, 0.0415,
+                         0.0557, -0.2040, 1.0570], True),
+        rational(50728, [1, 1, 1], False), short(50778, 21),
+    ]
+    entries.sort()
+    data_offset = 8 + 2 + 12 * len(entries) + 4
+    ifd, extra = struct.pack("<H", len(entries)), b""
+    for tag, kind, count, data in entries:
+        if tag == 273:
+            continue
+        if len(data) <= 4:
+            ifd += struct.pack("<HHI", tag, kind, count) + data.ljust(4, b"\0")
+        else:
+            ifd += struct.pack("<HHII", tag, kind, count,
+                               data_offset + len(extra))
+            extra += data + b"\0" * (len(data) % 2)
+    # StripOffsets points behind the tag data.
+    strip = struct.pack("<HHII", 273, 4, 1, data_offset + len(extra))
+    index = [e[0] for e in entries].index(273)
+    ifd = ifd[:2 + 12 * index] + strip + ifd[2 + 12 * index:]
+    with open(path, "wb") as f:
+        f.write(b"II*\0" + struct.pack("<I", 8) + ifd + b"\0" * 4 + extra)
+        f.write(pixels)
+
+
+class ConvertBatchTest(unittest.TestCase):
+    @classmethod
+    def setUpClass(cls):
+        cls.dir = tempfile.TemporaryDirectory()
+        cls.paths = []
+        for seed, (width, height) in enumerate([(48, 32), (40, 24), (32, 16)]):
+            path = os.path.join(cls.dir.name, "synthetic_%d.dng" % seed)
+            write_linear_dng(path, width, height, seed)
+            cls.paths.append(path)
+
+    @classmethod
+    def tearDownClass(cls):
+        cls.dir.cleanup()
+
+    def test_matches_convert(self):
+        threads = rc.num_threads()
+        images = rc.convert_batch(self.paths, jobs=2)
+        self.assertEqual(len(images), len(self.paths))
+        for path, image in zip(self.paths, images):
+            self.assertEqual(image.dtype, np.uint16)
+            np.testing.assert_array_equal(image, rc.convert(path))
+        self.assertEqual(rc.num_threads(), threads)
+
+        interleaved = rc.convert_batch(self.paths[:1], interleaved=True)
+        self.assertEqual(interleaved[0].shape, (32, 48, 3))
+
+    def test_concurrent_batches(self):
+        # Batches running side by side do not change the kernel thread
+        # count seen by each other or by the caller.
+        threads = rc.num_threads()
+        expected = [rc.convert(path) for path in self.paths]
+        results = [None] * 4
+
+        def run(i):
+            results[i] = rc.convert_batch(self.paths, jobs=i + 1)
+
+        workers = [threading.Thread(target=run, args=(i,)) for i in range(4)]
+        for w in workers:
+            w.start()
+        for w in workers:
+            w.join()
+        for images in results:
+            for image, reference in zip(images, expected):
+                np.testing.assert_array_equal(image, reference)
+        self.assertEqual(rc.num_threads(), threads)
+
+    def test_error(self):
+        with self.assertRaises(RuntimeError):
+            rc.convert_batch(self.paths + [self.paths[0] + ".missing"])
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,293 @@
+#pragma once
+
+#include "logging.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace yk {
+
+/**
+ * @class AsyncLogger
+ * @brief Bounded asynchronous log backend.
+ * Every producer thread owns a single-producer single-consumer ring buffer
+ * of fixed capacity, taken on its first record and returned to a free list
+ * when the thread exits, so that short-lived workers reuse rings. Pushing a
+ * record is wait-free: it moves the message into the ring or, if the ring
+ * is full, drops it and counts the drop, so logging never stalls a worker.
+ * One writer thread drains the rings and forwards records to the
+ * downstream sink, which therefore never sees concurrent calls. Records of
+ * one thread keep their order; records of different threads may
+ * interleave.
+ *
+ * Install it with set_log_sink(logger.sink()). The logger must outlive
+ * every thread that may still log through it.
+ */
+class AsyncLogger {
+public:
+  /**
+   * @param downstream sink receiving records on the writer thread
+   * @param capacity number of records buffered per producer thread, rounded
+   * up to a power of two
+   * @param max_threads maximum number of live producer threads. Records of
+   * further threads are dropped until one of them exits.
+   */
+  explicit AsyncLogger(LogSink downstream, const std::size_t capacity = 1024,
+                       const std::size_t max_threads = 256)
+      : downstream_(std::move(downstream)), capacity_(round_up(capacity)),
+        max_threads_(max_threads), pool_(std::make_shared<Pool>(max_threads)),
+        id_(next_id()), writer_([this] { run(); }) {}
+
+  AsyncLogger(const AsyncLogger &) = delete;
+  AsyncLogger &operator=(const AsyncLogger &) = delete;
+
+  /**
+   * @brief Drain all buffered records and stop the writer thread.
+   */
+  ~AsyncLogger() {
+    stop_.store(true, std::memory_order_release);
+    writer_.join();
+  }
+
+  /**
+   * @brief Queue a record from the calling thread.
+   * @return false if the record was dropped
+   */
+  bool push(const LogLevel level, std::string message) noexcept {
+    Ring *ring = local_ring();
+    if (!ring || !ring->push(level, std::move(message))) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    return true;
+  }
+
+  /**
+   * @brief Sink queueing records into this logger.
+   */
+  LogSink sink() {
+    return [this](LogLevel level, const std::string &message) {
+      push(level, message);
+    };
+  }
+
+  /**
+   * @brief Block until every record queued before the call has been passed
+   * to the downstream sink.
+   */
+  void flush() const {
+    const std::size_t n = pool_->size.load(std::memory_order_acquire);
+    for (std::size_t i = 0; i < n; i++) {
+      pool_->rings[i]->wait_empty();
+    }
+  }
+
+  /**
+   * @brief Number of records dropped because a ring was full or too many
+   * threads logged.
+   */
+  std::uint64_t dropped() const noexcept {
+    return dropped_.load(std::memory_order_relaxed);
+  }
+
+private:
+  struct Record {
+    LogLevel level;
+    std::string message;
+  };
+
+  class Ring {
+  public:
+    explicit Ring(const std::size_t capacity)
+        : mask_(capacity - 1), records_(new Record[capacity]) {}
+
+    bool push(const LogLevel level, std::string &&message) noexcept {
+      const std::size_t head = head_.load(std::memory_order_relaxed);
+      if (head - tail_cache_ > mask_) {
+        tail_cache_ = tail_.load(std::memory_order_acquire);
+        if (head - tail_cache_ > mask_) {
+          return false;
+        }
+      }
+      Record &r = records_[head & mask_];
+      r.level = level;
+      r.message = std::move(message);
+      head_.store(head + 1, std::memory_order_release);
+      return true;
+    }
+
+    // Forward all queued records. Called by the writer thread only.
+    template <class F> std::size_t drain(F &&f) {
+      const std::size_t head = head_.load(std::memory_order_acquire);
+      std::size_t tail = tail_.load(std::memory_order_relaxed);
+      const std::size_t count = head - tail;
+      for (; tail != head; tail++) {
+        Record &r = records_[tail & mask_];
+        f(r.level, r.message);
+        r.message.clear();
+        tail_.store(tail + 1, std::memory_order_release);
+      }
+      return count;
+    }
+
+    bool empty() const noexcept {
+      return tail_.load(std::memory_order_acquire) ==
+             head_.load(std::memory_order_relaxed);
+    }
+
+    void wait_empty() const {
+      const std::size_t head = head_.load(std::memory_order_acquire);
+      while (tail_.load(std::memory_order_acquire) < head) {
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+      }
+    }
+
+  private:
+    const std::size_t mask_;
+    std::unique_ptr<Record[]> records_;
+    alignas(64) std::atomic<std::size_t> head_{0};
+    std::size_t tail_cache_ = 0;
+    alignas(64) std::atomic<std::size_t> tail_{0};
+  };
+
+  // Rings of a logger and those whose thread has exited. Leases share it so
+  // that a thread exiting after the logger is destroyed still returns its
+  // ring into live memory.
+  struct Pool {
+    explicit Pool(const std::size_t max_threads)
+        : rings(std::make_unique<std::unique_ptr<Ring>[]>(max_threads)) {
+      // Returning a ring then never allocates.
+      free.reserve(max_threads);
+    }
+
+    std::unique_ptr<std::unique_ptr<Ring>[]> rings;
+    std::atomic<std::size_t> size{0};
+    std::mutex mutex;
+    std::vector<Ring *> free;
+  };
+
+  // Ring lent to a thread, returned when the thread exits or logs into
+  // another logger.
+  struct Lease {
+    std::uint64_t id = 0;
+    std::shared_ptr<Pool> pool;
+    Ring *ring = nullptr;
+
+    ~Lease() { release(); }
+
+    void release() noexcept {
+      if (ring) {
+        std::lock_guard<std::mutex> lock(pool->mutex);
+        pool->free.push_back(ring);
+      }
+      id = 0;
+      pool.reset();
+      ring = nullptr;
+    }
+  };
+
+  static std::size_t round_up(const std::size_t n) noexcept {
+    std::size_t res = 1;
+    while (res < n) {
+      res <<= 1;
+    }
+    return res;
+  }
+
+  static std::uint64_t next_id() noexcept {
+    static std::atomic<std::uint64_t> id{0};
+    return ++id;
+  }
+
+  // Ring of the calling thread on its first record: a drained ring of an
+  // exited thread, else a new ring, else any ring of an exited thread. The
+  // lease is keyed by the logger id so that a new logger at the same address
+  // does not reuse a stale ring. A reused ring may still hold records of its
+  // previous thread; the mutex orders them before those of the next one.
+  Ring *local_ring() noexcept {
+    thread_local Lease lease;
+    if (lease.id == id_) {
+      return lease.ring;
+    }
+    lease.release();
+    Ring *ring = nullptr;
+    {
+      std::lock_guard<std::mutex> lock(pool_->mutex);
+      const std::size_t n = pool_->size.load(std::memory_order_relaxed);
+      auto &free = pool_->free;
+      auto it = std::find_if(free.begin(), free.end(),
+                             [](const Ring *r) { return r->empty(); });
+      if (it == free.end() && n < max_threads_) {
+        try {
+          pool_->rings[n] = std::make_unique<Ring>(capacity_);
+          ring = pool_->rings[n].get();
+          pool_->size.store(n + 1, std::memory_order_release);
+        } catch (...) {
+        }
+      }
+      if (!ring && !free.empty()) {
+        if (it == free.end()) {
+          it = free.begin();
+        }
+        ring = *it;
+        free.erase(it);
+      }
+    }
+    // Without a ring, retry on the next record in case a thread has exited.
+    if (ring) {
+      lease.id = id_;
+      lease.pool = pool_;
+      lease.ring = ring;
+    }
+    return ring;
+  }
+
+  void run() {
+    auto forward = [this](LogLevel level, const std::string &message) {
+      if (downstream_) {
+        try {
+          downstream_(level, message);
+        } catch (...) {
+          dropped_.fetch_add(1, std::memory_order_relaxed);
+        }
+      }
+    };
+    auto idle = std::chrono::microseconds(0);
+    for (;;) {
+      const bool stopping = stop_.load(std::memory_order_acquire);
+      std::size_t count = 0;
+      const std::size_t n = pool_->size.load(std::memory_order_acquire);
+      for (std::size_t i = 0; i < n; i++) {
+        count += pool_->rings[i]->drain(forward);
+      }
+      if (count) {
+        idle = std::chrono::microseconds(0);
+      } else if (stopping) {
+        return;
+      } else {
+        idle = std::min(std::chrono::microseconds(1000),
+                        idle + std::chrono::microseconds(50));
+        std::this_thread::sleep_for(idle);
+      }
+    }
+  }
+
+  LogSink downstream_;
+  const std::size_t capacity_;
+  const std::size_t max_threads_;
+  std::shared_ptr<Pool> pool_;
+  std::atomic<std::uint64_t> dropped_{0};
+  std::atomic<bool> stop_{false};
+  const std::uint64_t id_;
+  std::thread writer_;
+};
+
+} // namespace yk
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace yk {
+
+/**
+ * @brief Kernel parameters chosen for one host.
+ */
+struct TuningProfile {
+  std::string host;
+  // Hardware threads of the host when the profile was made. A profile made
+  // on a machine with a different core count is recalibrated.
+  std::size_t hardware_threads = 0;
+  // See set_num_threads(), set_grain_size() and set_color_block().
+  std::size_t threads = 0;
+  std::size_t grain_size = 0;
+  std::size_t color_block = 0;
+};
+
+/**
+ * @brief Workload and candidates of calibrate(). Empty candidate lists use
+ * defaults derived from the host.
+ */
+struct CalibrationParams {
+  // Pixels of the synthetic calibration frame.
+  std::size_t pixels = 1 << 22;
+  // Runs per candidate; the fastest run counts.
+  std::size_t repeat = 3;
+  std::vector<std::size_t> threads;
+  std::vector<std::size_t> grain_sizes;
+  std::vector<std::size_t> color_blocks;
+};
+
+/**
+ * @brief Name of this host as used in tuning profiles.
+ */
+std::string host_name();
+
+/**
+ * @brief Path of the tuning profile of this host:
+ * $RAWCONVERTER_TUNING_PROFILE if set, otherwise
+ * $XDG_CACHE_HOME/rawconverter/tuning-<host>.conf, falling back to
+ * $HOME/.cache.
+ */
+std::string default_profile_path();
+
+/**
+ * @brief Parameters currently in effect.
+ */
+TuningProfile current_profile();
+
+/**
+ * @brief Make the parameters of a profile current. Zero fields restore the
+ * defaults.
+ */
+void apply_profile(const TuningProfile &profile) noexcept;
+
+/**
+ * @brief Choose the parameters with short benchmarks of the fused
+ * conversion path (color transform with luminance histogram, then tone
+ * curve). Thread count, grain size and color block size are tuned in turn,
+ * each with the best values found so far. A candidate replaces the current
+ * choice only if it is more than 3% faster, so the smaller thread count
+ * wins ties. The parameters in effect are restored afterwards.
+ * @param params workload and candidates
+ * @return chosen parameters of this host
+ */
+TuningProfile calibrate(const CalibrationParams &params = {});
+
+/**
+ * @brief Read a profile written by save_profile().
+ * @return false if the file does not exist or is not a valid profile
+ */
+bool load_profile(const std::string &path, TuningProfile &profile);
+
+/**
+ * @brief Write a profile, creating parent directories as needed.
+ * @throw std::runtime_error if the file cannot be written
+ */
+void save_profile(const std::string &path, const TuningProfile &profile);
+
+/**
+ * @brief Apply the tuning profile of this host, calibrating and saving it
+ * first if it is missing, belongs to another machine or recalibrate is set.
+ * Failure to save is logged and otherwise ignored.
+ * @param path profile path
+ * @param recalibrate calibrate even if a valid profile exists
+ * @param params calibration workload and candidates
+ * @return applied profile
+ */
+TuningProfile autotune(const std::string &path = default_profile_path(),
+                       bool recalibrate = false,
+                       const CalibrationParams &params = {});
+
+} // namespace yk
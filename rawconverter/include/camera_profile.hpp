@@ -0,0 +1,147 @@
+#pragma once
+
+#include "color_transform.hpp"
+#include "histogram.hpp"
+#include "tiff_reader.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace yk {
+
+/**
+ * @brief HueSatMap or LookTable of a camera profile: hue shifts and
+ * saturation and value scales over a grid of HSV coordinates of linear
+ * ProPhoto RGB.
+ */
+struct HueSatMap {
+  // Number of hue, saturation and value divisions. vals == 1 is a 2D table.
+  std::uint32_t hues = 0, sats = 0, vals = 1;
+  // The value axis is indexed with sRGB-encoded values
+  // (ProfileHueSatMapEncoding / ProfileLookTableEncoding 1).
+  bool srgb_gamma = false;
+  // hues * sats * vals triplets of hue shift in degrees, saturation scale
+  // and value scale; value varies slowest and saturation fastest.
+  std::vector<float> data;
+
+  bool empty() const noexcept { return data.empty(); }
+};
+
+/**
+ * @brief Rendering tables of a DNG camera profile or a DCP file.
+ */
+struct CameraProfile {
+  // ProfileHueSatMapData1/2, for CalibrationIlluminant1/2.
+  std::array<HueSatMap, 2> hue_sat_maps;
+  HueSatMap look_table;
+  // ProfileToneCurve as (input, output) points in [0, 1].
+  std::vector<std::array<float, 2>> tone_curve;
+
+  bool empty() const noexcept {
+    return hue_sat_maps[0].empty() && hue_sat_maps[1].empty() &&
+           look_table.empty() && tone_curve.empty();
+  }
+};
+
+constexpr std::uint16_t profile_hue_sat_map_dims_tag = 50937;
+constexpr std::uint16_t profile_hue_sat_map_data1_tag = 50938;
+constexpr std::uint16_t profile_hue_sat_map_data2_tag = 50939;
+constexpr std::uint16_t profile_tone_curve_tag = 50940;
+constexpr std::uint16_t profile_look_table_dims_tag = 50981;
+constexpr std::uint16_t profile_look_table_data_tag = 50982;
+constexpr std::uint16_t profile_hue_sat_map_encoding_tag = 51107;
+constexpr std::uint16_t profile_look_table_encoding_tag = 51108;
+
+/**
+ * @brief Read the rendering tables from IFD0 of a DNG or a DCP file.
+ * @return whether the file has any of them
+ * @throw std::runtime_error if a table does not match its dimensions
+ */
+bool read_camera_profile(const TiffReader &tiff, CameraProfile &profile);
+
+/**
+ * @brief Interpolate the HueSatMaps of both illuminants, e.g. with
+ * WhitePointSolution::weight. A missing map yields the other.
+ * @param weight weight of hue_sat_maps[0]
+ * @throw std::invalid_argument if the maps differ in size
+ */
+HueSatMap interpolate_hue_sat_map(const CameraProfile &profile, float weight);
+
+/**
+ * @brief HueSatMap prepared for lookups. Each cell holds its entry and the
+ * difference to the next saturation division, so interpolating along
+ * saturation needs one cell. Hue wraps around and the last value division
+ * is repeated, so that every lookup reads cells (h, v) to (h + 1, v + 1)
+ * without bounds checks. Hue shifts are in sixths of the hue circle.
+ */
+struct HueSatTable {
+  struct Cell {
+    float hue_shift, sat_scale, val_scale;
+    float d_hue_shift, d_sat_scale, d_val_scale;
+    float pad[2];
+  };
+
+  std::uint32_t hues = 0, sats = 0, vals = 1;
+  bool srgb_gamma = false;
+  // (vals + 1) * (hues + 1) * sats cells, in the order of the map.
+  std::vector<Cell> cells;
+
+  static HueSatTable prepare(const HueSatMap &map);
+
+  bool empty() const noexcept { return cells.empty(); }
+};
+
+/**
+ * @brief Everything profile_transform() needs, precomputed once per
+ * profile and white balance.
+ */
+struct ProfileTables {
+  HueSatTable hue_sat;
+  HueSatTable look;
+  // ProfileToneCurve sampled at ToneCurve::lut_size inputs over [0, 1],
+  // empty if the profile has none.
+  std::vector<float> tone;
+
+  /**
+   * @param profile camera profile
+   * @param weight weight of the first HueSatMap, see
+   * interpolate_hue_sat_map()
+   */
+  static ProfileTables prepare(const CameraProfile &profile,
+                               float weight = 0.f);
+};
+
+/**
+ * @brief Natural cubic spline through the points of ProfileToneCurve,
+ * sampled at n inputs over [0, 1] and clamped to [0, 1].
+ * @throw std::invalid_argument if there are fewer than two points or the
+ * inputs are not increasing
+ */
+std::vector<float> sample_tone_curve(
+    const std::vector<std::array<float, 2>> &points, std::size_t n);
+
+/**
+ * @brief Convert a planar 3-channel camera image with the rendering tables
+ * of a camera profile, in one pass: pcs_from_camera takes the camera values
+ * to linear ProPhoto RGB, where HueSatMap, LookTable and the tone curve are
+ * applied as in the DNG specification (the curve with the hue-preserving
+ * RGB method of the DNG SDK), and rgb_from_pcs takes the result to the
+ * output color space. Pixels are processed in blocks of color_block(); the
+ * matrix, HSV and tone steps are written for auto-vectorisation.
+ * @param src camera image of shape (3, n), 16-bit white at USHRT_MAX
+ * @param dst output image of shape (3, n) with the same scale
+ * @param n number of pixels per channel
+ * @param luminance if not nullptr, receives the histogram of the output
+ * luminance computed in the same pass
+ * @param weights luminance weights of the output color space
+ */
+template <class In, class Out>
+void profile_transform(const In *src, Out *dst, std::size_t n,
+                       const Matrix3 &pcs_from_camera,
+                       const Matrix3 &rgb_from_pcs,
+                       const ProfileTables &tables,
+                       Histogram *luminance = nullptr,
+                       const std::array<float, 3> &weights = sRGB_luminance);
+
+} // namespace yk
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "color_transform.hpp"
+#include "tone_curve.hpp"
+#include "transfer_function.hpp"
+#include <array>
+#include <string>
+
+namespace yk {
+
+/**
+ * @brief RGB output color spaces.
+ * Each is reached from linear sRGB by one 3x3 matrix, which callers
+ * precompose with their camera matrix, and encoded by one 16-bit LUT, so
+ * the choice of space does not change the per-pixel cost.
+ */
+enum class ColorSpace {
+  // IEC 61966-2-1, D65.
+  sRGB,
+  // DCI-P3 primaries, D65 white and the sRGB curve.
+  display_p3,
+  // ITU-R BT.2020 primaries, D65 white and the BT.709 curve.
+  rec2020,
+  // ROMM RGB primaries, D50 white and gamma 1.8.
+  prophoto,
+  // ACES AP1 primaries, ACES white (about D60), linear.
+  acescg
+};
+
+/**
+ * @brief Parse a color space name: srgb, display-p3, rec2020, prophoto or
+ * acescg.
+ * @throw std::invalid_argument for other names
+ */
+ColorSpace parse_color_space(const std::string &name);
+
+/**
+ * @brief Name of a color space as accepted by parse_color_space().
+ */
+const char *to_string(ColorSpace cs) noexcept;
+
+/**
+ * @brief Matrix from linear RGB of a color space to CIE XYZ relative to its
+ * own white, built from the chromaticities of its primaries and white.
+ */
+Matrix3 xyz_from_rgb(ColorSpace cs) noexcept;
+
+/**
+ * @brief Bradford chromatic adaptation between two white points given as
+ * CIE xy chromaticities.
+ */
+Matrix3 bradford_adaptation(const std::array<float, 2> &from,
+                            const std::array<float, 2> &to) noexcept;
+
+/**
+ * @brief Matrix from linear sRGB to linear RGB of a color space. Spaces
+ * with another white than D65 are adapted with Bradford, so sRGB white maps
+ * to the white of the space. Composing it with a camera to sRGB matrix
+ * gives the single matrix of the color pass.
+ */
+Matrix3 rgb_from_sRGB(ColorSpace cs) noexcept;
+
+/**
+ * @brief Luminance weights of linear RGB of a color space, for the
+ * luminance histogram of color_transform().
+ */
+std::array<float, 3> luminance_weights(ColorSpace cs) noexcept;
+
+/**
+ * @brief Transfer function a color space is encoded with.
+ */
+TransferFunction transfer_function(ColorSpace cs) noexcept;
+
+/**
+ * @brief 16-bit encoding curve of a color space, rounded to nearest. Built
+ * on first use and shared afterwards.
+ */
+const ToneCurve &output_curve(ColorSpace cs);
+
+} // namespace yk
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "histogram.hpp"
+#include <array>
+#include <cstddef>
+
+namespace yk {
+
+using Matrix3 = std::array<std::array<float, 3>, 3>;
+
+/**
+ * @brief Luminance weights of linear sRGB (second row of the sRGB to XYZ
+ * matrix).
+ */
+constexpr std::array<float, 3> sRGB_luminance = {0.2126729f, 0.7151522f,
+                                                 0.0721750f};
+/**
+ * @brief Luminance weights of CIE XYZ.
+ */
+constexpr std::array<float, 3> xyz_luminance = {0.f, 1.f, 0.f};
+
+/**
+ * @brief Product of two 3x3 matrices.
+ */
+Matrix3 multiply(const Matrix3 &a, const Matrix3 &b) noexcept;
+
+/**
+ * @brief Inverse of a 3x3 matrix. A singular matrix yields all zeros.
+ */
+Matrix3 invert(const Matrix3 &m) noexcept;
+
+/**
+ * @brief Matrix converting camera native color space to CIE D65 XYZ.
+ * Same computation as RawConverter::camera_to_xyz(): the rows of
+ * AnalogBalance * ColorMatrix are normalised to sum to one and the result is
+ * inverted.
+ * @param cm transformation matrix from XYZ to reference camera native color
+ * space (ColorMatrix in DNG)
+ * @param ab AnalogBalance values in DNG
+ */
+Matrix3 xyz_from_camera(const float cm[4][3], const float ab[4]) noexcept;
+
+/**
+ * @brief Number of pixels color_transform() processes per block. Defaults to
+ * 2048.
+ */
+std::size_t color_block() noexcept;
+
+/**
+ * @brief Set the block size of color_transform(), e.g. from a tuning
+ * profile. Values are clamped to [64, 8192].
+ * @param n number of pixels. 0 restores the default.
+ */
+void set_color_block(std::size_t n) noexcept;
+
+/**
+ * @brief Apply a 3x3 color matrix to a planar 3-channel image, optionally
+ * building the luminance histogram of the result in the same pass.
+ * dst(:, i) = m * src(:, i). The luminance of each output pixel is
+ * weights . dst(:, i); it is computed from the input with the precomposed
+ * row weights * m, clamped to [0, USHRT_MAX] and counted into a 65536-bin
+ * histogram, so stretch parameters are available as soon as the transform
+ * ends without reading the output again. With luminance_stride > 1 only
+ * every luminance_stride-th pixel is counted. Instantiated for std::uint16_t
+ * and float inputs and std::uint16_t, float and Half outputs.
+ * @tparam In element type of the source image
+ * @tparam Out element type of the destination image. 16-bit outputs are
+ * truncated and clamped to [0, USHRT_MAX]; Half outputs are divided by
+ * half_unit.
+ * @param src source image, channel ch starting at src + ch * n
+ * @param dst destination image with the same layout. Must not alias src.
+ * @param n number of pixels per channel
+ * @param m color matrix
+ * @param luminance if not nullptr, receives the luminance histogram
+ * @param weights luminance weights of the output color space
+ * @param luminance_stride sampling stride of the luminance histogram
+ */
+template <class In, class Out>
+void color_transform(const In *src, Out *dst, std::size_t n, const Matrix3 &m,
+                     Histogram *luminance = nullptr,
+                     const std::array<float, 3> &weights = sRGB_luminance,
+                     std::size_t luminance_stride = 1);
+
+} // namespace yk
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace yk {
+
+/**
+ * @brief Interpolation of a Bayer mosaic, see demosaic().
+ */
+enum class DemosaicMethod {
+  // Mean of the nearest samples of each color.
+  bilinear,
+  // Green interpolated along the smoother of the horizontal and vertical
+  // directions with a Laplacian correction (Hamilton-Adams), red and blue
+  // from the color differences to green.
+  edge_aware
+};
+
+/**
+ * @brief Parse a demosaic method: bilinear or edge.
+ * @throw std::invalid_argument for other strings
+ */
+DemosaicMethod parse_demosaic_method(const std::string &s);
+
+/**
+ * @brief Colors (0 red, 1 green, 2 blue) of the 2x2 tile of a Bayer CFA in
+ * the order (even row, even column), (even, odd), (odd, even), (odd, odd).
+ */
+using CfaPattern = std::array<std::uint8_t, 4>;
+
+/**
+ * @brief Parse a Bayer pattern such as RGGB, BGGR, GRBG or GBRG.
+ * @throw std::invalid_argument for other strings
+ */
+CfaPattern parse_cfa_pattern(const std::string &s);
+
+/**
+ * @brief Check that a pattern is a Bayer tile: green on one diagonal, red
+ * and blue on the other.
+ * @throw std::invalid_argument otherwise
+ */
+void validate_cfa_pattern(const CfaPattern &cfa);
+
+/**
+ * @brief Demosaic a Bayer mosaic into a planar 3-channel image.
+ * The image is processed in bands of rows in parallel; each band is copied
+ * with a halo mirrored at the image borders (which keeps the CFA phase)
+ * into a float tile that stays in cache, and the row loops handle the even
+ * and odd columns separately so they run without per-pixel branches and
+ * auto-vectorise. Output values are clamped to [0, USHRT_MAX].
+ * @param raw mosaic of width x height samples
+ * @param width image width, at least 4
+ * @param height image height, at least 4
+ * @param stride distance between rows of raw in samples, at least width,
+ * e.g. to read the visible area of LibRaw's raw_image in place
+ * @param cfa Bayer pattern of the first row and column of raw
+ * @param dst output of shape (3, width * height)
+ * @param method interpolation
+ * @throw std::invalid_argument if the image is too small or cfa is not a
+ * Bayer pattern
+ */
+void demosaic(const std::uint16_t *raw, std::size_t width, std::size_t height,
+              std::size_t stride, const CfaPattern &cfa, std::uint16_t *dst,
+              DemosaicMethod method = DemosaicMethod::bilinear);
+
+} // namespace yk
@@ -0,0 +1,132 @@
+#pragma once
+
+#include "color_transform.hpp"
+#include "lru_cache.hpp"
+#include <array>
+#include <cstddef>
+#include <mutex>
+
+namespace yk {
+
+/**
+ * @brief Color calibration of a DNG for its two reference illuminants.
+ * Index 0 holds the *1 tags and index 1 the *2 tags.
+ */
+struct DngColorProfile {
+  // CalibrationIlluminant1/2 as EXIF LightSource codes; 17 is Standard
+  // Light A and 21 is D65.
+  std::array<int, 2> illuminants = {17, 21};
+  // ColorMatrix1/2: XYZ to reference camera native color space. A zero
+  // matrix marks a missing tag.
+  std::array<Matrix3, 2> color_matrices{};
+  // ForwardMatrix1/2: white-balanced camera native color space to D50 XYZ.
+  // Zero when the DNG has none.
+  std::array<Matrix3, 2> forward_matrices{};
+  // CameraCalibration1/2. Zero is read as identity.
+  std::array<Matrix3, 2> calibrations{};
+  std::array<float, 3> analog_balance = {1.f, 1.f, 1.f};
+};
+
+/**
+ * @brief White point found for a camera neutral.
+ */
+struct WhitePointSolution {
+  // CIE xy chromaticity of the neutral.
+  std::array<float, 2> xy = {0.f, 0.f};
+  // Correlated color temperature in kelvin.
+  float temperature = 0;
+  // Weight of the *1 matrices; the *2 matrices get 1 - weight.
+  float weight = 0;
+  int iterations = 0;
+};
+
+/**
+ * @brief Correlated color temperature of an EXIF LightSource code, with the
+ * values of the DNG SDK. 0 for unknown codes.
+ */
+float illuminant_temperature(int light_source) noexcept;
+
+/**
+ * @brief Correlated color temperature of a CIE xy chromaticity after
+ * McCamy's approximation, within a few kelvin from 2000 K to 12500 K.
+ */
+float correlated_color_temperature(const std::array<float, 2> &xy) noexcept;
+
+/**
+ * @brief Matrix converting camera native color space to CIE D65 XYZ
+ * normalised to white, so the camera neutral maps to (1, 1, 1) as in
+ * xyz_from_camera(). Follows the DNG specification: the white point of the
+ * neutral is solved by iterating between its chromaticity and the matrices
+ * interpolated linearly in inverse color temperature. With ForwardMatrix the
+ * interpolated forward matrix is used, otherwise the inverse color matrix
+ * adapted with Bradford. The result is adapted from D50 to D65.
+ * @param profile color calibration of the DNG
+ * @param neutral AsShotNeutral in camera native color space
+ * @param solution if not nullptr, receives the solved white point
+ */
+Matrix3 xyz_from_camera(const DngColorProfile &profile,
+                        const std::array<float, 3> &neutral,
+                        WhitePointSolution *solution = nullptr) noexcept;
+
+/**
+ * @brief xyz_from_camera() for image data already multiplied by white
+ * balance gains, e.g. by normalize_levels(). The white point is that of
+ * the neutral the gains balance, 1 / gains, and the gains are divided out
+ * of the matrix, since the DNG matrices expect unbalanced data. Gains of 1
+ * leave the data unbalanced and use as_shot_neutral.
+ * @param profile color calibration of the DNG
+ * @param as_shot_neutral AsShotNeutral in camera native color space
+ * @param gains white balance gains applied to the data
+ * @param solution if not nullptr, receives the solved white point
+ */
+Matrix3
+xyz_from_balanced_camera(const DngColorProfile &profile,
+                         const std::array<float, 3> &as_shot_neutral,
+                         const std::array<float, 3> &gains,
+                         WhitePointSolution *solution = nullptr) noexcept;
+
+/**
+ * @class ColorMatrixCache
+ * @brief Results of the dual-illuminant xyz_from_camera() per unique
+ * profile and neutral. Frames of a batch that share a white balance reuse
+ * the solved matrix. At most capacity() matrices are kept; the least
+ * recently used one is dropped first, so a long run over many white
+ * balances does not grow the cache. Thread-safe.
+ */
+class ColorMatrixCache {
+public:
+  static constexpr std::size_t default_capacity = 64;
+
+  /**
+   * @param capacity maximum number of cached matrices, at least 1
+   */
+  explicit ColorMatrixCache(std::size_t capacity = default_capacity);
+
+  /**
+   * @brief Cached xyz_from_camera(profile, neutral).
+   */
+  Matrix3 xyz_from_camera(const DngColorProfile &profile,
+                          const std::array<float, 3> &neutral);
+
+  std::size_t hits() const;
+  std::size_t misses() const;
+  std::size_t size() const;
+  std::size_t capacity() const noexcept { return matrices_.capacity(); }
+  void clear();
+
+  /**
+   * @brief Cache shared by the whole process.
+   */
+  static ColorMatrixCache &global();
+
+private:
+  // All matrices, the illuminants, AnalogBalance and the neutral.
+  using Key = std::array<float, 6 * 9 + 2 + 3 + 3>;
+
+  mutable std::mutex mutex_;
+  LruCache<Key, Matrix3> matrices_;
+  std::size_t hits_ = 0;
+  std::size_t misses_ = 0;
+};
+
+} // namespace yk
@@ -0,0 +1,151 @@
+#pragma once
+
+#include "tiff_reader.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace yk {
+
+/**
+ * @brief Opcode IDs of DNG opcode lists (DNG 1.6, chapter 7).
+ */
+enum class DngOpcode : std::uint32_t {
+  warp_rectilinear = 1,
+  warp_fisheye = 2,
+  fix_vignette_radial = 3,
+  fix_bad_pixels_constant = 4,
+  fix_bad_pixels_list = 5,
+  trim_bounds = 6,
+  map_table = 7,
+  map_polynomial = 8,
+  gain_map = 9,
+  delta_per_row = 10,
+  delta_per_column = 11,
+  scale_per_row = 12,
+  scale_per_column = 13,
+  warp_rectilinear2 = 14
+};
+
+/**
+ * @brief One entry of an opcode list with its raw parameter bytes.
+ */
+struct Opcode {
+  std::uint32_t id = 0;
+  // DNG version the opcode was defined in.
+  std::uint32_t version = 0;
+  std::uint32_t flags = 0;
+  // Big-endian parameter bytes.
+  std::vector<std::uint8_t> params;
+
+  /**
+   * @brief Whether a reader may skip the opcode if it does not support it.
+   */
+  bool optional() const noexcept { return flags & 1; }
+};
+
+/**
+ * @brief GainMap opcode: a grid of gains over the image, interpolated
+ * bilinearly and multiplied into the pixels of some planes, e.g. lens
+ * shading correction.
+ */
+struct GainMap {
+  // Area the map applies to, in pixels. Bottom and right are exclusive.
+  std::uint32_t top = 0, left = 0, bottom = 0, right = 0;
+  // First plane and number of planes the map applies to.
+  std::uint32_t plane = 0, planes = 1;
+  // Only every row_pitch-th row and col_pitch-th column of the area.
+  std::uint32_t row_pitch = 1, col_pitch = 1;
+  // Number of map points vertically and horizontally.
+  std::uint32_t points_v = 1, points_h = 1;
+  // Distance between and position of the first map points, relative to the
+  // image height and width.
+  double spacing_v = 1, spacing_h = 1;
+  double origin_v = 0, origin_h = 0;
+  // Planes of the map. Image planes beyond the last map plane use it.
+  std::uint32_t map_planes = 1;
+  // points_v * points_h * map_planes gains, the map plane varying fastest.
+  std::vector<float> gains;
+
+  float gain(const std::uint32_t v, const std::uint32_t h,
+             const std::uint32_t map_plane) const noexcept {
+    return gains[(std::size_t(v) * points_h + h) * map_planes + map_plane];
+  }
+};
+
+namespace detail {
+// Map point k and weight f of point k + 1 at map coordinate u of a grid of
+// `points` points, as GainMap and ProfileGainTableMap place them. Positions
+// beyond the first and last points use the edge values.
+inline void map_position(const double u, const std::uint32_t points,
+                         std::uint32_t &k, float &f) noexcept {
+  if (points == 1 || !(u > 0)) {
+    k = 0;
+    f = 0.f;
+  } else if (u >= points - 1) {
+    k = points - 2;
+    f = 1.f;
+  } else {
+    k = static_cast<std::uint32_t>(u);
+    f = static_cast<float>(u - k);
+  }
+}
+} // namespace detail
+
+/**
+ * @brief Opcode list tags of DNG. OpcodeList1 applies to the raw data as
+ * stored, OpcodeList2 after linearisation and black subtraction and
+ * OpcodeList3 after demosaicing.
+ */
+constexpr std::uint16_t opcode_list1_tag = 51008;
+constexpr std::uint16_t opcode_list2_tag = 51009;
+constexpr std::uint16_t opcode_list3_tag = 51022;
+
+/**
+ * @brief Name of an opcode ID for logs, "unknown" for IDs beyond DNG 1.6.
+ */
+const char *opcode_name(std::uint32_t id) noexcept;
+
+/**
+ * @brief Split the value of an opcode list tag into opcodes. Opcode lists
+ * are big-endian regardless of the byte order of the file.
+ * @throw std::runtime_error if the list is truncated
+ */
+std::vector<Opcode> parse_opcode_list(const std::uint8_t *data,
+                                      std::size_t size);
+
+/**
+ * @brief Decode the parameters of a GainMap opcode.
+ * @throw std::invalid_argument if op is not a GainMap
+ * @throw std::runtime_error if the parameters are inconsistent
+ */
+GainMap parse_gain_map(const Opcode &op);
+
+/**
+ * @brief GainMap opcodes of one opcode list of the raw image, in the order
+ * they are to be applied.
+ * @param tiff directories of a DNG
+ * @param tag opcode_list2_tag or opcode_list3_tag
+ * @param skipped if not nullptr, receives the names of the other opcodes
+ * of the list, which are not applied. A warning is logged for each of them
+ * that is not optional.
+ */
+std::vector<GainMap>
+read_gain_maps(const TiffReader &tiff, std::uint16_t tag,
+               std::vector<std::string> *skipped = nullptr);
+
+/**
+ * @brief GainMap opcodes of OpcodeList2 and OpcodeList3 of the raw image,
+ * in the order they are to be applied. For a Bayer DNG, OpcodeList2 maps
+ * address CFA sites and belong to the mosaic (see
+ * apply_mosaic_gain_maps()), so read the lists separately.
+ * @param tiff directories of a DNG
+ * @param skipped if not nullptr, receives the names of the other opcodes
+ * of these lists, which are not applied
+ */
+std::vector<GainMap>
+read_gain_maps(const TiffReader &tiff,
+               std::vector<std::string> *skipped = nullptr);
+
+} // namespace yk
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "color_transform.hpp"
+#include "histogram.hpp"
+#include "tiff_reader.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace yk {
+
+/**
+ * @brief ProfileGainTableMap of DNG 1.6: a grid of gain curves over the
+ * image, indexed by position and by a weighted pixel value. ProRaw stores
+ * the local tone mapping of the camera rendering in it.
+ */
+struct GainTableMap {
+  // Number of map points vertically and horizontally.
+  std::uint32_t points_v = 1, points_h = 1;
+  // Distance between and position of the first map points, relative to the
+  // image height and width, as in GainMap.
+  double spacing_v = 1, spacing_h = 1;
+  double origin_v = 0, origin_h = 0;
+  // Number of table entries per map point, spanning weights [0, 1].
+  std::uint32_t points_n = 1;
+  // Weights of R, G, B, min(R, G, B) and max(R, G, B) that give the table
+  // coordinate of a pixel.
+  std::array<float, 5> input_weights = {0.f, 0.f, 0.f, 0.f, 0.f};
+  // points_v * points_h * points_n gains, the table entry varying fastest.
+  std::vector<float> gains;
+
+  float gain(const std::uint32_t v, const std::uint32_t h,
+             const std::uint32_t n) const noexcept {
+    return gains[(std::size_t(v) * points_h + h) * points_n + n];
+  }
+};
+
+constexpr std::uint16_t profile_gain_table_map_tag = 52525;
+
+/**
+ * @brief Decode the value of a ProfileGainTableMap tag.
+ * @param data tag value
+ * @param size size of the value in bytes
+ * @param big_endian byte order of the file the tag was read from
+ * @throw std::runtime_error if the value is truncated or inconsistent
+ */
+GainTableMap parse_gain_table_map(const std::uint8_t *data, std::size_t size,
+                                  bool big_endian);
+
+/**
+ * @brief ProfileGainTableMap of a DNG, looked up in IFD0 and then in the
+ * raw image directory.
+ * @param map receives the table if there is one
+ * @return whether the file has a table
+ * @throw std::runtime_error if the table is malformed
+ */
+bool read_gain_table_map(const TiffReader &tiff, GainTableMap &map);
+
+/**
+ * @brief Apply a ProfileGainTableMap to a linear planar 3-channel image in
+ * place. Each pixel is multiplied by the gain interpolated trilinearly at
+ * its position and its table coordinate, the input weights applied to the
+ * pixel divided by white and clamped to [0, 1]. The table is interpolated
+ * vertically once per row, and rows are processed in parallel in blocks of
+ * color_block() pixels.
+ * @param data image of shape (3, width * height)
+ * @param width image width
+ * @param height image height
+ * @param map gain table
+ * @param white value of diffuse white, e.g. USHRT_MAX for the output of
+ * RawConverter::camera_to_rgb()
+ * @param luminance if not nullptr, receives the histogram of the luminance
+ * after the gains, computed in the same pass
+ * @param weights luminance weights of the image's color space
+ */
+void apply_gain_table_map(float *data, std::size_t width, std::size_t height,
+                          const GainTableMap &map, float white,
+                          Histogram *luminance = nullptr,
+                          const std::array<float, 3> &weights = sRGB_luminance);
+
+} // namespace yk
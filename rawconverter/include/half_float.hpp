@@ -0,0 +1,131 @@
+#pragma once
+
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+
+namespace yk {
+
+/**
+ * @brief IEEE 754 binary16 value used as storage for intermediate images.
+ * Arithmetic is done in float; values are converted on load and store.
+ * Intermediates hold 16-bit code values divided by half_unit, so full-scale
+ * white is 1.0 and highlights up to 65504 times white remain representable.
+ * The relative rounding error is at most 2^-11 (about 32 codes at white);
+ * below 4 codes, where Half is subnormal, the error is below 0.002 codes.
+ */
+struct Half {
+  std::uint16_t bits = 0;
+};
+
+static_assert(sizeof(Half) == 2, "Half must be 16 bits wide");
+
+/**
+ * @brief 16-bit code value stored as 1.0 in Half intermediates.
+ */
+constexpr float half_unit = USHRT_MAX;
+
+/**
+ * @brief Round a float to the nearest Half, ties to even. Values beyond the
+ * Half range become infinity and NaN stays NaN.
+ */
+inline Half to_half(const float value) noexcept {
+  constexpr std::uint32_t f32_infinity = 255u << 23;
+  // 65536.f, the first float that is not rounded to a finite Half.
+  constexpr std::uint32_t f16_overflow = (127u + 16) << 23;
+  // 0.5f: adding it aligns subnormal Half mantissas to the float LSBs.
+  constexpr std::uint32_t denorm_magic = ((127u - 15) + (23 - 10) + 1) << 23;
+  std::uint32_t x;
+  std::memcpy(&x, &value, sizeof(x));
+  const std::uint32_t sign = x & 0x80000000u;
+  x ^= sign;
+  std::uint32_t res;
+  if (x >= f16_overflow) {
+    res = x > f32_infinity ? 0x7e00 : 0x7c00;
+  } else if (x < (113u << 23)) {
+    // Subnormal Half or zero; the float addition does the rounding.
+    float f, magic;
+    std::memcpy(&f, &x, sizeof(f));
+    std::memcpy(&magic, &denorm_magic, sizeof(magic));
+    f += magic;
+    std::memcpy(&x, &f, sizeof(x));
+    res = x - denorm_magic;
+  } else {
+    const std::uint32_t odd = (x >> 13) & 1;
+    x += ((15u - 127) << 23) + 0xfff + odd;
+    res = x >> 13;
+  }
+  return Half{static_cast<std::uint16_t>(res | (sign >> 16))};
+}
+
+/**
+ * @brief Exact conversion of a Half to float.
+ */
+inline float to_float(const Half value) noexcept {
+  constexpr std::uint32_t shifted_exp = 0x7c00u << 13;
+  std::uint32_t x = (value.bits & 0x7fffu) << 13;
+  const std::uint32_t exp = x & shifted_exp;
+  x += (127u - 15) << 23;
+  float res;
+  if (exp == shifted_exp) {
+    x += (128u - 16) << 23; // infinity or NaN
+    std::memcpy(&res, &x, sizeof(res));
+  } else if (exp == 0) {
+    // Subnormal: renormalise through a float subtraction.
+    constexpr std::uint32_t magic_bits = 113u << 23;
+    float magic;
+    std::memcpy(&magic, &magic_bits, sizeof(magic));
+    x += 1u << 23;
+    std::memcpy(&res, &x, sizeof(res));
+    res -= magic;
+  } else {
+    std::memcpy(&res, &x, sizeof(res));
+  }
+  return (value.bits & 0x8000u) ? -res : res;
+}
+
+/**
+ * @brief Convert n floats to Half, scaling them by scale first. Uses F16C
+ * on CPUs that support it and the scalar conversion otherwise; both round
+ * to nearest even.
+ */
+void to_half(const float *src, Half *dst, std::size_t n,
+             float scale = 1.f) noexcept;
+
+/**
+ * @brief Convert n Half values to float, scaling them by scale afterwards.
+ */
+void to_float(const Half *src, float *dst, std::size_t n,
+              float scale = 1.f) noexcept;
+
+/**
+ * @brief Error of storing an intermediate as Half instead of float, in
+ * 16-bit code values.
+ */
+struct HalfErrorStats {
+  std::size_t count = 0;
+  double max_abs = 0;
+  double mean_abs = 0;
+  // Largest error relative to the value, over values of at least 4 codes
+  // (normal Half numbers).
+  double max_rel = 0;
+  // Values above full-scale white, kept by Half and clipped by ushort.
+  std::size_t above_white = 0;
+  // Values whose truncated 16-bit code differs from the float path.
+  std::size_t changed_codes = 0;
+  std::size_t max_code_diff = 0;
+};
+
+/**
+ * @brief Measure the Half round trip of float intermediates given in code
+ * values (as emitted by camera_to_sRGB()).
+ * @param values reference values
+ * @param n number of values
+ */
+HalfErrorStats half_error(const float *values, std::size_t n);
+
+std::ostream &operator<<(std::ostream &os, const HalfErrorStats &stats);
+
+} // namespace yk
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "tone_curve.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace yk {
+
+/**
+ * @brief Histogram of 16-bit values with one bin per value.
+ */
+using Histogram = std::vector<std::uint32_t>;
+
+/**
+ * @brief Build a 65536-bin histogram of n values in one parallel pass.
+ * Each chunk counts into its own sub-histogram, which is split in two
+ * interleaved halves so that runs of equal values do not serialise on one
+ * counter. Sub-histograms are summed bin-parallel at the end.
+ * @param data 16-bit values
+ * @param n number of values
+ * @param stride only every stride-th value is counted
+ * @return histogram with ToneCurve::lut_size bins
+ */
+Histogram compute_histogram(const std::uint16_t *data, std::size_t n,
+                            std::size_t stride = 1);
+
+/**
+ * @brief Number of values counted in a histogram.
+ */
+std::uint64_t histogram_total(const Histogram &histogram) noexcept;
+
+/**
+ * @brief In-place inclusive prefix sum, four lanes at a time with SSE2.
+ */
+void inclusive_scan(std::uint32_t *data, std::size_t n) noexcept;
+
+/**
+ * @brief Histogram equalisation curve: v -> USHRT_MAX * cdf(v) / total.
+ * @param histogram histogram with ToneCurve::lut_size bins
+ * @return tone curve mapping each value to its scaled cumulative count
+ */
+ToneCurve equalization_curve(Histogram histogram);
+
+} // namespace yk
@@ -0,0 +1,114 @@
+#pragma once
+
+#include "histogram.hpp"
+#include "tone_curve.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <ostream>
+
+namespace yk {
+
+/**
+ * @struct ChannelStats
+ * @brief Count, mean, sum of squared deviations, min and max of a set of
+ * values. Partial results are combined with merge() (Chan et al.), which
+ * stays numerically stable for large images.
+ */
+struct ChannelStats {
+  std::size_t count = 0;
+  double mean = 0;
+  // Sum of squared deviations from the mean.
+  double m2 = 0;
+  double min = std::numeric_limits<double>::infinity();
+  double max = -std::numeric_limits<double>::infinity();
+
+  double sum() const noexcept { return mean * count; }
+  double variance() const noexcept { return count ? m2 / count : 0.; }
+  double stddev() const noexcept { return std::sqrt(variance()); }
+
+  /**
+   * @brief Combine with the statistics of another, disjoint set of values.
+   */
+  ChannelStats &merge(const ChannelStats &other) noexcept {
+    if (other.count == 0) {
+      return *this;
+    }
+    if (count == 0) {
+      return *this = other;
+    }
+    const double n = count + other.count;
+    const double delta = other.mean - mean;
+    mean += delta * other.count / n;
+    m2 += other.m2 + delta * delta * (double(count) * other.count / n);
+    count += other.count;
+    min = std::min(min, other.min);
+    max = std::max(max, other.max);
+    return *this;
+  }
+};
+
+inline std::ostream &operator<<(std::ostream &os, const ChannelStats &s) {
+  return os << "count: " << s.count << ", mean: " << s.mean
+            << ", stddev: " << s.stddev() << ", min: " << s.min
+            << ", max: " << s.max;
+}
+
+/**
+ * @brief Statistics of the three channels of an image.
+ */
+struct ImageStats {
+  std::array<ChannelStats, 3> channels;
+
+  const ChannelStats &operator[](const int ch) const noexcept {
+    return channels[ch];
+  }
+
+  /**
+   * @brief Statistics of all channels pooled together.
+   */
+  ChannelStats pooled() const noexcept {
+    ChannelStats res;
+    for (auto &c : channels) {
+      res.merge(c);
+    }
+    return res;
+  }
+};
+
+/**
+ * @brief Statistics of n values in one parallel pass.
+ * Instantiated for std::uint16_t and float.
+ * @tparam T element type
+ * @param data values
+ * @param n number of values
+ * @param stride only every stride-th value is sampled
+ */
+template <class T>
+ChannelStats compute_stats(const T *data, std::size_t n, std::size_t stride = 1);
+
+/**
+ * @brief Statistics of all three channels of a planar image in one parallel
+ * pass. Instantiated for std::uint16_t and float.
+ * @tparam T element type
+ * @param data image data, channel ch starting at data + ch * n
+ * @param n number of pixels per channel
+ * @param stride only every stride-th pixel is sampled
+ */
+template <class T>
+ImageStats compute_image_stats(const T *data, std::size_t n,
+                               std::size_t stride = 1);
+
+/**
+ * @brief Statistics of the values counted in a histogram.
+ */
+ChannelStats histogram_stats(const Histogram &histogram) noexcept;
+
+inline ImageStats compute_image_stats(const ImageView &image,
+                                      const std::size_t stride = 1) {
+  return compute_image_stats(image.data, image.size, stride);
+}
+
+} // namespace yk
@@ -0,0 +1,135 @@
+#pragma once
+
+#include "dng_opcodes.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace yk {
+
+/**
+ * @brief Parameters of normalize_levels().
+ */
+struct LevelParams {
+  // Factor applied to the stored values first; 8 maps the 13-bit values of
+  // ProRaw to 16 bits as RawConverter::raw_adjust() does.
+  float scale = 8.f;
+  // Black level per channel, subtracted after the scale.
+  std::array<float, 3> black = {0.f, 0.f, 0.f};
+  // White level after the scale. Values are clipped at white - black once
+  // the black level is subtracted, before the gains, so a saturated pixel
+  // is clipped in every channel whatever its black level.
+  float white = 65535.f;
+  // White balance gains per channel, applied after the clip. They are
+  // folded into the scale, clip and black constants, so they cost no extra
+  // operation.
+  std::array<float, 3> gains = {1.f, 1.f, 1.f};
+};
+
+/**
+ * @brief Level parameters that map stored values from [black, white] to
+ * [0, USHRT_MAX], e.g. for a demosaiced Bayer image. The scale is set by
+ * the largest black level, so a saturated pixel reaches USHRT_MAX in every
+ * channel and stays neutral under any white balance.
+ * @param white white level in stored units
+ * @param black black level per channel in stored units
+ */
+LevelParams white_point_levels(float white, const std::array<float, 3> &black);
+
+/**
+ * @brief How the white balance gains of normalize_levels() are chosen.
+ */
+struct WhiteBalance {
+  enum class Mode {
+    // Gains of 1; the color matrix is expected to balance.
+    none,
+    // Inverse of the camera neutral (AsShotNeutral).
+    as_shot,
+    // Gray world: channel means of a sample of unclipped pixels made equal.
+    gray_world,
+    // The given multipliers.
+    custom
+  };
+  Mode mode = Mode::none;
+  // Multipliers of Mode::custom.
+  std::array<float, 3> multipliers = {1.f, 1.f, 1.f};
+};
+
+/**
+ * @brief Parse a white balance: none, as-shot, auto (gray world) or three
+ * comma-separated multipliers such as 2.1,1,1.6.
+ * @throw std::invalid_argument for other strings
+ */
+WhiteBalance parse_white_balance(const std::string &s);
+
+/**
+ * @brief White balance gains scaled so that the smallest is 1, so clipped
+ * highlights stay clipped in every channel.
+ * @throw std::invalid_argument if a multiplier is not positive and finite
+ */
+std::array<float, 3> normalize_gains(const std::array<float, 3> &multipliers);
+
+/**
+ * @brief Gains of a white balance for normalize_levels().
+ * @param wb white balance
+ * @param src image data of shape (3, n) as passed to normalize_levels();
+ * only read for the gray world, every stride-th pixel
+ * @param n number of pixels per channel
+ * @param params scale and black levels the image will be normalised with
+ * @param neutral camera neutral for Mode::as_shot, e.g.
+ * RawConverter::as_shot_neutral(). A neutral with an entry that is not
+ * positive and finite gives gains of 1, as does a gray world without
+ * usable pixels.
+ * @param stride sampling stride of the gray world
+ * @return gains normalised with normalize_gains()
+ */
+std::array<float, 3>
+white_balance_gains(const WhiteBalance &wb, const std::uint16_t *src,
+                    std::size_t n, const LevelParams &params,
+                    const std::array<float, 3> &neutral,
+                    std::size_t stride = 64);
+
+/**
+ * @brief Level normalisation of a planar 3-channel image in one pass:
+ * dst = clamp(min(src * scale - black, white - black) * gains * map), where
+ * gains are the white balance and map is the product of the gain maps that
+ * cover the pixel, interpolated
+ * bilinearly. Gains are expanded into one row of floats at a time, so the
+ * maps cost no extra pass over the image, and rows are processed in
+ * parallel.
+ * @param src image data of shape (3, width * height)
+ * @param dst output image. May be src.
+ * @param width image width
+ * @param height image height
+ * @param params scale, black levels and white balance gains
+ * @param gain_maps GainMap opcodes, e.g. from read_gain_maps(); planes
+ * beyond the third are ignored
+ */
+void normalize_levels(const std::uint16_t *src, std::uint16_t *dst,
+                      std::size_t width, std::size_t height,
+                      const LevelParams &params,
+                      const std::vector<GainMap> &gain_maps = {});
+
+/**
+ * @brief Apply the OpcodeList2 gain maps of a Bayer DNG to the mosaic in
+ * place, before demosaic(). The mosaic is plane 0 and the maps select
+ * their CFA sites with top, left and the row and column pitch. As
+ * OpcodeList2 comes after black subtraction, the gain scales the value
+ * above the black level: v = black + (v - black) * gain.
+ * @param raw mosaic of width x height samples
+ * @param width image width
+ * @param height image height
+ * @param stride distance between rows of raw in samples
+ * @param black black level of the 2x2 CFA sites in stored units, in the
+ * order of CfaPattern
+ * @param gain_maps GainMap opcodes, e.g. read_gain_maps(tiff,
+ * opcode_list2_tag); maps of other planes are ignored
+ */
+void apply_mosaic_gain_maps(std::uint16_t *raw, std::size_t width,
+                            std::size_t height, std::size_t stride,
+                            const std::array<float, 4> &black,
+                            const std::vector<GainMap> &gain_maps);
+
+} // namespace yk
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "histogram.hpp"
+#include "tone_curve.hpp"
+#include <cstddef>
+#include <cstdint>
+
+namespace yk {
+
+/**
+ * @brief Parameters of the tiled local histogram equalisation.
+ */
+struct LocalToneMapParams {
+  // Number of tiles along each axis.
+  std::size_t tiles_x = 8;
+  std::size_t tiles_y = 8;
+  // Maximum bin count as a multiple of the mean bin count of a tile. Counts
+  // above the limit are redistributed uniformly. Values <= 0 disable
+  // clipping (plain adaptive histogram equalisation).
+  float clip_limit = 4.f;
+  // log2 of the number of histogram bins per tile.
+  int bin_bits = 12;
+};
+
+/**
+ * @brief Equalisation curve of a clipped histogram.
+ * The histogram has 2^bin_bits bins covering [0, USHRT_MAX]; the curve is
+ * interpolated linearly inside each bin so that it has one entry per
+ * 16-bit value.
+ * @param histogram histogram with 2^bin_bits bins
+ * @param clip_limit maximum bin count as a multiple of the mean bin count
+ * @param bin_bits log2 of the number of bins, in [1, 16]
+ * @throw std::invalid_argument if bin_bits is out of range or the histogram
+ * does not have 2^bin_bits bins
+ */
+ToneCurve clipped_equalization_curve(Histogram histogram, float clip_limit,
+                                     int bin_bits);
+
+/**
+ * @brief Tiled local histogram equalisation (CLAHE).
+ * The image is divided into tiles_x * tiles_y tiles. Each tile gets a
+ * clipped-histogram equalisation curve computed from its green channel and
+ * every pixel is mapped through the curves of the four nearest tiles,
+ * blended bilinearly by the distance to the tile centres. Tile curves and
+ * output rows are processed in parallel; each row is mapped through the
+ * four curves with apply_lut() and the lookups are blended in a separate
+ * vectorised loop. An empty image is left untouched.
+ * @param image image to map, clipped to [0, USHRT_MAX]
+ * @param width image width
+ * @param height image height
+ * @param dst output image with the same layout as image. May alias image.
+ * @param params tiling and clipping parameters
+ */
+void local_equalization(const ImageView &image, std::size_t width,
+                        std::size_t height, std::uint16_t *dst,
+                        const LocalToneMapParams &params = {});
+
+} // namespace yk
@@ -0,0 +1,165 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <utility>
+
+/**
+ * @file logging.hpp
+ * @brief Logging facade of the converter.
+ * Statements below YK_LOG_MIN_LEVEL are removed at compile time; by default
+ * trace and debug statements only exist in builds without NDEBUG. Enabled
+ * statements check the run-time level with one relaxed atomic load before
+ * any formatting, and records are handed to a replaceable sink (e.g. one
+ * forwarding to Boost.Log in the experiments).
+ */
+
+#define YK_LOG_LEVEL_TRACE 0
+#define YK_LOG_LEVEL_DEBUG 1
+#define YK_LOG_LEVEL_INFO 2
+#define YK_LOG_LEVEL_WARNING 3
+#define YK_LOG_LEVEL_ERROR 4
+#define YK_LOG_LEVEL_FATAL 5
+
+#ifndef YK_LOG_MIN_LEVEL
+#ifdef NDEBUG
+#define YK_LOG_MIN_LEVEL YK_LOG_LEVEL_INFO
+#else
+#define YK_LOG_MIN_LEVEL YK_LOG_LEVEL_TRACE
+#endif
+#endif
+
+namespace yk {
+
+enum class LogLevel {
+  trace = YK_LOG_LEVEL_TRACE,
+  debug = YK_LOG_LEVEL_DEBUG,
+  info = YK_LOG_LEVEL_INFO,
+  warning = YK_LOG_LEVEL_WARNING,
+  error = YK_LOG_LEVEL_ERROR,
+  fatal = YK_LOG_LEVEL_FATAL
+};
+
+inline const char *to_string(const LogLevel level) noexcept {
+  constexpr const char *names[] = {"trace",   "debug", "info",
+                                   "warning", "error", "fatal"};
+  return names[static_cast<int>(level)];
+}
+
+/**
+ * @brief Receiver of formatted log records.
+ */
+using LogSink = std::function<void(LogLevel, const std::string &)>;
+
+namespace detail {
+inline std::atomic<int> &log_level_storage() noexcept {
+  static std::atomic<int> level{YK_LOG_LEVEL_INFO};
+  return level;
+}
+
+// The active sink is shared with the threads emitting records, so a
+// replaced sink is freed once the last record passed to it is done.
+struct LogSinkHolder {
+  std::shared_ptr<const LogSink> sink = std::make_shared<const LogSink>(
+      [](LogLevel level, const std::string &message) {
+        std::clog << "[" << to_string(level) << "] " << message << "\n";
+      });
+};
+
+inline LogSinkHolder &log_sink_holder() {
+  static LogSinkHolder holder;
+  return holder;
+}
+
+inline void emit(const LogLevel level, const std::string &message) {
+  const auto sink = std::atomic_load(&log_sink_holder().sink);
+  if (*sink) {
+    (*sink)(level, message);
+  }
+}
+} // namespace detail
+
+/**
+ * @brief Set the minimum level of records passed to the sink at run time.
+ * Levels below YK_LOG_MIN_LEVEL stay disabled regardless.
+ */
+inline void set_log_level(const LogLevel level) noexcept {
+  detail::log_level_storage().store(static_cast<int>(level),
+                                    std::memory_order_relaxed);
+}
+
+/**
+ * @brief Replace the sink receiving log records. An empty sink discards
+ * them. The sink may be called from several threads at once.
+ */
+inline void set_log_sink(LogSink sink) {
+  std::atomic_store(&detail::log_sink_holder().sink,
+                    std::make_shared<const LogSink>(std::move(sink)));
+}
+
+/**
+ * @brief Whether records of the given level are emitted. Constant false for
+ * levels compiled out.
+ */
+inline bool log_enabled(const LogLevel level) noexcept {
+  return YK_LOG_MIN_LEVEL <= static_cast<int>(level) &&
+         detail::log_level_storage().load(std::memory_order_relaxed) <=
+             static_cast<int>(level);
+}
+
+/**
+ * @class LogBuffer
+ * @brief Stream collecting the messages of a stage into one record.
+ * stream() is nullptr when the level is disabled, so callees that take an
+ * optional std::ostream* skip their diagnostics entirely. The record is
+ * emitted on destruction.
+ */
+class LogBuffer {
+public:
+  explicit LogBuffer(const LogLevel level, const bool requested = true)
+      : level_(level), enabled_(requested && log_enabled(level)) {}
+  LogBuffer(const LogBuffer &) = delete;
+  LogBuffer &operator=(const LogBuffer &) = delete;
+  ~LogBuffer() {
+    if (enabled_ && 0 < os_.tellp()) {
+      detail::emit(level_, os_.str());
+    }
+  }
+
+  std::ostream *stream() noexcept { return enabled_ ? &os_ : nullptr; }
+
+private:
+  LogLevel level_;
+  bool enabled_;
+  std::ostringstream os_;
+};
+
+} // namespace yk
+
+/**
+ * @brief Log a stream expression, e.g. YK_LOG_DEBUG("rate: " << rate).
+ * The expression is only evaluated when the level is enabled, and the whole
+ * statement compiles to nothing for levels below YK_LOG_MIN_LEVEL.
+ */
+#define YK_LOG(level_value, expr)                                              \
+  do {                                                                         \
+    if constexpr (YK_LOG_MIN_LEVEL <= (level_value)) {                         \
+      if (::yk::log_enabled(static_cast<::yk::LogLevel>(level_value))) {       \
+        std::ostringstream yk_log_os_;                                         \
+        yk_log_os_ << expr;                                                    \
+        ::yk::detail::emit(static_cast<::yk::LogLevel>(level_value),           \
+                           yk_log_os_.str());                                  \
+      }                                                                        \
+    }                                                                          \
+  } while (0)
+
+#define YK_LOG_TRACE(expr) YK_LOG(YK_LOG_LEVEL_TRACE, expr)
+#define YK_LOG_DEBUG(expr) YK_LOG(YK_LOG_LEVEL_DEBUG, expr)
+#define YK_LOG_INFO(expr) YK_LOG(YK_LOG_LEVEL_INFO, expr)
+#define YK_LOG_WARNING(expr) YK_LOG(YK_LOG_LEVEL_WARNING, expr)
+#define YK_LOG_ERROR(expr) YK_LOG(YK_LOG_LEVEL_ERROR, expr)
+#define YK_LOG_FATAL(expr) YK_LOG(YK_LOG_LEVEL_FATAL, expr)
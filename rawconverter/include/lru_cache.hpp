@@ -0,0 +1,70 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <list>
+#include <map>
+#include <utility>
+
+namespace yk {
+
+/**
+ * @class LruCache
+ * @brief Map of at most capacity() entries that drops the least recently
+ * used entry first. Not thread-safe.
+ * @tparam Key ordered key type
+ * @tparam Value cached value type
+ */
+template <class Key, class Value> class LruCache {
+public:
+  /**
+   * @param capacity maximum number of entries, at least 1
+   */
+  explicit LruCache(const std::size_t capacity)
+      : capacity_(std::max<std::size_t>(1, capacity)) {}
+
+  /**
+   * @brief Cached value of key, marked as most recently used, or nullptr.
+   * The pointer is valid until the next insert() or clear().
+   */
+  const Value *find(const Key &key) {
+    const auto found = index_.find(key);
+    if (found == index_.end()) {
+      return nullptr;
+    }
+    entries_.splice(entries_.begin(), entries_, found->second);
+    return &found->second->second;
+  }
+
+  /**
+   * @brief Add a key that is not cached, dropping the least recently used
+   * entry if the cache is full.
+   */
+  const Value &insert(const Key &key, Value value) {
+    if (entries_.size() == capacity_) {
+      index_.erase(entries_.back().first);
+      entries_.pop_back();
+    }
+    entries_.emplace_front(key, std::move(value));
+    index_.emplace(key, entries_.begin());
+    return entries_.front().second;
+  }
+
+  std::size_t size() const noexcept { return entries_.size(); }
+  std::size_t capacity() const noexcept { return capacity_; }
+
+  void clear() {
+    entries_.clear();
+    index_.clear();
+  }
+
+private:
+  // Most recently used first.
+  using Entries = std::list<std::pair<Key, Value>>;
+
+  std::size_t capacity_;
+  Entries entries_;
+  std::map<Key, typename Entries::iterator> index_;
+};
+
+} // namespace yk
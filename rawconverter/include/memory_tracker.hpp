@@ -0,0 +1,199 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#ifdef __unix__
+#include <sys/resource.h>
+#endif
+
+/**
+ * @file memory_tracker.hpp
+ * @brief Allocation accounting of the pipeline stages.
+ * When YK_TRACK_ALLOCATIONS is defined, TrackingAllocator becomes the
+ * default allocator of xtensor containers, so every image buffer allocated
+ * by RawConverter is counted by MemoryTracker. This header must then be
+ * included before any xtensor header; raw_converter.hpp does so.
+ * Memory allocated by LibRaw, which uses malloc directly, is covered by
+ * heap_in_use() instead.
+ */
+
+namespace yk {
+
+#ifdef YK_TRACK_ALLOCATIONS
+inline constexpr bool allocation_tracking = true;
+#else
+inline constexpr bool allocation_tracking = false;
+#endif
+
+/**
+ * @brief Allocation counters of a measured region.
+ */
+struct MemoryStats {
+  std::uint64_t allocations = 0;
+  std::uint64_t bytes_allocated = 0;
+  // Peak of live tracked bytes above the live bytes at the start.
+  std::size_t peak_bytes = 0;
+  // Change of the malloc heap in use, including memory held by LibRaw.
+  std::ptrdiff_t heap_delta = 0;
+};
+
+/**
+ * @brief Bytes of the malloc heap currently in use, or 0 where this cannot
+ * be queried.
+ */
+inline std::size_t heap_in_use() noexcept {
+#if defined(__GLIBC__) &&                                                      \
+    (2 < __GLIBC__ || (__GLIBC__ == 2 && 33 <= __GLIBC_MINOR__))
+  const struct mallinfo2 info = mallinfo2();
+  return info.uordblks + info.hblkhd;
+#else
+  return 0;
+#endif
+}
+
+/**
+ * @brief Peak resident set size of the process in bytes, or 0 where this
+ * cannot be queried.
+ */
+inline std::size_t peak_rss() noexcept {
+#ifdef __unix__
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) == 0) {
+    return static_cast<std::size_t>(usage.ru_maxrss) * 1024;
+  }
+#endif
+  return 0;
+}
+
+/**
+ * @class MemoryTracker
+ * @brief Process-wide counters updated by TrackingAllocator.
+ * A measured region resets the peak to the current live bytes, so regions
+ * must not be nested.
+ */
+class MemoryTracker {
+public:
+  static MemoryTracker &instance() noexcept {
+    static MemoryTracker tracker;
+    return tracker;
+  }
+
+  void on_allocate(const std::size_t bytes) noexcept {
+    allocations_.fetch_add(1, std::memory_order_relaxed);
+    bytes_allocated_.fetch_add(bytes, std::memory_order_relaxed);
+    const std::size_t live =
+        live_.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+    std::size_t peak = peak_.load(std::memory_order_relaxed);
+    while (peak < live && !peak_.compare_exchange_weak(
+                              peak, live, std::memory_order_relaxed)) {
+    }
+  }
+
+  void on_deallocate(const std::size_t bytes) noexcept {
+    live_.fetch_sub(bytes, std::memory_order_relaxed);
+  }
+
+  std::size_t live_bytes() const noexcept {
+    return live_.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Snapshot taken at the start of a measured region.
+   */
+  struct Mark {
+    std::uint64_t allocations;
+    std::uint64_t bytes_allocated;
+    std::size_t live;
+    std::size_t heap;
+  };
+
+  Mark mark() noexcept {
+    const std::size_t live = live_.load(std::memory_order_relaxed);
+    peak_.store(live, std::memory_order_relaxed);
+    return {allocations_.load(std::memory_order_relaxed),
+            bytes_allocated_.load(std::memory_order_relaxed), live,
+            heap_in_use()};
+  }
+
+  /**
+   * @brief Counters accumulated since mark.
+   */
+  MemoryStats since(const Mark &mark) const noexcept {
+    MemoryStats res;
+    res.allocations =
+        allocations_.load(std::memory_order_relaxed) - mark.allocations;
+    res.bytes_allocated =
+        bytes_allocated_.load(std::memory_order_relaxed) - mark.bytes_allocated;
+    res.peak_bytes =
+        std::max(peak_.load(std::memory_order_relaxed), mark.live) - mark.live;
+    res.heap_delta = static_cast<std::ptrdiff_t>(heap_in_use()) -
+                     static_cast<std::ptrdiff_t>(mark.heap);
+    return res;
+  }
+
+private:
+  MemoryTracker() = default;
+
+  std::atomic<std::uint64_t> allocations_{0};
+  std::atomic<std::uint64_t> bytes_allocated_{0};
+  std::atomic<std::size_t> live_{0};
+  std::atomic<std::size_t> peak_{0};
+};
+
+/**
+ * @class TrackingAllocator
+ * @brief std::allocator reporting to MemoryTracker.
+ */
+template <class T> class TrackingAllocator : public std::allocator<T> {
+public:
+  using value_type = T;
+  using size_type = std::size_t;
+  using difference_type = std::ptrdiff_t;
+  using propagate_on_container_move_assignment = std::true_type;
+  using is_always_equal = std::true_type;
+  template <class U> struct rebind { using other = TrackingAllocator<U>; };
+
+  TrackingAllocator() noexcept = default;
+  template <class U>
+  TrackingAllocator(const TrackingAllocator<U> &) noexcept {}
+
+  T *allocate(const std::size_t n) {
+    T *p = std::allocator<T>::allocate(n);
+    MemoryTracker::instance().on_allocate(n * sizeof(T));
+    return p;
+  }
+
+  void deallocate(T *p, const std::size_t n) noexcept {
+    MemoryTracker::instance().on_deallocate(n * sizeof(T));
+    std::allocator<T>::deallocate(p, n);
+  }
+};
+
+template <class T, class U>
+bool operator==(const TrackingAllocator<T> &,
+                const TrackingAllocator<U> &) noexcept {
+  return true;
+}
+
+template <class T, class U>
+bool operator!=(const TrackingAllocator<T> &,
+                const TrackingAllocator<U> &) noexcept {
+  return false;
+}
+
+} // namespace yk
+
+#ifdef YK_TRACK_ALLOCATIONS
+#ifdef XTENSOR_DEFAULT_ALLOCATOR
+#error "memory_tracker.hpp must be included before any xtensor header"
+#endif
+#define XTENSOR_DEFAULT_ALLOCATOR(T) ::yk::TrackingAllocator<T>
+#endif
@@ -0,0 +1,164 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <thread>
+#include <vector>
+
+namespace yk {
+
+namespace detail {
+inline std::atomic<std::size_t> &num_threads_storage() noexcept {
+  static std::atomic<std::size_t> n{
+      std::max<std::size_t>(1, std::thread::hardware_concurrency())};
+  return n;
+}
+
+constexpr std::size_t default_grain_size = 1 << 16;
+
+inline std::atomic<std::size_t> &grain_size_storage() noexcept {
+  static std::atomic<std::size_t> n{default_grain_size};
+  return n;
+}
+
+// Thread count of the calling thread set by ScopedNumThreads; 0 if none.
+inline std::size_t &local_num_threads() noexcept {
+  thread_local std::size_t n = 0;
+  return n;
+}
+} // namespace detail
+
+/**
+ * @brief Number of worker threads used by the parallel kernels called from
+ * this thread. Defaults to std::thread::hardware_concurrency().
+ */
+inline std::size_t num_threads() noexcept {
+  const std::size_t local = detail::local_num_threads();
+  return local ? local
+               : detail::num_threads_storage().load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief Set the number of worker threads used by the parallel kernels.
+ * @param n number of threads. 0 restores the hardware default.
+ */
+inline void set_num_threads(const std::size_t n) noexcept {
+  detail::num_threads_storage().store(
+      n ? n : std::max<std::size_t>(1, std::thread::hardware_concurrency()),
+      std::memory_order_relaxed);
+}
+
+/**
+ * @class ScopedNumThreads
+ * @brief Override num_threads() for the kernels called from the current
+ * thread while the object lives, e.g. to split the cores among concurrent
+ * conversions without changing the process-wide setting that other
+ * threads read. Workers spawned by the kernels do not inherit it.
+ */
+class ScopedNumThreads {
+public:
+  /**
+   * @param n number of threads. 0 keeps the current count.
+   */
+  explicit ScopedNumThreads(const std::size_t n) noexcept
+      : previous_(detail::local_num_threads()) {
+    if (n) {
+      detail::local_num_threads() = n;
+    }
+  }
+  ScopedNumThreads(const ScopedNumThreads &) = delete;
+  ScopedNumThreads &operator=(const ScopedNumThreads &) = delete;
+  ~ScopedNumThreads() { detail::local_num_threads() = previous_; }
+
+private:
+  std::size_t previous_;
+};
+
+/**
+ * @brief Default minimum number of elements per chunk of the parallel
+ * kernels. Defaults to 65536.
+ */
+inline std::size_t grain_size() noexcept {
+  return detail::grain_size_storage().load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief Set the default minimum number of elements per chunk, e.g. from a
+ * tuning profile. Kernels that size per-chunk buffers read grain_size() once
+ * and pass it to both parallel_chunks() and parallel_for().
+ * @param n number of elements. 0 restores the default.
+ */
+inline void set_grain_size(const std::size_t n) noexcept {
+  detail::grain_size_storage().store(n ? n : detail::default_grain_size,
+                                     std::memory_order_relaxed);
+}
+
+/**
+ * @brief Number of chunks parallel_for() splits [0, n) into.
+ * @param n number of elements
+ * @param min_chunk minimum number of elements per chunk
+ */
+inline std::size_t parallel_chunks(const std::size_t n,
+                                   const std::size_t min_chunk) noexcept {
+  const std::size_t by_size = std::max<std::size_t>(
+      1, n / std::max<std::size_t>(1, min_chunk));
+  return std::min(num_threads(), by_size);
+}
+
+/**
+ * @brief Run fn(begin, end, chunk) over contiguous chunks of [0, n) in
+ * parallel. The number of chunks is parallel_chunks(n, min_chunk) and chunk
+ * indices are dense, so callers can keep per-chunk scratch buffers (e.g.
+ * sub-histograms) indexed by chunk. The calling thread processes the first
+ * chunk. An exception thrown by fn is rethrown on the calling thread once
+ * every chunk has finished; if several chunks throw, the one of the lowest
+ * chunk index is rethrown.
+ * @tparam F callable with signature void(std::size_t, std::size_t,
+ * std::size_t)
+ * @param n number of elements
+ * @param fn function applied to each chunk
+ * @param min_chunk minimum number of elements per chunk. 0 uses
+ * grain_size().
+ */
+template <class F>
+void parallel_for(const std::size_t n, F &&fn,
+                  const std::size_t min_chunk = 0) {
+  const std::size_t chunks =
+      parallel_chunks(n, min_chunk ? min_chunk : grain_size());
+  if (chunks <= 1) {
+    fn(std::size_t(0), n, std::size_t(0));
+    return;
+  }
+  const std::size_t step = (n + chunks - 1) / chunks;
+  // An exception escaping a worker would call std::terminate, so each chunk
+  // keeps its own until the join.
+  std::vector<std::exception_ptr> errors(chunks);
+  auto run = [&fn, &errors](const std::size_t begin, const std::size_t end,
+                            const std::size_t c) {
+    try {
+      fn(begin, end, c);
+    } catch (...) {
+      errors[c] = std::current_exception();
+    }
+  };
+  std::vector<std::thread> workers;
+  workers.reserve(chunks - 1);
+  for (std::size_t c = 1; c < chunks; c++) {
+    const std::size_t begin = std::min(n, c * step);
+    const std::size_t end = std::min(n, begin + step);
+    workers.emplace_back(run, begin, end, c);
+  }
+  run(std::size_t(0), std::min(n, step), std::size_t(0));
+  for (auto &w : workers) {
+    w.join();
+  }
+  for (const auto &error : errors) {
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+}
+
+} // namespace yk
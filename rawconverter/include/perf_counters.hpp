@@ -0,0 +1,240 @@
+#pragma once
+
+#include "memory_tracker.hpp"
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iomanip>
+#include <ostream>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace yk {
+
+/**
+ * @brief Wall time and hardware counters of one measured region. Counter
+ * values are scaled for multiplexing; valid is false when the counters
+ * could not be read.
+ */
+struct PerfSample {
+  double ms = 0;
+  bool valid = false;
+  std::uint64_t cycles = 0;
+  std::uint64_t instructions = 0;
+  std::uint64_t llc_misses = 0;
+  std::uint64_t branch_misses = 0;
+
+  double ipc() const noexcept {
+    return cycles ? double(instructions) / cycles : 0.;
+  }
+  double bytes_per_cycle(const std::size_t bytes) const noexcept {
+    return cycles ? double(bytes) / cycles : 0.;
+  }
+};
+
+/**
+ * @class PerfCounters
+ * @brief Cycles, instructions, last-level cache misses and branch misses of
+ * the calling thread and the threads it spawns, read with perf_event_open.
+ * The counters form one group, so they are scheduled onto the PMU together
+ * and multiplexing scales them by the same factor; ratios such as IPC
+ * compare counts of the same intervals. Counters are inherited by threads
+ * created while they run, which covers the workers of parallel_for(); their
+ * counts are included once they have been joined. On other platforms, or
+ * when the kernel denies access (see /proc/sys/kernel/perf_event_paranoid),
+ * available() is false and only wall time is measured.
+ */
+class PerfCounters {
+public:
+  PerfCounters() {
+#ifdef __linux__
+    constexpr std::array<std::pair<std::uint32_t, std::uint64_t>, 4> events =
+        {{{PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+          {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+          {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+          {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES}}};
+    for (std::size_t i = 0; i < events.size(); i++) {
+      perf_event_attr attr{};
+      attr.size = sizeof(attr);
+      attr.type = events[i].first;
+      attr.config = events[i].second;
+      // Members follow the leader, which is enabled in start().
+      attr.disabled = i == 0;
+      attr.inherit = 1;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                         PERF_FORMAT_TOTAL_TIME_RUNNING;
+      fds_[i] = static_cast<int>(
+          syscall(SYS_perf_event_open, &attr, 0, -1, fds_[0], 0));
+      if (fds_[0] < 0) {
+        break;
+      }
+    }
+#endif
+  }
+  PerfCounters(const PerfCounters &) = delete;
+  PerfCounters &operator=(const PerfCounters &) = delete;
+  ~PerfCounters() {
+#ifdef __linux__
+    for (int fd : fds_) {
+      if (0 <= fd) {
+        close(fd);
+      }
+    }
+#endif
+  }
+
+  /**
+   * @brief Whether all hardware counters could be opened.
+   */
+  bool available() const noexcept {
+    for (int fd : fds_) {
+      if (fd < 0) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  void start() noexcept {
+#ifdef __linux__
+    if (0 <= fds_[0]) {
+      ioctl(fds_[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+      ioctl(fds_[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+#endif
+    start_ = std::chrono::steady_clock::now();
+  }
+
+  PerfSample stop() noexcept {
+    PerfSample res;
+    res.ms = std::chrono::duration<double, std::milli>(
+                 std::chrono::steady_clock::now() - start_)
+                 .count();
+#ifdef __linux__
+    std::array<std::uint64_t, 4> values{};
+    res.valid = available();
+    if (0 <= fds_[0]) {
+      ioctl(fds_[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+      // Number of counters, time enabled, time running and the values of
+      // the counters that could be opened, leader first.
+      std::uint64_t data[3 + 4] = {};
+      const ssize_t size = read(fds_[0], data, sizeof(data));
+      if (size < static_cast<ssize_t>(3 * sizeof(data[0])) ||
+          size != static_cast<ssize_t>((3 + data[0]) * sizeof(data[0]))) {
+        res.valid = false;
+      } else {
+        const double scale = data[2] ? double(data[1]) / data[2] : 0.;
+        for (std::size_t i = 0, k = 3; i < fds_.size(); i++) {
+          if (0 <= fds_[i]) {
+            values[i] = static_cast<std::uint64_t>(data[k++] * scale);
+          }
+        }
+      }
+    }
+    res.cycles = values[0];
+    res.instructions = values[1];
+    res.llc_misses = values[2];
+    res.branch_misses = values[3];
+#endif
+    return res;
+  }
+
+private:
+  std::array<int, 4> fds_ = {-1, -1, -1, -1};
+  std::chrono::steady_clock::time_point start_;
+};
+
+/**
+ * @brief Measurement of one pipeline stage.
+ */
+struct StageReport {
+  std::string name;
+  // Bytes read and written by the stage, for bytes per cycle.
+  std::size_t bytes = 0;
+  PerfSample sample;
+  MemoryStats memory;
+};
+
+inline std::ostream &operator<<(std::ostream &os, const StageReport &r) {
+  os << std::left << std::setw(20) << r.name << std::right << std::fixed
+     << std::setprecision(2) << std::setw(10) << r.sample.ms << " ms";
+  if (r.sample.valid) {
+    os << std::setw(8) << r.sample.ipc() << " IPC";
+    if (r.bytes) {
+      os << std::setw(8) << r.sample.bytes_per_cycle(r.bytes) << " B/cycle";
+    }
+    os << std::setw(12) << r.sample.llc_misses << " LLC misses"
+       << std::setw(10) << r.sample.branch_misses << " branch misses";
+  }
+  constexpr double mib = 1 << 20;
+  if (allocation_tracking) {
+    os << std::setw(8) << r.memory.allocations << " allocs" << std::setw(10)
+       << r.memory.bytes_allocated / mib << " MiB allocated" << std::setw(10)
+       << r.memory.peak_bytes / mib << " MiB peak";
+  }
+  if (r.memory.heap_delta) {
+    os << std::showpos << std::setw(10) << r.memory.heap_delta / mib
+       << std::noshowpos << " MiB heap";
+  }
+  return os << std::defaultfloat;
+}
+
+/**
+ * @class StageProfiler
+ * @brief Collect a StageReport, with counters and memory use, for each
+ * measured stage. Stages must not be nested. When disabled, measure() only
+ * runs the stage.
+ */
+class StageProfiler {
+public:
+  explicit StageProfiler(const bool enabled = true) : enabled_(enabled) {}
+
+  /**
+   * @brief Run f and record its wall time and counters under name.
+   * @param name stage name
+   * @param bytes bytes read and written by the stage
+   * @param f stage to run
+   * @return result of f
+   */
+  template <class F>
+  decltype(auto) measure(std::string name, const std::size_t bytes, F &&f) {
+    if (!enabled_) {
+      return f();
+    }
+    auto &tracker = MemoryTracker::instance();
+    const auto mark = tracker.mark();
+    counters_.start();
+    if constexpr (std::is_void_v<std::invoke_result_t<F>>) {
+      f();
+      const auto sample = counters_.stop();
+      reports_.push_back({std::move(name), bytes, sample, tracker.since(mark)});
+    } else {
+      auto res = f();
+      const auto sample = counters_.stop();
+      reports_.push_back({std::move(name), bytes, sample, tracker.since(mark)});
+      return res;
+    }
+  }
+
+  bool enabled() const noexcept { return enabled_; }
+  bool counters_available() const noexcept { return counters_.available(); }
+  const std::vector<StageReport> &reports() const noexcept { return reports_; }
+
+private:
+  bool enabled_;
+  PerfCounters counters_;
+  std::vector<StageReport> reports_;
+};
+
+} // namespace yk
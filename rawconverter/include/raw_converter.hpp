@@ -1,13 +1,18 @@
 #pragma once
 
+// Selects the xtensor allocator, so it precedes the xtensor headers.
+#include "memory_tracker.hpp"
+
 #include <algorithm>
+#include <array>
 #include <execution>
 #include <iostream>
 #include <libraw.h>
 #include <math.h>
+#include <stdexcept>
 #include <string>
+#include <type_traits>
 #include <vector>
-#include <xtensor-blas/xlinalg.hpp>
 #include <xtensor/xadapt.hpp>
 #include <xtensor/xarray.hpp>
 #include <xtensor/xbuilder.hpp>
@@ -20,6 +25,18 @@
 #include <xtensor/xtensor.hpp>
 #include <xtensor/xview.hpp>
 
+#include "camera_profile.hpp"
+#include "color_space.hpp"
+#include "color_transform.hpp"
+#include "demosaic.hpp"
+#include "dng_color.hpp"
+#include "gain_table_map.hpp"
+#include "levels.hpp"
+#include "local_tone_map.hpp"
+#include "logging.hpp"
+#include "tone_mapper.hpp"
+#include "transfer_function.hpp"
+
 namespace yk {
 
 /**
@@ -38,11 +55,18 @@ public:
   static constexpr float linear_thresh_coeff = 0.0031308;
   static constexpr float black_offset = 0.055;
 
+  // CIE-XYZ to sRGB'
+  static constexpr Matrix3 sRGB_from_xyz = {
+      {{3.079955, -1.537139, -0.542816},
+       {-0.921259, 1.876011, 0.045247},
+       {0.052887, -0.204026, 1.151138}}};
+
   RawConverter()
-      : gamma_curve(1 << 16, -1), sRGB_from_xyzD65{
-                                      {3.079955, -1.537139, -0.542816},
-                                      {-0.921259, 1.876011, 0.045247},
-                                      {0.052887, -0.204026, 1.151138}} {};
+      : gamma_curve(gamma_tone_curve()),
+        sRGB_from_xyzD65{
+            {sRGB_from_xyz[0][0], sRGB_from_xyz[0][1], sRGB_from_xyz[0][2]},
+            {sRGB_from_xyz[1][0], sRGB_from_xyz[1][1], sRGB_from_xyz[1][2]},
+            {sRGB_from_xyz[2][0], sRGB_from_xyz[2][1], sRGB_from_xyz[2][2]}} {};
   RawConverter(const RawConverter &other) = delete;
   RawConverter &operator=(const RawConverter &other) = delete;
   RawConverter(RawConverter &&other) = default;
@@ -82,33 +106,81 @@ public:
    * @param cm transformation matrix that converts XYZ values to reference
    * camera native color space. It is stored as ColorMatrix2 in DNG.
    * @param ab AnalogBalance values in DNG
+   * @param luminance if not nullptr, receives the histogram of Y computed in
+   * the same pass
    * @return  image data converted to D65 XYZ
    */
   template <class E>
-  auto camera_to_xyz(const xt::xexpression<E> &e, const float cm[4][3],
-                     const float ab[4]) const noexcept {
-    auto &image = e.derived_cast();
-    // Matrix to convert from XYZ color space to camera native color space.
-    xt::xtensor<float, 2> color_matrix({3, 3});
-    for (int i = 0; i < 3; i++) {
-      for (int j = 0; j < 3; j++) {
-        color_matrix(i, j) = cm[i][j];
+  xt::xtensor<float, 2> camera_to_xyz(const xt::xexpression<E> &e,
+                                      const float cm[4][3], const float ab[4],
+                                      Histogram *luminance = nullptr) const {
+    return transform(e, xyz_from_camera(cm, ab), luminance, xyz_luminance);
+  }
+
+  /**
+   * @brief Convert image data in camera native color space to CIE D65 XYZ
+   * color space with the matrices of both DNG illuminants, interpolated for
+   * the white point of the neutral. The solved matrix is cached per unique
+   * profile and neutral in ColorMatrixCache::global(), so frames of a batch
+   * with the same white balance only pay for the color pass.
+   * @tparam E The derived type of xtensor
+   * @param e an image data stored in xtensor xexpression
+   * @param profile color calibration, e.g. from dng_color_profile()
+   * @param neutral AsShotNeutral, e.g. from as_shot_neutral()
+   * @param luminance if not nullptr, receives the histogram of Y computed in
+   * the same pass
+   * @return image data converted to D65 XYZ
+   */
+  template <class E>
+  xt::xtensor<float, 2> camera_to_xyz(const xt::xexpression<E> &e,
+                                      const DngColorProfile &profile,
+                                      const std::array<float, 3> &neutral,
+                                      Histogram *luminance = nullptr) const {
+    return transform(e,
+                     ColorMatrixCache::global().xyz_from_camera(profile,
+                                                                neutral),
+                     luminance, xyz_luminance);
+  }
+
+  /**
+   * @brief Read the color calibration of both DNG illuminants from LibRaw.
+   * @param color imgdata.color of an opened file
+   */
+  static DngColorProfile dng_color_profile(const libraw_colordata_t &color) {
+    DngColorProfile profile;
+    for (int k = 0; k < 2; k++) {
+      const auto &dng = color.dng_color[k];
+      profile.illuminants[k] = dng.illuminant;
+      for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+          profile.color_matrices[k][i][j] = dng.colormatrix[i][j];
+          profile.forward_matrices[k][i][j] = dng.forwardmatrix[i][j];
+          profile.calibrations[k][i][j] = dng.calibration[i][j];
+        }
       }
     }
-    auto &&analog_balance = xt::diag(xt::xarray<float>{ab[0], ab[1], ab[2]});
-    //   Matrix to convert from camera native color space to XYZ color
-    //   space.
-    auto &&cam_from_xyz = xt::linalg::dot(analog_balance, color_matrix);
-    auto sum = xt::sum(cam_from_xyz, {1});
     for (int i = 0; i < 3; i++) {
-      if (0.0000001 < sum(i)) {
-        xt::view(cam_from_xyz, i, xt::all()) /= sum(i);
-      } else {
-        xt::view(cam_from_xyz, i, xt::all()) = 0;
-      }
+      const float ab = color.dng_levels.analogbalance[i];
+      profile.analog_balance[i] = 0.f < ab ? ab : 1.f;
+    }
+    return profile;
+  }
+
+  /**
+   * @brief AsShotNeutral of a DNG, or the inverse of the as-shot white
+   * balance multipliers when the tag is missing.
+   * @param color imgdata.color of an opened file
+   */
+  static std::array<float, 3>
+  as_shot_neutral(const libraw_colordata_t &color) {
+    std::array<float, 3> res;
+    const float *asn = color.dng_levels.asshotneutral;
+    for (int i = 0; i < 3; i++) {
+      res[i] = 0.f < asn[0] ? asn[i]
+               : 0.f < color.cam_mul[i] ? 1.f / color.cam_mul[i]
+                                        : 1.f;
     }
-    auto &&xyz_from_cam = xt::linalg::inv(cam_from_xyz);
-    return xt::linalg::dot(xyz_from_cam, image);
+    return res;
   }
 
   /**
@@ -118,8 +190,8 @@ public:
    * @return image data converted to sRGB'
    */
   template <class E>
-  auto xyz_to_sRGB(const xt::xexpression<E> &e) const noexcept {
-    return xt::linalg::dot(sRGB_from_xyzD65, e);
+  xt::xtensor<float, 2> xyz_to_sRGB(const xt::xexpression<E> &e) const {
+    return transform(e, sRGB_from_xyz, nullptr, sRGB_luminance);
   }
 
   /**
@@ -128,56 +200,278 @@ public:
    * @param e an image data stored in xtensor xexpression
    * @param color_matrix transformation matrix that converts XYZ values to
    * reference camera native color space. It is stored as ColorMatrix2 in DNG.
+   * @param luminance if not nullptr, receives the histogram of the linear
+   * sRGB luminance computed in the same pass
+   * @tparam Out element type of the result: float, or Half to halve the
+   * memory traffic of the following passes (values divided by half_unit)
    * @return image data converted to sRGB'
    */
-  template <class E>
-  auto camera_to_sRGB(const xt::xexpression<E> &e,
-                      const float color_matrix[3][4]) const noexcept {
-    auto &image = e.derived_cast();
-    // Conversion Matrix from Camera Native Color Spaxce to sRGB'
-    xt::xtensor<float, 2> srgb_to_cam({3, 3});
+  template <class Out = float, class E>
+  xt::xtensor<Out, 2> camera_to_sRGB(const xt::xexpression<E> &e,
+                                     const float color_matrix[3][4],
+                                     Histogram *luminance = nullptr) const {
+    return camera_to_rgb<Out>(e, color_matrix, ColorSpace::sRGB, luminance);
+  }
+
+  /**
+   * @brief Convert an image data in camera native color space to linear RGB
+   * of an output color space. The camera to sRGB matrix and the sRGB to
+   * output matrix are composed first, so this is a single pass like
+   * camera_to_sRGB().
+   * @tparam E The derived type of xtensor
+   * @param e an image data stored in xtensor xexpression
+   * @param color_matrix camera native to sRGB matrix, as in camera_to_sRGB()
+   * @param cs output color space
+   * @param luminance if not nullptr, receives the histogram of the luminance
+   * of the output color space computed in the same pass
+   * @tparam Out element type of the result: float or Half
+   * @return image data converted to the output color space
+   */
+  template <class Out = float, class E>
+  xt::xtensor<Out, 2> camera_to_rgb(const xt::xexpression<E> &e,
+                                    const float color_matrix[3][4],
+                                    const ColorSpace cs,
+                                    Histogram *luminance = nullptr) const {
+    return transform<Out>(e, rgb_from_camera(color_matrix, cs), luminance,
+                          luminance_weights(cs));
+  }
+
+  /**
+   * @brief camera_to_rgb() rendered with the HueSatMap, LookTable and
+   * ProfileToneCurve of a camera profile, fused into the same pass with
+   * profile_transform(). The tables are applied in linear ProPhoto RGB.
+   * @tparam E The derived type of xtensor
+   * @param e an image data stored in xtensor xexpression
+   * @param color_matrix camera native to sRGB matrix, as in camera_to_sRGB()
+   * @param tables prepared tables, see ProfileTables::prepare()
+   * @param cs output color space
+   * @param luminance if not nullptr, receives the histogram of the luminance
+   * of the output color space computed in the same pass
+   * @tparam Out element type of the result: float or ushort
+   * @return rendered image data in the output color space
+   */
+  template <class Out = float, class E>
+  xt::xtensor<Out, 2>
+  camera_to_rgb(const xt::xexpression<E> &e, const float color_matrix[3][4],
+                const ProfileTables &tables,
+                const ColorSpace cs = ColorSpace::sRGB,
+                Histogram *luminance = nullptr) const {
+    return render_profile<Out>(
+        e, rgb_from_camera(color_matrix, ColorSpace::prophoto), tables, cs,
+        luminance);
+  }
+
+  /**
+   * @brief camera_to_rgb() with a camera profile, starting from a matrix to
+   * D65 XYZ solved from the DNG color calibration instead of LibRaw's
+   * rgb_cam, which expects data balanced with pre_mul.
+   * @tparam E The derived type of xtensor
+   * @param e an image data stored in xtensor xexpression
+   * @param xyz_matrix camera native to D65 XYZ matrix, e.g. from
+   * xyz_from_balanced_camera()
+   * @param tables prepared tables, see ProfileTables::prepare()
+   * @param cs output color space
+   * @param luminance if not nullptr, receives the histogram of the luminance
+   * of the output color space computed in the same pass
+   * @tparam Out element type of the result: float or ushort
+   * @return rendered image data in the output color space
+   */
+  template <class Out = float, class E>
+  xt::xtensor<Out, 2>
+  camera_to_rgb(const xt::xexpression<E> &e, const Matrix3 &xyz_matrix,
+                const ProfileTables &tables,
+                const ColorSpace cs = ColorSpace::sRGB,
+                Histogram *luminance = nullptr) const {
+    const Matrix3 pcs_from_xyz =
+        multiply(rgb_from_sRGB(ColorSpace::prophoto), sRGB_from_xyz);
+    return render_profile<Out>(e, multiply(pcs_from_xyz, xyz_matrix), tables,
+                               cs, luminance);
+  }
+
+  /**
+   * @brief Profile rendering of the camera_to_rgb() overloads with tables.
+   * @param pcs_from_camera camera native to linear ProPhoto RGB matrix
+   */
+  template <class Out, class E>
+  xt::xtensor<Out, 2> render_profile(const xt::xexpression<E> &e,
+                                     const Matrix3 &pcs_from_camera,
+                                     const ProfileTables &tables,
+                                     const ColorSpace cs,
+                                     Histogram *luminance) const {
+    auto &src = e.derived_cast();
+    const std::size_t n = src.shape()[1];
+    xt::xtensor<Out, 2> res({3, n});
+    const Matrix3 rgb_from_pcs = multiply(
+        rgb_from_sRGB(cs), invert(rgb_from_sRGB(ColorSpace::prophoto)));
+    if constexpr (std::is_same_v<E, xt::xtensor<ushort, 2>>) {
+      profile_transform(src.data(), res.data(), n, pcs_from_camera,
+                        rgb_from_pcs, tables, luminance,
+                        luminance_weights(cs));
+    } else {
+      const xt::xtensor<float, 2> image = src;
+      profile_transform(image.data(), res.data(), n, pcs_from_camera,
+                        rgb_from_pcs, tables, luminance,
+                        luminance_weights(cs));
+    }
+    return res;
+  }
+
+  /**
+   * @brief Matrix from camera native color space to linear RGB of an output
+   * color space.
+   * @param color_matrix camera native to sRGB matrix, as in camera_to_sRGB()
+   * @param cs output color space
+   */
+  static Matrix3 rgb_from_camera(const float color_matrix[3][4],
+                                 const ColorSpace cs = ColorSpace::sRGB) {
+    // Conversion Matrix from Camera Native Color Space to sRGB'
+    Matrix3 srgb_from_cam;
     for (int i = 0; i < 3; i++) {
       for (int j = 0; j < 3; j++) {
-        srgb_to_cam(i, j) = color_matrix[i][j];
+        srgb_from_cam[i][j] = color_matrix[i][j];
       }
     }
-    return xt::linalg::dot(srgb_to_cam, image);
+    if (cs == ColorSpace::sRGB) {
+      return srgb_from_cam;
+    }
+    return multiply(rgb_from_sRGB(cs), srgb_from_cam);
   }
 
   /**
-   * @brief Apply gamma correction
+   * @brief Apply a 3x3 color matrix to image data with color_transform().
    * @tparam E The derived type of xtensor
    * @param e an image data stored in xtensor xexpression
-   * @return
+   * @param m color matrix
+   * @param luminance if not nullptr, receives the luminance histogram
+   * @param weights luminance weights of the output color space
+   * @tparam Out element type of the result: float or Half
+   * @return transformed image data
    */
-  template <class E>
-  auto gamma_correction(const xt::xexpression<E> &e) noexcept {
+  template <class Out = float, class E>
+  xt::xtensor<Out, 2>
+  transform(const xt::xexpression<E> &e, const Matrix3 &m,
+            Histogram *luminance = nullptr,
+            const std::array<float, 3> &weights = sRGB_luminance) const {
     auto &src = e.derived_cast();
-    auto image = xt::eval(src);
+    const std::size_t n = src.shape()[1];
+    xt::xtensor<Out, 2> res({3, n});
+    using T = typename E::value_type;
+    if constexpr (std::is_same_v<E, xt::xtensor<T, 2>> &&
+                  (std::is_same_v<T, ushort> || std::is_same_v<T, float>)) {
+      color_transform(src.data(), res.data(), n, m, luminance, weights);
+    } else {
+      const xt::xtensor<float, 2> image = src;
+      color_transform(image.data(), res.data(), n, m, luminance, weights);
+    }
+    return res;
+  }
+
+  /**
+   * @brief Copy a 3x3 xtensor matrix into a Matrix3.
+   */
+  template <class E> static Matrix3 to_matrix3(const E &m) {
+    Matrix3 res;
+    for (int i = 0; i < 3; i++) {
+      for (int j = 0; j < 3; j++) {
+        res[i][j] = m(i, j);
+      }
+    }
+    return res;
+  }
+
+  /**
+   * @brief sRGB gamma curve as a ToneCurve, so that it can be composed with
+   * a brightness curve and applied in the same pass.
+   */
+  static ToneCurve gamma_tone_curve() {
     constexpr float max_value = USHRT_MAX;
     constexpr ushort thresh = linear_thresh_coeff * max_value;
+    return ToneCurve::from_function([](int v) {
+      if (v < thresh) {
+        return v * linear_coeff;
+      }
+      float value = static_cast<float>(v) / max_value;
+      value = (std::pow(value, 1. / gmm) * 1.055) - black_offset;
+      return value * max_value;
+    });
+  }
 
-    for (int ch = 0; ch < 3; ch++) {
-      for (int i = 0; i < image.shape()[1]; i++) {
-        const int src_val =
-            std::min<int>(USHRT_MAX, std::max<int>(0, image(ch, i)));
-        if (0 <= gamma_curve[src_val]) {
-          image(ch, i) = static_cast<ushort>(gamma_curve[src_val]);
-        } else if (image(ch, i) < thresh) {
-          gamma_curve[src_val] = std::max<int>(
-              0, std::min<int>(USHRT_MAX, image(ch, i) * linear_coeff));
-          image(ch, i) = static_cast<ushort>(gamma_curve[src_val]);
-        } else {
-          float value = static_cast<float>(src_val) / max_value;
-          value = (std::pow(value, 1. / gmm) * 1.055) - black_offset;
-          value *= max_value;
-          gamma_curve[src_val] =
-              std::max<int>(0, std::min<int>(USHRT_MAX, value));
-          image(ch, i) = static_cast<ushort>(gamma_curve[src_val]);
-        }
+  /**
+   * @brief Encoding curve of an output color space: the cached
+   * gamma_tone_curve() for sRGB and output_curve() otherwise.
+   */
+  const ToneCurve &output_tone_curve(const ColorSpace cs) const {
+    return cs == ColorSpace::sRGB ? gamma_curve : output_curve(cs);
+  }
+
+  /**
+   * @brief Apply gamma correction with the cached gamma_tone_curve(), or
+   * with the encoding curve of another output color space.
+   * @tparam E The derived type of xtensor
+   * @param e an image data stored in xtensor xexpression
+   * @param cs color space e is in, e.g. from camera_to_rgb()
+   * @return gamma-corrected image data of type ushort
+   */
+  template <class E>
+  xt::xtensor<ushort, 2>
+  gamma_correction(const xt::xexpression<E> &e,
+                   const ColorSpace cs = ColorSpace::sRGB) const {
+    auto &src = e.derived_cast();
+    const ToneCurve &curve = output_tone_curve(cs);
+    if constexpr (std::is_same_v<E, xt::xtensor<float, 2>> ||
+                  std::is_same_v<E, xt::xtensor<Half, 2>>) {
+      xt::xtensor<ushort, 2> image({3, src.shape()[1]});
+      apply_tone_curve(src.data(), image.data(), src.shape()[1], curve);
+      return image;
+    } else {
+      auto image = to_ushort(e);
+      apply_tone_curve(image.data(), image.data(), image.shape()[1], curve);
+      return image;
+    }
+  }
+
+  /**
+   * @brief Convert an image in camera native color space to scene-linear
+   * RGB in fp32, with diffuse white at 1.0. Unlike the 16-bit path nothing
+   * is clipped: negative values out of gamut and highlights above white are
+   * kept for encode().
+   * @tparam E The derived type of xtensor
+   * @param e an image data stored in xtensor xexpression
+   * @param color_matrix camera native to sRGB matrix, as in camera_to_sRGB()
+   * @param exposure linear gain, applied in the same pass
+   * @param cs primaries of the result
+   * @return scene-linear image data
+   */
+  template <class E>
+  xt::xtensor<float, 2>
+  scene_linear(const xt::xexpression<E> &e, const float color_matrix[3][4],
+               const float exposure = 1.f,
+               const ColorSpace cs = ColorSpace::sRGB) const {
+    Matrix3 m = rgb_from_camera(color_matrix, cs);
+    for (auto &row : m) {
+      for (auto &v : row) {
+        v *= exposure / USHRT_MAX;
       }
     }
-    return image;
+    return transform(e, m);
+  }
+
+  /**
+   * @brief Encode scene-linear image data with a transfer function.
+   * @tparam E The derived type of xtensor
+   * @param e scene-linear image data, e.g. from scene_linear()
+   * @param tf transfer function
+   * @return encoded image data; values outside [0, 1] are kept except
+   * above the PQ peak
+   * @see transfer_encode
+   */
+  template <class E>
+  xt::xtensor<float, 2> encode(const xt::xexpression<E> &e,
+                               const TransferFunction tf) const {
+    const xt::xtensor<float, 2> &src = e.derived_cast();
+    xt::xtensor<float, 2> res({3, src.shape()[1]});
+    apply_transfer(tf, src.data(), res.data(), src.shape()[1]);
+    return res;
   }
 
   template <class E>
@@ -192,227 +486,292 @@ public:
     }
   }
 
-  template <class E>
-  auto adjust_brightness_6(const xt::xexpression<E> &e,
-                           const bool debug = false) const noexcept {
-    auto &src = e.derived_cast();
-    auto minv = xt::amin(src);
-    auto maxv = xt::amax(src);
-    float scale =
-        1. / std::clamp<float>(maxv() - minv(), 0.00000001, USHRT_MAX);
-    return (src - minv) * scale;
+  /**
+   * @brief raw_adjust() and subtract_black() in one pass, with the DNG gain
+   * maps (e.g. lens shading) multiplied in after the black level.
+   * @param image image data of shape (3, width * height), updated in place
+   * @param width image width
+   * @param height image height
+   * @param params scale and black levels, e.g. from level_params()
+   * @param gain_maps GainMap opcodes, e.g. from read_gain_maps()
+   * @see yk::normalize_levels
+   */
+  void normalize_levels(xt::xtensor<ushort, 2> &image, const std::size_t width,
+                        const std::size_t height, const LevelParams &params,
+                        const std::vector<GainMap> &gain_maps = {}) const {
+    yk::normalize_levels(image.data(), image.data(), width, height, params,
+                         gain_maps);
   }
 
-  template <class E>
-  auto adjust_brightness_5(const xt::xexpression<E> &e,
-                           const float stddev_rate = 0.96,
-                           const bool debug = false) noexcept {
-    auto &src = e.derived_cast();
-    int n = src.shape()[1];
+  /**
+   * @brief Level parameters of a file opened by LibRaw: the scale of
+   * raw_adjust() and the black levels used by subtract_black().
+   * @param color imgdata.color of an opened file
+   */
+  static LevelParams level_params(const libraw_colordata_t &color) {
+    LevelParams params;
+    for (int ch = 0; ch < 3; ch++) {
+      params.black[ch] = color.black ? color.black : color.cblack[ch];
+    }
+    return params;
+  }
 
-    float stddev = xt::stddev(xt::view(src, 1, xt::all()))();
-    float stddev_after = (float(USHRT_MAX) * stddev_rate) / 3.f;
+  /**
+   * @brief Level parameters of a Bayer file opened by LibRaw and passed
+   * through demosaic(): the values are scaled from [black, maximum] to 16
+   * bits, so saturated sites reach full scale in every channel.
+   * @param color imgdata.color of an opened file
+   * @see white_point_levels
+   */
+  static LevelParams cfa_level_params(const libraw_colordata_t &color) {
+    std::array<float, 3> black;
+    for (int ch = 0; ch < 3; ch++) {
+      black[ch] = static_cast<float>(color.black + color.cblack[ch]);
+    }
+    return white_point_levels(static_cast<float>(color.maximum), black);
+  }
 
-    if (debug) {
-      std::cout << "stddev: " << stddev << std::endl;
-      debug_message << "stddev: " << stddev << "\n";
-      std::cout << "stddev_after: " << stddev_after << std::endl;
-      debug_message << "stddev_after: " << stddev_after << "\n";
+  /**
+   * @brief Bayer pattern of the visible area of a file opened by LibRaw.
+   * @param raw LibRaw instance after unpack()
+   * @throw std::runtime_error if the sensor has no Bayer CFA
+   */
+  static CfaPattern cfa_pattern(LibRaw &raw) {
+    const auto &idata = raw.imgdata.idata;
+    if (idata.filters < 1000 || !raw.imgdata.rawdata.raw_image) {
+      throw std::runtime_error("Not a Bayer raw image");
     }
-    std::vector<int> mapped(1 << 16, -1);
-    auto res = src;
-    auto it = res.begin();
-    while (it != res.end()) {
-      int v = *it;
-      if (mapped[v] < 0) {
-        float fv = v;
-        fv /= stddev;
-        fv *= stddev_after;
-        *it = std::clamp<int>(int(fv), 0, USHRT_MAX);
-        mapped[v] = *it;
-      } else {
-        *it = mapped[v];
+    std::string pattern;
+    for (int y = 0; y < 2; y++) {
+      for (int x = 0; x < 2; x++) {
+        pattern += idata.cdesc[raw.COLOR(y, x)];
       }
-      it++;
     }
-
-    if (debug) {
-      float stddev_actual = xt::stddev(res)();
-      std::cout << "stddev_actual: " << stddev_actual << std::endl;
-      debug_message << "stddev_actual: " << stddev_actual << "\n";
+    try {
+      return parse_cfa_pattern(pattern);
+    } catch (const std::invalid_argument &) {
+      throw std::runtime_error("Unsupported CFA pattern: " + pattern);
     }
+  }
 
-    return res;
+  /**
+   * @brief Demosaic the visible area of a Bayer raw image.
+   * @param raw imgdata.rawdata of a file unpacked by LibRaw
+   * @param sizes imgdata.sizes of the file
+   * @param cfa Bayer pattern, e.g. from cfa_pattern()
+   * @param method interpolation
+   * @return image data of shape (3, width * height) in the stored range
+   * @see yk::demosaic
+   */
+  xt::xtensor<ushort, 2>
+  demosaic(const libraw_rawdata_t &raw, const libraw_image_sizes_t &sizes,
+           const CfaPattern &cfa,
+           const DemosaicMethod method = DemosaicMethod::bilinear) const {
+    const std::size_t stride = sizes.raw_pitch / sizeof(ushort);
+    xt::xtensor<ushort, 2> image(
+        {3, (std::size_t)sizes.width * sizes.height});
+    yk::demosaic(raw.raw_image + sizes.top_margin * stride + sizes.left_margin,
+                 sizes.width, sizes.height, stride, cfa, image.data(), method);
+    return image;
+  }
+
+  /**
+   * @brief Apply the OpcodeList2 gain maps of a Bayer DNG to the visible
+   * area of raw_image in place; call it before demosaic().
+   * @param raw imgdata.rawdata of a file unpacked by LibRaw
+   * @param sizes imgdata.sizes of the file
+   * @param color imgdata.color of the file
+   * @param cfa Bayer pattern, e.g. from cfa_pattern()
+   * @param gain_maps GainMap opcodes, e.g. read_gain_maps(tiff,
+   * opcode_list2_tag)
+   * @see yk::apply_mosaic_gain_maps
+   */
+  void apply_mosaic_gain_maps(libraw_rawdata_t &raw,
+                              const libraw_image_sizes_t &sizes,
+                              const libraw_colordata_t &color,
+                              const CfaPattern &cfa,
+                              const std::vector<GainMap> &gain_maps) const {
+    const std::size_t stride = sizes.raw_pitch / sizeof(ushort);
+    std::array<float, 4> black;
+    for (std::size_t i = 0; i < 4; i++) {
+      black[i] = static_cast<float>(color.black + color.cblack[cfa[i]]);
+    }
+    yk::apply_mosaic_gain_maps(
+        raw.raw_image + sizes.top_margin * stride + sizes.left_margin,
+        sizes.width, sizes.height, stride, black, gain_maps);
   }
 
+  /**
+   * @brief Clip image data to [0, USHRT_MAX] and store it as ushort.
+   * @tparam E The derived type of xtensor
+   * @param e an image data stored in xtensor xexpression
+   * @return image data of type ushort with shape (3, N)
+   */
   template <class E>
-  auto adjust_brightness_4(const xt::xexpression<E> &e,
-                           const float mean_rate = 0.5,
-                           const float stddev_rate = 0.96,
-                           const bool debug = false) noexcept {
+  xt::xtensor<ushort, 2> to_ushort(const xt::xexpression<E> &e) const {
     auto &src = e.derived_cast();
-    int n = src.shape()[1];
-
-    float mean = xt::mean(xt::view(src, 1, xt::all()))();
-    float stddev = xt::stddev(xt::view(src, 1, xt::all()))();
-    float mean_after = float(USHRT_MAX) * mean_rate;
-    float stddev_after = (float(USHRT_MAX) * stddev_rate - mean_after) / 3.f;
-
-    if (debug) {
-      std::cout << "mean: " << mean << std::endl;
-      debug_message << "mean: " << mean << "\n";
-      std::cout << "stddev: " << stddev << std::endl;
-      debug_message << "stddev: " << stddev << "\n";
-      std::cout << "mean_after: " << mean_after << std::endl;
-      debug_message << "mean_after: " << mean_after << "\n";
-      std::cout << "stddev_after: " << stddev_after << std::endl;
-      debug_message << "stddev_after: " << stddev_after << "\n";
-    }
-    std::vector<int> mapped(1 << 16, -1);
-    auto res = src;
-    auto it = res.begin();
-    while (it != res.end()) {
-      int v = *it;
-      if (mapped[v] < 0) {
-        float fv = v;
-        fv = (fv - mean) / stddev;
-        fv = fv * stddev_after + mean_after;
-        *it = std::clamp<int>(int(fv), 0, USHRT_MAX);
-        mapped[v] = *it;
-      } else {
-        *it = mapped[v];
-      }
-      it++;
+    xt::xtensor<ushort, 2> image({3, src.shape()[1]});
+    if constexpr (std::is_same_v<typename E::value_type, ushort>) {
+      image = src;
+    } else if constexpr (std::is_same_v<E, xt::xtensor<Half, 2>>) {
+      half_to_ushort(src.data(), image.data(), src.size());
+    } else {
+      image = xt::cast<ushort>(xt::clip(src, 0, USHRT_MAX));
     }
+    return image;
+  }
 
-    if (debug) {
-      float mean_actual = xt::mean(res)();
-      float stddev_actual = xt::stddev(res)();
-      std::cout << "mean after actual: " << mean_actual << std::endl;
-      debug_message << "mean after actual: " << mean_actual << "\n";
-      std::cout << "stddev_actual: " << stddev_actual << std::endl;
-      debug_message << "stddev_actual: " << stddev_actual << "\n";
+  /**
+   * @brief Adjust the brightness and contrast with a tone mapping strategy.
+   * The image is clipped to [0, USHRT_MAX], the strategy builds a tone curve
+   * from it and the curve is applied with apply_tone_curve().
+   * @tparam E The derived type of xtensor
+   * @param e an image data stored in xtensor xexpression
+   * @param mapper tone mapping strategy
+   * @param debug log debug messages of the strategy
+   * @param luminance if not nullptr, the curve is built from this histogram
+   * (e.g. emitted by camera_to_sRGB()) instead of the green channel
+   * @return adjusted image data of type ushort
+   */
+  template <class E>
+  xt::xtensor<ushort, 2> tone_map(const xt::xexpression<E> &e,
+                                  const ToneMapper &mapper,
+                                  const bool debug = false,
+                                  const Histogram *luminance = nullptr) const {
+    LogBuffer log(LogLevel::debug, debug);
+    if constexpr (std::is_same_v<E, xt::xtensor<Half, 2>>) {
+      // Read the Half image once when the curve comes from the histogram.
+      if (luminance) {
+        auto &src = e.derived_cast();
+        xt::xtensor<ushort, 2> image({3, src.shape()[1]});
+        apply_tone_curve(
+            src.data(), image.data(), src.shape()[1],
+            mapper.build_curve_from_histogram(*luminance, log.stream()));
+        return image;
+      }
     }
+    auto image = to_ushort(e);
+    const ImageView view{image.data(), image.shape()[1]};
+    const ToneCurve curve =
+        luminance ? mapper.build_curve_from_histogram(*luminance, log.stream())
+                  : mapper.build_curve(view, log.stream());
+    apply_tone_curve(image.data(), image.data(), image.shape()[1], curve);
+    return image;
+  }
 
-    return res;
+  /**
+   * @brief Apply the ProfileGainTableMap of a DNG, the local tone mapping of
+   * the camera rendering, to the linear output of camera_to_rgb() in place.
+   * @param image float image of shape (3, width * height) relative to 16-bit
+   * white
+   * @param width image width
+   * @param height image height
+   * @param map gain table, e.g. from read_gain_table_map()
+   * @param luminance if not nullptr, receives the luminance histogram of the
+   * result, replacing the one of camera_to_rgb()
+   * @param cs color space of the image, for the luminance weights
+   * @see yk::apply_gain_table_map
+   */
+  void apply_gain_table_map(xt::xtensor<float, 2> &image,
+                            const std::size_t width, const std::size_t height,
+                            const GainTableMap &map,
+                            Histogram *luminance = nullptr,
+                            const ColorSpace cs = ColorSpace::sRGB) const {
+    yk::apply_gain_table_map(image.data(), width, height, map, USHRT_MAX,
+                             luminance, luminance_weights(cs));
   }
 
+  /**
+   * @brief Adjust the brightness and contrast locally with tiled histogram
+   * equalisation (CLAHE).
+   * @tparam E The derived type of xtensor
+   * @param e an image data stored in xtensor xexpression
+   * @param width image width
+   * @param height image height
+   * @param params tiling and clipping parameters
+   * @return adjusted image data of type ushort
+   * @see local_equalization
+   */
   template <class E>
-  auto adjust_brightness_3(const xt::xexpression<E> &e,
-                           const bool debug = false) noexcept {
-    auto &src = e.derived_cast();
-
-    std::vector<std::size_t> size = {1 << 16};
-    xt::xtensor<float, 1> histogram = xt::zeros<float>(size);
-    for (int i = 0; i < src.shape()[1]; i++) {
-      histogram(std::clamp<int>(src(1, i), 0, USHRT_MAX))++;
-    }
+  xt::xtensor<ushort, 2>
+  adjust_local_contrast(const xt::xexpression<E> &e, const std::size_t width,
+                        const std::size_t height,
+                        const LocalToneMapParams &params = {}) const {
+    auto image = to_ushort(e);
+    local_equalization({image.data(), image.shape()[1]}, width, height,
+                       image.data(), params);
+    return image;
+  }
 
-    histogram =
-        xt::fma(histogram, float(USHRT_MAX) / float(src.shape()[1]), 0.);
+  /**
+   * @brief Map [min, max] of all channels to [0, USHRT_MAX].
+   */
+  template <class E>
+  auto adjust_brightness_6(const xt::xexpression<E> &e,
+                           const bool debug = false) const {
+    return tone_map(e, MinMaxStretch{}, debug);
+  }
 
-    for (int i = 1; i < 1 << 16; i++) {
-      histogram(i) += histogram(i - 1);
+  /**
+   * @brief Scale the standard deviation of the green channel.
+   * @see StddevScale
+   */
+  template <class E>
+  auto adjust_brightness_5(const xt::xexpression<E> &e,
+                           const float stddev_rate = 0.96,
+                           const bool debug = false) const {
+    auto &&res = tone_map(e, StddevScale{stddev_rate}, debug);
+    if (debug && log_enabled(LogLevel::debug)) {
+      const auto actual = compute_image_stats(res.data(), res.shape()[1]);
+      YK_LOG_DEBUG("stddev_actual: " << actual.pooled().stddev());
     }
+    return res;
+  }
 
-    auto res = xt::empty_like(src);
-    for (int i = 0; i < src.shape()[1]; i++) {
-      res(0, i) = histogram(std::clamp<int>(src(0, i), 0, USHRT_MAX));
-      res(1, i) = histogram(std::clamp<int>(src(1, i), 0, USHRT_MAX));
-      res(2, i) = histogram(std::clamp<int>(src(2, i), 0, USHRT_MAX));
+  /**
+   * @brief Normalise the mean and standard deviation of the green channel.
+   * @see MeanStddevStretch
+   */
+  template <class E>
+  auto adjust_brightness_4(const xt::xexpression<E> &e,
+                           const float mean_rate = 0.5,
+                           const float stddev_rate = 0.96,
+                           const bool debug = false) const {
+    auto &&res = tone_map(e, MeanStddevStretch{mean_rate, stddev_rate}, debug);
+    if (debug && log_enabled(LogLevel::debug)) {
+      const auto actual = compute_image_stats(res.data(), res.shape()[1]);
+      for (int ch = 0; ch < 3; ch++) {
+        YK_LOG_DEBUG("actual[" << ch << "]: " << actual[ch]);
+      }
+      YK_LOG_DEBUG("mean after actual: " << actual.pooled().mean);
+      YK_LOG_DEBUG("stddev_actual: " << actual.pooled().stddev());
     }
-
     return res;
   }
 
+  /**
+   * @brief Histogram equalisation of the green channel.
+   * @see HistogramEqualization
+   */
+  template <class E>
+  auto adjust_brightness_3(const xt::xexpression<E> &e,
+                           const bool debug = false) const {
+    return tone_map(e, HistogramEqualization{}, debug);
+  }
+
+  /**
+   * @brief Histogram stretching with linear segments at both edges.
+   * @see PiecewiseStretch
+   */
   template <class E>
   auto adjust_brightness_2(const xt::xexpression<E> &e,
                            const float edge_acc_rate = 0.01,
                            const float edge_val_rage = 0.001,
-                           const bool debug = false) noexcept {
-    if (debug) {
-      debug_message << "Start adjust_brightness_2()\n";
-    }
-    auto &src = e.derived_cast();
-    auto image = xt::clip(src, 0, USHRT_MAX);
-    auto res = xt::eval(image);
-
-    int acc_thresh = image.shape()[1] * edge_acc_rate;
-    if (debug) {
-      debug_message << "acc_thresh: " << acc_thresh << "\n";
-    }
-    std::vector<long long> histogram(1 << 13, 0);
-    for (int i = 0; i < image.shape()[1]; i++) {
-      histogram[static_cast<ushort>(image(1, i)) >> 3]++;
-    }
-
-    // calculate the minimum value in the scope.
-    ushort lower_bound = 0;
-    {
-      int bin = 0;
-      int acc = 0;
-      while (acc < acc_thresh && bin < histogram.size()) {
-        acc += histogram[bin];
-        bin++;
-      }
-      if (debug) {
-        debug_message << "min bin: " << bin << "\n";
-      }
-      lower_bound = (bin << 3);
-    }
-
-    // calculate the maximum value in the scope.
-    ushort upper_bound = USHRT_MAX;
-    {
-      int bin = histogram.size() - 1;
-      int acc = 0;
-      while (acc < acc_thresh && 0 < bin) {
-        acc += histogram[bin];
-        bin--;
-      }
-      if (debug) {
-        debug_message << "max bin: " << bin << "\n";
-      }
-      upper_bound = (bin << 3);
-    }
-
-    ushort mapped_lower_bound = USHRT_MAX * edge_val_rage;
-    ushort mapped_upper_bound = USHRT_MAX - mapped_lower_bound;
-
-    float lower_edge_slope = float(mapped_lower_bound) / float(lower_bound);
-    float upper_edge_slope =
-        float(USHRT_MAX - mapped_lower_bound) / float(USHRT_MAX - upper_bound);
-    float mid_slope = float(mapped_upper_bound - mapped_lower_bound) /
-                      float(upper_bound - lower_bound);
+                           const bool debug = false) const {
     if (debug) {
-      debug_message << "lower bound: " << lower_bound << "\n";
-      debug_message << "mapped lower bound: " << mapped_lower_bound << "\n";
-      debug_message << "upper bound: " << upper_bound << "\n";
-      debug_message << "mapped bound: " << mapped_upper_bound << "\n";
-      debug_message << "lower edge slope: " << lower_edge_slope << "\n";
-      debug_message << "upper edge slope: " << upper_edge_slope << "\n";
-      debug_message << "mid slope: " << mid_slope << "\n";
-    }
-
-    std::vector<int> mapped(1 << 16, -1);
-    auto it = res.begin();
-    while (it != res.end()) {
-      if (mapped[*it] < 0) {
-        ushort val = std::clamp<int>(*it, 0., USHRT_MAX);
-        if (*it < lower_bound) {
-          *it = *it * lower_edge_slope;
-        } else if (upper_bound < *it) {
-          *it = (*it - upper_bound) * upper_edge_slope + mapped_upper_bound;
-        } else {
-          *it = (*it - lower_bound) * mid_slope + mapped_lower_bound;
-        }
-        mapped[val] = *it;
-      } else {
-        *it = mapped[*it];
-      }
-      it++;
+      YK_LOG_DEBUG("Start adjust_brightness_2()");
     }
-    return res;
+    return tone_map(e, PiecewiseStretch{edge_acc_rate, edge_val_rage}, debug);
   }
 
   /**
@@ -425,87 +784,33 @@ public:
    * @param e an image data stored in xtensor xexpression
    * @param stretch_rate Percentage that defines the min and max thresholds
    * (Range [0, 1])
-   * @return
+   * @param luminance if not nullptr, the thresholds are taken from this
+   * histogram instead of the green channel
+   * @return adjusted image data of type ushort
    */
   template <class E>
   auto adjust_brightness(const xt::xexpression<E> &e,
                          const float strech_rate = 0.4,
-                         const bool debug = false) noexcept {
+                         const bool debug = false,
+                         const Histogram *luminance = nullptr) const {
     if (debug) {
-      debug_message << "Start adjust_brightness()\n";
+      YK_LOG_DEBUG("Start adjust_brightness()");
     }
-    auto &src = e.derived_cast();
     if (strech_rate < 0.000001f) {
-      return src;
+      return to_ushort(e);
     }
-    auto &&image = xt::clip(src, 0, USHRT_MAX);
-    float min_value = xt::amin(image)(), max_value = xt::amax(image)();
-    if (0.999999f <= strech_rate) {
-      max_value = min_value;
-    } else if (0 < strech_rate) {
-      int acc_thresh = image.shape()[1] * strech_rate * 0.5f;
-      if (debug) {
-        debug_message << "acc_thresh: " << acc_thresh << "\n";
-      }
-      std::vector<long long> histogram(1 << 13, 0);
-      for (int i = 0; i < image.shape()[1]; i++) {
-        histogram[static_cast<ushort>(image(1, i)) >> 3]++;
-      }
-      // calculate the minimum value in the scope.
-      {
-        int bin = 0;
-        int acc = 0;
-        while (acc < acc_thresh && bin < histogram.size()) {
-          acc += histogram[bin];
-          bin++;
-        }
-        if (debug) {
-          debug_message << "min bin: " << bin << "\n";
-        }
-        min_value = (bin << 3);
-      }
-      // calculate the maximum value in the scope.
-      {
-        int bin = histogram.size() - 1;
-        int acc = 0;
-        while (acc < acc_thresh && 0 < bin) {
-          acc += histogram[bin];
-          bin--;
-        }
-        if (debug) {
-          debug_message << "max bin: " << bin << "\n";
-        }
-        max_value = (bin << 3);
-      }
-    }
-    // scaling: min_value -> 0, max_value -> USHRT_MAX
-    if (debug) {
-      debug_message << "max value: " << max_value << "\n";
-      debug_message << "min value: " << min_value << "\n";
-    }
-    const float alpha =
-        (max_value - min_value) < 0.00001
-            ? 0
-            : static_cast<float>(USHRT_MAX) / (max_value - min_value);
-    const float beta = -min_value * alpha;
+    auto &&res =
+        tone_map(e, HistogramStretch{strech_rate}, debug, luminance);
     if (debug) {
-      debug_message << "alpha: " << std::to_string(alpha) << "\n";
-      debug_message << "beta: " << std::to_string(beta) << "\n";
-    }
-    // calculate image * alpha + beta
-    auto &&res = xt::eval(xt::fma(image, alpha, beta));
-    if (debug) {
-      debug_message << "End adjust_brightness()\n";
+      YK_LOG_DEBUG("End adjust_brightness()");
     }
     return res;
   }
 
-  // Cache gamma correction values
-  std::vector<int> gamma_curve;
+  // Gamma correction lookup table
+  const ToneCurve gamma_curve;
 
-  // CIE-XYZ to sRGB'
+  // CIE-XYZ to sRGB' as xtensor, a copy of sRGB_from_xyz
   const xt::xtensor_fixed<float, xt::xshape<3, 3>> sRGB_from_xyzD65;
-
-  std::stringstream debug_message;
 };
 } // namespace yk
\ No newline at end of file
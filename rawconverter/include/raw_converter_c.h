@@ -0,0 +1,177 @@
+/**
+ * @file raw_converter_c.h
+ * @brief C interface of the raw converter for embedding it in other
+ * languages. Images are decoded with LibRaw and converted with the same
+ * pipeline as experiments/my_conversion (camera native -> sRGB', brightness
+ * adjustment, optional local contrast, gamma correction) into buffers owned
+ * by the caller.
+ *
+ * A handle may be used by one thread at a time; different handles may be
+ * used concurrently. All functions report failures through rc_status and
+ * never throw.
+ */
+#ifndef YK_RAW_CONVERTER_C_H
+#define YK_RAW_CONVERTER_C_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32)
+#if defined(RC_BUILDING_LIBRARY)
+#define RC_API __declspec(dllexport)
+#else
+#define RC_API __declspec(dllimport)
+#endif
+#elif defined(__GNUC__) || defined(__clang__)
+#define RC_API __attribute__((visibility("default")))
+#else
+#define RC_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Version of this interface. Bumped when a struct layout changes or a
+ * function is added.
+ */
+#define RC_API_VERSION 3
+
+typedef enum rc_status {
+  RC_OK = 0,
+  RC_ERROR_INVALID_ARGUMENT = 1,
+  RC_ERROR_OPEN = 2,
+  RC_ERROR_UNPACK = 3,
+  RC_ERROR_BUFFER_TOO_SMALL = 4,
+  RC_ERROR_NO_RESULT = 5,
+  RC_ERROR_OUT_OF_MEMORY = 6,
+  RC_ERROR_INTERNAL = 7,
+  /** The sensor has neither linear data nor a Bayer CFA (e.g. X-Trans). */
+  RC_ERROR_UNSUPPORTED = 8
+} rc_status;
+
+/** Memory layout of converted images. */
+typedef enum rc_layout {
+  /** Three planes of width * height values, R then G then B. */
+  RC_LAYOUT_PLANAR = 0,
+  /** width * height pixels of interleaved R, G, B values. */
+  RC_LAYOUT_INTERLEAVED = 1
+} rc_layout;
+
+/** Opaque handle of an opened raw image. */
+typedef struct rc_image rc_image;
+
+/** Size of an opened raw image. */
+typedef struct rc_info {
+  uint32_t width;
+  uint32_t height;
+} rc_info;
+
+/** Conversion parameters. Initialise with rc_default_params(). */
+typedef struct rc_params {
+  /** Tone mapper name, see ToneMapperRegistry. NULL selects "stretch". */
+  const char *tone_mapper;
+  /** Stretch rate of the "stretch" tone mapper. 0 disables the adjustment. */
+  float stretch_rate;
+  /** Clip limit of the local contrast equalisation. 0 disables it. */
+  float local_clip_limit;
+  /** Non-zero to apply sRGB gamma correction. */
+  int gamma;
+  /** Layout of the output buffer. */
+  rc_layout layout;
+  /**
+   * Kernel threads of this conversion only, e.g. to run several
+   * conversions side by side. 0 uses rc_num_threads().
+   */
+  size_t num_threads;
+} rc_params;
+
+/** Statistics of one channel of the last converted image. */
+typedef struct rc_channel_stats {
+  uint64_t count;
+  double mean;
+  double stddev;
+  double min;
+  double max;
+} rc_channel_stats;
+
+/** Version of the library, to be compared with RC_API_VERSION. */
+RC_API int rc_api_version(void);
+
+/** Human-readable description of a status code. */
+RC_API const char *rc_status_string(rc_status status);
+
+/** Fill params with the defaults of my_conversion -a 0.01. */
+RC_API void rc_default_params(rc_params *params);
+
+/**
+ * Open and unpack a raw file. Linear DNGs such as ProRaw are used as
+ * decoded by LibRaw; Bayer files are demosaiced bilinearly. Other sensor
+ * layouts yield RC_ERROR_UNSUPPORTED.
+ * @param path file path
+ * @param image receives the handle, to be released with rc_close()
+ */
+RC_API rc_status rc_open(const char *path, rc_image **image);
+
+/**
+ * Open and unpack a raw file held in memory. The buffer must stay valid
+ * until rc_close().
+ */
+RC_API rc_status rc_open_buffer(const void *data, size_t size,
+                                rc_image **image);
+
+/** Size of the image, which determines the output buffer size. */
+RC_API rc_status rc_get_info(const rc_image *image, rc_info *info);
+
+/**
+ * Convert the image into a caller-provided buffer.
+ * @param image opened image
+ * @param params conversion parameters, or NULL for the defaults
+ * @param dst output buffer of 3 * width * height 16-bit values
+ * @param dst_size number of uint16_t elements available at dst
+ */
+RC_API rc_status rc_convert_into(rc_image *image, const rc_params *params,
+                                 uint16_t *dst, size_t dst_size);
+
+/**
+ * Per-channel statistics (R, G, B) of the last image written by
+ * rc_convert_into().
+ */
+RC_API rc_status rc_stats(const rc_image *image, rc_channel_stats stats[3]);
+
+/**
+ * Set the number of threads used by the conversion kernels of all threads.
+ * 0 restores the hardware default. To limit one conversion, set
+ * rc_params.num_threads instead, or rc_set_thread_num_threads() for every
+ * call of one thread.
+ */
+RC_API void rc_set_num_threads(size_t n);
+
+/**
+ * Set the number of kernel threads of the calls made from the current
+ * thread only, rc_open() and the demosaic included, e.g. for a worker that
+ * converts files side by side with others. 0 removes the override.
+ * rc_params.num_threads still takes precedence in rc_convert_into().
+ */
+RC_API void rc_set_thread_num_threads(size_t n);
+
+/** Number of threads used by the conversion kernels of the calling thread. */
+RC_API size_t rc_num_threads(void);
+
+/**
+ * Apply the tuned kernel parameters of this host (thread count, chunk and
+ * block sizes), calibrating and saving them first if the profile is missing
+ * or recalibrate is nonzero. path may be NULL for the default per-host
+ * profile in the user's cache directory.
+ */
+RC_API rc_status rc_autotune(const char *path, int recalibrate);
+
+/** Release a handle. NULL is ignored. */
+RC_API void rc_close(rc_image *image);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // YK_RAW_CONVERTER_C_H
@@ -0,0 +1,231 @@
+#pragma once
+
+#include "color_space.hpp"
+#include "color_transform.hpp"
+#include "dng_color.hpp"
+#include "lru_cache.hpp"
+#include "raw_converter.hpp"
+#include "tone_mapper.hpp"
+#include <array>
+#include <chrono>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace yk {
+
+/**
+ * @brief Parameters of SequenceConverter.
+ */
+struct SequenceParams {
+  // Name of the tone mapper in ToneMapperRegistry and its parameters.
+  std::string tone_mapper = "stretch";
+  ToneMapParams tone_params = {{"stretch_rate", 0.01f}};
+  // Weight of the previous frame's curve in the exponential moving average.
+  // 0 disables temporal smoothing.
+  float smoothing = 0.8f;
+  // Only every sample_stride-th pixel contributes to the luminance histogram.
+  std::size_t sample_stride = 16;
+  // Compose the encoding curve of the output color space into the tone
+  // curve.
+  bool gamma = true;
+  // Output color space. Its matrix is composed into color_matrix() and its
+  // curve into the tone curve, so frames still cost two passes.
+  ColorSpace output = ColorSpace::sRGB;
+};
+
+/**
+ * @brief Per-frame latency of SequenceConverter::process().
+ */
+struct FrameReport {
+  std::size_t frame = 0;
+  bool color_cache_hit = false;
+  double color_ms = 0;
+  double curve_ms = 0;
+  double apply_ms = 0;
+  double total_ms = 0;
+};
+
+inline std::ostream &operator<<(std::ostream &os, const FrameReport &r) {
+  return os << "frame " << r.frame << ": color " << r.color_ms
+            << " ms, curve " << r.curve_ms << " ms, apply " << r.apply_ms
+            << " ms, total " << r.total_ms << " ms"
+            << (r.color_cache_hit ? " (cached color matrix)" : "");
+}
+
+/**
+ * @class SequenceConverter
+ * @brief Converter for bursts and timelapses from the same device.
+ * State is carried across frames: color matrices are cached per unique DNG
+ * color metadata, and the tone curve is built from a sparse luminance
+ * sample taken during the color pass and smoothed temporally. Each frame
+ * then costs one color pass (camera -> sRGB' as 16-bit) and one LUT pass
+ * (brightness and gamma composed).
+ */
+class SequenceConverter {
+public:
+  explicit SequenceConverter(SequenceParams params = {})
+      : params_(std::move(params)),
+        mapper_(ToneMapperRegistry::instance().create(params_.tone_mapper,
+                                                      params_.tone_params)),
+        gamma_(params_.output == ColorSpace::sRGB
+                   ? RawConverter::gamma_tone_curve()
+                   : output_curve(params_.output)),
+        weights_(luminance_weights(params_.output)) {}
+
+  /**
+   * @brief Matrix converting camera native color space to the linear output
+   * color space (sRGB' by default).
+   * Results are cached per unique (ColorMatrix, AnalogBalance) pair, up to
+   * ColorMatrixCache::default_capacity pairs.
+   * @param cm ColorMatrix of the DNG
+   * @param ab AnalogBalance of the DNG
+   */
+  const Matrix3 &color_matrix(const float cm[4][3], const float ab[4]) {
+    std::array<float, 12> key;
+    for (int i = 0; i < 3; i++) {
+      for (int j = 0; j < 3; j++) {
+        key[i * 3 + j] = cm[i][j];
+      }
+      key[9 + i] = ab[i];
+    }
+    const Matrix3 *found = color_cache_.find(key);
+    last_cache_hit_ = found != nullptr;
+    if (!last_cache_hit_) {
+      const Matrix3 srgb =
+          multiply(RawConverter::sRGB_from_xyz, xyz_from_camera(cm, ab));
+      found = &color_cache_.insert(
+          key, multiply(rgb_from_sRGB(params_.output), srgb));
+    }
+    matrix_ = *found;
+    return matrix_;
+  }
+
+  /**
+   * @brief Matrix converting camera native color space to the linear output
+   * color space with the matrices of both DNG illuminants, interpolated for
+   * the white point of the neutral. The white point solve is cached per
+   * unique (profile, neutral) pair.
+   * @param profile color calibration, e.g. from
+   * RawConverter::dng_color_profile()
+   * @param neutral AsShotNeutral of the frame
+   * @param gains white balance gains the frame was normalised with; other
+   * gains than 1 balance the neutral 1 / gains, as in
+   * xyz_from_balanced_camera()
+   */
+  const Matrix3 &color_matrix(const DngColorProfile &profile,
+                              const std::array<float, 3> &neutral,
+                              const std::array<float, 3> &gains = {1.f, 1.f,
+                                                                   1.f}) {
+    const bool balanced = gains != std::array<float, 3>{1.f, 1.f, 1.f};
+    std::array<float, 3> white = neutral;
+    if (balanced) {
+      for (int i = 0; i < 3; i++) {
+        white[i] = 0.f < gains[i] ? 1.f / gains[i] : 1.f;
+      }
+    }
+    const std::size_t hits = dng_cache_.hits();
+    Matrix3 xyz = dng_cache_.xyz_from_camera(profile, white);
+    last_cache_hit_ = dng_cache_.hits() != hits;
+    if (balanced) {
+      for (auto &row : xyz) {
+        for (int j = 0; j < 3; j++) {
+          row[j] *= white[j];
+        }
+      }
+    }
+    matrix_ = multiply(rgb_from_sRGB(params_.output),
+                       multiply(RawConverter::sRGB_from_xyz, xyz));
+    return matrix_;
+  }
+
+  /**
+   * @brief Convert one frame.
+   * @param image camera native image of shape (3, N), black level subtracted
+   * @param camera_to_output camera native to linear output matrix, e.g.
+   * from color_matrix() or RawConverter::rgb_from_camera() of LibRaw's
+   * rgb_cam
+   * @return gamma-corrected image in the output color space of type ushort
+   */
+  xt::xtensor<ushort, 2> process(const xt::xtensor<ushort, 2> &image,
+                                 const Matrix3 &camera_to_output) {
+    using clock = std::chrono::steady_clock;
+    FrameReport report;
+    report.frame = reports_.size();
+    report.color_cache_hit = last_cache_hit_;
+    last_cache_hit_ = false;
+    const auto start = clock::now();
+
+    const std::size_t n = image.shape()[1];
+    xt::xtensor<ushort, 2> res({3, n});
+    Histogram luminance;
+    color_transform(image.data(), res.data(), n, camera_to_output,
+                    &luminance, weights_, params_.sample_stride);
+    const auto color_end = clock::now();
+
+    update_curve(mapper_->build_curve_from_histogram(luminance));
+    const ToneCurve curve =
+        params_.gamma ? compose(current(), gamma_) : current();
+    const auto curve_end = clock::now();
+
+    apply_tone_curve(res.data(), res.data(), n, curve);
+    const auto end = clock::now();
+
+    auto ms = [](auto a, auto b) {
+      return std::chrono::duration<double, std::milli>(b - a).count();
+    };
+    report.color_ms = ms(start, color_end);
+    report.curve_ms = ms(color_end, curve_end);
+    report.apply_ms = ms(curve_end, end);
+    report.total_ms = ms(start, end);
+    reports_.push_back(report);
+    return res;
+  }
+
+  /**
+   * @brief Latency reports of all processed frames.
+   */
+  const std::vector<FrameReport> &reports() const noexcept {
+    return reports_;
+  }
+
+  /**
+   * @brief Forget the temporal state, e.g. at a scene cut.
+   */
+  void reset() noexcept { smoothed_.clear(); }
+
+private:
+  void update_curve(const ToneCurve &curve) {
+    const float a = smoothed_.empty() ? 0.f : params_.smoothing;
+    smoothed_.resize(ToneCurve::lut_size * 3);
+    for (int ch = 0; ch < 3; ch++) {
+      const std::uint16_t *lut = curve.lut(ch);
+      float *s = smoothed_.data() + ch * ToneCurve::lut_size;
+      for (std::size_t v = 0; v < ToneCurve::lut_size; v++) {
+        s[v] = a * s[v] + (1.f - a) * lut[v];
+      }
+    }
+  }
+
+  ToneCurve current() const {
+    return ToneCurve::from_channel_function([this](int ch, int v) {
+      return smoothed_[ch * ToneCurve::lut_size + v] + 0.5f;
+    });
+  }
+
+  SequenceParams params_;
+  std::unique_ptr<ToneMapper> mapper_;
+  ToneCurve gamma_;
+  std::array<float, 3> weights_;
+  LruCache<std::array<float, 12>, Matrix3> color_cache_{
+      ColorMatrixCache::default_capacity};
+  ColorMatrixCache dng_cache_;
+  // Result of the last color_matrix() call.
+  Matrix3 matrix_{};
+  bool last_cache_hit_ = false;
+  std::vector<float> smoothed_;
+  std::vector<FrameReport> reports_;
+};
+
+} // namespace yk
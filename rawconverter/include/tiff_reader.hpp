@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace yk {
+
+/**
+ * @brief One TIFF directory entry with its value bytes in file byte order.
+ */
+struct TiffEntry {
+  std::uint16_t type = 0;
+  std::uint32_t count = 0;
+  std::vector<std::uint8_t> bytes;
+  bool big_endian = false;
+
+  /**
+   * @brief Size of one value of a TIFF field type in bytes, 0 if unknown.
+   */
+  static std::size_t type_size(std::uint16_t type) noexcept;
+
+  /**
+   * @brief Value i converted to double. Rationals are divided out.
+   * @throw std::out_of_range if i >= count or the type is not numeric
+   */
+  double number(std::size_t i = 0) const;
+
+  /**
+   * @brief All values converted to double.
+   */
+  std::vector<double> numbers() const;
+};
+
+/**
+ * @brief Entries of one image file directory by tag.
+ */
+using TiffIfd = std::map<std::uint16_t, TiffEntry>;
+
+/**
+ * @class TiffReader
+ * @brief Minimal reader of the directories of a TIFF, DNG or DCP file.
+ * It follows the IFD chain from the header and the SubIFDs of every
+ * directory, and loads the values of all entries; image data is not read.
+ */
+class TiffReader {
+public:
+  static constexpr std::uint16_t new_subfile_type_tag = 254;
+  static constexpr std::uint16_t sub_ifds_tag = 330;
+  // Magic number of DCP camera profile files in place of 42.
+  static constexpr std::uint16_t dcp_magic = 0x4352;
+
+  /**
+   * @brief Parse the directories of a TIFF stream.
+   * @throw std::runtime_error if the stream is not a valid TIFF
+   */
+  explicit TiffReader(std::istream &is);
+
+  /**
+   * @brief Parse the directories of a TIFF or DNG file.
+   * @throw std::runtime_error if the file cannot be read or is not a TIFF
+   */
+  static TiffReader open(const std::string &path);
+
+  bool big_endian() const noexcept { return big_endian_; }
+
+  /**
+   * @brief All directories: the main chain first, then SubIFDs in the order
+   * they were found.
+   */
+  const std::vector<TiffIfd> &ifds() const noexcept { return ifds_; }
+
+  /**
+   * @brief Directory of the full-resolution raw image: the first with
+   * NewSubFileType 0, or IFD0 if none is marked.
+   */
+  const TiffIfd &raw_ifd() const noexcept;
+
+  /**
+   * @brief Entry of a tag in a directory, or nullptr if it is missing.
+   */
+  static const TiffEntry *find(const TiffIfd &ifd, std::uint16_t tag) noexcept;
+
+  /**
+   * @brief Entry of a tag in IFD0, or nullptr if it is missing. DNG keeps
+   * its camera profile tags there.
+   */
+  const TiffEntry *find(std::uint16_t tag) const noexcept;
+
+private:
+  // Parse the directory at offset, queue its SubIFDs and return the offset
+  // of the next directory in the chain.
+  std::uint32_t read_ifd(std::istream &is, std::uint32_t offset,
+                         std::vector<std::uint32_t> &sub_ifds);
+  std::uint16_t read16(std::istream &is) const;
+  std::uint32_t read32(std::istream &is) const;
+
+  bool big_endian_ = false;
+  std::uint64_t file_size_ = 0;
+  std::vector<TiffIfd> ifds_;
+};
+
+} // namespace yk
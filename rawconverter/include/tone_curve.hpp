@@ -0,0 +1,194 @@
+#pragma once
+
+#include "half_float.hpp"
+#include "parallel.hpp"
+#include <algorithm>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace yk {
+
+/**
+ * @brief Non-owning view of a planar 3-channel 16-bit image.
+ * The layout matches xt::xtensor<ushort, 2> of shape (3, N): channel ch
+ * starts at data + ch * size.
+ */
+struct ImageView {
+  const std::uint16_t *data = nullptr;
+  std::size_t size = 0;
+
+  const std::uint16_t *channel(const int ch) const noexcept {
+    return data + ch * size;
+  }
+};
+
+/**
+ * @class ToneCurve
+ * @brief 16-bit to 16-bit tone curve stored as a lookup table.
+ * A curve either holds one table shared by all channels or one table per
+ * channel. Each table has lut_size entries plus one padding entry so that
+ * vectorised kernels may read 32 bits at the last index.
+ */
+class ToneCurve {
+public:
+  static constexpr std::size_t lut_size = 1 << 16;
+
+  /**
+   * @brief Create the identity curve.
+   * @param per_channel allocate one table per channel
+   */
+  explicit ToneCurve(const bool per_channel = false)
+      : per_channel_(per_channel),
+        luts_((per_channel ? 3 : 1) * stride, 0) {
+    for (int ch = 0; ch < channels(); ch++) {
+      for (std::size_t v = 0; v < lut_size; v++) {
+        lut(ch)[v] = static_cast<std::uint16_t>(v);
+      }
+    }
+  }
+
+  /**
+   * @brief Create a shared curve from a function of the input value.
+   * Results are truncated towards zero and clamped to [0, USHRT_MAX].
+   * @tparam F callable with signature float(int)
+   * @param f mapping from input value to output value
+   */
+  template <class F> static ToneCurve from_function(F &&f) {
+    ToneCurve curve(false);
+    for (int v = 0; v < static_cast<int>(lut_size); v++) {
+      curve.lut(0)[v] = clamp_value(f(v));
+    }
+    return curve;
+  }
+
+  /**
+   * @brief Create a per-channel curve from a function of the channel and
+   * input value.
+   * @tparam F callable with signature float(int, int)
+   * @param f mapping from (channel, input value) to output value
+   */
+  template <class F> static ToneCurve from_channel_function(F &&f) {
+    ToneCurve curve(true);
+    for (int ch = 0; ch < 3; ch++) {
+      for (int v = 0; v < static_cast<int>(lut_size); v++) {
+        curve.lut(ch)[v] = clamp_value(f(ch, v));
+      }
+    }
+    return curve;
+  }
+
+  /**
+   * @brief Truncate a curve value towards zero and clamp it to the 16-bit
+   * range.
+   */
+  template <class T> static std::uint16_t clamp_value(const T value) noexcept {
+    if (!(value > T(0))) {
+      return 0;
+    }
+    if (!(value < T(USHRT_MAX))) {
+      return USHRT_MAX;
+    }
+    return static_cast<std::uint16_t>(value);
+  }
+
+  bool per_channel() const noexcept { return per_channel_; }
+  int channels() const noexcept { return per_channel_ ? 3 : 1; }
+
+  /**
+   * @brief Lookup table applied to channel ch.
+   */
+  const std::uint16_t *lut(const int ch) const noexcept {
+    return luts_.data() + (per_channel_ ? ch : 0) * stride;
+  }
+  std::uint16_t *lut(const int ch) noexcept {
+    return luts_.data() + (per_channel_ ? ch : 0) * stride;
+  }
+
+private:
+  static constexpr std::size_t stride = lut_size + 1;
+
+  bool per_channel_;
+  std::vector<std::uint16_t> luts_;
+};
+
+/**
+ * @brief Curve applying first and then second, so that a chain of curves
+ * costs a single pass over the image.
+ * @return per-channel curve if either input is per-channel
+ */
+ToneCurve compose(const ToneCurve &first, const ToneCurve &second);
+
+/**
+ * @brief Map n values through a lookup table: dst[i] = lut[src[i]].
+ * Values are truncated and clamped to [0, USHRT_MAX] before the lookup.
+ * This generic version handles element types without a compiled kernel.
+ * @tparam T element type of the source buffer
+ * @param src source values
+ * @param dst destination buffer
+ * @param n number of values
+ * @param lut lookup table with at least (1 << 16) + 1 entries
+ */
+template <class T>
+void apply_lut(const T *src, std::uint16_t *dst, const std::size_t n,
+               const std::uint16_t *lut) noexcept {
+  for (std::size_t i = 0; i < n; i++) {
+    dst[i] = lut[ToneCurve::clamp_value(src[i])];
+  }
+}
+
+/**
+ * @brief Compiled lookup kernels for 16-bit and float sources.
+ * src and dst may be the same buffer. On CPUs with AVX2 the lookup runs
+ * eight values at a time with 32-bit gathers, which relies on the padding
+ * entry after index USHRT_MAX that ToneCurve guarantees.
+ */
+void apply_lut(const std::uint16_t *src, std::uint16_t *dst, std::size_t n,
+               const std::uint16_t *lut) noexcept;
+void apply_lut(const float *src, std::uint16_t *dst, std::size_t n,
+               const std::uint16_t *lut) noexcept;
+
+/**
+ * @brief Lookup kernel for Half intermediates. Values are scaled back to
+ * code values by half_unit, so index USHRT_MAX corresponds to 1.0.
+ */
+void apply_lut(const Half *src, std::uint16_t *dst, std::size_t n,
+               const std::uint16_t *lut) noexcept;
+
+/**
+ * @brief Truncate Half intermediates to 16-bit code values, clamped to
+ * [0, USHRT_MAX].
+ */
+void half_to_ushort(const Half *src, std::uint16_t *dst,
+                    std::size_t n) noexcept;
+
+/**
+ * @brief Apply a tone curve to a planar 3-channel image in parallel.
+ * This is the single application path shared by all tone mappers.
+ * @tparam T element type of the source image
+ * @param src source image, channel ch starting at src + ch * n
+ * @param dst destination image with the same layout. May be src when T is
+ * 16-bit.
+ * @param n number of pixels per channel
+ * @param curve tone curve to apply
+ */
+template <class T>
+void apply_tone_curve(const T *src, std::uint16_t *dst, const std::size_t n,
+                      const ToneCurve &curve) {
+  parallel_for(n, [&](std::size_t begin, std::size_t end, std::size_t) {
+    for (int ch = 0; ch < 3; ch++) {
+      apply_lut(src + ch * n + begin, dst + ch * n + begin, end - begin,
+                curve.lut(ch));
+    }
+  });
+}
+
+extern template void apply_tone_curve(const std::uint16_t *, std::uint16_t *,
+                                      std::size_t, const ToneCurve &);
+extern template void apply_tone_curve(const float *, std::uint16_t *,
+                                      std::size_t, const ToneCurve &);
+extern template void apply_tone_curve(const Half *, std::uint16_t *,
+                                      std::size_t, const ToneCurve &);
+
+} // namespace yk
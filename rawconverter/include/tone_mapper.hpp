@@ -0,0 +1,433 @@
+#pragma once
+
+#include "histogram.hpp"
+#include "image_stats.hpp"
+#include "tone_curve.hpp"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <functional>
+#include <map>
+#include <memory>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace yk {
+
+/**
+ * @brief Named scalar parameters passed to tone mapper factories.
+ */
+class ToneMapParams {
+public:
+  ToneMapParams() = default;
+  ToneMapParams(std::initializer_list<std::pair<const std::string, float>> l)
+      : values_(l) {}
+
+  ToneMapParams &set(const std::string &name, const float value) {
+    values_[name] = value;
+    return *this;
+  }
+  float get(const std::string &name, const float default_value) const {
+    auto it = values_.find(name);
+    return it == values_.end() ? default_value : it->second;
+  }
+
+private:
+  std::map<std::string, float> values_;
+};
+
+/**
+ * @class ToneMapper
+ * @brief Strategy interface for global brightness and contrast adjustment.
+ * A tone mapper only computes statistics of the image and emits a tone
+ * curve. Applying the curve is left to apply_tone_curve(), so every
+ * strategy shares the same optimised application path.
+ * Every strategy can build its curve from a 65536-bin histogram alone, e.g.
+ * the luminance histogram emitted by color_transform(). By default the
+ * image-based entry point uses the histogram of the green channel.
+ */
+class ToneMapper {
+public:
+  virtual ~ToneMapper() = default;
+
+  /**
+   * @brief Build the tone curve for an image.
+   * @param image image data clipped to [0, USHRT_MAX]
+   * @param debug stream receiving debug messages. nullptr disables them.
+   * @return tone curve to apply to the image
+   */
+  virtual ToneCurve build_curve(const ImageView &image,
+                                std::ostream *debug = nullptr) const {
+    return build_curve_from_histogram(
+        compute_histogram(image.channel(1), image.size), debug);
+  }
+
+  /**
+   * @brief Build the tone curve from a histogram of the reference signal
+   * (green or luminance).
+   * @param histogram histogram with ToneCurve::lut_size bins
+   * @param debug stream receiving debug messages. nullptr disables them.
+   * @return tone curve to apply to the image
+   */
+  virtual ToneCurve
+  build_curve_from_histogram(const Histogram &histogram,
+                             std::ostream *debug = nullptr) const = 0;
+};
+
+namespace detail {
+/**
+ * @brief Histogram with interval 8 (8192 bins).
+ */
+inline std::vector<long long> coarse_histogram(const Histogram &fine) {
+  std::vector<long long> histogram(1 << 13, 0);
+  for (std::size_t v = 0; v < fine.size(); v++) {
+    histogram[v >> 3] += fine[v];
+  }
+  return histogram;
+}
+
+/**
+ * @brief Lowest and highest coarse-histogram values such that acc_thresh
+ * pixels lie outside the range on each side.
+ */
+inline std::pair<int, int>
+histogram_bounds(const std::vector<long long> &histogram,
+                 const long long acc_thresh, std::ostream *debug) {
+  int lower = 0, upper = 0;
+  {
+    int bin = 0;
+    long long acc = 0;
+    while (acc < acc_thresh && bin < static_cast<int>(histogram.size())) {
+      acc += histogram[bin];
+      bin++;
+    }
+    if (debug) {
+      *debug << "min bin: " << bin << "\n";
+    }
+    lower = bin << 3;
+  }
+  {
+    int bin = histogram.size() - 1;
+    long long acc = 0;
+    while (acc < acc_thresh && 0 < bin) {
+      acc += histogram[bin];
+      bin--;
+    }
+    if (debug) {
+      *debug << "max bin: " << bin << "\n";
+    }
+    upper = bin << 3;
+  }
+  return {lower, upper};
+}
+} // namespace detail
+
+/**
+ * @brief Histogram stretching.
+ * min-point and max-point are determined to be the top and bottom
+ * stretch_rate/2 of the green histogram (interval 8) and [min-point,
+ * max-point] is linearly mapped to [0, USHRT_MAX].
+ */
+class HistogramStretch : public ToneMapper {
+public:
+  explicit HistogramStretch(const float stretch_rate = 0.4)
+      : stretch_rate(stretch_rate) {}
+
+  ToneCurve
+  build_curve_from_histogram(const Histogram &histogram,
+                             std::ostream *debug = nullptr) const override {
+    float min_value = 0, max_value = 0;
+    if (stretch_rate < 0.999999f) {
+      const long long acc_thresh =
+          histogram_total(histogram) * stretch_rate * 0.5f;
+      if (debug) {
+        *debug << "acc_thresh: " << acc_thresh << "\n";
+      }
+      auto [lower, upper] = detail::histogram_bounds(
+          detail::coarse_histogram(histogram), acc_thresh, debug);
+      min_value = lower;
+      max_value = upper;
+    }
+    // scaling: min_value -> 0, max_value -> USHRT_MAX
+    if (debug) {
+      *debug << "max value: " << max_value << "\n";
+      *debug << "min value: " << min_value << "\n";
+    }
+    const float alpha =
+        (max_value - min_value) < 0.00001
+            ? 0
+            : static_cast<float>(USHRT_MAX) / (max_value - min_value);
+    const float beta = -min_value * alpha;
+    if (debug) {
+      *debug << "alpha: " << std::to_string(alpha) << "\n";
+      *debug << "beta: " << std::to_string(beta) << "\n";
+    }
+    return ToneCurve::from_function(
+        [=](int v) { return static_cast<float>(v) * alpha + beta; });
+  }
+
+  float stretch_rate;
+};
+
+/**
+ * @brief Histogram stretching with linear segments at both edges.
+ * The bottom and top edge_acc_rate of the green histogram are mapped to
+ * [0, edge_val_rate] and [1 - edge_val_rate, 1] of the output range.
+ */
+class PiecewiseStretch : public ToneMapper {
+public:
+  explicit PiecewiseStretch(const float edge_acc_rate = 0.01,
+                            const float edge_val_rate = 0.001)
+      : edge_acc_rate(edge_acc_rate), edge_val_rate(edge_val_rate) {}
+
+  ToneCurve
+  build_curve_from_histogram(const Histogram &histogram,
+                             std::ostream *debug = nullptr) const override {
+    const long long acc_thresh = histogram_total(histogram) * edge_acc_rate;
+    if (debug) {
+      *debug << "acc_thresh: " << acc_thresh << "\n";
+    }
+    auto [lower_bound, upper_bound] = detail::histogram_bounds(
+        detail::coarse_histogram(histogram), acc_thresh, debug);
+
+    const float mapped_lower_bound =
+        static_cast<std::uint16_t>(USHRT_MAX * edge_val_rate);
+    const float mapped_upper_bound = USHRT_MAX - mapped_lower_bound;
+
+    const float lower_edge_slope =
+        0 < lower_bound ? mapped_lower_bound / float(lower_bound) : 0.f;
+    const float upper_edge_slope =
+        upper_bound < USHRT_MAX ? float(USHRT_MAX - mapped_lower_bound) /
+                                      float(USHRT_MAX - upper_bound)
+                                : 0.f;
+    const float mid_slope =
+        lower_bound < upper_bound ? (mapped_upper_bound - mapped_lower_bound) /
+                                        float(upper_bound - lower_bound)
+                                  : 0.f;
+    if (debug) {
+      *debug << "lower bound: " << lower_bound << "\n";
+      *debug << "mapped lower bound: " << mapped_lower_bound << "\n";
+      *debug << "upper bound: " << upper_bound << "\n";
+      *debug << "mapped bound: " << mapped_upper_bound << "\n";
+      *debug << "lower edge slope: " << lower_edge_slope << "\n";
+      *debug << "upper edge slope: " << upper_edge_slope << "\n";
+      *debug << "mid slope: " << mid_slope << "\n";
+    }
+    const int lower = lower_bound, upper = upper_bound;
+    return ToneCurve::from_function([=](int v) {
+      if (v < lower) {
+        return v * lower_edge_slope;
+      } else if (upper < v) {
+        return (v - upper) * upper_edge_slope + mapped_upper_bound;
+      }
+      return (v - lower) * mid_slope + mapped_lower_bound;
+    });
+  }
+
+  float edge_acc_rate;
+  float edge_val_rate;
+};
+
+/**
+ * @brief Histogram equalisation of the green channel applied to all
+ * channels.
+ */
+class HistogramEqualization : public ToneMapper {
+public:
+  ToneCurve
+  build_curve_from_histogram(const Histogram &histogram,
+                             std::ostream *debug = nullptr) const override {
+    if (debug) {
+      *debug << "total: " << histogram_total(histogram) << "\n";
+    }
+    return equalization_curve(histogram);
+  }
+};
+
+/**
+ * @brief Normalise the green mean and standard deviation to
+ * mean_rate * USHRT_MAX and (stddev_rate * USHRT_MAX - mean) / 3.
+ */
+class MeanStddevStretch : public ToneMapper {
+public:
+  explicit MeanStddevStretch(const float mean_rate = 0.5,
+                             const float stddev_rate = 0.96)
+      : mean_rate(mean_rate), stddev_rate(stddev_rate) {}
+
+  ToneCurve build_curve(const ImageView &image,
+                        std::ostream *debug = nullptr) const override {
+    return curve(compute_stats(image.channel(1), image.size), debug);
+  }
+
+  ToneCurve
+  build_curve_from_histogram(const Histogram &histogram,
+                             std::ostream *debug = nullptr) const override {
+    return curve(histogram_stats(histogram), debug);
+  }
+
+  float mean_rate;
+  float stddev_rate;
+
+private:
+  ToneCurve curve(const ChannelStats &stats, std::ostream *debug) const {
+    const double mean = stats.mean, stddev = stats.stddev();
+    const float mean_after = float(USHRT_MAX) * mean_rate;
+    const float stddev_after =
+        (float(USHRT_MAX) * stddev_rate - mean_after) / 3.f;
+    if (debug) {
+      *debug << "mean: " << mean << "\n";
+      *debug << "stddev: " << stddev << "\n";
+      *debug << "mean_after: " << mean_after << "\n";
+      *debug << "stddev_after: " << stddev_after << "\n";
+    }
+    const float m = mean, s = std::max(stddev, 1e-6);
+    return ToneCurve::from_function(
+        [=](int v) { return (v - m) / s * stddev_after + mean_after; });
+  }
+};
+
+/**
+ * @brief Scale values so that the green standard deviation becomes
+ * stddev_rate * USHRT_MAX / 3.
+ */
+class StddevScale : public ToneMapper {
+public:
+  explicit StddevScale(const float stddev_rate = 0.96)
+      : stddev_rate(stddev_rate) {}
+
+  ToneCurve build_curve(const ImageView &image,
+                        std::ostream *debug = nullptr) const override {
+    return curve(compute_stats(image.channel(1), image.size), debug);
+  }
+
+  ToneCurve
+  build_curve_from_histogram(const Histogram &histogram,
+                             std::ostream *debug = nullptr) const override {
+    return curve(histogram_stats(histogram), debug);
+  }
+
+  float stddev_rate;
+
+private:
+  ToneCurve curve(const ChannelStats &stats, std::ostream *debug) const {
+    const float stddev = stats.stddev();
+    const float stddev_after = (float(USHRT_MAX) * stddev_rate) / 3.f;
+    if (debug) {
+      *debug << "stddev: " << stddev << "\n";
+      *debug << "stddev_after: " << stddev_after << "\n";
+    }
+    const float s = std::max(stddev, 1e-6f);
+    return ToneCurve::from_function(
+        [=](int v) { return v / s * stddev_after; });
+  }
+};
+
+/**
+ * @brief Map [min, max] of all channels (or of the histogram) linearly to
+ * [0, USHRT_MAX].
+ */
+class MinMaxStretch : public ToneMapper {
+public:
+  ToneCurve build_curve(const ImageView &image,
+                        std::ostream *debug = nullptr) const override {
+    return curve(compute_image_stats(image).pooled(), debug);
+  }
+
+  ToneCurve
+  build_curve_from_histogram(const Histogram &histogram,
+                             std::ostream *debug = nullptr) const override {
+    return curve(histogram_stats(histogram), debug);
+  }
+
+private:
+  ToneCurve curve(const ChannelStats &stats, std::ostream *debug) const {
+    const float minv = stats.count ? stats.min : 0;
+    const float maxv = stats.count ? stats.max : 0;
+    const float scale =
+        float(USHRT_MAX) / std::clamp<float>(maxv - minv, 0.00000001, USHRT_MAX);
+    if (debug) {
+      *debug << "min: " << minv << "\n";
+      *debug << "max: " << maxv << "\n";
+    }
+    return ToneCurve::from_function(
+        [=](int v) { return (v - minv) * scale; });
+  }
+};
+
+/**
+ * @class ToneMapperRegistry
+ * @brief Registry of tone mapping strategies by name.
+ * Built-in strategies: "stretch", "piecewise", "equalize", "mean_stddev",
+ * "stddev" and "minmax". New strategies are made available to all drivers
+ * by registering a factory.
+ */
+class ToneMapperRegistry {
+public:
+  using Factory =
+      std::function<std::unique_ptr<ToneMapper>(const ToneMapParams &)>;
+
+  static ToneMapperRegistry &instance() {
+    static ToneMapperRegistry registry;
+    return registry;
+  }
+
+  void add(const std::string &name, Factory factory) {
+    factories_[name] = std::move(factory);
+  }
+
+  bool contains(const std::string &name) const {
+    return factories_.count(name) != 0;
+  }
+
+  /**
+   * @brief Create a registered tone mapper.
+   * @throw std::invalid_argument if no strategy is registered as name
+   */
+  std::unique_ptr<ToneMapper> create(const std::string &name,
+                                     const ToneMapParams &params = {}) const {
+    auto it = factories_.find(name);
+    if (it == factories_.end()) {
+      throw std::invalid_argument("Unknown tone mapper: " + name);
+    }
+    return it->second(params);
+  }
+
+  std::vector<std::string> names() const {
+    std::vector<std::string> res;
+    for (auto &kv : factories_) {
+      res.push_back(kv.first);
+    }
+    return res;
+  }
+
+private:
+  ToneMapperRegistry() {
+    add("stretch", [](const ToneMapParams &p) {
+      return std::make_unique<HistogramStretch>(p.get("stretch_rate", 0.4));
+    });
+    add("piecewise", [](const ToneMapParams &p) {
+      return std::make_unique<PiecewiseStretch>(p.get("edge_acc_rate", 0.01),
+                                                p.get("edge_val_rate", 0.001));
+    });
+    add("equalize", [](const ToneMapParams &) {
+      return std::make_unique<HistogramEqualization>();
+    });
+    add("mean_stddev", [](const ToneMapParams &p) {
+      return std::make_unique<MeanStddevStretch>(p.get("mean_rate", 0.5),
+                                                 p.get("stddev_rate", 0.96));
+    });
+    add("stddev", [](const ToneMapParams &p) {
+      return std::make_unique<StddevScale>(p.get("stddev_rate", 0.96));
+    });
+    add("minmax", [](const ToneMapParams &) {
+      return std::make_unique<MinMaxStretch>();
+    });
+  }
+
+  std::map<std::string, Factory> factories_;
+};
+
+} // namespace yk
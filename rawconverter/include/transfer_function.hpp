@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace yk {
+
+/**
+ * @brief Opto-electronic transfer functions of the scene-linear output path.
+ */
+enum class TransferFunction {
+  // Scene-linear values are passed through.
+  linear,
+  // IEC 61966-2-1 sRGB.
+  sRGB,
+  // ITU-R BT.709 camera OETF, also used by BT.2020.
+  rec709,
+  // ROMM RGB (ProPhoto) gamma 1.8 with a linear segment near black.
+  prophoto,
+  // SMPTE ST 2084 perceptual quantizer (absolute, 10000 nits at 1.0).
+  pq,
+  // ITU-R BT.2100 hybrid log-gamma OETF.
+  hlg
+};
+
+/**
+ * @brief Luminance in nits of scene-linear 1.0 (diffuse white) in PQ
+ * outputs, after ITU-R BT.2408.
+ */
+constexpr float pq_reference_white = 203.f;
+
+/**
+ * @brief Scene light of diffuse white in HLG outputs. It is encoded at 75%
+ * signal, after ITU-R BT.2408.
+ */
+constexpr float hlg_reference_white = 0.26496256f;
+
+/**
+ * @brief Bound of the absolute difference between transfer_encode() and
+ * transfer_reference() for inputs in [-64, 64] (scene-linear 1.0 = diffuse
+ * white), in units of the encoded signal; a 12-bit code is 2.4e-4. PQ comes
+ * closest because its exponent of 78.8 amplifies float rounding.
+ */
+constexpr float transfer_max_error = 2e-5f;
+
+/**
+ * @brief Parse a transfer function name: linear, srgb, rec709, prophoto, pq
+ * or hlg.
+ * @throw std::invalid_argument for other names
+ */
+TransferFunction parse_transfer_function(const std::string &name);
+
+/**
+ * @brief Name of a transfer function as accepted by
+ * parse_transfer_function().
+ */
+const char *to_string(TransferFunction tf) noexcept;
+
+/**
+ * @brief Reference encoding of one scene-linear value in double precision
+ * with std::pow and std::log.
+ * sRGB, Rec.709 and ProPhoto are extended to negative values by symmetry
+ * and continue above 1.0, so nothing is clipped. PQ maps 1.0 to
+ * pq_reference_white nits and clips at 10000 nits; HLG maps 1.0 to
+ * hlg_reference_white and continues its log segment above the nominal
+ * peak. PQ and HLG encode negative values as black.
+ */
+double transfer_reference(TransferFunction tf, double x) noexcept;
+
+/**
+ * @brief Encode n scene-linear values. Powers and logarithms are evaluated
+ * with polynomial approximations of log2 and exp2 in branch-free loops that
+ * the compiler vectorises; the error against transfer_reference() is below
+ * transfer_max_error.
+ * @param tf transfer function
+ * @param src scene-linear values
+ * @param dst encoded values. May be src.
+ * @param n number of values
+ * @param scale factor applied to the input first, e.g. exposure divided by
+ * the code value of white
+ */
+void transfer_encode(TransferFunction tf, const float *src, float *dst,
+                     std::size_t n, float scale = 1.f) noexcept;
+
+/**
+ * @brief transfer_encode() over a planar 3-channel image in parallel.
+ * @param n number of pixels per channel
+ */
+void apply_transfer(TransferFunction tf, const float *src, float *dst,
+                    std::size_t n, float scale = 1.f);
+
+} // namespace yk
@@ -0,0 +1,250 @@
+#include "autotune.hpp"
+#include "color_transform.hpp"
+#include "logging.hpp"
+#include "parallel.hpp"
+#include "tone_curve.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <thread>
+#ifdef __unix__
+#include <unistd.h>
+#endif
+
+namespace yk {
+
+namespace {
+constexpr int profile_version = 1;
+
+// A candidate must beat the current choice by this factor to replace it.
+constexpr double min_gain = 0.97;
+
+std::size_t hardware_threads() noexcept {
+  return std::max<std::size_t>(1, std::thread::hardware_concurrency());
+}
+
+std::vector<std::size_t> default_thread_candidates() {
+  const std::size_t hw = hardware_threads();
+  std::vector<std::size_t> res;
+  for (std::size_t t = 1; t < hw; t *= 2) {
+    res.push_back(t);
+  }
+  res.push_back(hw);
+  return res;
+}
+
+// Synthetic frame and tone curve of the calibration workload.
+struct Workload {
+  std::vector<std::uint16_t> src;
+  std::vector<std::uint16_t> dst;
+  std::size_t n;
+  Matrix3 m = {
+      {{1.6f, -0.4f, -0.2f}, {-0.2f, 1.4f, -0.2f}, {0.f, -0.5f, 1.5f}}};
+  ToneCurve curve = ToneCurve::from_function(
+      [](int v) { return 65535.f * std::sqrt(v / 65535.f); });
+  Histogram luminance;
+
+  explicit Workload(const std::size_t pixels)
+      : src(3 * pixels), dst(3 * pixels), n(pixels) {
+    std::uint32_t x = 1;
+    for (auto &v : src) {
+      x = x * 1664525u + 1013904223u;
+      v = x >> 16;
+    }
+  }
+
+  double best_ms(const std::size_t repeat) {
+    double res = std::numeric_limits<double>::max();
+    for (std::size_t r = 0; r < std::max<std::size_t>(1, repeat); r++) {
+      const auto start = std::chrono::steady_clock::now();
+      color_transform(src.data(), dst.data(), n, m, &luminance);
+      apply_tone_curve(dst.data(), dst.data(), n, curve);
+      res = std::min(res, std::chrono::duration<double, std::milli>(
+                              std::chrono::steady_clock::now() - start)
+                              .count());
+    }
+    return res;
+  }
+};
+
+// Try each candidate through set and keep the fastest.
+template <class Set>
+std::size_t tune(Workload &w, const std::size_t repeat,
+                 const std::vector<std::size_t> &candidates, Set &&set,
+                 const char *name) {
+  std::size_t best = 0;
+  double best_ms = std::numeric_limits<double>::max();
+  for (const std::size_t c : candidates) {
+    set(c);
+    const double ms = w.best_ms(repeat);
+    YK_LOG_DEBUG("calibrate " << name << "=" << c << ": " << ms << " ms");
+    if (ms < best_ms * min_gain) {
+      best = c;
+      best_ms = ms;
+    }
+  }
+  set(best);
+  return best;
+}
+} // namespace
+
+std::string host_name() {
+#ifdef __unix__
+  char name[256] = {};
+  if (gethostname(name, sizeof(name) - 1) == 0 && name[0]) {
+    return name;
+  }
+#endif
+  if (const char *name = std::getenv("COMPUTERNAME")) {
+    return name;
+  }
+  return "unknown";
+}
+
+std::string default_profile_path() {
+  if (const char *path = std::getenv("RAWCONVERTER_TUNING_PROFILE")) {
+    return path;
+  }
+  std::filesystem::path dir;
+  if (const char *cache = std::getenv("XDG_CACHE_HOME")) {
+    dir = cache;
+  } else if (const char *home = std::getenv("HOME")) {
+    dir = std::filesystem::path(home) / ".cache";
+  }
+  return (dir / "rawconverter" / ("tuning-" + host_name() + ".conf"))
+      .string();
+}
+
+TuningProfile current_profile() {
+  TuningProfile res;
+  res.host = host_name();
+  res.hardware_threads = hardware_threads();
+  res.threads = num_threads();
+  res.grain_size = grain_size();
+  res.color_block = color_block();
+  return res;
+}
+
+void apply_profile(const TuningProfile &profile) noexcept {
+  set_num_threads(profile.threads);
+  set_grain_size(profile.grain_size);
+  set_color_block(profile.color_block);
+}
+
+TuningProfile calibrate(const CalibrationParams &params) {
+  const TuningProfile saved = current_profile();
+  Workload w(std::max<std::size_t>(1, params.pixels));
+  auto or_default = [](const std::vector<std::size_t> &v,
+                       std::vector<std::size_t> fallback) {
+    return v.empty() ? fallback : v;
+  };
+  TuningProfile res = saved;
+  try {
+    w.best_ms(1); // warm up caches and page in the buffers
+    res.threads = tune(w, params.repeat,
+                       or_default(params.threads, default_thread_candidates()),
+                       set_num_threads, "threads");
+    res.grain_size =
+        tune(w, params.repeat,
+             or_default(params.grain_sizes,
+                        {1 << 14, 1 << 15, 1 << 16, 1 << 17, 1 << 18}),
+             set_grain_size, "grain_size");
+    res.color_block = tune(
+        w, params.repeat,
+        or_default(params.color_blocks, {512, 1024, 2048, 4096, 8192}),
+        set_color_block, "color_block");
+  } catch (...) {
+    apply_profile(saved);
+    throw;
+  }
+  // Report the values in effect, e.g. after clamping of the block size.
+  res.color_block = color_block();
+  apply_profile(saved);
+  return res;
+}
+
+bool load_profile(const std::string &path, TuningProfile &profile) {
+  std::ifstream is(path);
+  if (!is) {
+    return false;
+  }
+  TuningProfile res;
+  int version = 0;
+  std::string line;
+  while (std::getline(is, line)) {
+    const auto eq = line.find('=');
+    if (line.empty() || line[0] == '#' || eq == std::string::npos) {
+      continue;
+    }
+    const std::string key = line.substr(0, eq), value = line.substr(eq + 1);
+    try {
+      if (key == "version") {
+        version = std::stoi(value);
+      } else if (key == "host") {
+        res.host = value;
+      } else if (key == "hardware_threads") {
+        res.hardware_threads = std::stoul(value);
+      } else if (key == "threads") {
+        res.threads = std::stoul(value);
+      } else if (key == "grain_size") {
+        res.grain_size = std::stoul(value);
+      } else if (key == "color_block") {
+        res.color_block = std::stoul(value);
+      }
+    } catch (const std::exception &) {
+      return false;
+    }
+  }
+  if (version != profile_version) {
+    return false;
+  }
+  profile = res;
+  return true;
+}
+
+void save_profile(const std::string &path, const TuningProfile &profile) {
+  const std::filesystem::path p(path);
+  std::error_code ec;
+  if (p.has_parent_path()) {
+    std::filesystem::create_directories(p.parent_path(), ec);
+  }
+  std::ofstream os(path);
+  os << "# Kernel parameters of the raw converter, written by autotune().\n"
+     << "version=" << profile_version << "\n"
+     << "host=" << profile.host << "\n"
+     << "hardware_threads=" << profile.hardware_threads << "\n"
+     << "threads=" << profile.threads << "\n"
+     << "grain_size=" << profile.grain_size << "\n"
+     << "color_block=" << profile.color_block << "\n";
+  if (!os) {
+    throw std::runtime_error("Cannot write tuning profile: " + path);
+  }
+}
+
+TuningProfile autotune(const std::string &path, const bool recalibrate,
+                       const CalibrationParams &params) {
+  TuningProfile profile;
+  if (!recalibrate && load_profile(path, profile) &&
+      profile.host == host_name() &&
+      profile.hardware_threads == hardware_threads()) {
+    YK_LOG_DEBUG("Loaded tuning profile " << path);
+  } else {
+    YK_LOG_INFO("Calibrating kernel parameters of " << host_name());
+    profile = calibrate(params);
+    try {
+      save_profile(path, profile);
+    } catch (const std::exception &e) {
+      YK_LOG_WARNING(e.what());
+    }
+  }
+  apply_profile(profile);
+  return profile;
+}
+
+} // namespace yk
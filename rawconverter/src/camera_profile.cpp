@@ -0,0 +1,422 @@
+#include "camera_profile.hpp"
+#include "parallel.hpp"
+#include "tone_curve.hpp"
+#include "transfer_function.hpp"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <type_traits>
+
+namespace yk {
+
+namespace {
+// Read the dimensions, data and encoding tags of one table.
+bool read_table(const TiffReader &tiff, const std::uint16_t dims_tag,
+                const std::uint16_t data_tag,
+                const std::uint16_t encoding_tag, HueSatMap &map) {
+  const TiffEntry *dims = tiff.find(dims_tag);
+  const TiffEntry *data = tiff.find(data_tag);
+  if (!dims || !data) {
+    return false;
+  }
+  if (dims->count < 2) {
+    throw std::runtime_error("Invalid camera profile table dimensions");
+  }
+  map.hues = static_cast<std::uint32_t>(dims->number(0));
+  map.sats = static_cast<std::uint32_t>(dims->number(1));
+  map.vals = dims->count > 2 ? static_cast<std::uint32_t>(dims->number(2)) : 1;
+  // Divided out rather than multiplied, so huge dimensions cannot overflow.
+  std::size_t rest = data->count;
+  bool valid = map.hues && map.sats && map.vals && rest % 3 == 0;
+  for (const std::uint32_t d : {3u, map.hues, map.sats}) {
+    valid = valid && rest % d == 0;
+    rest = valid ? rest / d : 0;
+  }
+  if (!valid || rest != map.vals) {
+    throw std::runtime_error("Camera profile table does not match its "
+                             "dimensions");
+  }
+  const auto values = data->numbers();
+  map.data.assign(values.begin(), values.end());
+  const TiffEntry *encoding = tiff.find(encoding_tag);
+  map.srgb_gamma = encoding && encoding->number() == 1;
+  return true;
+}
+
+// sRGB decoding of [0, 1] at decode_size + 1 points, for the value axis of
+// sRGB-encoded tables.
+constexpr std::size_t decode_size = 4096;
+
+const std::vector<float> &srgb_decode_table() {
+  static const std::vector<float> table = [] {
+    std::vector<float> res(decode_size + 1);
+    for (std::size_t i = 0; i <= decode_size; i++) {
+      const double x = double(i) / decode_size;
+      res[i] = static_cast<float>(
+          x <= 0.04045 ? x / 12.92 : std::pow((x + 0.055) / 1.055, 2.4));
+    }
+    return res;
+  }();
+  return table;
+}
+
+inline float srgb_decode(const float *table, const float x) noexcept {
+  const float t = std::min(std::max(0.f, x), 1.f) * decode_size;
+  const std::size_t i = std::min(static_cast<std::size_t>(t), decode_size - 1);
+  return table[i] + (table[i + 1] - table[i]) * (t - i);
+}
+
+// Look up h, s, v (v sRGB-encoded for such tables) in a prepared table and
+// apply the hue shift and the scales. v_scale receives the value scale.
+inline void lookup(const HueSatTable &table, float &h, float &s,
+                   const float v, float &v_scale) noexcept {
+  const std::uint32_t hues = table.hues, sats = table.sats;
+  const float hs = h * (hues * (1.f / 6.f));
+  const std::uint32_t h0 = std::min(static_cast<std::uint32_t>(hs), hues - 1);
+  const float fh = hs - h0;
+  const float ss = s * (sats - 1);
+  const std::uint32_t s0 = std::min(static_cast<std::uint32_t>(ss), sats - 1);
+  const float fs = ss - s0;
+  const float vs = std::min(std::max(0.f, v), 1.f) * (table.vals - 1);
+  const std::uint32_t v0 =
+      std::min(static_cast<std::uint32_t>(vs), table.vals - 1);
+  const float fv = vs - v0;
+
+  const std::size_t hue_step = sats, val_step = std::size_t(hues + 1) * sats;
+  const HueSatTable::Cell *c =
+      table.cells.data() + v0 * val_step + h0 * hue_step + s0;
+  const HueSatTable::Cell *cells[4] = {c, c + hue_step, c + val_step,
+                                       c + val_step + hue_step};
+  const float w[4] = {(1 - fh) * (1 - fv), fh * (1 - fv), (1 - fh) * fv,
+                      fh * fv};
+  float hue_shift = 0, sat_scale = 0, val_scale = 0;
+  for (int k = 0; k < 4; k++) {
+    hue_shift += w[k] * (cells[k]->hue_shift + cells[k]->d_hue_shift * fs);
+    sat_scale += w[k] * (cells[k]->sat_scale + cells[k]->d_sat_scale * fs);
+    val_scale += w[k] * (cells[k]->val_scale + cells[k]->d_val_scale * fs);
+  }
+  h += hue_shift;
+  h = h < 0 ? h + 6 : h >= 6 ? h - 6 : h;
+  s = std::min(s * sat_scale, 1.f);
+  v_scale = val_scale;
+}
+
+// Apply a table to a block of HSV values in place.
+void apply_table(const HueSatTable &table, float *h, float *s, float *v,
+                 float *scratch, const std::size_t len) {
+  if (table.srgb_gamma) {
+    transfer_encode(TransferFunction::sRGB, v, scratch, len);
+    const float *decode = srgb_decode_table().data();
+    for (std::size_t i = 0; i < len; i++) {
+      float scale;
+      lookup(table, h[i], s[i], scratch[i], scale);
+      v[i] = srgb_decode(decode, scratch[i] * scale);
+    }
+  } else {
+    for (std::size_t i = 0; i < len; i++) {
+      float scale;
+      lookup(table, h[i], s[i], v[i], scale);
+      v[i] = std::min(v[i] * scale, 1.f);
+    }
+  }
+}
+
+template <class Out> inline Out store_value(const float v) noexcept {
+  if constexpr (std::is_same_v<Out, std::uint16_t>) {
+    return ToneCurve::clamp_value(v);
+  } else {
+    return static_cast<Out>(v);
+  }
+}
+} // namespace
+
+bool read_camera_profile(const TiffReader &tiff, CameraProfile &profile) {
+  const std::uint16_t data_tags[2] = {profile_hue_sat_map_data1_tag,
+                                      profile_hue_sat_map_data2_tag};
+  for (int k = 0; k < 2; k++) {
+    read_table(tiff, profile_hue_sat_map_dims_tag, data_tags[k],
+               profile_hue_sat_map_encoding_tag, profile.hue_sat_maps[k]);
+  }
+  read_table(tiff, profile_look_table_dims_tag, profile_look_table_data_tag,
+             profile_look_table_encoding_tag, profile.look_table);
+  if (const TiffEntry *curve = tiff.find(profile_tone_curve_tag)) {
+    const auto values = curve->numbers();
+    profile.tone_curve.clear();
+    for (std::size_t i = 0; i + 1 < values.size(); i += 2) {
+      profile.tone_curve.push_back(
+          {static_cast<float>(values[i]), static_cast<float>(values[i + 1])});
+    }
+  }
+  return !profile.empty();
+}
+
+HueSatMap interpolate_hue_sat_map(const CameraProfile &profile,
+                                  const float weight) {
+  const HueSatMap &a = profile.hue_sat_maps[0], &b = profile.hue_sat_maps[1];
+  if (a.empty() || b.empty()) {
+    return a.empty() ? b : a;
+  }
+  if (a.hues != b.hues || a.sats != b.sats || a.vals != b.vals) {
+    throw std::invalid_argument("HueSatMaps differ in size");
+  }
+  HueSatMap res = b;
+  for (std::size_t i = 0; i < res.data.size(); i++) {
+    res.data[i] = weight * a.data[i] + (1 - weight) * b.data[i];
+  }
+  return res;
+}
+
+HueSatTable HueSatTable::prepare(const HueSatMap &map) {
+  HueSatTable res;
+  if (map.empty()) {
+    return res;
+  }
+  res.hues = map.hues;
+  res.sats = map.sats;
+  res.vals = map.vals;
+  res.srgb_gamma = map.srgb_gamma;
+  const std::size_t sats = map.sats;
+  res.cells.resize(std::size_t(map.vals + 1) * (map.hues + 1) * sats);
+  auto entry = [&](std::uint32_t v, std::uint32_t h, std::uint32_t s) {
+    return map.data.data() + 3 * ((std::size_t(v) * map.hues + h) * sats + s);
+  };
+  for (std::uint32_t v = 0; v <= map.vals; v++) {
+    for (std::uint32_t h = 0; h <= map.hues; h++) {
+      for (std::uint32_t s = 0; s < map.sats; s++) {
+        const std::uint32_t mv = std::min(v, map.vals - 1);
+        const std::uint32_t mh = h % map.hues;
+        const float *e = entry(mv, mh, s);
+        const float *next = entry(mv, mh, std::min(s + 1, map.sats - 1));
+        Cell &c = res.cells[(std::size_t(v) * (map.hues + 1) + h) * sats + s];
+        c.hue_shift = e[0] * (6.f / 360.f);
+        c.sat_scale = e[1];
+        c.val_scale = e[2];
+        c.d_hue_shift = (next[0] - e[0]) * (6.f / 360.f);
+        c.d_sat_scale = next[1] - e[1];
+        c.d_val_scale = next[2] - e[2];
+        c.pad[0] = c.pad[1] = 0.f;
+      }
+    }
+  }
+  return res;
+}
+
+ProfileTables ProfileTables::prepare(const CameraProfile &profile,
+                                     const float weight) {
+  ProfileTables res;
+  res.hue_sat = HueSatTable::prepare(interpolate_hue_sat_map(profile, weight));
+  res.look = HueSatTable::prepare(profile.look_table);
+  if (!profile.tone_curve.empty()) {
+    res.tone = sample_tone_curve(profile.tone_curve, ToneCurve::lut_size);
+  }
+  return res;
+}
+
+std::vector<float>
+sample_tone_curve(const std::vector<std::array<float, 2>> &points,
+                  const std::size_t n) {
+  const std::size_t m = points.size();
+  if (m < 2 || n < 2) {
+    throw std::invalid_argument("A tone curve needs two points");
+  }
+  for (std::size_t i = 1; i < m; i++) {
+    if (!(points[i - 1][0] < points[i][0])) {
+      throw std::invalid_argument("Tone curve inputs must increase");
+    }
+  }
+  // Second derivatives of the natural spline by the tridiagonal algorithm.
+  std::vector<double> d2(m, 0.), c(m, 0.);
+  for (std::size_t i = 1; i + 1 < m; i++) {
+    const double h0 = points[i][0] - points[i - 1][0];
+    const double h1 = points[i + 1][0] - points[i][0];
+    const double rhs = 6 * ((points[i + 1][1] - points[i][1]) / h1 -
+                            (points[i][1] - points[i - 1][1]) / h0);
+    const double diag = 2 * (h0 + h1) - h0 * c[i - 1];
+    c[i] = h1 / diag;
+    d2[i] = (rhs - h0 * d2[i - 1]) / diag;
+  }
+  for (std::size_t i = m - 2; 0 < i; i--) {
+    d2[i] -= c[i] * d2[i + 1];
+  }
+
+  std::vector<float> res(n);
+  std::size_t k = 0;
+  for (std::size_t i = 0; i < n; i++) {
+    const double x = double(i) / (n - 1);
+    while (k + 2 < m && points[k + 1][0] < x) {
+      k++;
+    }
+    const double x0 = points[k][0], x1 = points[k + 1][0], h = x1 - x0;
+    double y;
+    if (x <= x0) {
+      y = points[k][1];
+    } else if (x >= x1) {
+      y = points[k + 1][1];
+    } else {
+      const double a = (x1 - x) / h, b = (x - x0) / h;
+      y = a * points[k][1] + b * points[k + 1][1] +
+          ((a * a * a - a) * d2[k] + (b * b * b - b) * d2[k + 1]) * h * h / 6;
+    }
+    res[i] = static_cast<float>(std::clamp(y, 0., 1.));
+  }
+  return res;
+}
+
+template <class In, class Out>
+void profile_transform(const In *src, Out *dst, const std::size_t n,
+                       const Matrix3 &pcs_from_camera,
+                       const Matrix3 &rgb_from_pcs,
+                       const ProfileTables &tables, Histogram *luminance,
+                       const std::array<float, 3> &weights) {
+  constexpr float white = USHRT_MAX;
+  // Luminance weights of the output folded into the last matrix.
+  std::array<float, 3> y{};
+  for (int j = 0; j < 3; j++) {
+    for (int k = 0; k < 3; k++) {
+      y[j] += weights[k] * rgb_from_pcs[k][j] * white;
+    }
+  }
+  constexpr std::size_t bins = ToneCurve::lut_size;
+  const std::size_t grain = grain_size();
+  const std::size_t chunks = parallel_chunks(n, grain);
+  const std::size_t block = color_block();
+  std::vector<std::uint32_t> sub(luminance ? chunks * bins : 0, 0);
+  const bool has_tables = !tables.hue_sat.empty() || !tables.look.empty();
+  const float *tone = tables.tone.empty() ? nullptr : tables.tone.data();
+  constexpr float tone_scale = ToneCurve::lut_size - 1;
+
+  parallel_for(
+      n,
+      [&](std::size_t begin, std::size_t end, std::size_t c) {
+        std::vector<float> scratch(7 * block);
+        float *rgb[3] = {scratch.data(), scratch.data() + block,
+                         scratch.data() + 2 * block};
+        float *hh = scratch.data() + 3 * block, *ss = hh + block,
+              *vv = ss + block, *tmp = vv + block;
+        std::vector<std::uint16_t> yq(block);
+        std::uint32_t *hist = luminance ? sub.data() + c * bins : nullptr;
+        for (std::size_t b0 = begin; b0 < end; b0 += block) {
+          const std::size_t len = std::min(block, end - b0);
+          const In *r = src + b0, *g = src + n + b0, *b = src + 2 * n + b0;
+          // Camera to linear ProPhoto RGB in [0, 1].
+          for (int ch = 0; ch < 3; ch++) {
+            const float m0 = pcs_from_camera[ch][0] / white,
+                        m1 = pcs_from_camera[ch][1] / white,
+                        m2 = pcs_from_camera[ch][2] / white;
+            float *out = rgb[ch];
+            for (std::size_t i = 0; i < len; i++) {
+              const float v = m0 * r[i] + m1 * g[i] + m2 * b[i];
+              out[i] = std::min(std::max(0.f, v), 1.f);
+            }
+          }
+          float *pr = rgb[0], *pg = rgb[1], *pb = rgb[2];
+
+          if (has_tables) {
+            // RGB to HSV with hue in [0, 6), as the DNG SDK does.
+            for (std::size_t i = 0; i < len; i++) {
+              const float mx = std::max(pr[i], std::max(pg[i], pb[i]));
+              const float mn = std::min(pr[i], std::min(pg[i], pb[i]));
+              const float gap = mx - mn;
+              const float inv = 0.f < gap ? 1.f / gap : 0.f;
+              float h = pr[i] == mx   ? (pg[i] - pb[i]) * inv
+                        : pg[i] == mx ? 2 + (pb[i] - pr[i]) * inv
+                                      : 4 + (pr[i] - pg[i]) * inv;
+              h = h < 0 ? h + 6 : h;
+              hh[i] = 0.f < gap ? h : 0.f;
+              ss[i] = 0.f < mx ? gap / mx : 0.f;
+              vv[i] = mx;
+            }
+            // HueSatMap and then LookTable; the RGB round trip between
+            // them is the identity within [0, 1] and is skipped.
+            if (!tables.hue_sat.empty()) {
+              apply_table(tables.hue_sat, hh, ss, vv, tmp, len);
+            }
+            if (!tables.look.empty()) {
+              apply_table(tables.look, hh, ss, vv, tmp, len);
+            }
+            // HSV to RGB: c = v - v * s * clamp(min(k, 4 - k), 0, 1) with
+            // k = (offset + h) mod 6.
+            for (std::size_t i = 0; i < len; i++) {
+              const float vs = vv[i] * ss[i];
+              auto channel = [&](const float offset) {
+                float k = offset + hh[i];
+                k = k >= 6 ? k - 6 : k;
+                return vv[i] -
+                       vs * std::min(std::max(0.f, std::min(k, 4 - k)), 1.f);
+              };
+              pr[i] = channel(5);
+              pg[i] = channel(3);
+              pb[i] = channel(1);
+            }
+          }
+
+          if (tone) {
+            // Hue-preserving RGB tone: the curve is applied to the largest
+            // and smallest channel and the middle one keeps its relative
+            // position between them.
+            for (std::size_t i = 0; i < len; i++) {
+              const float mx = std::max(pr[i], std::max(pg[i], pb[i]));
+              const float mn = std::min(pr[i], std::min(pg[i], pb[i]));
+              const float tmx =
+                  tone[static_cast<std::uint32_t>(mx * tone_scale + 0.5f)];
+              const float tmn =
+                  tone[static_cast<std::uint32_t>(mn * tone_scale + 0.5f)];
+              const float k = mn < mx ? (tmx - tmn) / (mx - mn) : 0.f;
+              pr[i] = tmn + (pr[i] - mn) * k;
+              pg[i] = tmn + (pg[i] - mn) * k;
+              pb[i] = tmn + (pb[i] - mn) * k;
+            }
+          }
+
+          // ProPhoto to the output color space at 16-bit white.
+          for (int ch = 0; ch < 3; ch++) {
+            const float m0 = rgb_from_pcs[ch][0] * white,
+                        m1 = rgb_from_pcs[ch][1] * white,
+                        m2 = rgb_from_pcs[ch][2] * white;
+            Out *out = dst + ch * n + b0;
+            for (std::size_t i = 0; i < len; i++) {
+              out[i] = store_value<Out>(m0 * pr[i] + m1 * pg[i] + m2 * pb[i]);
+            }
+          }
+          if (hist) {
+            for (std::size_t i = 0; i < len; i++) {
+              yq[i] = ToneCurve::clamp_value(y[0] * pr[i] + y[1] * pg[i] +
+                                             y[2] * pb[i]);
+            }
+            for (std::size_t i = 0; i < len; i++) {
+              hist[yq[i]]++;
+            }
+          }
+        }
+      },
+      grain);
+
+  if (luminance) {
+    luminance->assign(bins, 0);
+    for (std::size_t c = 0; c < chunks; c++) {
+      const std::uint32_t *h = sub.data() + c * bins;
+      for (std::size_t v = 0; v < bins; v++) {
+        (*luminance)[v] += h[v];
+      }
+    }
+  }
+}
+
+template void profile_transform(const std::uint16_t *, float *, std::size_t,
+                                const Matrix3 &, const Matrix3 &,
+                                const ProfileTables &, Histogram *,
+                                const std::array<float, 3> &);
+template void profile_transform(const std::uint16_t *, std::uint16_t *,
+                                std::size_t, const Matrix3 &, const Matrix3 &,
+                                const ProfileTables &, Histogram *,
+                                const std::array<float, 3> &);
+template void profile_transform(const float *, float *, std::size_t,
+                                const Matrix3 &, const Matrix3 &,
+                                const ProfileTables &, Histogram *,
+                                const std::array<float, 3> &);
+template void profile_transform(const float *, std::uint16_t *, std::size_t,
+                                const Matrix3 &, const Matrix3 &,
+                                const ProfileTables &, Histogram *,
+                                const std::array<float, 3> &);
+
+} // namespace yk
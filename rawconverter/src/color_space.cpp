@@ -0,0 +1,169 @@
+#include "color_space.hpp"
+#include <stdexcept>
+
+namespace yk {
+
+namespace {
+using Chromaticity = std::array<float, 2>;
+
+struct Primaries {
+  Chromaticity r, g, b, white;
+};
+
+constexpr Chromaticity d65 = {0.3127f, 0.3290f};
+constexpr Chromaticity d50 = {0.3457f, 0.3585f};
+constexpr Chromaticity aces_white = {0.32168f, 0.33767f};
+
+constexpr ColorSpace all_color_spaces[] = {
+    ColorSpace::sRGB, ColorSpace::display_p3, ColorSpace::rec2020,
+    ColorSpace::prophoto, ColorSpace::acescg};
+
+Primaries primaries(const ColorSpace cs) noexcept {
+  switch (cs) {
+  case ColorSpace::sRGB:
+    break;
+  case ColorSpace::display_p3:
+    return {{0.680f, 0.320f}, {0.265f, 0.690f}, {0.150f, 0.060f}, d65};
+  case ColorSpace::rec2020:
+    return {{0.708f, 0.292f}, {0.170f, 0.797f}, {0.131f, 0.046f}, d65};
+  case ColorSpace::prophoto:
+    return {{0.7347f, 0.2653f}, {0.1596f, 0.8404f}, {0.0366f, 0.0001f}, d50};
+  case ColorSpace::acescg:
+    return {{0.713f, 0.293f}, {0.165f, 0.830f}, {0.128f, 0.044f}, aces_white};
+  }
+  return {{0.64f, 0.33f}, {0.30f, 0.60f}, {0.15f, 0.06f}, d65};
+}
+
+// XYZ with Y = 1 of a chromaticity.
+std::array<float, 3> xyz(const Chromaticity &c) noexcept {
+  return {c[0] / c[1], 1.f, (1.f - c[0] - c[1]) / c[1]};
+}
+
+std::array<float, 3> mul(const Matrix3 &m,
+                         const std::array<float, 3> &v) noexcept {
+  std::array<float, 3> res{};
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 3; j++) {
+      res[i] += m[i][j] * v[j];
+    }
+  }
+  return res;
+}
+} // namespace
+
+ColorSpace parse_color_space(const std::string &name) {
+  for (const auto cs : all_color_spaces) {
+    if (name == to_string(cs)) {
+      return cs;
+    }
+  }
+  throw std::invalid_argument("Unknown color space: " + name);
+}
+
+const char *to_string(const ColorSpace cs) noexcept {
+  switch (cs) {
+  case ColorSpace::sRGB:
+    return "srgb";
+  case ColorSpace::display_p3:
+    return "display-p3";
+  case ColorSpace::rec2020:
+    return "rec2020";
+  case ColorSpace::prophoto:
+    return "prophoto";
+  case ColorSpace::acescg:
+    return "acescg";
+  }
+  return "";
+}
+
+Matrix3 xyz_from_rgb(const ColorSpace cs) noexcept {
+  const Primaries p = primaries(cs);
+  const std::array<float, 3> r = xyz(p.r), g = xyz(p.g), b = xyz(p.b);
+  Matrix3 res;
+  for (int i = 0; i < 3; i++) {
+    res[i] = {r[i], g[i], b[i]};
+  }
+  // Scale the primaries so that RGB (1, 1, 1) is the white point.
+  const std::array<float, 3> s = mul(invert(res), xyz(p.white));
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 3; j++) {
+      res[i][j] *= s[j];
+    }
+  }
+  return res;
+}
+
+Matrix3 bradford_adaptation(const Chromaticity &from,
+                            const Chromaticity &to) noexcept {
+  constexpr Matrix3 bradford = {{{0.8951f, 0.2664f, -0.1614f},
+                                 {-0.7502f, 1.7135f, 0.0367f},
+                                 {0.0389f, -0.0685f, 1.0296f}}};
+  const std::array<float, 3> src = mul(bradford, xyz(from));
+  const std::array<float, 3> dst = mul(bradford, xyz(to));
+  Matrix3 gain{};
+  for (int i = 0; i < 3; i++) {
+    gain[i][i] = dst[i] / src[i];
+  }
+  return multiply(invert(bradford), multiply(gain, bradford));
+}
+
+Matrix3 rgb_from_sRGB(const ColorSpace cs) noexcept {
+  if (cs == ColorSpace::sRGB) {
+    return {{{1.f, 0.f, 0.f}, {0.f, 1.f, 0.f}, {0.f, 0.f, 1.f}}};
+  }
+  const Matrix3 xyz_d65 = xyz_from_rgb(ColorSpace::sRGB);
+  const Matrix3 xyz_white =
+      multiply(bradford_adaptation(d65, primaries(cs).white), xyz_d65);
+  return multiply(invert(xyz_from_rgb(cs)), xyz_white);
+}
+
+std::array<float, 3> luminance_weights(const ColorSpace cs) noexcept {
+  if (cs == ColorSpace::sRGB) {
+    return sRGB_luminance;
+  }
+  return xyz_from_rgb(cs)[1];
+}
+
+TransferFunction transfer_function(const ColorSpace cs) noexcept {
+  switch (cs) {
+  case ColorSpace::sRGB:
+  case ColorSpace::display_p3:
+    return TransferFunction::sRGB;
+  case ColorSpace::rec2020:
+    return TransferFunction::rec709;
+  case ColorSpace::prophoto:
+    return TransferFunction::prophoto;
+  case ColorSpace::acescg:
+    return TransferFunction::linear;
+  }
+  return TransferFunction::sRGB;
+}
+
+const ToneCurve &output_curve(const ColorSpace cs) {
+  auto build = [](const TransferFunction tf) {
+    return ToneCurve::from_function([tf](int v) {
+      return USHRT_MAX * transfer_reference(tf, double(v) / USHRT_MAX) + 0.5;
+    });
+  };
+  // One curve per transfer function, built on first use.
+  switch (transfer_function(cs)) {
+  case TransferFunction::sRGB: {
+    static const ToneCurve curve = build(TransferFunction::sRGB);
+    return curve;
+  }
+  case TransferFunction::rec709: {
+    static const ToneCurve curve = build(TransferFunction::rec709);
+    return curve;
+  }
+  case TransferFunction::prophoto: {
+    static const ToneCurve curve = build(TransferFunction::prophoto);
+    return curve;
+  }
+  default: {
+    static const ToneCurve curve;
+    return curve;
+  }
+  }
+}
+
+} // namespace yk
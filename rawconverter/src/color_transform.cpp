@@ -0,0 +1,186 @@
+#include "color_transform.hpp"
+#include "half_float.hpp"
+#include "parallel.hpp"
+#include "tone_curve.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+namespace yk {
+
+Matrix3 multiply(const Matrix3 &a, const Matrix3 &b) noexcept {
+  Matrix3 res{};
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 3; j++) {
+      for (int k = 0; k < 3; k++) {
+        res[i][j] += a[i][k] * b[k][j];
+      }
+    }
+  }
+  return res;
+}
+
+Matrix3 invert(const Matrix3 &m) noexcept {
+  Matrix3 res{};
+  const double det = double(m[0][0]) * (m[1][1] * m[2][2] - m[1][2] * m[2][1]) -
+                     double(m[0][1]) * (m[1][0] * m[2][2] - m[1][2] * m[2][0]) +
+                     double(m[0][2]) * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+  if (std::abs(det) < 1e-12) {
+    return res;
+  }
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 3; j++) {
+      const int r0 = (j + 1) % 3, r1 = (j + 2) % 3;
+      const int c0 = (i + 1) % 3, c1 = (i + 2) % 3;
+      res[i][j] = (double(m[r0][c0]) * m[r1][c1] -
+                   double(m[r0][c1]) * m[r1][c0]) /
+                  det;
+    }
+  }
+  return res;
+}
+
+Matrix3 xyz_from_camera(const float cm[4][3], const float ab[4]) noexcept {
+  Matrix3 cam_from_xyz;
+  for (int i = 0; i < 3; i++) {
+    float sum = 0;
+    for (int j = 0; j < 3; j++) {
+      cam_from_xyz[i][j] = ab[i] * cm[i][j];
+      sum += cam_from_xyz[i][j];
+    }
+    for (int j = 0; j < 3; j++) {
+      cam_from_xyz[i][j] = 0.0000001 < sum ? cam_from_xyz[i][j] / sum : 0.f;
+    }
+  }
+  return invert(cam_from_xyz);
+}
+
+namespace detail {
+// Pixels are transformed in blocks small enough for the luminance scratch
+// buffer to stay in L1, so the matrix loop vectorises and the histogram
+// scatter runs on cached data.
+constexpr std::size_t default_color_block = 2048;
+constexpr std::size_t min_color_block = 64;
+constexpr std::size_t max_color_block = 8192;
+
+std::atomic<std::size_t> &color_block_storage() noexcept {
+  static std::atomic<std::size_t> n{default_color_block};
+  return n;
+}
+
+template <class Out> inline Out store_value(const float v) noexcept {
+  if constexpr (std::is_same_v<Out, std::uint16_t>) {
+    return ToneCurve::clamp_value(v);
+  } else {
+    return static_cast<Out>(v);
+  }
+}
+} // namespace detail
+
+std::size_t color_block() noexcept {
+  return detail::color_block_storage().load(std::memory_order_relaxed);
+}
+
+void set_color_block(const std::size_t n) noexcept {
+  detail::color_block_storage().store(
+      n ? std::clamp(n, detail::min_color_block, detail::max_color_block)
+        : detail::default_color_block,
+      std::memory_order_relaxed);
+}
+
+template <class In, class Out>
+void color_transform(const In *src, Out *dst, const std::size_t n,
+                     const Matrix3 &m, Histogram *luminance,
+                     const std::array<float, 3> &weights,
+                     const std::size_t luminance_stride) {
+  std::array<float, 3> y{};
+  for (int j = 0; j < 3; j++) {
+    for (int k = 0; k < 3; k++) {
+      y[j] += weights[k] * m[k][j];
+    }
+  }
+  constexpr std::size_t bins = ToneCurve::lut_size;
+  const std::size_t grain = grain_size();
+  const std::size_t chunks = parallel_chunks(n, grain);
+  const std::size_t block = color_block();
+  std::vector<std::uint32_t> sub(luminance ? chunks * bins : 0, 0);
+
+  parallel_for(
+      n,
+      [&](std::size_t begin, std::size_t end, std::size_t c) {
+        std::uint16_t yq[detail::max_color_block];
+        std::uint32_t *h = luminance ? sub.data() + c * bins : nullptr;
+        for (std::size_t b0 = begin; b0 < end; b0 += block) {
+          const std::size_t len = std::min(block, end - b0);
+          const In *r = src + b0, *g = src + n + b0, *b = src + 2 * n + b0;
+          for (int ch = 0; ch < 3; ch++) {
+            Out *out = dst + ch * n + b0;
+            const float m0 = m[ch][0], m1 = m[ch][1], m2 = m[ch][2];
+            if constexpr (std::is_same_v<Out, Half>) {
+              // Computed in float, then converted to code values / half_unit
+              // eight at a time.
+              float v[detail::max_color_block];
+              for (std::size_t i = 0; i < len; i++) {
+                v[i] = m0 * r[i] + m1 * g[i] + m2 * b[i];
+              }
+              to_half(v, out, len, 1.f / half_unit);
+            } else {
+              for (std::size_t i = 0; i < len; i++) {
+                out[i] = detail::store_value<Out>(m0 * r[i] + m1 * g[i] +
+                                                  m2 * b[i]);
+              }
+            }
+          }
+          if (h && luminance_stride == 1) {
+            for (std::size_t i = 0; i < len; i++) {
+              yq[i] = ToneCurve::clamp_value(y[0] * r[i] + y[1] * g[i] +
+                                             y[2] * b[i]);
+            }
+            for (std::size_t i = 0; i < len; i++) {
+              h[yq[i]]++;
+            }
+          } else if (h) {
+            const std::size_t s = luminance_stride;
+            for (std::size_t i = (b0 + s - 1) / s * s - b0; i < len; i += s) {
+              h[ToneCurve::clamp_value(y[0] * r[i] + y[1] * g[i] +
+                                       y[2] * b[i])]++;
+            }
+          }
+        }
+      },
+      grain);
+
+  if (luminance) {
+    luminance->assign(bins, 0);
+    for (std::size_t c = 0; c < chunks; c++) {
+      const std::uint32_t *h = sub.data() + c * bins;
+      for (std::size_t v = 0; v < bins; v++) {
+        (*luminance)[v] += h[v];
+      }
+    }
+  }
+}
+
+template void color_transform(const std::uint16_t *, float *, std::size_t,
+                              const Matrix3 &, Histogram *,
+                              const std::array<float, 3> &, std::size_t);
+template void color_transform(const std::uint16_t *, std::uint16_t *,
+                              std::size_t, const Matrix3 &, Histogram *,
+                              const std::array<float, 3> &, std::size_t);
+template void color_transform(const float *, float *, std::size_t,
+                              const Matrix3 &, Histogram *,
+                              const std::array<float, 3> &, std::size_t);
+template void color_transform(const float *, std::uint16_t *, std::size_t,
+                              const Matrix3 &, Histogram *,
+                              const std::array<float, 3> &, std::size_t);
+template void color_transform(const std::uint16_t *, Half *, std::size_t,
+                              const Matrix3 &, Histogram *,
+                              const std::array<float, 3> &, std::size_t);
+template void color_transform(const float *, Half *, std::size_t,
+                              const Matrix3 &, Histogram *,
+                              const std::array<float, 3> &, std::size_t);
+
+} // namespace yk
@@ -0,0 +1,35 @@
+#pragma once
+
+namespace yk {
+namespace detail {
+
+/**
+ * @brief Whether the running CPU supports AVX2. Kernels built in a separate
+ * translation unit with -mavx2 are only called when this returns true, so
+ * the library itself can be built for the baseline ISA.
+ */
+inline bool cpu_has_avx2() noexcept {
+#if defined(YK_HAVE_AVX2_KERNELS) && (defined(__GNUC__) || defined(__clang__))
+  static const bool res = __builtin_cpu_supports("avx2");
+  return res;
+#else
+  return false;
+#endif
+}
+
+/**
+ * @brief Whether the running CPU supports the F16C half-float conversions
+ * (with the AVX registers they operate on).
+ */
+inline bool cpu_has_f16c() noexcept {
+#if defined(YK_HAVE_F16C_KERNELS) && (defined(__GNUC__) || defined(__clang__))
+  static const bool res =
+      __builtin_cpu_supports("avx") && __builtin_cpu_supports("f16c");
+  return res;
+#else
+  return false;
+#endif
+}
+
+} // namespace detail
+} // namespace yk
@@ -0,0 +1,249 @@
+#include "demosaic.hpp"
+#include "parallel.hpp"
+#include "tone_curve.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <stdexcept>
+#include <vector>
+
+namespace yk {
+
+namespace {
+// Rows and columns read around a pixel: 1 for bilinear, 3 for the green
+// gradients of edge_aware at the halo of the green plane.
+constexpr std::ptrdiff_t halo = 3;
+// Rows per tile; a tile of 4K columns is about 0.6 MB per plane.
+constexpr std::size_t tile_rows = 32;
+
+// Mirror a coordinate into [0, n) without repeating the border, so that
+// mirrored samples keep the color of the CFA position they replace.
+std::size_t reflect(const std::ptrdiff_t i, const std::size_t n) {
+  if (i < 0) {
+    return static_cast<std::size_t>(-i);
+  }
+  if (static_cast<std::size_t>(i) >= n) {
+    return 2 * (n - 1) - static_cast<std::size_t>(i);
+  }
+  return static_cast<std::size_t>(i);
+}
+
+inline std::uint16_t to_ushort(const float v) {
+  return ToneCurve::clamp_value(v + 0.5f);
+}
+
+// Mosaic rows [y0 - halo, y1 + halo) as float, mirrored at the borders.
+// Row r of the tile starts at tile + (r + halo) * pitch + halo.
+void load_tile(const std::uint16_t *raw, const std::size_t width,
+               const std::size_t height, const std::size_t stride,
+               const std::size_t y0, const std::size_t y1,
+               const std::size_t pitch, float *tile) {
+  const auto first = static_cast<std::ptrdiff_t>(y0) - halo;
+  const auto last = static_cast<std::ptrdiff_t>(y1) + halo;
+  for (std::ptrdiff_t y = first; y < last; y++) {
+    const std::uint16_t *s = raw + reflect(y, height) * stride;
+    float *t = tile + (y - first) * pitch + halo;
+    for (std::size_t x = 0; x < width; x++) {
+      t[x] = s[x];
+    }
+    for (std::ptrdiff_t k = 1; k <= halo; k++) {
+      t[-k] = s[k];
+      t[width - 1 + k] = s[width - 1 - k];
+    }
+  }
+}
+
+// Color at (y, x) of the CFA; y and x may be negative.
+inline std::uint8_t color_at(const CfaPattern &cfa, const std::ptrdiff_t y,
+                             const std::ptrdiff_t x) {
+  return cfa[(y & 1) * 2 + (x & 1)];
+}
+
+void bilinear_row(const float *p, const std::ptrdiff_t w,
+                  const std::ptrdiff_t width, const CfaPattern &cfa,
+                  const std::size_t y, std::uint16_t *const out[3]) {
+  for (std::ptrdiff_t px = 0; px < 2; px++) {
+    const std::uint8_t c = color_at(cfa, y, px);
+    if (c == 1) {
+      std::uint16_t *g = out[1];
+      std::uint16_t *h = out[color_at(cfa, y, px + 1)];
+      std::uint16_t *v = out[color_at(cfa, y + 1, px)];
+      for (std::ptrdiff_t x = px; x < width; x += 2) {
+        g[x] = to_ushort(p[x]);
+        h[x] = to_ushort(0.5f * (p[x - 1] + p[x + 1]));
+        v[x] = to_ushort(0.5f * (p[x - w] + p[x + w]));
+      }
+    } else {
+      std::uint16_t *s = out[c];
+      std::uint16_t *g = out[1];
+      std::uint16_t *d = out[2 - c];
+      for (std::ptrdiff_t x = px; x < width; x += 2) {
+        s[x] = to_ushort(p[x]);
+        g[x] = to_ushort(0.25f * (p[x - 1] + p[x + 1] + p[x - w] + p[x + w]));
+        d[x] = to_ushort(0.25f * (p[x - w - 1] + p[x - w + 1] +
+                                  p[x + w - 1] + p[x + w + 1]));
+      }
+    }
+  }
+}
+
+// Green of row y over columns [-1, width]: the sample at green sites,
+// Hamilton-Adams interpolation along the smaller gradient elsewhere.
+void green_row(const float *p, const std::ptrdiff_t w,
+               const std::size_t width, const CfaPattern &cfa,
+               const std::ptrdiff_t y, float *g) {
+  const auto end = static_cast<std::ptrdiff_t>(width) + 1;
+  for (std::ptrdiff_t px = 0; px < 2; px++) {
+    const std::ptrdiff_t x0 = px - 1;
+    if (color_at(cfa, y, x0) == 1) {
+      for (std::ptrdiff_t x = x0; x < end; x += 2) {
+        g[x] = p[x];
+      }
+      continue;
+    }
+    for (std::ptrdiff_t x = x0; x < end; x += 2) {
+      const float lh = 2 * p[x] - p[x - 2] - p[x + 2];
+      const float lv = 2 * p[x] - p[x - 2 * w] - p[x + 2 * w];
+      const float gh = 0.5f * (p[x - 1] + p[x + 1]) + 0.25f * lh;
+      const float gv = 0.5f * (p[x - w] + p[x + w]) + 0.25f * lv;
+      const float dh = std::fabs(p[x - 1] - p[x + 1]) + std::fabs(lh);
+      const float dv = std::fabs(p[x - w] - p[x + w]) + std::fabs(lv);
+      // The gradients are integers, so the weight of gh is 1 if dh < dv, 0
+      // if dv < dh and 0.5 on a tie; a clamp instead of a select lets the
+      // loop vectorise.
+      const float wh = std::min(std::max(0.5f + (dv - dh), 0.f), 1.f);
+      const float v = gv + wh * (gh - gv);
+      g[x] = std::min(std::max(v, 0.f), 65535.f);
+    }
+  }
+}
+
+// Red and blue of row y from the color differences to the green plane g.
+void edge_aware_row(const float *p, const float *g, const std::ptrdiff_t w,
+                    const std::ptrdiff_t width, const CfaPattern &cfa,
+                    const std::size_t y, std::uint16_t *const out[3]) {
+  for (std::ptrdiff_t px = 0; px < 2; px++) {
+    const std::uint8_t c = color_at(cfa, y, px);
+    if (c == 1) {
+      std::uint16_t *gg = out[1];
+      std::uint16_t *h = out[color_at(cfa, y, px + 1)];
+      std::uint16_t *v = out[color_at(cfa, y + 1, px)];
+      for (std::ptrdiff_t x = px; x < width; x += 2) {
+        gg[x] = to_ushort(p[x]);
+        h[x] = to_ushort(g[x] + 0.5f * (p[x - 1] - g[x - 1] + p[x + 1] -
+                                        g[x + 1]));
+        v[x] = to_ushort(g[x] + 0.5f * (p[x - w] - g[x - w] + p[x + w] -
+                                        g[x + w]));
+      }
+    } else {
+      std::uint16_t *s = out[c];
+      std::uint16_t *gg = out[1];
+      std::uint16_t *d = out[2 - c];
+      for (std::ptrdiff_t x = px; x < width; x += 2) {
+        s[x] = to_ushort(p[x]);
+        gg[x] = to_ushort(g[x]);
+        const float diff = p[x - w - 1] - g[x - w - 1] + p[x - w + 1] -
+                           g[x - w + 1] + p[x + w - 1] - g[x + w - 1] +
+                           p[x + w + 1] - g[x + w + 1];
+        d[x] = to_ushort(g[x] + 0.25f * diff);
+      }
+    }
+  }
+}
+} // namespace
+
+DemosaicMethod parse_demosaic_method(const std::string &s) {
+  if (s == "bilinear") {
+    return DemosaicMethod::bilinear;
+  }
+  if (s == "edge") {
+    return DemosaicMethod::edge_aware;
+  }
+  throw std::invalid_argument("Unknown demosaic method: " + s);
+}
+
+CfaPattern parse_cfa_pattern(const std::string &s) {
+  if (s.size() != 4) {
+    throw std::invalid_argument("Invalid CFA pattern: " + s);
+  }
+  CfaPattern cfa;
+  for (std::size_t i = 0; i < 4; i++) {
+    switch (s[i]) {
+    case 'R':
+      cfa[i] = 0;
+      break;
+    case 'G':
+      cfa[i] = 1;
+      break;
+    case 'B':
+      cfa[i] = 2;
+      break;
+    default:
+      throw std::invalid_argument("Invalid CFA pattern: " + s);
+    }
+  }
+  validate_cfa_pattern(cfa);
+  return cfa;
+}
+
+void validate_cfa_pattern(const CfaPattern &cfa) {
+  const bool main_green = cfa[0] == 1 && cfa[3] == 1 && cfa[1] != 1 &&
+                          cfa[2] != 1 && cfa[1] + cfa[2] == 2;
+  const bool anti_green = cfa[1] == 1 && cfa[2] == 1 && cfa[0] != 1 &&
+                          cfa[3] != 1 && cfa[0] + cfa[3] == 2;
+  if (!main_green && !anti_green) {
+    throw std::invalid_argument("Not a Bayer CFA pattern");
+  }
+}
+
+void demosaic(const std::uint16_t *raw, const std::size_t width,
+              const std::size_t height, const std::size_t stride,
+              const CfaPattern &cfa, std::uint16_t *dst,
+              const DemosaicMethod method) {
+  if (width < 4 || height < 4 || stride < width) {
+    throw std::invalid_argument("Image too small to demosaic");
+  }
+  validate_cfa_pattern(cfa);
+  const std::size_t n = width * height;
+  const std::size_t pitch = width + 2 * halo;
+  const auto w = static_cast<std::ptrdiff_t>(pitch);
+  const auto iwidth = static_cast<std::ptrdiff_t>(width);
+  const std::size_t min_rows = std::max(tile_rows, grain_size() / width);
+  parallel_for(
+      height,
+      [&](const std::size_t begin, const std::size_t end, std::size_t) {
+        const std::size_t rows = std::min(tile_rows, end - begin);
+        std::vector<float> tile((rows + 2 * halo) * pitch);
+        std::vector<float> green(
+            method == DemosaicMethod::edge_aware ? tile.size() : 0);
+        for (std::size_t y0 = begin; y0 < end; y0 += tile_rows) {
+          const std::size_t y1 = std::min(end, y0 + tile_rows);
+          load_tile(raw, width, height, stride, y0, y1, pitch, tile.data());
+          auto row = [&](std::vector<float> &t, const std::ptrdiff_t r) {
+            return t.data() + (r + halo) * w + halo;
+          };
+          if (method == DemosaicMethod::edge_aware) {
+            const auto rows1 = static_cast<std::ptrdiff_t>(y1 - y0) + 1;
+            for (std::ptrdiff_t r = -1; r < rows1; r++) {
+              green_row(row(tile, r), w, width, cfa,
+                        static_cast<std::ptrdiff_t>(y0) + r, row(green, r));
+            }
+          }
+          for (std::size_t y = y0; y < y1; y++) {
+            const auto r = static_cast<std::ptrdiff_t>(y - y0);
+            std::uint16_t *const out[3] = {dst + y * width,
+                                           dst + n + y * width,
+                                           dst + 2 * n + y * width};
+            if (method == DemosaicMethod::edge_aware) {
+              edge_aware_row(row(tile, r), row(green, r), w, iwidth, cfa, y,
+                             out);
+            } else {
+              bilinear_row(row(tile, r), w, iwidth, cfa, y, out);
+            }
+          }
+        }
+      },
+      min_rows);
+}
+
+} // namespace yk
@@ -0,0 +1,295 @@
+#include "dng_color.hpp"
+#include "color_space.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace yk {
+
+namespace {
+using Vector3 = std::array<float, 3>;
+
+constexpr std::array<float, 2> d50 = {0.3457f, 0.3585f};
+constexpr std::array<float, 2> d65 = {0.3127f, 0.3290f};
+// The solve usually converges in 3 to 5 iterations.
+constexpr int max_iterations = 30;
+constexpr float xy_tolerance = 1e-6f;
+
+bool is_zero(const Matrix3 &m) noexcept {
+  for (const auto &row : m) {
+    for (const float v : row) {
+      if (v != 0.f) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+Matrix3 diagonal(const Vector3 &v) noexcept {
+  Matrix3 res{};
+  for (int i = 0; i < 3; i++) {
+    res[i][i] = v[i];
+  }
+  return res;
+}
+
+Vector3 mul(const Matrix3 &m, const Vector3 &v) noexcept {
+  Vector3 res{};
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 3; j++) {
+      res[i] += m[i][j] * v[j];
+    }
+  }
+  return res;
+}
+
+// w * a + (1 - w) * b. A missing (zero) matrix takes the other one.
+Matrix3 interpolate(const Matrix3 &a, const Matrix3 &b, const float w) {
+  if (is_zero(b)) {
+    return a;
+  }
+  if (is_zero(a)) {
+    return b;
+  }
+  Matrix3 res;
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 3; j++) {
+      res[i][j] = w * a[i][j] + (1.f - w) * b[i][j];
+    }
+  }
+  return res;
+}
+
+std::array<float, 2> chromaticity(const Vector3 &xyz) noexcept {
+  const float sum = xyz[0] + xyz[1] + xyz[2];
+  if (!(0.f < sum)) {
+    return d50;
+  }
+  return {xyz[0] / sum, xyz[1] / sum};
+}
+
+// Weight of the *1 matrices at a color temperature, linear in 1 / T.
+float matrix_weight(const DngColorProfile &profile,
+                    const float temperature) noexcept {
+  if (is_zero(profile.color_matrices[1])) {
+    return 1.f;
+  }
+  const float t1 = illuminant_temperature(profile.illuminants[0]);
+  const float t2 = illuminant_temperature(profile.illuminants[1]);
+  if (is_zero(profile.color_matrices[0]) || t1 <= 0.f || t2 <= 0.f ||
+      t1 == t2) {
+    // Without two known illuminants ColorMatrix2 is used, as before.
+    return 0.f;
+  }
+  const float w = (1.f / temperature - 1.f / t2) / (1.f / t1 - 1.f / t2);
+  return std::clamp(w, 0.f, 1.f);
+}
+
+Matrix3 calibration(const DngColorProfile &profile, const float w) {
+  Matrix3 c[2];
+  for (int k = 0; k < 2; k++) {
+    c[k] = is_zero(profile.calibrations[k]) ? diagonal({1.f, 1.f, 1.f})
+                                            : profile.calibrations[k];
+  }
+  return interpolate(c[0], c[1], w);
+}
+} // namespace
+
+float illuminant_temperature(const int light_source) noexcept {
+  switch (light_source) {
+  case 3:  // Tungsten
+  case 17: // Standard light A
+    return 2850.f;
+  case 24: // ISO studio tungsten
+    return 3200.f;
+  case 23: // D50
+    return 5000.f;
+  case 1:  // Daylight
+  case 4:  // Flash
+  case 9:  // Fine weather
+  case 18: // Standard light B
+  case 20: // D55
+    return 5500.f;
+  case 10: // Cloudy weather
+  case 19: // Standard light C
+  case 21: // D65
+    return 6500.f;
+  case 11: // Shade
+  case 22: // D75
+    return 7500.f;
+  case 12: // Daylight fluorescent
+    return 6400.f;
+  case 13: // Day white fluorescent
+    return 5050.f;
+  case 2:  // Fluorescent
+  case 14: // Cool white fluorescent
+    return 4150.f;
+  case 15: // White fluorescent
+    return 3525.f;
+  case 16: // Warm white fluorescent
+    return 2925.f;
+  default:
+    return 0.f;
+  }
+}
+
+float correlated_color_temperature(const std::array<float, 2> &xy) noexcept {
+  const float n = (xy[0] - 0.3320f) / (0.1858f - xy[1]);
+  return ((449.f * n + 3525.f) * n + 6823.3f) * n + 5520.33f;
+}
+
+Matrix3 xyz_from_camera(const DngColorProfile &profile,
+                        const std::array<float, 3> &neutral,
+                        WhitePointSolution *solution) noexcept {
+  // The brightest channel of the neutral is the camera's white level.
+  Vector3 n = neutral;
+  const float peak = std::max({n[0], n[1], n[2]});
+  for (auto &v : n) {
+    v = 0.f < peak ? v / peak : 1.f;
+  }
+  const Matrix3 ab = diagonal(profile.analog_balance);
+  auto camera_from_xyz = [&](const float w) {
+    return multiply(ab, multiply(calibration(profile, w),
+                                 interpolate(profile.color_matrices[0],
+                                             profile.color_matrices[1], w)));
+  };
+
+  // Solve for the white point of the neutral, starting from D50.
+  std::array<float, 2> xy = d50;
+  int iterations = 0;
+  while (iterations < max_iterations) {
+    iterations++;
+    const float w = matrix_weight(profile, correlated_color_temperature(xy));
+    const std::array<float, 2> next =
+        chromaticity(mul(invert(camera_from_xyz(w)), n));
+    const bool converged = std::abs(next[0] - xy[0]) < xy_tolerance &&
+                           std::abs(next[1] - xy[1]) < xy_tolerance;
+    xy = next;
+    if (converged) {
+      break;
+    }
+  }
+  const float temperature = correlated_color_temperature(xy);
+  const float w = matrix_weight(profile, temperature);
+  if (solution) {
+    *solution = {xy, temperature, w, iterations};
+  }
+
+  // Camera native to D50 XYZ with the neutral at Y = 1.
+  Matrix3 xyz_d50;
+  if (!is_zero(profile.forward_matrices[0]) ||
+      !is_zero(profile.forward_matrices[1])) {
+    const Matrix3 camera_from_reference =
+        multiply(ab, calibration(profile, w));
+    const Matrix3 reference_from_camera = invert(camera_from_reference);
+    const Vector3 reference_neutral = mul(reference_from_camera, n);
+    Vector3 balance;
+    for (int i = 0; i < 3; i++) {
+      balance[i] =
+          0.f < reference_neutral[i] ? 1.f / reference_neutral[i] : 0.f;
+    }
+    const Matrix3 fm = interpolate(profile.forward_matrices[0],
+                                   profile.forward_matrices[1], w);
+    xyz_d50 = multiply(fm, multiply(diagonal(balance), reference_from_camera));
+  } else {
+    Matrix3 xyz = invert(camera_from_xyz(w));
+    const float y = mul(xyz, n)[1];
+    for (auto &row : xyz) {
+      for (auto &v : row) {
+        v = 0.f < y ? v / y : 0.f;
+      }
+    }
+    xyz_d50 = multiply(bradford_adaptation(xy, d50), xyz);
+  }
+
+  // D65 XYZ divided by the white, as expected by the sRGB' matrices.
+  Matrix3 res = multiply(bradford_adaptation(d50, d65), xyz_d50);
+  const Vector3 white = {d65[0] / d65[1], 1.f,
+                         (1.f - d65[0] - d65[1]) / d65[1]};
+  for (int i = 0; i < 3; i++) {
+    for (auto &v : res[i]) {
+      v /= white[i];
+    }
+  }
+  return res;
+}
+
+Matrix3 xyz_from_balanced_camera(const DngColorProfile &profile,
+                                 const std::array<float, 3> &as_shot_neutral,
+                                 const std::array<float, 3> &gains,
+                                 WhitePointSolution *solution) noexcept {
+  if (gains == std::array<float, 3>{1.f, 1.f, 1.f}) {
+    return xyz_from_camera(profile, as_shot_neutral, solution);
+  }
+  Vector3 neutral;
+  for (int i = 0; i < 3; i++) {
+    neutral[i] = 0.f < gains[i] ? 1.f / gains[i] : 1.f;
+  }
+  Matrix3 res = xyz_from_camera(profile, neutral, solution);
+  for (auto &row : res) {
+    for (int j = 0; j < 3; j++) {
+      row[j] *= neutral[j];
+    }
+  }
+  return res;
+}
+
+ColorMatrixCache::ColorMatrixCache(const std::size_t capacity)
+    : matrices_(capacity) {}
+
+Matrix3 ColorMatrixCache::xyz_from_camera(const DngColorProfile &profile,
+                                          const std::array<float, 3> &neutral) {
+  Key key;
+  auto it = key.begin();
+  for (const auto *matrices : {&profile.color_matrices,
+                               &profile.forward_matrices,
+                               &profile.calibrations}) {
+    for (const auto &m : *matrices) {
+      for (const auto &row : m) {
+        it = std::copy(row.begin(), row.end(), it);
+      }
+    }
+  }
+  *it++ = static_cast<float>(profile.illuminants[0]);
+  *it++ = static_cast<float>(profile.illuminants[1]);
+  it = std::copy(profile.analog_balance.begin(), profile.analog_balance.end(),
+                 it);
+  std::copy(neutral.begin(), neutral.end(), it);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (const Matrix3 *found = matrices_.find(key)) {
+    hits_++;
+    return *found;
+  }
+  misses_++;
+  return matrices_.insert(key, yk::xyz_from_camera(profile, neutral));
+}
+
+std::size_t ColorMatrixCache::hits() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return hits_;
+}
+
+std::size_t ColorMatrixCache::misses() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return misses_;
+}
+
+std::size_t ColorMatrixCache::size() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return matrices_.size();
+}
+
+void ColorMatrixCache::clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  matrices_.clear();
+  hits_ = 0;
+  misses_ = 0;
+}
+
+ColorMatrixCache &ColorMatrixCache::global() {
+  static ColorMatrixCache cache;
+  return cache;
+}
+
+} // namespace yk
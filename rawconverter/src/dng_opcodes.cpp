@@ -0,0 +1,184 @@
+#include "dng_opcodes.hpp"
+#include "logging.hpp"
+#include <cstring>
+#include <stdexcept>
+
+namespace yk {
+
+namespace {
+// Sequential big-endian reader over a byte range.
+class BigEndianReader {
+public:
+  BigEndianReader(const std::uint8_t *data, const std::size_t size)
+      : data_(data), size_(size) {}
+
+  std::uint32_t u32() {
+    const std::uint8_t *p = take(4);
+    return (std::uint32_t(p[0]) << 24) | (std::uint32_t(p[1]) << 16) |
+           (std::uint32_t(p[2]) << 8) | std::uint32_t(p[3]);
+  }
+
+  float f32() {
+    const std::uint32_t bits = u32();
+    float res;
+    std::memcpy(&res, &bits, sizeof(res));
+    return res;
+  }
+
+  double f64() {
+    const std::uint64_t bits = (std::uint64_t(u32()) << 32) | u32();
+    double res;
+    std::memcpy(&res, &bits, sizeof(res));
+    return res;
+  }
+
+  const std::uint8_t *take(const std::size_t n) {
+    if (size_ - position_ < n) {
+      throw std::runtime_error("Truncated DNG opcode list");
+    }
+    const std::uint8_t *p = data_ + position_;
+    position_ += n;
+    return p;
+  }
+
+private:
+  const std::uint8_t *data_;
+  std::size_t size_;
+  std::size_t position_ = 0;
+};
+
+constexpr std::uint32_t max_opcodes = 1 << 16;
+} // namespace
+
+const char *opcode_name(const std::uint32_t id) noexcept {
+  switch (static_cast<DngOpcode>(id)) {
+  case DngOpcode::warp_rectilinear:
+    return "WarpRectilinear";
+  case DngOpcode::warp_fisheye:
+    return "WarpFisheye";
+  case DngOpcode::fix_vignette_radial:
+    return "FixVignetteRadial";
+  case DngOpcode::fix_bad_pixels_constant:
+    return "FixBadPixelsConstant";
+  case DngOpcode::fix_bad_pixels_list:
+    return "FixBadPixelsList";
+  case DngOpcode::trim_bounds:
+    return "TrimBounds";
+  case DngOpcode::map_table:
+    return "MapTable";
+  case DngOpcode::map_polynomial:
+    return "MapPolynomial";
+  case DngOpcode::gain_map:
+    return "GainMap";
+  case DngOpcode::delta_per_row:
+    return "DeltaPerRow";
+  case DngOpcode::delta_per_column:
+    return "DeltaPerColumn";
+  case DngOpcode::scale_per_row:
+    return "ScalePerRow";
+  case DngOpcode::scale_per_column:
+    return "ScalePerColumn";
+  case DngOpcode::warp_rectilinear2:
+    return "WarpRectilinear2";
+  }
+  return "unknown";
+}
+
+std::vector<Opcode> parse_opcode_list(const std::uint8_t *data,
+                                      const std::size_t size) {
+  BigEndianReader reader(data, size);
+  const std::uint32_t count = reader.u32();
+  if (count > max_opcodes) {
+    throw std::runtime_error("Too many DNG opcodes");
+  }
+  std::vector<Opcode> res(count);
+  for (auto &op : res) {
+    op.id = reader.u32();
+    op.version = reader.u32();
+    op.flags = reader.u32();
+    const std::uint32_t n = reader.u32();
+    const std::uint8_t *params = reader.take(n);
+    op.params.assign(params, params + n);
+  }
+  return res;
+}
+
+GainMap parse_gain_map(const Opcode &op) {
+  if (op.id != static_cast<std::uint32_t>(DngOpcode::gain_map)) {
+    throw std::invalid_argument(std::string("Not a GainMap opcode: ") +
+                                opcode_name(op.id));
+  }
+  BigEndianReader reader(op.params.data(), op.params.size());
+  GainMap map;
+  map.top = reader.u32();
+  map.left = reader.u32();
+  map.bottom = reader.u32();
+  map.right = reader.u32();
+  map.plane = reader.u32();
+  map.planes = reader.u32();
+  map.row_pitch = reader.u32();
+  map.col_pitch = reader.u32();
+  map.points_v = reader.u32();
+  map.points_h = reader.u32();
+  map.spacing_v = reader.f64();
+  map.spacing_h = reader.f64();
+  map.origin_v = reader.f64();
+  map.origin_h = reader.f64();
+  map.map_planes = reader.u32();
+  if (map.bottom < map.top || map.right < map.left || map.planes == 0 ||
+      map.row_pitch == 0 || map.col_pitch == 0 || map.points_v == 0 ||
+      map.points_h == 0 || map.map_planes == 0 || !(map.spacing_v > 0) ||
+      !(map.spacing_h > 0)) {
+    throw std::runtime_error("Invalid GainMap parameters");
+  }
+  const std::size_t n =
+      std::size_t(map.points_v) * map.points_h * map.map_planes;
+  if (n > (op.params.size() - 76) / 4) {
+    throw std::runtime_error("Truncated GainMap");
+  }
+  map.gains.resize(n);
+  for (auto &g : map.gains) {
+    g = reader.f32();
+  }
+  return map;
+}
+
+std::vector<GainMap> read_gain_maps(const TiffReader &tiff,
+                                    const std::uint16_t tag,
+                                    std::vector<std::string> *skipped) {
+  std::vector<GainMap> res;
+  const TiffEntry *entry = TiffReader::find(tiff.raw_ifd(), tag);
+  if (!entry) {
+    entry = tiff.find(tag);
+  }
+  if (!entry) {
+    return res;
+  }
+  for (const auto &op :
+       parse_opcode_list(entry->bytes.data(), entry->bytes.size())) {
+    if (op.id == static_cast<std::uint32_t>(DngOpcode::gain_map)) {
+      res.push_back(parse_gain_map(op));
+    } else {
+      // A reader must not ignore a required opcode without a word.
+      if (!op.optional()) {
+        YK_LOG_WARNING("DNG opcode " << opcode_name(op.id)
+                                     << " is not optional but is not "
+                                        "applied");
+      }
+      if (skipped) {
+        skipped->push_back(opcode_name(op.id));
+      }
+    }
+  }
+  return res;
+}
+
+std::vector<GainMap> read_gain_maps(const TiffReader &tiff,
+                                    std::vector<std::string> *skipped) {
+  auto res = read_gain_maps(tiff, opcode_list2_tag, skipped);
+  auto list3 = read_gain_maps(tiff, opcode_list3_tag, skipped);
+  res.insert(res.end(), list3.begin(), list3.end());
+  return res;
+}
+
+} // namespace yk
@@ -0,0 +1,222 @@
+#include "gain_table_map.hpp"
+#include "dng_opcodes.hpp"
+#include "parallel.hpp"
+#include "tone_curve.hpp"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace yk {
+
+namespace {
+// Sequential reader over a tag value in the byte order of its file.
+class ValueReader {
+public:
+  ValueReader(const std::uint8_t *data, const std::size_t size,
+              const bool big_endian)
+      : data_(data), size_(size), big_endian_(big_endian) {}
+
+  std::uint32_t u32() {
+    if (size_ - position_ < 4) {
+      throw std::runtime_error("Truncated ProfileGainTableMap");
+    }
+    const std::uint8_t *p = data_ + position_;
+    position_ += 4;
+    return big_endian_
+               ? (std::uint32_t(p[0]) << 24) | (std::uint32_t(p[1]) << 16) |
+                     (std::uint32_t(p[2]) << 8) | std::uint32_t(p[3])
+               : (std::uint32_t(p[3]) << 24) | (std::uint32_t(p[2]) << 16) |
+                     (std::uint32_t(p[1]) << 8) | std::uint32_t(p[0]);
+  }
+
+  float f32() {
+    const std::uint32_t bits = u32();
+    float res;
+    std::memcpy(&res, &bits, sizeof(res));
+    return res;
+  }
+
+  double f64() {
+    const std::uint64_t first = u32(), second = u32();
+    const std::uint64_t bits =
+        big_endian_ ? (first << 32) | second : (second << 32) | first;
+    double res;
+    std::memcpy(&res, &bits, sizeof(res));
+    return res;
+  }
+
+private:
+  const std::uint8_t *data_;
+  std::size_t size_;
+  bool big_endian_;
+  std::size_t position_ = 0;
+};
+
+// Bytes before the gains: three LONGs, four DOUBLEs and five FLOATs.
+constexpr std::size_t header_size = 64;
+} // namespace
+
+GainTableMap parse_gain_table_map(const std::uint8_t *data,
+                                  const std::size_t size,
+                                  const bool big_endian) {
+  ValueReader reader(data, size, big_endian);
+  GainTableMap map;
+  map.points_v = reader.u32();
+  map.points_h = reader.u32();
+  map.spacing_v = reader.f64();
+  map.spacing_h = reader.f64();
+  map.origin_v = reader.f64();
+  map.origin_h = reader.f64();
+  map.points_n = reader.u32();
+  for (auto &w : map.input_weights) {
+    w = reader.f32();
+  }
+  if (map.points_v == 0 || map.points_h == 0 || map.points_n == 0 ||
+      !(map.spacing_v > 0) || !(map.spacing_h > 0)) {
+    throw std::runtime_error("Invalid ProfileGainTableMap parameters");
+  }
+  const std::size_t available = (size - header_size) / 4;
+  if (available < map.points_v ||
+      available / map.points_v < map.points_h ||
+      available / (std::size_t(map.points_v) * map.points_h) <
+          map.points_n) {
+    throw std::runtime_error("Truncated ProfileGainTableMap");
+  }
+  map.gains.resize(std::size_t(map.points_v) * map.points_h * map.points_n);
+  for (auto &g : map.gains) {
+    g = reader.f32();
+  }
+  return map;
+}
+
+bool read_gain_table_map(const TiffReader &tiff, GainTableMap &map) {
+  const TiffEntry *entry = tiff.find(profile_gain_table_map_tag);
+  if (!entry) {
+    entry = TiffReader::find(tiff.raw_ifd(), profile_gain_table_map_tag);
+  }
+  if (!entry) {
+    return false;
+  }
+  map = parse_gain_table_map(entry->bytes.data(), entry->bytes.size(),
+                             entry->big_endian);
+  return true;
+}
+
+void apply_gain_table_map(float *data, const std::size_t width,
+                          const std::size_t height, const GainTableMap &map,
+                          const float white, Histogram *luminance,
+                          const std::array<float, 3> &weights) {
+  const std::size_t n = width * height;
+  const std::uint32_t points_h = map.points_h, points_n = map.points_n;
+  // Rows of the vertically interpolated table get one extra entry and the
+  // table one extra row, copies of the last, so that the upper neighbours
+  // of the trilinear interpolation need no bounds checks.
+  const std::size_t stride = points_n + 1;
+
+  // Left map point and weight of the right one of every column.
+  std::vector<std::uint32_t> column(width);
+  std::vector<float> fraction(width);
+  for (std::size_t x = 0; x < width; x++) {
+    std::uint32_t k;
+    detail::map_position(((x + 0.5) / width - map.origin_h) / map.spacing_h,
+                         points_h, k, fraction[x]);
+    column[x] = static_cast<std::uint32_t>(k * stride);
+  }
+
+  // Input weights folded with the normalisation by white and the scale to
+  // table entries.
+  const float to_entry = float(points_n - 1);
+  std::array<float, 5> w;
+  for (int i = 0; i < 5; i++) {
+    w[i] = map.input_weights[i] / white;
+  }
+
+  constexpr std::size_t bins = ToneCurve::lut_size;
+  const std::size_t min_rows =
+      std::max<std::size_t>(1, grain_size() / std::max<std::size_t>(1, width));
+  const std::size_t chunks = parallel_chunks(height, min_rows);
+  const std::size_t block = color_block();
+  std::vector<std::uint32_t> sub(luminance ? chunks * bins : 0, 0);
+
+  parallel_for(
+      height,
+      [&](std::size_t begin, std::size_t end, std::size_t c) {
+        std::vector<float> table((points_h + 1) * stride);
+        std::vector<float> coordinate(block), gain(block);
+        std::vector<std::uint16_t> yq(block);
+        std::uint32_t *h = luminance ? sub.data() + c * bins : nullptr;
+        for (std::size_t y = begin; y < end; y++) {
+          std::uint32_t k;
+          float f;
+          detail::map_position(((y + 0.5) / height - map.origin_v) /
+                                   map.spacing_v,
+                               map.points_v, k, f);
+          const std::uint32_t k1 = std::min(k + 1, map.points_v - 1);
+          for (std::uint32_t p = 0; p < points_h; p++) {
+            float *row = table.data() + p * stride;
+            const float *a = &map.gains[(std::size_t(k) * points_h + p) *
+                                        points_n];
+            const float *b = &map.gains[(std::size_t(k1) * points_h + p) *
+                                        points_n];
+            for (std::uint32_t m = 0; m < points_n; m++) {
+              row[m] = a[m] + (b[m] - a[m]) * f;
+            }
+            row[points_n] = row[points_n - 1];
+          }
+          std::copy_n(table.data() + (points_h - 1) * stride, stride,
+                      table.data() + points_h * stride);
+
+          float *r = data + y * width, *g = r + n, *b = r + 2 * n;
+          for (std::size_t x0 = 0; x0 < width; x0 += block) {
+            const std::size_t len = std::min(block, width - x0);
+            float *rb = r + x0, *gb = g + x0, *bb = b + x0;
+            for (std::size_t i = 0; i < len; i++) {
+              const float lo = std::min(rb[i], std::min(gb[i], bb[i]));
+              const float hi = std::max(rb[i], std::max(gb[i], bb[i]));
+              const float v = w[0] * rb[i] + w[1] * gb[i] + w[2] * bb[i] +
+                              w[3] * lo + w[4] * hi;
+              coordinate[i] = std::min(std::max(0.f, v), 1.f) * to_entry;
+            }
+            const std::uint32_t *col = column.data() + x0;
+            const float *fx = fraction.data() + x0;
+            for (std::size_t i = 0; i < len; i++) {
+              const float t = coordinate[i];
+              const std::uint32_t m = static_cast<std::uint32_t>(t);
+              const float ft = t - m;
+              const float *p = table.data() + col[i] + m;
+              const float g0 = p[0] + (p[1] - p[0]) * ft;
+              const float g1 = p[stride] + (p[stride + 1] - p[stride]) * ft;
+              gain[i] = g0 + (g1 - g0) * fx[i];
+            }
+            for (std::size_t i = 0; i < len; i++) {
+              rb[i] *= gain[i];
+              gb[i] *= gain[i];
+              bb[i] *= gain[i];
+            }
+            if (h) {
+              for (std::size_t i = 0; i < len; i++) {
+                yq[i] = ToneCurve::clamp_value(
+                    weights[0] * rb[i] + weights[1] * gb[i] +
+                    weights[2] * bb[i]);
+              }
+              for (std::size_t i = 0; i < len; i++) {
+                h[yq[i]]++;
+              }
+            }
+          }
+        }
+      },
+      min_rows);
+
+  if (luminance) {
+    luminance->assign(bins, 0);
+    for (std::size_t c = 0; c < chunks; c++) {
+      const std::uint32_t *h = sub.data() + c * bins;
+      for (std::size_t v = 0; v < bins; v++) {
+        (*luminance)[v] += h[v];
+      }
+    }
+  }
+}
+
+} // namespace yk
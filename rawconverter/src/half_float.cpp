@@ -0,0 +1,84 @@
+#include "half_float.hpp"
+#include "cpu_features.hpp"
+#include "tone_curve.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace yk {
+
+#ifdef YK_HAVE_F16C_KERNELS
+namespace detail {
+// Defined in half_float_f16c.cpp.
+void to_half_f16c(const float *src, Half *dst, std::size_t n,
+                  float scale) noexcept;
+void to_float_f16c(const Half *src, float *dst, std::size_t n,
+                   float scale) noexcept;
+} // namespace detail
+#endif
+
+void to_half(const float *src, Half *dst, const std::size_t n,
+             const float scale) noexcept {
+#ifdef YK_HAVE_F16C_KERNELS
+  if (detail::cpu_has_f16c()) {
+    detail::to_half_f16c(src, dst, n, scale);
+    return;
+  }
+#endif
+  for (std::size_t i = 0; i < n; i++) {
+    dst[i] = to_half(src[i] * scale);
+  }
+}
+
+void to_float(const Half *src, float *dst, const std::size_t n,
+              const float scale) noexcept {
+#ifdef YK_HAVE_F16C_KERNELS
+  if (detail::cpu_has_f16c()) {
+    detail::to_float_f16c(src, dst, n, scale);
+    return;
+  }
+#endif
+  for (std::size_t i = 0; i < n; i++) {
+    dst[i] = to_float(src[i]) * scale;
+  }
+}
+
+HalfErrorStats half_error(const float *values, const std::size_t n) {
+  // Smallest normal Half in code values.
+  const float min_normal = std::ldexp(half_unit, -14);
+  HalfErrorStats res;
+  res.count = n;
+  double sum = 0;
+  for (std::size_t i = 0; i < n; i++) {
+    const float v = values[i];
+    const float h = to_float(to_half(v / half_unit)) * half_unit;
+    const double err = std::abs(double(h) - v);
+    sum += err;
+    res.max_abs = std::max(res.max_abs, err);
+    if (min_normal <= std::abs(v)) {
+      res.max_rel = std::max(res.max_rel, err / std::abs(v));
+    }
+    if (half_unit < v) {
+      res.above_white++;
+    }
+    const int a = ToneCurve::clamp_value(v), b = ToneCurve::clamp_value(h);
+    if (a != b) {
+      res.changed_codes++;
+      res.max_code_diff =
+          std::max<std::size_t>(res.max_code_diff, std::abs(a - b));
+    }
+  }
+  res.mean_abs = n ? sum / n : 0;
+  return res;
+}
+
+std::ostream &operator<<(std::ostream &os, const HalfErrorStats &stats) {
+  const double changed =
+      stats.count ? 100. * stats.changed_codes / stats.count : 0;
+  return os << "fp16 error over " << stats.count
+            << " values (16-bit codes): max " << stats.max_abs << ", mean "
+            << stats.mean_abs << ", max relative " << stats.max_rel
+            << "; changed codes " << changed << "% (max "
+            << stats.max_code_diff << "); above white " << stats.above_white;
+}
+
+} // namespace yk
@@ -0,0 +1,38 @@
+// Built with -mavx -mf16c. Only reached through the dispatch in
+// half_float.cpp.
+#include "half_float.hpp"
+#include <immintrin.h>
+
+namespace yk {
+namespace detail {
+
+void to_half_f16c(const float *src, Half *dst, const std::size_t n,
+                  const float scale) noexcept {
+  const __m256 s = _mm256_set1_ps(scale);
+  std::size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const __m256 v = _mm256_mul_ps(_mm256_loadu_ps(src + i), s);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i),
+                     _mm256_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT));
+  }
+  for (; i < n; i++) {
+    dst[i] = to_half(src[i] * scale);
+  }
+}
+
+void to_float_f16c(const Half *src, float *dst, const std::size_t n,
+                   const float scale) noexcept {
+  const __m256 s = _mm256_set1_ps(scale);
+  std::size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const __m256 v = _mm256_cvtph_ps(
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i)));
+    _mm256_storeu_ps(dst + i, _mm256_mul_ps(v, s));
+  }
+  for (; i < n; i++) {
+    dst[i] = to_float(src[i]) * scale;
+  }
+}
+
+} // namespace detail
+} // namespace yk
@@ -0,0 +1,90 @@
+#include "histogram.hpp"
+#include "parallel.hpp"
+#include <climits>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace yk {
+
+Histogram compute_histogram(const std::uint16_t *data, const std::size_t n,
+                            const std::size_t stride) {
+  constexpr std::size_t bins = ToneCurve::lut_size;
+  // Counting is cheap per element, so chunks are larger than elsewhere.
+  const std::size_t grain = 4 * grain_size();
+  const std::size_t chunks = parallel_chunks(n, grain);
+  std::vector<std::uint32_t> sub(chunks * 2 * bins, 0);
+  parallel_for(
+      n,
+      [&](std::size_t begin, std::size_t end, std::size_t c) {
+        std::uint32_t *h0 = sub.data() + c * 2 * bins;
+        std::uint32_t *h1 = h0 + bins;
+        std::size_t i = (begin + stride - 1) / stride * stride;
+        for (; i + stride < end; i += 2 * stride) {
+          h0[data[i]]++;
+          h1[data[i + stride]]++;
+        }
+        for (; i < end; i += stride) {
+          h0[data[i]]++;
+        }
+      },
+      grain);
+
+  Histogram histogram(bins, 0);
+  parallel_for(
+      bins,
+      [&](std::size_t begin, std::size_t end, std::size_t) {
+        for (std::size_t h = 0; h < 2 * chunks; h++) {
+          const std::uint32_t *src = sub.data() + h * bins;
+          for (std::size_t b = begin; b < end; b++) {
+            histogram[b] += src[b];
+          }
+        }
+      },
+      bins / 4);
+  return histogram;
+}
+
+std::uint64_t histogram_total(const Histogram &histogram) noexcept {
+  std::uint64_t total = 0;
+  for (auto h : histogram) {
+    total += h;
+  }
+  return total;
+}
+
+void inclusive_scan(std::uint32_t *data, const std::size_t n) noexcept {
+  std::size_t i = 0;
+  std::uint32_t carry = 0;
+#ifdef __SSE2__
+  __m128i acc = _mm_setzero_si128();
+  for (; i + 4 <= n; i += 4) {
+    __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+    x = _mm_add_epi32(x, _mm_slli_si128(x, 4));
+    x = _mm_add_epi32(x, _mm_slli_si128(x, 8));
+    x = _mm_add_epi32(x, acc);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(data + i), x);
+    acc = _mm_shuffle_epi32(x, _MM_SHUFFLE(3, 3, 3, 3));
+  }
+  carry = static_cast<std::uint32_t>(_mm_cvtsi128_si32(acc));
+#endif
+  for (; i < n; i++) {
+    carry += data[i];
+    data[i] = carry;
+  }
+}
+
+ToneCurve equalization_curve(Histogram histogram) {
+  inclusive_scan(histogram.data(), histogram.size());
+  const std::uint64_t total = histogram.back();
+  ToneCurve curve;
+  std::uint16_t *lut = curve.lut(0);
+  for (std::size_t v = 0; v < ToneCurve::lut_size; v++) {
+    lut[v] = total ? static_cast<std::uint16_t>(
+                         std::uint64_t(histogram[v]) * USHRT_MAX / total)
+                   : 0;
+  }
+  return curve;
+}
+
+} // namespace yk
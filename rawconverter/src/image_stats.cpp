@@ -0,0 +1,137 @@
+#include "image_stats.hpp"
+#include "parallel.hpp"
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+namespace yk {
+
+namespace detail {
+// Values are accumulated in blocks around a shift (the first value of the
+// block) before being merged into the running statistics, so the error
+// does not grow with the image size. For 16-bit integers the block sums
+// are exact.
+constexpr std::size_t stats_block = 4096;
+
+template <class T>
+ChannelStats block_stats(const T *data, const std::size_t n,
+                         const std::size_t stride) noexcept {
+  ChannelStats res;
+  if (n == 0) {
+    return res;
+  }
+  using Acc = std::conditional_t<std::is_integral_v<T>, std::int64_t, double>;
+  const Acc shift = data[0];
+  Acc sum = 0, sum_sq = 0;
+  T minv = data[0], maxv = data[0];
+  std::size_t count = 0;
+  for (std::size_t i = 0; i < n; i += stride, count++) {
+    const T v = data[i];
+    const Acc d = Acc(v) - shift;
+    sum += d;
+    sum_sq += d * d;
+    minv = std::min(minv, v);
+    maxv = std::max(maxv, v);
+  }
+  res.count = count;
+  res.mean = double(shift) + double(sum) / count;
+  if constexpr (std::is_integral_v<T>) {
+    res.m2 = double(Acc(count) * sum_sq - sum * sum) / count;
+  } else {
+    res.m2 = std::max(0., sum_sq - sum * sum / count);
+  }
+  res.min = minv;
+  res.max = maxv;
+  return res;
+}
+
+template <class T>
+ChannelStats range_stats(const T *data, const std::size_t begin,
+                         const std::size_t end,
+                         const std::size_t stride) noexcept {
+  ChannelStats res;
+  const std::size_t block = stats_block * stride;
+  // Align the first sample to the stride so that sampling does not depend
+  // on how the range was split.
+  std::size_t i = (begin + stride - 1) / stride * stride;
+  for (; i < end; i += block) {
+    res.merge(block_stats(data + i, std::min(block, end - i), stride));
+  }
+  return res;
+}
+} // namespace detail
+
+template <class T>
+ChannelStats compute_stats(const T *data, const std::size_t n,
+                           const std::size_t stride) {
+  const std::size_t grain = grain_size();
+  std::vector<ChannelStats> partial(parallel_chunks(n, grain));
+  parallel_for(
+      n,
+      [&](std::size_t begin, std::size_t end, std::size_t c) {
+        partial[c] = detail::range_stats(data, begin, end, stride);
+      },
+      grain);
+  ChannelStats res;
+  for (auto &p : partial) {
+    res.merge(p);
+  }
+  return res;
+}
+
+template <class T>
+ImageStats compute_image_stats(const T *data, const std::size_t n,
+                               const std::size_t stride) {
+  const std::size_t grain = grain_size();
+  std::vector<ImageStats> partial(parallel_chunks(n, grain));
+  parallel_for(
+      n,
+      [&](std::size_t begin, std::size_t end, std::size_t c) {
+        for (int ch = 0; ch < 3; ch++) {
+          partial[c].channels[ch] =
+              detail::range_stats(data + ch * n, begin, end, stride);
+        }
+      },
+      grain);
+  ImageStats res;
+  for (auto &p : partial) {
+    for (int ch = 0; ch < 3; ch++) {
+      res.channels[ch].merge(p.channels[ch]);
+    }
+  }
+  return res;
+}
+
+ChannelStats histogram_stats(const Histogram &histogram) noexcept {
+  ChannelStats res;
+  std::uint64_t count = 0;
+  double sum = 0;
+  for (std::size_t v = 0; v < histogram.size(); v++) {
+    if (histogram[v]) {
+      count += histogram[v];
+      sum += double(histogram[v]) * v;
+      res.min = std::min<double>(res.min, v);
+      res.max = std::max<double>(res.max, v);
+    }
+  }
+  if (!count) {
+    return res;
+  }
+  res.count = count;
+  res.mean = sum / count;
+  for (std::size_t v = 0; v < histogram.size(); v++) {
+    const double d = v - res.mean;
+    res.m2 += histogram[v] * d * d;
+  }
+  return res;
+}
+
+template ChannelStats compute_stats(const std::uint16_t *, std::size_t,
+                                    std::size_t);
+template ChannelStats compute_stats(const float *, std::size_t, std::size_t);
+template ImageStats compute_image_stats(const std::uint16_t *, std::size_t,
+                                        std::size_t);
+template ImageStats compute_image_stats(const float *, std::size_t,
+                                        std::size_t);
+
+} // namespace yk
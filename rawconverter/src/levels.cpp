@@ -0,0 +1,270 @@
+#include "levels.hpp"
+#include "parallel.hpp"
+#include "tone_curve.hpp"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+
+namespace yk {
+
+namespace {
+// Columns of a map area between the same two map points.
+struct Run {
+  std::size_t begin, end;
+  std::uint32_t k;
+};
+
+// Horizontal interpolation weights of a gain map, shared by all rows.
+struct PreparedMap {
+  const GainMap *map;
+  std::size_t left, right, bottom;
+  // Weight of the right map point of each column of [left, right).
+  std::vector<float> fraction;
+  std::vector<Run> runs;
+};
+
+PreparedMap prepare(const GainMap &map, const std::size_t width,
+                    const std::size_t height) {
+  PreparedMap res;
+  res.map = &map;
+  res.left = std::min<std::size_t>(map.left, width);
+  res.right = std::min<std::size_t>(map.right, width);
+  res.bottom = std::min<std::size_t>(map.bottom, height);
+  res.fraction.resize(res.right - res.left);
+  for (std::size_t x = res.left; x < res.right; x++) {
+    const double u = ((x + 0.5) / width - map.origin_h) / map.spacing_h;
+    std::uint32_t k;
+    detail::map_position(u, map.points_h, k, res.fraction[x - res.left]);
+    if (res.runs.empty() || res.runs.back().k != k) {
+      res.runs.push_back({x, x, k});
+    }
+    res.runs.back().end = x + 1;
+  }
+  return res;
+}
+
+// Multiply the gains of a map at row y into gain[0, width). Returns false
+// if the map does not cover the row and channel.
+bool accumulate(const PreparedMap &pm, const std::size_t y,
+                const std::size_t height, const std::uint32_t channel,
+                std::vector<float> &points, float *gain) {
+  const GainMap &map = *pm.map;
+  if (channel < map.plane || channel - map.plane >= map.planes ||
+      y < map.top || y >= pm.bottom || (y - map.top) % map.row_pitch) {
+    return false;
+  }
+  const std::uint32_t plane =
+      std::min(channel - map.plane, map.map_planes - 1);
+  std::uint32_t k;
+  float f;
+  detail::map_position(((y + 0.5) / height - map.origin_v) / map.spacing_v,
+                       map.points_v, k, f);
+  const std::uint32_t k1 = std::min(k + 1, map.points_v - 1);
+  // Vertically interpolated row of map points, padded for points_h == 1.
+  points.resize(map.points_h + 1);
+  for (std::uint32_t h = 0; h < map.points_h; h++) {
+    const float a = map.gain(k, h, plane), b = map.gain(k1, h, plane);
+    points[h] = a + (b - a) * f;
+  }
+  points[map.points_h] = points[map.points_h - 1];
+
+  for (const Run &run : pm.runs) {
+    const float base = points[run.k], delta = points[run.k + 1] - base;
+    const float *fraction = pm.fraction.data() - pm.left;
+    if (map.col_pitch == 1) {
+      for (std::size_t x = run.begin; x < run.end; x++) {
+        gain[x] *= base + delta * fraction[x];
+      }
+    } else {
+      for (std::size_t x = run.begin; x < run.end; x++) {
+        if ((x - map.left) % map.col_pitch == 0) {
+          gain[x] *= base + delta * fraction[x];
+        }
+      }
+    }
+  }
+  return true;
+}
+} // namespace
+
+LevelParams white_point_levels(const float white,
+                               const std::array<float, 3> &black) {
+  LevelParams params;
+  const float range =
+      white - *std::max_element(black.begin(), black.end());
+  params.scale = USHRT_MAX / std::max(range, 1.f);
+  for (int ch = 0; ch < 3; ch++) {
+    params.black[ch] = black[ch] * params.scale;
+  }
+  params.white = white * params.scale;
+  return params;
+}
+
+WhiteBalance parse_white_balance(const std::string &s) {
+  WhiteBalance wb;
+  if (s == "none") {
+    wb.mode = WhiteBalance::Mode::none;
+  } else if (s == "as-shot") {
+    wb.mode = WhiteBalance::Mode::as_shot;
+  } else if (s == "auto") {
+    wb.mode = WhiteBalance::Mode::gray_world;
+  } else {
+    wb.mode = WhiteBalance::Mode::custom;
+    std::istringstream is(s);
+    char comma[2] = {};
+    is >> wb.multipliers[0] >> comma[0] >> wb.multipliers[1] >> comma[1] >>
+        wb.multipliers[2];
+    if (!is || !is.eof() || comma[0] != ',' || comma[1] != ',') {
+      throw std::invalid_argument("Unknown white balance: " + s);
+    }
+  }
+  return wb;
+}
+
+std::array<float, 3> normalize_gains(const std::array<float, 3> &multipliers) {
+  for (const float m : multipliers) {
+    if (!(0.f < m) || !std::isfinite(m)) {
+      throw std::invalid_argument("White balance multipliers must be "
+                                  "positive");
+    }
+  }
+  const float low = *std::min_element(multipliers.begin(), multipliers.end());
+  return {multipliers[0] / low, multipliers[1] / low, multipliers[2] / low};
+}
+
+std::array<float, 3>
+white_balance_gains(const WhiteBalance &wb, const std::uint16_t *src,
+                    const std::size_t n, const LevelParams &params,
+                    const std::array<float, 3> &neutral,
+                    const std::size_t stride) {
+  switch (wb.mode) {
+  case WhiteBalance::Mode::none:
+    return {1.f, 1.f, 1.f};
+  case WhiteBalance::Mode::as_shot:
+    for (const float v : neutral) {
+      if (!(0.f < v) || !std::isfinite(v)) {
+        return {1.f, 1.f, 1.f};
+      }
+    }
+    return normalize_gains(
+        {1.f / neutral[0], 1.f / neutral[1], 1.f / neutral[2]});
+  case WhiteBalance::Mode::custom:
+    return normalize_gains(wb.multipliers);
+  case WhiteBalance::Mode::gray_world:
+    break;
+  }
+  // Means of the sampled pixels after scale and black level, leaving out
+  // pixels clipped in any channel, whose color is lost. Scaled 13-bit data
+  // peaks at 65528, so anything within 1/64 of white counts as clipped.
+  const float clip_value = params.white * (63.f / 64.f);
+  std::array<double, 3> sum = {0., 0., 0.};
+  std::size_t count = 0;
+  for (std::size_t i = 0; i < n; i += std::max<std::size_t>(1, stride)) {
+    std::array<float, 3> v;
+    bool clipped = false;
+    for (int ch = 0; ch < 3; ch++) {
+      const float scaled = src[ch * n + i] * params.scale;
+      clipped |= clip_value <= scaled;
+      v[ch] = scaled - params.black[ch];
+    }
+    if (!clipped) {
+      for (int ch = 0; ch < 3; ch++) {
+        sum[ch] += v[ch];
+      }
+      count++;
+    }
+  }
+  if (count == 0 || !(0. < sum[0] && 0. < sum[1] && 0. < sum[2])) {
+    return {1.f, 1.f, 1.f};
+  }
+  return normalize_gains({float(sum[1] / sum[0]), 1.f, float(sum[1] / sum[2])});
+}
+
+void normalize_levels(const std::uint16_t *src, std::uint16_t *dst,
+                      const std::size_t width, const std::size_t height,
+                      const LevelParams &params,
+                      const std::vector<GainMap> &gain_maps) {
+  std::vector<PreparedMap> maps;
+  for (const auto &map : gain_maps) {
+    maps.push_back(prepare(map, width, height));
+  }
+  const std::size_t n = width * height;
+  parallel_for(
+      height,
+      [&](std::size_t begin, std::size_t end, std::size_t) {
+        std::vector<float> gain(width), points;
+        for (std::size_t y = begin; y < end; y++) {
+          for (std::uint32_t ch = 0; ch < 3; ch++) {
+            bool has_gain = false;
+            if (!maps.empty()) {
+              std::fill(gain.begin(), gain.end(), 1.f);
+            }
+            for (const auto &pm : maps) {
+              has_gain |= accumulate(pm, y, height, ch, points, gain.data());
+            }
+            const std::uint16_t *s = src + ch * n + y * width;
+            std::uint16_t *d = dst + ch * n + y * width;
+            // min(s * scale - black, white - black) * wb with wb folded
+            // in.
+            const float wb = params.gains[ch];
+            const float scale = params.scale * wb,
+                        black = params.black[ch] * wb,
+                        clip = (params.white - params.black[ch]) * wb;
+            if (has_gain) {
+              const float *g = gain.data();
+              for (std::size_t x = 0; x < width; x++) {
+                const float v = std::min(s[x] * scale - black, clip);
+                d[x] = ToneCurve::clamp_value(v * g[x] + 0.5f);
+              }
+            } else {
+              for (std::size_t x = 0; x < width; x++) {
+                const float v = std::min(s[x] * scale - black, clip);
+                d[x] = ToneCurve::clamp_value(v + 0.5f);
+              }
+            }
+          }
+        }
+      },
+      16);
+}
+
+void apply_mosaic_gain_maps(std::uint16_t *raw, const std::size_t width,
+                            const std::size_t height, const std::size_t stride,
+                            const std::array<float, 4> &black,
+                            const std::vector<GainMap> &gain_maps) {
+  std::vector<PreparedMap> maps;
+  for (const auto &map : gain_maps) {
+    maps.push_back(prepare(map, width, height));
+  }
+  if (maps.empty()) {
+    return;
+  }
+  parallel_for(
+      height,
+      [&](std::size_t begin, std::size_t end, std::size_t) {
+        std::vector<float> gain(width), points;
+        for (std::size_t y = begin; y < end; y++) {
+          std::fill(gain.begin(), gain.end(), 1.f);
+          bool has_gain = false;
+          for (const auto &pm : maps) {
+            has_gain |= accumulate(pm, y, height, 0, points, gain.data());
+          }
+          if (!has_gain) {
+            continue;
+          }
+          std::uint16_t *row = raw + y * stride;
+          const float row_black[2] = {black[(y & 1) * 2],
+                                      black[(y & 1) * 2 + 1]};
+          const float *g = gain.data();
+          for (std::size_t x = 0; x < width; x++) {
+            const float b = row_black[x & 1];
+            row[x] = ToneCurve::clamp_value(b + (row[x] - b) * g[x] + 0.5f);
+          }
+        }
+      },
+      16);
+}
+
+} // namespace yk
@@ -0,0 +1,168 @@
+#include "local_tone_map.hpp"
+#include "parallel.hpp"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+namespace yk {
+
+ToneCurve clipped_equalization_curve(Histogram histogram,
+                                     const float clip_limit,
+                                     const int bin_bits) {
+  if (bin_bits < 1 || 16 < bin_bits) {
+    throw std::invalid_argument("bin_bits must be in [1, 16]");
+  }
+  const std::size_t bins = histogram.size();
+  if (bins != std::size_t(1) << bin_bits) {
+    throw std::invalid_argument("histogram must have 2^bin_bits bins");
+  }
+  const std::uint64_t total = histogram_total(histogram);
+  if (0 < clip_limit && total) {
+    const auto limit = std::max<std::uint32_t>(
+        1, static_cast<std::uint32_t>(clip_limit * total / bins));
+    std::uint64_t excess = 0;
+    for (auto &h : histogram) {
+      if (limit < h) {
+        excess += h - limit;
+        h = limit;
+      }
+    }
+    const std::uint32_t uniform = excess / bins;
+    const std::size_t residual = excess % bins;
+    for (std::size_t b = 0; b < bins; b++) {
+      histogram[b] += uniform + (b < residual ? 1 : 0);
+    }
+  }
+  inclusive_scan(histogram.data(), bins);
+
+  ToneCurve curve;
+  std::uint16_t *lut = curve.lut(0);
+  if (!total) {
+    return curve;
+  }
+  const int shift = 16 - bin_bits;
+  const float scale = float(USHRT_MAX) / total;
+  const float inv_width = 1.f / (1 << shift);
+  for (std::size_t v = 0; v < ToneCurve::lut_size; v++) {
+    const std::size_t b = v >> shift;
+    const float lo = b ? histogram[b - 1] : 0.f;
+    const float hi = histogram[b];
+    const float t = ((v & ((1 << shift) - 1)) + 1) * inv_width;
+    lut[v] = ToneCurve::clamp_value((lo + (hi - lo) * t) * scale + 0.5f);
+  }
+  return curve;
+}
+
+void local_equalization(const ImageView &image, const std::size_t width,
+                        const std::size_t height, std::uint16_t *dst,
+                        const LocalToneMapParams &params) {
+  if (width == 0 || height == 0) {
+    return;
+  }
+  const std::size_t tiles_x = std::clamp<std::size_t>(params.tiles_x, 1, width);
+  const std::size_t tiles_y =
+      std::clamp<std::size_t>(params.tiles_y, 1, height);
+  const int bin_bits = std::clamp(params.bin_bits, 1, 16);
+  const int shift = 16 - bin_bits;
+
+  // Per-tile curves.
+  std::vector<ToneCurve> curves(tiles_x * tiles_y);
+  parallel_for(
+      curves.size(),
+      [&](std::size_t begin, std::size_t end, std::size_t) {
+        for (std::size_t t = begin; t < end; t++) {
+          const std::size_t tx = t % tiles_x, ty = t / tiles_x;
+          const std::size_t x0 = tx * width / tiles_x;
+          const std::size_t x1 = (tx + 1) * width / tiles_x;
+          const std::size_t y0 = ty * height / tiles_y;
+          const std::size_t y1 = (ty + 1) * height / tiles_y;
+          Histogram histogram(std::size_t(1) << bin_bits, 0);
+          for (std::size_t y = y0; y < y1; y++) {
+            const std::uint16_t *row = image.channel(1) + y * width;
+            for (std::size_t x = x0; x < x1; x++) {
+              histogram[row[x] >> shift]++;
+            }
+          }
+          curves[t] = clipped_equalization_curve(std::move(histogram),
+                                                 params.clip_limit, bin_bits);
+        }
+      },
+      1);
+
+  if (curves.size() == 1) {
+    apply_tone_curve(image.data, dst, image.size, curves[0]);
+    return;
+  }
+
+  // Neighbouring tiles and blend weights of each column.
+  struct Neighbours {
+    std::uint32_t t0, t1;
+    float w;
+  };
+  auto neighbours = [](const std::size_t pos, const std::size_t length,
+                       const std::size_t tiles) {
+    const float f = (pos + 0.5f) * tiles / length - 0.5f;
+    const long t0 = std::clamp<long>(std::floor(f), 0, tiles - 1);
+    const long t1 = std::min<long>(t0 + 1, tiles - 1);
+    return Neighbours{static_cast<std::uint32_t>(t0),
+                      static_cast<std::uint32_t>(t1),
+                      std::clamp(f - t0, 0.f, 1.f)};
+  };
+  // The pair of neighbouring tiles only changes between tile centres, so a
+  // row splits into at most tiles_x + 1 runs of columns sharing four curves.
+  struct Run {
+    std::size_t x0, x1;
+    std::uint32_t t0, t1;
+  };
+  std::vector<float> weights(width);
+  std::vector<Run> runs;
+  for (std::size_t x = 0; x < width; x++) {
+    const Neighbours c = neighbours(x, width, tiles_x);
+    weights[x] = c.w;
+    if (runs.empty() || runs.back().t0 != c.t0) {
+      runs.push_back({x, x, c.t0, c.t1});
+    }
+    runs.back().x1 = x + 1;
+  }
+
+  // Each run goes through the four curves with the shared lookup kernel
+  // (AVX2 gathers where available) into scratch rows; the bilinear blend of
+  // the four rows is then plain arithmetic that auto-vectorises.
+  parallel_for(
+      height,
+      [&](std::size_t begin, std::size_t end, std::size_t) {
+        std::vector<std::uint16_t> scratch(4 * width);
+        std::uint16_t *a = scratch.data(), *b = a + width, *d = b + width,
+                      *e = d + width;
+        for (std::size_t y = begin; y < end; y++) {
+          const Neighbours row = neighbours(y, height, tiles_y);
+          const ToneCurve *top = curves.data() + row.t0 * tiles_x;
+          const ToneCurve *bottom = curves.data() + row.t1 * tiles_x;
+          const float wy = row.w;
+          for (int ch = 0; ch < 3; ch++) {
+            const std::uint16_t *src = image.channel(ch) + y * width;
+            std::uint16_t *out = dst + ch * image.size + y * width;
+            for (const Run &r : runs) {
+              const std::size_t len = r.x1 - r.x0;
+              apply_lut(src + r.x0, a + r.x0, len, top[r.t0].lut(0));
+              apply_lut(src + r.x0, b + r.x0, len, top[r.t1].lut(0));
+              apply_lut(src + r.x0, d + r.x0, len, bottom[r.t0].lut(0));
+              apply_lut(src + r.x0, e + r.x0, len, bottom[r.t1].lut(0));
+            }
+            const float *wx = weights.data();
+            for (std::size_t x = 0; x < width; x++) {
+              const float upper = a[x] + (float(b[x]) - a[x]) * wx[x];
+              const float lower = d[x] + (float(e[x]) - d[x]) * wx[x];
+              const float v = upper + (lower - upper) * wy + 0.5f;
+              out[x] = static_cast<std::uint16_t>(
+                  std::min(std::max(v, 0.f), float(USHRT_MAX)));
+            }
+          }
+        }
+      },
+      16);
+}
+
+} // namespace yk
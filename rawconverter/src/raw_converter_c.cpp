@@ -0,0 +1,277 @@
+#include "raw_converter_c.h"
+#include "autotune.hpp"
+#include "parallel.hpp"
+#include "raw_converter.hpp"
+#include <libraw.h>
+#include <memory>
+#include <new>
+#include <stdexcept>
+
+struct rc_image {
+  LibRaw raw;
+  // Camera native image of shape (3, N) after demosaicing (Bayer files),
+  // level adjustment and black subtraction, shared by every conversion of
+  // the handle.
+  xt::xtensor<ushort, 2> camera;
+  // Intermediate sRGB' image, kept to avoid reallocating per conversion.
+  xt::xtensor<ushort, 2> scratch;
+  yk::ImageStats stats;
+  bool has_stats = false;
+};
+
+namespace {
+
+// Stateless parts of the pipeline are shared by all handles.
+const yk::RawConverter &converter() {
+  static const yk::RawConverter rc;
+  return rc;
+}
+
+template <class F> rc_status guarded(F &&f) noexcept {
+  try {
+    return f();
+  } catch (const std::bad_alloc &) {
+    return RC_ERROR_OUT_OF_MEMORY;
+  } catch (const std::invalid_argument &) {
+    return RC_ERROR_INVALID_ARGUMENT;
+  } catch (...) {
+    return RC_ERROR_INTERNAL;
+  }
+}
+
+template <class Open> rc_status open_image(Open &&open, rc_image **image) {
+  if (!image) {
+    return RC_ERROR_INVALID_ARGUMENT;
+  }
+  *image = nullptr;
+  return guarded([&] {
+    auto res = std::make_unique<rc_image>();
+    if (open(res->raw) != LIBRAW_SUCCESS) {
+      return RC_ERROR_OPEN;
+    }
+    if (res->raw.unpack() != LIBRAW_SUCCESS) {
+      return RC_ERROR_UNPACK;
+    }
+    const auto &rawdata = res->raw.imgdata.rawdata;
+    if (rawdata.color4_image) {
+      // Linear DNG (ProRaw): LibRaw has already interpolated the image.
+      const std::size_t n = (std::size_t)res->raw.imgdata.sizes.iheight *
+                            res->raw.imgdata.sizes.iwidth;
+      res->camera = xt::xtensor<ushort, 2>({3, n});
+      const auto *src = rawdata.color4_image;
+      ushort *dst = res->camera.data();
+      yk::parallel_for(n,
+                       [&](std::size_t begin, std::size_t end, std::size_t) {
+                         for (std::size_t i = begin; i < end; i++) {
+                           for (int ch = 0; ch < 3; ch++) {
+                             dst[ch * n + i] = src[i][ch];
+                           }
+                         }
+                       });
+      converter().raw_adjust(res->camera);
+      converter().subtract_black(res->camera, res->raw.imgdata.color.black,
+                                 res->raw.imgdata.color.cblack);
+    } else {
+      // Bayer mosaic, demosaiced here as in my_conversion.
+      yk::CfaPattern cfa;
+      try {
+        cfa = yk::RawConverter::cfa_pattern(res->raw);
+      } catch (const std::runtime_error &) {
+        return RC_ERROR_UNSUPPORTED;
+      }
+      const auto &sizes = res->raw.imgdata.sizes;
+      res->camera = converter().demosaic(rawdata, sizes, cfa);
+      converter().normalize_levels(
+          res->camera, sizes.width, sizes.height,
+          yk::RawConverter::cfa_level_params(res->raw.imgdata.color));
+    }
+    *image = res.release();
+    return RC_OK;
+  });
+}
+
+} // namespace
+
+extern "C" {
+
+int rc_api_version(void) { return RC_API_VERSION; }
+
+const char *rc_status_string(const rc_status status) {
+  switch (status) {
+  case RC_OK:
+    return "success";
+  case RC_ERROR_INVALID_ARGUMENT:
+    return "invalid argument";
+  case RC_ERROR_OPEN:
+    return "LibRaw failed to read the image";
+  case RC_ERROR_UNPACK:
+    return "LibRaw failed to unpack the image";
+  case RC_ERROR_BUFFER_TOO_SMALL:
+    return "output buffer too small";
+  case RC_ERROR_NO_RESULT:
+    return "no image has been converted yet";
+  case RC_ERROR_OUT_OF_MEMORY:
+    return "out of memory";
+  case RC_ERROR_INTERNAL:
+    return "internal error";
+  case RC_ERROR_UNSUPPORTED:
+    return "unsupported sensor layout";
+  }
+  return "unknown status";
+}
+
+void rc_default_params(rc_params *params) {
+  if (params) {
+    params->tone_mapper = "stretch";
+    params->stretch_rate = 0.01f;
+    params->local_clip_limit = 0.f;
+    params->gamma = 1;
+    params->layout = RC_LAYOUT_PLANAR;
+    params->num_threads = 0;
+  }
+}
+
+rc_status rc_open(const char *path, rc_image **image) {
+  if (!path) {
+    return RC_ERROR_INVALID_ARGUMENT;
+  }
+  return open_image([&](LibRaw &raw) { return raw.open_file(path); }, image);
+}
+
+rc_status rc_open_buffer(const void *data, const size_t size,
+                         rc_image **image) {
+  if (!data || !size) {
+    return RC_ERROR_INVALID_ARGUMENT;
+  }
+  return open_image(
+      [&](LibRaw &raw) {
+        return raw.open_buffer(const_cast<void *>(data), size);
+      },
+      image);
+}
+
+rc_status rc_get_info(const rc_image *image, rc_info *info) {
+  if (!image || !info) {
+    return RC_ERROR_INVALID_ARGUMENT;
+  }
+  info->width = image->raw.imgdata.sizes.iwidth;
+  info->height = image->raw.imgdata.sizes.iheight;
+  return RC_OK;
+}
+
+rc_status rc_convert_into(rc_image *image, const rc_params *params,
+                          uint16_t *dst, const size_t dst_size) {
+  if (!image || !dst) {
+    return RC_ERROR_INVALID_ARGUMENT;
+  }
+  rc_params p;
+  rc_default_params(&p);
+  if (params) {
+    p = *params;
+  }
+  if (p.layout != RC_LAYOUT_PLANAR && p.layout != RC_LAYOUT_INTERLEAVED) {
+    return RC_ERROR_INVALID_ARGUMENT;
+  }
+  const std::size_t n = image->camera.shape()[1];
+  if (dst_size < 3 * n) {
+    return RC_ERROR_BUFFER_TOO_SMALL;
+  }
+  image->has_stats = false;
+  const yk::ScopedNumThreads threads(p.num_threads);
+
+  return guarded([&] {
+    // Camera native -> sRGB' with the luminance histogram in the same pass.
+    auto &srgb = image->scratch;
+    if (srgb.size() != 3 * n) {
+      srgb = xt::xtensor<ushort, 2>({3, n});
+    }
+    yk::Matrix3 srgb_from_cam;
+    for (int i = 0; i < 3; i++) {
+      for (int j = 0; j < 3; j++) {
+        srgb_from_cam[i][j] = image->raw.imgdata.color.rgb_cam[i][j];
+      }
+    }
+    yk::Histogram luminance;
+    yk::color_transform(image->camera.data(), srgb.data(), n, srgb_from_cam,
+                        &luminance, yk::sRGB_luminance);
+
+    // Global brightness adjustment.
+    const std::string name = p.tone_mapper ? p.tone_mapper : "stretch";
+    yk::ToneCurve curve;
+    if (name != "stretch" || 1e-6 <= p.stretch_rate) {
+      curve = yk::ToneMapperRegistry::instance()
+                  .create(name, {{"stretch_rate", p.stretch_rate}})
+                  ->build_curve_from_histogram(luminance);
+    }
+
+    // Brightness and gamma are applied in one pass unless local contrast
+    // equalisation has to run in between.
+    const yk::ToneCurve &gamma = converter().gamma_curve;
+    const bool local = 0.f < p.local_clip_limit;
+    if (local) {
+      yk::apply_tone_curve(srgb.data(), srgb.data(), n, curve);
+      yk::LocalToneMapParams local_params;
+      local_params.clip_limit = p.local_clip_limit;
+      yk::local_equalization({srgb.data(), n},
+                             image->raw.imgdata.sizes.iwidth,
+                             image->raw.imgdata.sizes.iheight, srgb.data(),
+                             local_params);
+      curve = yk::ToneCurve();
+    }
+    if (p.gamma) {
+      curve = yk::compose(curve, gamma);
+    }
+
+    if (p.layout == RC_LAYOUT_PLANAR) {
+      yk::apply_tone_curve(srgb.data(), dst, n, curve);
+      image->stats = yk::compute_image_stats(dst, n);
+    } else {
+      yk::apply_tone_curve(srgb.data(), srgb.data(), n, curve);
+      image->stats = yk::compute_image_stats(srgb.data(), n);
+      const ushort *src = srgb.data();
+      yk::parallel_for(n,
+                       [&](std::size_t begin, std::size_t end, std::size_t) {
+                         for (std::size_t i = begin; i < end; i++) {
+                           dst[3 * i] = src[i];
+                           dst[3 * i + 1] = src[n + i];
+                           dst[3 * i + 2] = src[2 * n + i];
+                         }
+                       });
+    }
+    image->has_stats = true;
+    return RC_OK;
+  });
+}
+
+rc_status rc_stats(const rc_image *image, rc_channel_stats stats[3]) {
+  if (!image || !stats) {
+    return RC_ERROR_INVALID_ARGUMENT;
+  }
+  if (!image->has_stats) {
+    return RC_ERROR_NO_RESULT;
+  }
+  for (int ch = 0; ch < 3; ch++) {
+    const yk::ChannelStats &s = image->stats[ch];
+    stats[ch] = {s.count, s.mean, s.stddev(), s.min, s.max};
+  }
+  return RC_OK;
+}
+
+void rc_set_num_threads(const size_t n) { yk::set_num_threads(n); }
+
+void rc_set_thread_num_threads(const size_t n) {
+  yk::detail::local_num_threads() = n;
+}
+
+size_t rc_num_threads(void) { return yk::num_threads(); }
+
+rc_status rc_autotune(const char *path, const int recalibrate) {
+  return guarded([&] {
+    yk::autotune(path ? path : yk::default_profile_path(), recalibrate != 0);
+    return RC_OK;
+  });
+}
+
+void rc_close(rc_image *image) { delete image; }
+
+} // extern "C"
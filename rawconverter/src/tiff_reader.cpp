@@ -0,0 +1,230 @@
+#include "tiff_reader.hpp"
+#include <cstring>
+#include <fstream>
+#include <set>
+#include <stdexcept>
+
+namespace yk {
+
+namespace {
+// Bounds on malformed files: directories linked in a cycle or absurd
+// entry counts.
+constexpr std::size_t max_ifds = 256;
+constexpr std::uint16_t max_entries = 4096;
+
+template <class T>
+T load(const std::uint8_t *p, const bool big_endian) noexcept {
+  std::uint8_t b[sizeof(T)];
+  for (std::size_t i = 0; i < sizeof(T); i++) {
+    b[i] = big_endian ? p[sizeof(T) - 1 - i] : p[i];
+  }
+  T res;
+  std::memcpy(&res, b, sizeof(T));
+  return res;
+}
+
+[[noreturn]] void malformed(const std::string &what) {
+  throw std::runtime_error("Malformed TIFF: " + what);
+}
+} // namespace
+
+std::size_t TiffEntry::type_size(const std::uint16_t type) noexcept {
+  switch (type) {
+  case 1:  // BYTE
+  case 2:  // ASCII
+  case 6:  // SBYTE
+  case 7:  // UNDEFINED
+    return 1;
+  case 3:  // SHORT
+  case 8:  // SSHORT
+    return 2;
+  case 4:  // LONG
+  case 9:  // SLONG
+  case 11: // FLOAT
+  case 13: // IFD
+    return 4;
+  case 5:  // RATIONAL
+  case 10: // SRATIONAL
+  case 12: // DOUBLE
+    return 8;
+  default:
+    return 0;
+  }
+}
+
+double TiffEntry::number(const std::size_t i) const {
+  const std::size_t size = type_size(type);
+  if (i >= count || size == 0 || bytes.size() < (i + 1) * size) {
+    throw std::out_of_range("TIFF value index out of range");
+  }
+  const std::uint8_t *p = bytes.data() + i * size;
+  switch (type) {
+  case 1:
+  case 7:
+    return p[0];
+  case 6:
+    return static_cast<std::int8_t>(p[0]);
+  case 3:
+    return load<std::uint16_t>(p, big_endian);
+  case 8:
+    return load<std::int16_t>(p, big_endian);
+  case 4:
+  case 13:
+    return load<std::uint32_t>(p, big_endian);
+  case 9:
+    return load<std::int32_t>(p, big_endian);
+  case 5: {
+    const std::uint32_t d = load<std::uint32_t>(p + 4, big_endian);
+    return d ? double(load<std::uint32_t>(p, big_endian)) / d : 0.;
+  }
+  case 10: {
+    const std::int32_t d = load<std::int32_t>(p + 4, big_endian);
+    return d ? double(load<std::int32_t>(p, big_endian)) / d : 0.;
+  }
+  case 11:
+    return load<float>(p, big_endian);
+  case 12:
+    return load<double>(p, big_endian);
+  default:
+    throw std::out_of_range("TIFF value is not numeric");
+  }
+}
+
+std::vector<double> TiffEntry::numbers() const {
+  std::vector<double> res(count);
+  for (std::size_t i = 0; i < count; i++) {
+    res[i] = number(i);
+  }
+  return res;
+}
+
+TiffReader::TiffReader(std::istream &is) {
+  is.seekg(0, std::ios::end);
+  file_size_ = static_cast<std::uint64_t>(is.tellg());
+  is.seekg(0);
+  char order[2] = {};
+  if (!is.read(order, 2)) {
+    malformed("no header");
+  }
+  if (order[0] == 'I' && order[1] == 'I') {
+    big_endian_ = false;
+  } else if (order[0] == 'M' && order[1] == 'M') {
+    big_endian_ = true;
+  } else {
+    malformed("unknown byte order");
+  }
+  // DCP camera profiles use the TIFF layout with the magic "RC".
+  const std::uint16_t magic = read16(is);
+  if (magic != 42 && magic != dcp_magic) {
+    malformed("not a classic TIFF");
+  }
+
+  std::vector<std::uint32_t> pending = {read32(is)};
+  std::set<std::uint32_t> seen;
+  for (std::size_t k = 0; k < pending.size(); k++) {
+    std::uint32_t offset = pending[k];
+    while (offset != 0 && seen.insert(offset).second) {
+      if (ifds_.size() >= max_ifds) {
+        malformed("too many directories");
+      }
+      offset = read_ifd(is, offset, pending);
+    }
+  }
+  if (ifds_.empty()) {
+    malformed("no directories");
+  }
+}
+
+TiffReader TiffReader::open(const std::string &path) {
+  std::ifstream is(path, std::ios::binary);
+  if (!is) {
+    throw std::runtime_error("Failed to open file: " + path);
+  }
+  return TiffReader(is);
+}
+
+const TiffIfd &TiffReader::raw_ifd() const noexcept {
+  for (const auto &ifd : ifds_) {
+    const TiffEntry *type = find(ifd, new_subfile_type_tag);
+    if (type && type->count == 1 && type->number() == 0.) {
+      return ifd;
+    }
+  }
+  return ifds_.front();
+}
+
+const TiffEntry *TiffReader::find(const TiffIfd &ifd,
+                                  const std::uint16_t tag) noexcept {
+  const auto it = ifd.find(tag);
+  return it == ifd.end() ? nullptr : &it->second;
+}
+
+const TiffEntry *TiffReader::find(const std::uint16_t tag) const noexcept {
+  return find(ifds_.front(), tag);
+}
+
+std::uint32_t TiffReader::read_ifd(std::istream &is, const std::uint32_t offset,
+                                   std::vector<std::uint32_t> &sub_ifds) {
+  if (offset + std::uint64_t(2) > file_size_) {
+    malformed("directory offset out of range");
+  }
+  is.seekg(offset);
+  const std::uint16_t n = read16(is);
+  if (n > max_entries) {
+    malformed("too many entries");
+  }
+  TiffIfd ifd;
+  for (std::uint16_t e = 0; e < n; e++) {
+    const std::uint64_t position = offset + 2 + std::uint64_t(12) * e;
+    is.seekg(position);
+    const std::uint16_t tag = read16(is);
+    TiffEntry entry;
+    entry.type = read16(is);
+    entry.count = read32(is);
+    entry.big_endian = big_endian_;
+    const std::size_t size = TiffEntry::type_size(entry.type);
+    if (size == 0) {
+      continue; // Unknown types are skipped, as the TIFF spec asks.
+    }
+    const std::uint64_t length = std::uint64_t(size) * entry.count;
+    std::uint64_t value_offset = position + 8;
+    if (length > 4) {
+      value_offset = read32(is);
+    }
+    if (value_offset + length > file_size_) {
+      malformed("value of tag " + std::to_string(tag) + " out of range");
+    }
+    entry.bytes.resize(length);
+    is.seekg(value_offset);
+    if (!is.read(reinterpret_cast<char *>(entry.bytes.data()), length)) {
+      malformed("truncated value");
+    }
+    if (tag == sub_ifds_tag && (entry.type == 4 || entry.type == 13)) {
+      for (std::size_t i = 0; i < entry.count; i++) {
+        sub_ifds.push_back(static_cast<std::uint32_t>(entry.number(i)));
+      }
+    }
+    ifd.emplace(tag, std::move(entry));
+  }
+  ifds_.push_back(std::move(ifd));
+  is.seekg(offset + 2 + std::uint64_t(12) * n);
+  return read32(is);
+}
+
+std::uint16_t TiffReader::read16(std::istream &is) const {
+  std::uint8_t b[2];
+  if (!is.read(reinterpret_cast<char *>(b), 2)) {
+    malformed("unexpected end of file");
+  }
+  return load<std::uint16_t>(b, big_endian_);
+}
+
+std::uint32_t TiffReader::read32(std::istream &is) const {
+  std::uint8_t b[4];
+  if (!is.read(reinterpret_cast<char *>(b), 4)) {
+    malformed("unexpected end of file");
+  }
+  return load<std::uint32_t>(b, big_endian_);
+}
+
+} // namespace yk
@@ -0,0 +1,89 @@
+#include "tone_curve.hpp"
+#include "cpu_features.hpp"
+
+namespace yk {
+
+#ifdef YK_HAVE_AVX2_KERNELS
+namespace detail {
+// Defined in tone_curve_avx2.cpp.
+void apply_lut_avx2(const std::uint16_t *src, std::uint16_t *dst,
+                    std::size_t n, const std::uint16_t *lut) noexcept;
+void apply_lut_avx2(const float *src, std::uint16_t *dst, std::size_t n,
+                    const std::uint16_t *lut) noexcept;
+} // namespace detail
+#endif
+
+ToneCurve compose(const ToneCurve &first, const ToneCurve &second) {
+  ToneCurve res(first.per_channel() || second.per_channel());
+  for (int ch = 0; ch < res.channels(); ch++) {
+    const std::uint16_t *a = first.lut(ch), *b = second.lut(ch);
+    std::uint16_t *out = res.lut(ch);
+    for (std::size_t v = 0; v < ToneCurve::lut_size; v++) {
+      out[v] = b[a[v]];
+    }
+  }
+  return res;
+}
+
+void apply_lut(const std::uint16_t *src, std::uint16_t *dst,
+               const std::size_t n, const std::uint16_t *lut) noexcept {
+#ifdef YK_HAVE_AVX2_KERNELS
+  if (detail::cpu_has_avx2()) {
+    detail::apply_lut_avx2(src, dst, n, lut);
+    return;
+  }
+#endif
+  for (std::size_t i = 0; i < n; i++) {
+    dst[i] = lut[src[i]];
+  }
+}
+
+void apply_lut(const float *src, std::uint16_t *dst, const std::size_t n,
+               const std::uint16_t *lut) noexcept {
+#ifdef YK_HAVE_AVX2_KERNELS
+  if (detail::cpu_has_avx2()) {
+    detail::apply_lut_avx2(src, dst, n, lut);
+    return;
+  }
+#endif
+  for (std::size_t i = 0; i < n; i++) {
+    dst[i] = lut[ToneCurve::clamp_value(src[i])];
+  }
+}
+
+namespace {
+// Half values are widened in blocks that stay in L1 and then go through the
+// float kernels.
+constexpr std::size_t half_block = 1024;
+} // namespace
+
+void apply_lut(const Half *src, std::uint16_t *dst, const std::size_t n,
+               const std::uint16_t *lut) noexcept {
+  float v[half_block];
+  for (std::size_t b0 = 0; b0 < n; b0 += half_block) {
+    const std::size_t len = std::min(half_block, n - b0);
+    to_float(src + b0, v, len, half_unit);
+    apply_lut(v, dst + b0, len, lut);
+  }
+}
+
+void half_to_ushort(const Half *src, std::uint16_t *dst,
+                    const std::size_t n) noexcept {
+  float v[half_block];
+  for (std::size_t b0 = 0; b0 < n; b0 += half_block) {
+    const std::size_t len = std::min(half_block, n - b0);
+    to_float(src + b0, v, len, half_unit);
+    for (std::size_t i = 0; i < len; i++) {
+      dst[b0 + i] = ToneCurve::clamp_value(v[i]);
+    }
+  }
+}
+
+template void apply_tone_curve(const std::uint16_t *, std::uint16_t *,
+                               std::size_t, const ToneCurve &);
+template void apply_tone_curve(const float *, std::uint16_t *, std::size_t,
+                               const ToneCurve &);
+template void apply_tone_curve(const Half *, std::uint16_t *, std::size_t,
+                               const ToneCurve &);
+
+} // namespace yk
@@ -0,0 +1,52 @@
+// Built with -mavx2. Only reached through the dispatch in tone_curve.cpp.
+#include "tone_curve.hpp"
+#include <immintrin.h>
+
+namespace yk {
+namespace detail {
+
+namespace {
+// Gather 32 bits at byte offset 2 * idx and keep the low half, which is
+// lut[idx] on little-endian targets. Reading past index USHRT_MAX is safe
+// because ToneCurve pads every table with one entry.
+inline void gather_store(const std::uint16_t *lut, const __m256i idx,
+                         std::uint16_t *dst) noexcept {
+  const auto *base = reinterpret_cast<const int *>(lut);
+  __m256i out = _mm256_and_si256(_mm256_i32gather_epi32(base, idx, 2),
+                                 _mm256_set1_epi32(0xFFFF));
+  out = _mm256_packus_epi32(out, _mm256_permute2x128_si256(out, out, 1));
+  _mm_storeu_si128(reinterpret_cast<__m128i *>(dst),
+                   _mm256_castsi256_si128(out));
+}
+} // namespace
+
+void apply_lut_avx2(const std::uint16_t *src, std::uint16_t *dst,
+                    const std::size_t n, const std::uint16_t *lut) noexcept {
+  std::size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    gather_store(lut,
+                 _mm256_cvtepu16_epi32(_mm_loadu_si128(
+                     reinterpret_cast<const __m128i *>(src + i))),
+                 dst + i);
+  }
+  for (; i < n; i++) {
+    dst[i] = lut[src[i]];
+  }
+}
+
+void apply_lut_avx2(const float *src, std::uint16_t *dst, const std::size_t n,
+                    const std::uint16_t *lut) noexcept {
+  std::size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256 v = _mm256_loadu_ps(src + i);
+    v = _mm256_min_ps(_mm256_max_ps(v, _mm256_setzero_ps()),
+                      _mm256_set1_ps(float(USHRT_MAX)));
+    gather_store(lut, _mm256_cvttps_epi32(v), dst + i);
+  }
+  for (; i < n; i++) {
+    dst[i] = lut[ToneCurve::clamp_value(src[i])];
+  }
+}
+
+} // namespace detail
+} // namespace yk
@@ -0,0 +1,240 @@
+#include "transfer_function.hpp"
+#include "parallel.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+namespace yk {
+
+namespace {
+// sRGB
+constexpr float srgb_thresh = 0.0031308f;
+constexpr float srgb_slope = 12.92f;
+constexpr float srgb_gamma = 1.f / 2.4f;
+// Rec.709
+constexpr float rec709_thresh = 0.018f;
+constexpr float rec709_slope = 4.5f;
+constexpr float rec709_gamma = 0.45f;
+// ROMM RGB
+constexpr float prophoto_thresh = 1.f / 512;
+constexpr float prophoto_slope = 16.f;
+constexpr float prophoto_gamma = 1.f / 1.8f;
+// PQ
+constexpr float pq_m1 = 2610.f / 16384;
+constexpr float pq_m2 = 2523.f / 4096 * 128;
+constexpr float pq_c1 = 3424.f / 4096;
+constexpr float pq_c2 = 2413.f / 4096 * 32;
+constexpr float pq_c3 = 2392.f / 4096 * 32;
+constexpr float pq_peak = 10000.f;
+// HLG
+constexpr float hlg_a = 0.17883277f;
+constexpr float hlg_b = 0.28466892f;
+constexpr float hlg_c = 0.55991073f;
+
+inline std::uint32_t to_bits(const float x) noexcept {
+  std::uint32_t res;
+  std::memcpy(&res, &x, sizeof(res));
+  return res;
+}
+
+inline float from_bits(const std::uint32_t x) noexcept {
+  float res;
+  std::memcpy(&res, &x, sizeof(res));
+  return res;
+}
+
+// log2 of a positive normal float. x = 2^e * m with m in [sqrt(1/2),
+// sqrt(2)), and log2(m) = 2 / ln(2) * atanh(t) with t = (m - 1) / (m + 1)
+// is summed to t^9; the next term is below 1e-9.
+inline float fast_log2(const float x) noexcept {
+  const std::uint32_t bits = to_bits(x);
+  const std::int32_t e =
+      static_cast<std::int32_t>(bits - 0x3f3504f3u) >> 23; // sqrt(1/2)
+  const float m = from_bits(bits - (static_cast<std::uint32_t>(e) << 23));
+  const float t = (m - 1.f) / (m + 1.f), t2 = t * t;
+  const float p =
+      t * (2.8853900818f +
+           t2 * (0.9617966939f +
+                 t2 * (0.5770780164f + t2 * (0.4121985831f +
+                                             t2 * 0.3205988979f))));
+  return static_cast<float>(e) + p;
+}
+
+// 2^y for y in [-126, 127]: 2^round(y) is built in the exponent bits and
+// 2^f with |f| <= 1/2 is the Taylor series of exp(f ln 2) to f^7. The
+// callers keep y in range.
+inline float fast_exp2(const float y) noexcept {
+  // Round to nearest without a libm call; valid for |y| < 2^22.
+  const float r = (y + 12582912.f) - 12582912.f;
+  const float f = y - r;
+  const float p =
+      1.f + f * (0.6931471806f +
+                 f * (0.2402265070f +
+                      f * (0.0555041087f +
+                           f * (0.0096181291f +
+                                f * (0.0013333558f +
+                                     f * (0.0001540353f +
+                                          f * 0.0000152527f))))));
+  return p * from_bits(static_cast<std::uint32_t>(static_cast<int>(r) + 127)
+                       << 23);
+}
+
+// The kernels below avoid min/max against constants: GCC turns them into
+// branches to constant-fold the clamped path, and the loops stop
+// vectorising. Both segments of a curve are evaluated and then selected.
+
+// c ? a : b on the bits. A plain conditional lets GCC move the
+// computation of the unused operand under a branch.
+inline float select(const bool c, const float a, const float b) noexcept {
+  const std::uint32_t mask = 0u - static_cast<std::uint32_t>(c);
+  return from_bits((to_bits(a) & mask) | (to_bits(b) & ~mask));
+}
+
+// max(x, 0), exactly.
+inline float positive_part(const float x) noexcept {
+  return 0.5f * (x + std::abs(x));
+}
+
+// x^p for x >= 0. The offset keeps log2 finite at 0 and is lost in the
+// rounding of any x above 1e-23.
+inline float fast_pow(const float x, const float p) noexcept {
+  return fast_exp2(p * fast_log2(x + 1e-30f));
+}
+
+inline float encode_gamma(const float x, const float thresh, const float slope,
+                          const float gamma, const float a) noexcept {
+  const float v = std::abs(x);
+  const float linear = slope * v;
+  const float power = (1.f + a) * fast_pow(v, gamma) - a;
+  const float res = select(v <= thresh, linear, power);
+  return select(x < 0.f, -res, res);
+}
+
+// Input above the 10000-nit peak is clipped on the output; the curve is
+// increasing.
+inline float encode_pq(const float x) noexcept {
+  const float y = positive_part(x * (pq_reference_white / pq_peak));
+  const float p = fast_pow(y, pq_m1);
+  const float res = fast_pow((pq_c1 + pq_c2 * p) / (1.f + pq_c3 * p), pq_m2);
+  return select(y < 1.f, res, 1.f);
+}
+
+inline float encode_hlg(const float x) noexcept {
+  const float e = positive_part(x * hlg_reference_white);
+  const float low = fast_pow(3.f * e, 0.5f);
+  // The argument is only negative where the low segment is selected.
+  const float high =
+      hlg_a * 0.6931471806f * fast_log2(std::abs(12.f * e - hlg_b)) + hlg_c;
+  return select(e <= 1.f / 12, low, high);
+}
+
+template <class F>
+inline void encode_loop(const float *src, float *dst, const std::size_t n,
+                        const float scale, F &&f) noexcept {
+  for (std::size_t i = 0; i < n; i++) {
+    dst[i] = f(src[i] * scale);
+  }
+}
+} // namespace
+
+TransferFunction parse_transfer_function(const std::string &name) {
+  for (const auto tf :
+       {TransferFunction::linear, TransferFunction::sRGB,
+        TransferFunction::rec709, TransferFunction::prophoto,
+        TransferFunction::pq, TransferFunction::hlg}) {
+    if (name == to_string(tf)) {
+      return tf;
+    }
+  }
+  throw std::invalid_argument("Unknown transfer function: " + name);
+}
+
+const char *to_string(const TransferFunction tf) noexcept {
+  switch (tf) {
+  case TransferFunction::linear:
+    return "linear";
+  case TransferFunction::sRGB:
+    return "srgb";
+  case TransferFunction::rec709:
+    return "rec709";
+  case TransferFunction::prophoto:
+    return "prophoto";
+  case TransferFunction::pq:
+    return "pq";
+  case TransferFunction::hlg:
+    return "hlg";
+  }
+  return "";
+}
+
+double transfer_reference(const TransferFunction tf, const double x) noexcept {
+  const double v = std::abs(x), sign = x < 0 ? -1 : 1;
+  switch (tf) {
+  case TransferFunction::linear:
+    return x;
+  case TransferFunction::sRGB:
+    return sign * (v <= srgb_thresh
+                       ? srgb_slope * v
+                       : 1.055 * std::pow(v, 1. / 2.4) - 0.055);
+  case TransferFunction::rec709:
+    return sign * (v <= rec709_thresh ? rec709_slope * v
+                                     : 1.099 * std::pow(v, 0.45) - 0.099);
+  case TransferFunction::prophoto:
+    return sign * (v < prophoto_thresh ? prophoto_slope * v
+                                       : std::pow(v, 1. / 1.8));
+  case TransferFunction::pq: {
+    const double y = std::clamp(x * pq_reference_white / pq_peak, 0., 1.);
+    const double p = std::pow(y, double(pq_m1));
+    return std::pow((pq_c1 + pq_c2 * p) / (1 + pq_c3 * p), double(pq_m2));
+  }
+  case TransferFunction::hlg: {
+    const double e = std::max(x * hlg_reference_white, 0.);
+    return e <= 1. / 12 ? std::sqrt(3 * e)
+                        : hlg_a * std::log(12 * e - hlg_b) + hlg_c;
+  }
+  }
+  return x;
+}
+
+void transfer_encode(const TransferFunction tf, const float *src, float *dst,
+                     const std::size_t n, const float scale) noexcept {
+  switch (tf) {
+  case TransferFunction::linear:
+    encode_loop(src, dst, n, scale, [](float x) { return x; });
+    break;
+  case TransferFunction::sRGB:
+    encode_loop(src, dst, n, scale, [](float x) {
+      return encode_gamma(x, srgb_thresh, srgb_slope, srgb_gamma, 0.055f);
+    });
+    break;
+  case TransferFunction::rec709:
+    encode_loop(src, dst, n, scale, [](float x) {
+      return encode_gamma(x, rec709_thresh, rec709_slope, rec709_gamma,
+                          0.099f);
+    });
+    break;
+  case TransferFunction::prophoto:
+    encode_loop(src, dst, n, scale, [](float x) {
+      return encode_gamma(x, prophoto_thresh, prophoto_slope, prophoto_gamma,
+                          0.f);
+    });
+    break;
+  case TransferFunction::pq:
+    encode_loop(src, dst, n, scale, encode_pq);
+    break;
+  case TransferFunction::hlg:
+    encode_loop(src, dst, n, scale, encode_hlg);
+    break;
+  }
+}
+
+void apply_transfer(const TransferFunction tf, const float *src, float *dst,
+                    const std::size_t n, const float scale) {
+  parallel_for(3 * n, [&](std::size_t begin, std::size_t end, std::size_t) {
+    transfer_encode(tf, src + begin, dst + begin, end - begin, scale);
+  });
+}
+
+} // namespace yk
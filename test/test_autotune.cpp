@@ -0,0 +1,132 @@
+#include "autotune.hpp"
+#include "color_transform.hpp"
+#include "parallel.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <filesystem>
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+std::string temp_profile_path(const std::string &name) {
+  return (std::filesystem::temp_directory_path() / "rawconverter_test" / name)
+      .string();
+}
+
+bool contains(const std::vector<std::size_t> &v, const std::size_t x) {
+  return std::find(v.begin(), v.end(), x) != v.end();
+}
+} // namespace
+
+TEST(AutotuneTest, TestProfileRoundTrip) {
+  const auto path = temp_profile_path("roundtrip.conf");
+  yk::TuningProfile profile;
+  profile.host = "host-a";
+  profile.hardware_threads = 16;
+  profile.threads = 8;
+  profile.grain_size = 1 << 17;
+  profile.color_block = 4096;
+  yk::save_profile(path, profile);
+
+  yk::TuningProfile loaded;
+  ASSERT_TRUE(yk::load_profile(path, loaded));
+  EXPECT_EQ(loaded.host, "host-a");
+  EXPECT_EQ(loaded.hardware_threads, 16u);
+  EXPECT_EQ(loaded.threads, 8u);
+  EXPECT_EQ(loaded.grain_size, 1u << 17);
+  EXPECT_EQ(loaded.color_block, 4096u);
+  EXPECT_FALSE(yk::load_profile(path + ".missing", loaded));
+  std::filesystem::remove(path);
+}
+
+TEST(AutotuneTest, TestCalibrateRestoresParameters) {
+  const yk::TuningProfile before = yk::current_profile();
+  yk::CalibrationParams params;
+  params.pixels = 1 << 16;
+  params.repeat = 1;
+  params.threads = {1, 2};
+  params.grain_sizes = {1 << 14, 1 << 16};
+  params.color_blocks = {1024, 2048};
+  const yk::TuningProfile chosen = yk::calibrate(params);
+  EXPECT_TRUE(contains(params.threads, chosen.threads));
+  EXPECT_TRUE(contains(params.grain_sizes, chosen.grain_size));
+  EXPECT_TRUE(contains(params.color_blocks, chosen.color_block));
+
+  const yk::TuningProfile after = yk::current_profile();
+  EXPECT_EQ(after.threads, before.threads);
+  EXPECT_EQ(after.grain_size, before.grain_size);
+  EXPECT_EQ(after.color_block, before.color_block);
+}
+
+TEST(AutotuneTest, TestAutotuneLoadsSavedProfile) {
+  const auto path = temp_profile_path("autotune.conf");
+  std::filesystem::remove(path);
+  yk::CalibrationParams params;
+  params.pixels = 1 << 16;
+  params.repeat = 1;
+  params.threads = {1};
+  params.grain_sizes = {1 << 15};
+  params.color_blocks = {1024};
+  const yk::TuningProfile first = yk::autotune(path, false, params);
+  EXPECT_TRUE(std::filesystem::exists(path));
+  EXPECT_EQ(yk::num_threads(), 1u);
+  EXPECT_EQ(yk::grain_size(), 1u << 15);
+  EXPECT_EQ(yk::color_block(), 1024u);
+
+  // The second run loads the profile instead of calibrating with the new
+  // candidates.
+  params.threads = {2};
+  const yk::TuningProfile second = yk::autotune(path, false, params);
+  EXPECT_EQ(second.threads, first.threads);
+
+  yk::apply_profile({});
+  EXPECT_EQ(yk::grain_size(), 1u << 16);
+  EXPECT_EQ(yk::color_block(), 2048u);
+  std::filesystem::remove(path);
+}
+
+TEST(AutotuneTest, TestScopedNumThreads) {
+  // The override applies to the calling thread only and is undone at the
+  // end of its scope.
+  yk::set_num_threads(4);
+  {
+    const yk::ScopedNumThreads outer(2);
+    EXPECT_EQ(yk::num_threads(), 2u);
+    {
+      const yk::ScopedNumThreads keep(0);
+      EXPECT_EQ(yk::num_threads(), 2u);
+      const yk::ScopedNumThreads inner(3);
+      EXPECT_EQ(yk::num_threads(), 3u);
+    }
+    EXPECT_EQ(yk::num_threads(), 2u);
+    std::size_t other = 0;
+    std::thread([&] { other = yk::num_threads(); }).join();
+    EXPECT_EQ(other, 4u);
+  }
+  EXPECT_EQ(yk::num_threads(), 4u);
+  yk::set_num_threads(0);
+}
+
+TEST(AutotuneTest, TestParallelForRethrows) {
+  // An exception of a worker chunk reaches the caller after every chunk has
+  // finished, instead of terminating the process.
+  const yk::ScopedNumThreads threads(4);
+  for (const std::size_t failing : {0u, 3u}) {
+    std::atomic<std::size_t> finished{0};
+    EXPECT_THROW(yk::parallel_for(
+                     4,
+                     [&](std::size_t, std::size_t, std::size_t chunk) {
+                       if (chunk == failing) {
+                         throw std::runtime_error("chunk failed");
+                       }
+                       ++finished;
+                     },
+                     1),
+                 std::runtime_error);
+    EXPECT_EQ(finished.load(), 3u);
+  }
+}
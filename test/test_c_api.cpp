@@ -0,0 +1,93 @@
+#include "raw_converter_c.h"
+#include "synthetic_dng.hpp"
+#include <filesystem>
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+// Convert a synthetic DNG with the default parameters and return the
+// channel statistics.
+void convert_synthetic(const bool cfa, rc_channel_stats stats[3]) {
+  yk::SyntheticDngParams params;
+  params.width = 96;
+  params.height = 64;
+  params.cfa = cfa;
+  const auto path = (std::filesystem::temp_directory_path() /
+                     (cfa ? "rc_test_cfa.dng" : "rc_test_linear.dng"))
+                        .string();
+  yk::write_synthetic_dng(path, params);
+
+  rc_image *image = nullptr;
+  ASSERT_EQ(rc_open(path.c_str(), &image), RC_OK);
+  rc_info info;
+  ASSERT_EQ(rc_get_info(image, &info), RC_OK);
+  EXPECT_EQ(info.width, params.width);
+  EXPECT_EQ(info.height, params.height);
+  EXPECT_EQ(rc_stats(image, stats), RC_ERROR_NO_RESULT);
+  std::vector<uint16_t> dst(3 * std::size_t(info.width) * info.height);
+  EXPECT_EQ(rc_convert_into(image, nullptr, dst.data(), dst.size() - 1),
+            RC_ERROR_BUFFER_TOO_SMALL);
+  ASSERT_EQ(rc_convert_into(image, nullptr, dst.data(), dst.size()), RC_OK);
+  EXPECT_EQ(rc_stats(image, stats), RC_OK);
+  rc_close(image);
+  std::filesystem::remove(path);
+}
+} // namespace
+
+TEST(CApiTest, TestOpenMissingFile) {
+  rc_image *image = reinterpret_cast<rc_image *>(1);
+  EXPECT_EQ(rc_open("no_such_file.dng", &image), RC_ERROR_OPEN);
+  EXPECT_EQ(image, nullptr);
+  rc_close(image);
+}
+
+TEST(CApiTest, TestInvalidArguments) {
+  rc_image *image = nullptr;
+  EXPECT_EQ(rc_open(nullptr, &image), RC_ERROR_INVALID_ARGUMENT);
+  EXPECT_EQ(rc_open_buffer(nullptr, 0, &image), RC_ERROR_INVALID_ARGUMENT);
+  std::vector<uint16_t> dst(3);
+  EXPECT_EQ(rc_convert_into(nullptr, nullptr, dst.data(), dst.size()),
+            RC_ERROR_INVALID_ARGUMENT);
+  rc_channel_stats stats[3];
+  EXPECT_EQ(rc_stats(nullptr, stats), RC_ERROR_INVALID_ARGUMENT);
+}
+
+TEST(CApiTest, TestDefaults) {
+  EXPECT_EQ(rc_api_version(), RC_API_VERSION);
+  rc_params params;
+  rc_default_params(&params);
+  EXPECT_STREQ(params.tone_mapper, "stretch");
+  EXPECT_FLOAT_EQ(params.stretch_rate, 0.01f);
+  EXPECT_EQ(params.layout, RC_LAYOUT_PLANAR);
+  EXPECT_EQ(params.num_threads, 0u);
+  EXPECT_STREQ(rc_status_string(RC_OK), "success");
+}
+
+TEST(CApiTest, TestThreadNumThreads) {
+  // The override of one thread is not seen by the others.
+  const size_t global = rc_num_threads();
+  rc_set_thread_num_threads(global + 3);
+  EXPECT_EQ(rc_num_threads(), global + 3);
+  size_t other = 0;
+  std::thread([&] { other = rc_num_threads(); }).join();
+  EXPECT_EQ(other, global);
+  rc_set_thread_num_threads(0);
+  EXPECT_EQ(rc_num_threads(), global);
+}
+
+TEST(CApiTest, TestConvert) {
+  // The same scene as linear and as Bayer DNG converts to about the same
+  // image.
+  rc_channel_stats linear[3], bayer[3];
+  convert_synthetic(false, linear);
+  convert_synthetic(true, bayer);
+  for (int ch = 0; ch < 3; ch++) {
+    EXPECT_EQ(linear[ch].count, 96u * 64u);
+    EXPECT_EQ(bayer[ch].count, 96u * 64u);
+    EXPECT_LT(0., linear[ch].mean);
+    EXPECT_LT(linear[ch].mean, 65535.);
+    EXPECT_NEAR(bayer[ch].mean, linear[ch].mean, 0.05 * 65535);
+  }
+}
@@ -0,0 +1,148 @@
+#include "test_common.hpp"
+#include "camera_profile.hpp"
+#include "color_transform.hpp"
+#include <cmath>
+#include <gtest/gtest.h>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+// Table of hues x sats x vals entries that all shift the hue by shift
+// degrees and scale saturation and value by sat and val.
+yk::HueSatMap uniform_map(const std::uint32_t hues, const std::uint32_t sats,
+                          const std::uint32_t vals, const float shift,
+                          const float sat = 1.f, const float val = 1.f) {
+  yk::HueSatMap map;
+  map.hues = hues;
+  map.sats = sats;
+  map.vals = vals;
+  for (std::uint32_t i = 0; i < hues * sats * vals; i++) {
+    map.data.insert(map.data.end(), {shift, sat, val});
+  }
+  return map;
+}
+
+const yk::Matrix3 identity = {
+    {{1.f, 0.f, 0.f}, {0.f, 1.f, 0.f}, {0.f, 0.f, 1.f}}};
+
+std::vector<float> transform(const std::vector<float> &src,
+                             const yk::ProfileTables &tables) {
+  const std::size_t n = src.size() / 3;
+  std::vector<float> dst(src.size());
+  yk::profile_transform(src.data(), dst.data(), n, identity, identity,
+                        tables);
+  return dst;
+}
+} // namespace
+
+TEST(CameraProfileTest, TestToneCurve) {
+  const auto identity_curve = yk::sample_tone_curve({{0, 0}, {1, 1}}, 256);
+  for (std::size_t i = 0; i < identity_curve.size(); i++) {
+    EXPECT_NEAR(identity_curve[i], i / 255.f, 1e-6);
+  }
+  // The spline passes through its points and stays monotonic for an
+  // S-curve.
+  const auto curve = yk::sample_tone_curve(
+      {{0, 0}, {0.25f, 0.15f}, {0.5f, 0.5f}, {0.75f, 0.85f}, {1, 1}}, 1025);
+  EXPECT_NEAR(curve[256], 0.15f, 1e-6);
+  EXPECT_NEAR(curve[512], 0.5f, 1e-6);
+  EXPECT_NEAR(curve[768], 0.85f, 1e-6);
+  for (std::size_t i = 1; i < curve.size(); i++) {
+    EXPECT_LE(curve[i - 1], curve[i]);
+  }
+  EXPECT_THROW(yk::sample_tone_curve({{0.5f, 0}, {0.5f, 1}}, 16),
+               std::invalid_argument);
+}
+
+TEST(CameraProfileTest, TestHueSatMap) {
+  // Colors at 1/4 of white: red, yellow-orange, desaturated blue, gray.
+  const std::vector<float> src = {16383, 16383, 4000,  9000,
+                                  0,     12000, 4000,  9000,
+                                  0,     0,     16383, 9000};
+  // Identity tables change nothing.
+  yk::CameraProfile profile;
+  profile.hue_sat_maps[1] = uniform_map(6, 4, 1, 0.f);
+  profile.look_table = uniform_map(6, 4, 3, 0.f);
+  auto dst = transform(src, yk::ProfileTables::prepare(profile));
+  for (std::size_t i = 0; i < src.size(); i++) {
+    EXPECT_NEAR(dst[i], src[i], 0.05f) << i;
+  }
+
+  // A hue shift of 120 degrees rotates red to green; a saturation scale of
+  // 0 and a value scale of 0.5 leave gray at half the maximum.
+  profile.hue_sat_maps[1] = uniform_map(6, 4, 1, 120.f);
+  profile.look_table = yk::HueSatMap{};
+  dst = transform(src, yk::ProfileTables::prepare(profile));
+  EXPECT_NEAR(dst[0], 0.f, 0.05f);
+  EXPECT_NEAR(dst[4], 16383.f, 0.05f);
+  EXPECT_NEAR(dst[3], 9000.f, 0.05f);
+  profile.hue_sat_maps[1] = uniform_map(6, 4, 1, 0.f, 0.f, 0.5f);
+  dst = transform(src, yk::ProfileTables::prepare(profile));
+  for (std::size_t ch = 0; ch < 3; ch++) {
+    EXPECT_NEAR(dst[ch * 4 + 1], 0.5f * 16383, 0.05f);
+  }
+
+  // Both illuminants are blended by weight.
+  profile.hue_sat_maps[0] = uniform_map(6, 4, 1, 0.f, 1.f, 1.f);
+  profile.hue_sat_maps[1] = uniform_map(6, 4, 1, 0.f, 1.f, 0.5f);
+  const auto blended = yk::interpolate_hue_sat_map(profile, 0.25f);
+  EXPECT_FLOAT_EQ(blended.data[2], 0.625f);
+}
+
+TEST(CameraProfileTest, TestRgbTone) {
+  // A curve that doubles its input keeps hue: the ratios of the channel
+  // distances to the smallest one are unchanged.
+  yk::CameraProfile profile;
+  profile.tone_curve = {{0, 0}, {0.5f, 1}, {1, 1}};
+  const auto tables = yk::ProfileTables::prepare(profile);
+  const std::vector<float> src = {8000, 2000, 4000};
+  const auto dst = transform(src, tables);
+  const float lo = tables.tone[std::size_t(2000.f / 65535 * 65535 + 0.5f)];
+  const float hi = tables.tone[std::size_t(8000.f / 65535 * 65535 + 0.5f)];
+  EXPECT_NEAR(dst[1], lo * 65535, 1.f);
+  EXPECT_NEAR(dst[0], hi * 65535, 1.f);
+  EXPECT_NEAR((dst[2] - dst[1]) / (dst[0] - dst[1]), 2000.f / 6000, 1e-4);
+}
+
+TEST(CameraProfileTest, TestReadDcp) {
+  // Little-endian DCP with a 2x2x1 HueSatMap and a two-point tone curve.
+  const auto map = uniform_map(2, 2, 1, 10.f, 1.1f, 0.9f);
+  std::string b = "II";
+  put16(b, yk::TiffReader::dcp_magic, false);
+  put32(b, 8, false);
+  const std::uint32_t entries = 3, data = 8 + 2 + 12 * entries + 4;
+  put16(b, entries, false);
+  put16(b, yk::profile_hue_sat_map_dims_tag, false);
+  put16(b, 4, false);
+  put32(b, 3, false);
+  put32(b, data, false);
+  put16(b, yk::profile_hue_sat_map_data2_tag, false);
+  put16(b, 11, false);
+  put32(b, 12, false);
+  put32(b, data + 12, false);
+  put16(b, yk::profile_tone_curve_tag, false);
+  put16(b, 11, false);
+  put32(b, 4, false);
+  put32(b, data + 12 + 48, false);
+  put32(b, 0, false);
+  for (const std::uint32_t d : {2u, 2u, 1u}) {
+    put32(b, d, false);
+  }
+  for (const float v : map.data) {
+    putf(b, v, false);
+  }
+  for (const float v : {0.f, 0.f, 1.f, 1.f}) {
+    putf(b, v, false);
+  }
+
+  std::istringstream is(b);
+  yk::CameraProfile profile;
+  ASSERT_TRUE(yk::read_camera_profile(yk::TiffReader(is), profile));
+  EXPECT_TRUE(profile.hue_sat_maps[0].empty());
+  EXPECT_EQ(profile.hue_sat_maps[1].hues, 2u);
+  EXPECT_EQ(profile.hue_sat_maps[1].data, map.data);
+  ASSERT_EQ(profile.tone_curve.size(), 2u);
+  EXPECT_EQ(profile.tone_curve[1][0], 1.f);
+  EXPECT_TRUE(profile.look_table.empty());
+}
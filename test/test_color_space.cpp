@@ -0,0 +1,89 @@
+#include "color_space.hpp"
+#include <cmath>
+#include <gtest/gtest.h>
+#include <stdexcept>
+
+namespace {
+constexpr yk::ColorSpace all_color_spaces[] = {
+    yk::ColorSpace::sRGB, yk::ColorSpace::display_p3, yk::ColorSpace::rec2020,
+    yk::ColorSpace::prophoto, yk::ColorSpace::acescg};
+
+void expect_matrix_near(const yk::Matrix3 &a, const yk::Matrix3 &b,
+                        const float tolerance) {
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 3; j++) {
+      EXPECT_NEAR(a[i][j], b[i][j], tolerance) << i << ", " << j;
+    }
+  }
+}
+} // namespace
+
+TEST(ColorSpaceTest, TestXyzFromRGB) {
+  // IEC 61966-2-1
+  expect_matrix_near(yk::xyz_from_rgb(yk::ColorSpace::sRGB),
+                     {{{0.4124f, 0.3576f, 0.1805f},
+                       {0.2126f, 0.7152f, 0.0722f},
+                       {0.0193f, 0.1192f, 0.9505f}}},
+                     2e-4f);
+  for (const auto cs : all_color_spaces) {
+    const auto w = yk::luminance_weights(cs);
+    EXPECT_NEAR(w[0] + w[1] + w[2], 1.f, 1e-5f) << yk::to_string(cs);
+  }
+}
+
+TEST(ColorSpaceTest, TestRGBFromSRGB) {
+  using yk::ColorSpace;
+  expect_matrix_near(yk::rgb_from_sRGB(ColorSpace::display_p3),
+                     {{{0.8225f, 0.1774f, 0.f},
+                       {0.0332f, 0.9669f, 0.f},
+                       {0.0171f, 0.0724f, 0.9108f}}},
+                     2e-3f);
+  expect_matrix_near(yk::rgb_from_sRGB(ColorSpace::rec2020),
+                     {{{0.6274f, 0.3293f, 0.0433f},
+                       {0.0691f, 0.9195f, 0.0114f},
+                       {0.0164f, 0.0880f, 0.8956f}}},
+                     2e-3f);
+  // Bradford-adapted to D50 and to the ACES white.
+  expect_matrix_near(yk::rgb_from_sRGB(ColorSpace::prophoto),
+                     {{{0.5293f, 0.3300f, 0.1405f},
+                       {0.0983f, 0.8734f, 0.0283f},
+                       {0.0168f, 0.1177f, 0.8655f}}},
+                     2e-3f);
+  expect_matrix_near(yk::rgb_from_sRGB(ColorSpace::acescg),
+                     {{{0.6131f, 0.3395f, 0.0474f},
+                       {0.0702f, 0.9164f, 0.0134f},
+                       {0.0206f, 0.1096f, 0.8698f}}},
+                     2e-3f);
+  // sRGB white is the white of every space.
+  for (const auto cs : all_color_spaces) {
+    const yk::Matrix3 m = yk::rgb_from_sRGB(cs);
+    for (int i = 0; i < 3; i++) {
+      EXPECT_NEAR(m[i][0] + m[i][1] + m[i][2], 1.f, 1e-4f)
+          << yk::to_string(cs);
+    }
+  }
+}
+
+TEST(ColorSpaceTest, TestOutputCurves) {
+  using yk::ColorSpace;
+  const yk::ToneCurve &acescg = yk::output_curve(ColorSpace::acescg);
+  const yk::ToneCurve &prophoto = yk::output_curve(ColorSpace::prophoto);
+  const yk::ToneCurve &p3 = yk::output_curve(ColorSpace::display_p3);
+  for (int v = 0; v < int(yk::ToneCurve::lut_size); v += 97) {
+    EXPECT_EQ(acescg.lut(0)[v], v);
+    const double expected =
+        65535 * yk::transfer_reference(yk::TransferFunction::prophoto,
+                                       v / 65535.);
+    EXPECT_NEAR(prophoto.lut(0)[v], expected, 0.5) << v;
+  }
+  EXPECT_EQ(prophoto.lut(0)[65535], 65535);
+  // Spaces with the same curve share its table.
+  EXPECT_EQ(&p3, &yk::output_curve(ColorSpace::sRGB));
+}
+
+TEST(ColorSpaceTest, TestParseNames) {
+  for (const auto cs : all_color_spaces) {
+    EXPECT_EQ(yk::parse_color_space(yk::to_string(cs)), cs);
+  }
+  EXPECT_THROW(yk::parse_color_space("adobe-rgb"), std::invalid_argument);
+}
@@ -0,0 +1,76 @@
+#include "color_transform.hpp"
+#include "test_common.hpp"
+#include <gtest/gtest.h>
+#include <random>
+#include <vector>
+
+TEST(ColorTransformTest, TestMatrixAndLuminanceHistogram) {
+  const std::size_t n = 100000;
+  std::mt19937 rng(0);
+  std::uniform_int_distribution<int> dist(0, USHRT_MAX / 2);
+  std::vector<std::uint16_t> src(3 * n);
+  for (auto &v : src) {
+    v = dist(rng);
+  }
+  const yk::Matrix3 m = {{{1.6f, -0.4f, -0.2f},
+                          {-0.2f, 1.5f, -0.3f},
+                          {0.0f, -0.5f, 1.5f}}};
+  std::vector<float> dst(3 * n);
+  yk::Histogram luminance;
+  yk::set_num_threads(4);
+  yk::color_transform(src.data(), dst.data(), n, m, &luminance);
+  yk::set_num_threads(0);
+
+  yk::Histogram ans(1 << 16, 0);
+  for (std::size_t i = 0; i < n; i++) {
+    float y = 0;
+    for (int ch = 0; ch < 3; ch++) {
+      const float v = m[ch][0] * src[i] + m[ch][1] * src[n + i] +
+                      m[ch][2] * src[2 * n + i];
+      EXPECT_NEAR(dst[ch * n + i], v, 1e-2);
+      y += yk::sRGB_luminance[ch] * v;
+    }
+    ans[std::clamp<int>(y, 0, USHRT_MAX)]++;
+  }
+  EXPECT_EQ(yk::histogram_total(luminance), n);
+  // Luminance may round differently at bin edges; compare cumulatively.
+  std::uint64_t acc0 = 0, acc1 = 0;
+  for (std::size_t v = 0; v < ans.size(); v++) {
+    acc0 += luminance[v];
+    acc1 += ans[v];
+    EXPECT_NEAR(double(acc0), double(acc1), n * 1e-4);
+  }
+}
+
+TEST(ColorTransformTest, TestUshortOutputClamps) {
+  std::vector<std::uint16_t> src = {100, 60000, 0, 60000, 0, 0};
+  const yk::Matrix3 m = {{{2, 0, 0}, {-1, 0, 0}, {0, 0, 1}}};
+  std::vector<std::uint16_t> dst(src.size());
+  yk::color_transform(src.data(), dst.data(), 2, m);
+  std::vector<std::uint16_t> ans = {200, USHRT_MAX, 0, 0, 0, 0};
+  EXPECT_EQ(dst, ans);
+}
+
+TEST(ColorTransformTest, TestInvert) {
+  const yk::Matrix3 m = {{{0.6f, 0.3f, 0.1f},
+                          {0.2f, 0.7f, 0.1f},
+                          {0.05f, 0.15f, 0.8f}}};
+  const auto identity = yk::multiply(m, yk::invert(m));
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 3; j++) {
+      EXPECT_NEAR(identity[i][j], i == j ? 1.f : 0.f, 1e-5);
+    }
+  }
+}
+
+TEST(ColorTransformTest, TestXyzFromCameraMapsNeutral) {
+  // Rows of the normalised camera-from-XYZ matrix sum to one, so camera
+  // (1, 1, 1) maps back to XYZ (1, 1, 1).
+  const float cm[4][3] = {
+      {0.9f, -0.3f, -0.1f}, {-0.4f, 1.2f, 0.2f}, {-0.05f, 0.1f, 0.6f}, {}};
+  const float ab[4] = {1.f, 1.f, 1.f, 1.f};
+  const auto m = yk::xyz_from_camera(cm, ab);
+  for (int i = 0; i < 3; i++) {
+    EXPECT_NEAR(m[i][0] + m[i][1] + m[i][2], 1.f, 1e-5);
+  }
+}
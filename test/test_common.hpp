@@ -1,10 +1,50 @@
-#pragma ones
+#pragma once
+#include <cstdint>
+#include <cstring>
 #include <gtest/gtest.h>
+#include <vector>
 
 namespace yk {
 static constexpr bool DEBUG = false;
 }
 
+// Writers of binary test data such as TIFF headers, DNG opcodes and DCP
+// tags. Buffer is a byte vector or std::string.
+using Bytes = std::vector<std::uint8_t>;
+
+template <class Buffer>
+void put16(Buffer &b, const std::uint16_t v, const bool big_endian) {
+  for (int i = 0; i < 2; i++) {
+    b.push_back(static_cast<typename Buffer::value_type>(
+        v >> (big_endian ? 8 - 8 * i : 8 * i)));
+  }
+}
+
+template <class Buffer>
+void put32(Buffer &b, const std::uint32_t v, const bool big_endian) {
+  for (int i = 0; i < 4; i++) {
+    b.push_back(static_cast<typename Buffer::value_type>(
+        v >> (big_endian ? 24 - 8 * i : 8 * i)));
+  }
+}
+
+template <class Buffer>
+void put64(Buffer &b, const double v, const bool big_endian) {
+  std::uint64_t bits;
+  std::memcpy(&bits, &v, sizeof(bits));
+  const auto hi = static_cast<std::uint32_t>(bits >> 32);
+  const auto lo = static_cast<std::uint32_t>(bits);
+  put32(b, big_endian ? hi : lo, big_endian);
+  put32(b, big_endian ? lo : hi, big_endian);
+}
+
+template <class Buffer>
+void putf(Buffer &b, const float v, const bool big_endian) {
+  std::uint32_t bits;
+  std::memcpy(&bits, &v, sizeof(bits));
+  put32(b, bits, big_endian);
+}
+
 template <typename T0, typename T1> void CLOSE_ALL(T0 &&x0, T1 &&x1) {
   auto itr0 = x0.cbegin();
   auto itr1 = x1.cbegin();
@@ -0,0 +1,151 @@
+#include "demosaic.hpp"
+#include "parallel.hpp"
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+using Image = std::vector<std::uint16_t>;
+
+// Planar (3, width * height) image of f(channel, y, x).
+Image make_image(const std::size_t width, const std::size_t height,
+                 const std::function<float(int, std::size_t, std::size_t)> &f) {
+  const std::size_t n = width * height;
+  Image image(3 * n);
+  for (int ch = 0; ch < 3; ch++) {
+    for (std::size_t y = 0; y < height; y++) {
+      for (std::size_t x = 0; x < width; x++) {
+        image[ch * n + y * width + x] =
+            static_cast<std::uint16_t>(std::lround(f(ch, y, x)));
+      }
+    }
+  }
+  return image;
+}
+
+// Sample an image through a CFA into rows of stride samples.
+Image mosaic(const Image &image, const std::size_t width,
+             const std::size_t height, const std::size_t stride,
+             const yk::CfaPattern &cfa) {
+  const std::size_t n = width * height;
+  Image raw(stride * height, 0);
+  for (std::size_t y = 0; y < height; y++) {
+    for (std::size_t x = 0; x < width; x++) {
+      const std::size_t ch = cfa[(y & 1) * 2 + (x & 1)];
+      raw[y * stride + x] = image[ch * n + y * width + x];
+    }
+  }
+  return raw;
+}
+
+Image demosaic(const Image &raw, const std::size_t width,
+               const std::size_t height, const std::size_t stride,
+               const yk::CfaPattern &cfa, const yk::DemosaicMethod method) {
+  Image dst(3 * width * height);
+  yk::demosaic(raw.data(), width, height, stride, cfa, dst.data(), method);
+  return dst;
+}
+
+double squared_error(const Image &a, const Image &b) {
+  double res = 0;
+  for (std::size_t i = 0; i < a.size(); i++) {
+    res += (double(a[i]) - b[i]) * (double(a[i]) - b[i]);
+  }
+  return res;
+}
+
+const yk::DemosaicMethod methods[] = {yk::DemosaicMethod::bilinear,
+                                      yk::DemosaicMethod::edge_aware};
+} // namespace
+
+TEST(DemosaicTest, TestParse) {
+  EXPECT_EQ(yk::parse_demosaic_method("bilinear"),
+            yk::DemosaicMethod::bilinear);
+  EXPECT_EQ(yk::parse_demosaic_method("edge"),
+            yk::DemosaicMethod::edge_aware);
+  EXPECT_THROW(yk::parse_demosaic_method("ahd"), std::invalid_argument);
+  EXPECT_EQ(yk::parse_cfa_pattern("RGGB"), (yk::CfaPattern{0, 1, 1, 2}));
+  EXPECT_EQ(yk::parse_cfa_pattern("GBRG"), (yk::CfaPattern{1, 2, 0, 1}));
+  EXPECT_THROW(yk::parse_cfa_pattern("RGBG"), std::invalid_argument);
+  EXPECT_THROW(yk::parse_cfa_pattern("RRGB"), std::invalid_argument);
+  EXPECT_THROW(yk::parse_cfa_pattern("RGB"), std::invalid_argument);
+  Image raw(9);
+  Image dst(27);
+  EXPECT_THROW(yk::demosaic(raw.data(), 3, 3, 3,
+                            yk::parse_cfa_pattern("RGGB"), dst.data()),
+               std::invalid_argument);
+}
+
+TEST(DemosaicTest, TestFlatAndRamp) {
+  // Odd sizes and a row stride wider than the image.
+  const std::size_t width = 37, height = 23, stride = 41;
+  const auto flat = make_image(width, height, [](int ch, auto, auto) {
+    return 3000.f + 20000.f * ch;
+  });
+  const auto ramp = make_image(width, height, [](int ch, auto y, auto x) {
+    return 1000.f + 400.f * x + (ch + 1) * 300.f * y + 5000.f * ch;
+  });
+  for (const char *pattern : {"RGGB", "BGGR", "GRBG", "GBRG"}) {
+    const auto cfa = yk::parse_cfa_pattern(pattern);
+    for (const auto method : methods) {
+      // A flat field is reproduced everywhere, including at the borders.
+      EXPECT_EQ(demosaic(mosaic(flat, width, height, stride, cfa), width,
+                         height, stride, cfa, method),
+                flat)
+          << pattern;
+      // Both methods are exact for a linear ramp away from the borders.
+      const auto res = demosaic(mosaic(ramp, width, height, stride, cfa),
+                                width, height, stride, cfa, method);
+      const std::size_t n = width * height;
+      for (std::size_t ch = 0; ch < 3; ch++) {
+        for (std::size_t y = 3; y + 3 < height; y++) {
+          for (std::size_t x = 3; x + 3 < width; x++) {
+            const std::size_t i = ch * n + y * width + x;
+            ASSERT_NEAR(res[i], ramp[i], 1) << pattern << " " << y << " " << x;
+          }
+        }
+      }
+    }
+  }
+}
+
+TEST(DemosaicTest, TestEdge) {
+  // A gray image with a vertical edge: the edge-aware method interpolates
+  // along it and is closer to the original than bilinear.
+  const std::size_t width = 64, height = 48;
+  const auto image = make_image(width, height, [](int, auto, auto x) {
+    return x < 31 ? 8000.f : 40000.f;
+  });
+  const auto cfa = yk::parse_cfa_pattern("RGGB");
+  const auto raw = mosaic(image, width, height, width, cfa);
+  const double bilinear = squared_error(
+      demosaic(raw, width, height, width, cfa, yk::DemosaicMethod::bilinear),
+      image);
+  const double edge_aware = squared_error(
+      demosaic(raw, width, height, width, cfa, yk::DemosaicMethod::edge_aware),
+      image);
+  EXPECT_GT(bilinear, 0.);
+  EXPECT_LT(edge_aware, 0.5 * bilinear);
+}
+
+TEST(DemosaicTest, TestParallel) {
+  // Several chunks of several tiles give the same result as one thread.
+  const std::size_t width = 29, height = 211;
+  const auto image = make_image(width, height, [](int ch, auto y, auto x) {
+    return float((x * 7919 + y * 104729 + ch * 31) % 65536);
+  });
+  const auto cfa = yk::parse_cfa_pattern("GRBG");
+  const auto raw = mosaic(image, width, height, width, cfa);
+  for (const auto method : methods) {
+    yk::set_num_threads(1);
+    const auto expected = demosaic(raw, width, height, width, cfa, method);
+    yk::set_num_threads(3);
+    yk::set_grain_size(1);
+    EXPECT_EQ(demosaic(raw, width, height, width, cfa, method), expected);
+    yk::set_num_threads(0);
+    yk::set_grain_size(0);
+  }
+}
@@ -0,0 +1,166 @@
+#include "color_space.hpp"
+#include "dng_color.hpp"
+#include <algorithm>
+#include <cmath>
+#include <gtest/gtest.h>
+
+namespace {
+constexpr std::array<float, 2> illuminant_a = {0.44757f, 0.40745f};
+constexpr std::array<float, 2> d65 = {0.3127f, 0.3290f};
+
+// A camera whose sensitivities differ from XYZ, with one matrix per
+// illuminant as a DNG would carry them. The fits differ by a few percent.
+yk::DngColorProfile test_profile() {
+  const yk::Matrix3 camera_from_xyz = {{{0.9f, 0.25f, -0.15f},
+                                        {-0.3f, 1.2f, 0.1f},
+                                        {0.05f, -0.2f, 0.75f}}};
+  const yk::Matrix3 tungsten_fit = {
+      {{1.04f, 0.f, 0.f}, {0.f, 1.f, 0.f}, {0.f, 0.f, 0.93f}}};
+  yk::DngColorProfile profile;
+  profile.illuminants = {17, 21};
+  profile.color_matrices[0] = yk::multiply(tungsten_fit, camera_from_xyz);
+  profile.color_matrices[1] = camera_from_xyz;
+  return profile;
+}
+
+std::array<float, 3> xyz(const std::array<float, 2> &xy) {
+  return {xy[0] / xy[1], 1.f, (1.f - xy[0] - xy[1]) / xy[1]};
+}
+
+// Camera response to a white of the given chromaticity.
+std::array<float, 3> neutral_of(const yk::Matrix3 &camera_from_xyz,
+                                const std::array<float, 2> &xy) {
+  const auto white = xyz(xy);
+  std::array<float, 3> res{};
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 3; j++) {
+      res[i] += camera_from_xyz[i][j] * white[j];
+    }
+  }
+  return res;
+}
+
+void expect_maps_to_white(const yk::Matrix3 &m,
+                          const std::array<float, 3> &neutral) {
+  const float peak = std::max({neutral[0], neutral[1], neutral[2]});
+  for (int i = 0; i < 3; i++) {
+    float v = 0;
+    for (int j = 0; j < 3; j++) {
+      v += m[i][j] * neutral[j] / peak;
+    }
+    EXPECT_NEAR(v, 1.f, 1e-4f) << i;
+  }
+}
+} // namespace
+
+TEST(DngColorTest, TestTemperatures) {
+  EXPECT_EQ(yk::illuminant_temperature(17), 2850.f);
+  EXPECT_EQ(yk::illuminant_temperature(21), 6500.f);
+  EXPECT_EQ(yk::illuminant_temperature(255), 0.f);
+  EXPECT_NEAR(yk::correlated_color_temperature(d65), 6504.f, 5.f);
+  EXPECT_NEAR(yk::correlated_color_temperature(illuminant_a), 2856.f, 5.f);
+}
+
+TEST(DngColorTest, TestInterpolatedWhitePoint) {
+  const auto profile = test_profile();
+  yk::WhitePointSolution solution;
+
+  const auto daylight = neutral_of(profile.color_matrices[1], d65);
+  expect_maps_to_white(yk::xyz_from_camera(profile, daylight, &solution),
+                       daylight);
+  EXPECT_NEAR(solution.xy[0], d65[0], 1e-4f);
+  EXPECT_NEAR(solution.xy[1], d65[1], 1e-4f);
+  EXPECT_EQ(solution.weight, 0.f);
+  EXPECT_LT(solution.iterations, 30);
+
+  const auto tungsten = neutral_of(profile.color_matrices[0], illuminant_a);
+  expect_maps_to_white(yk::xyz_from_camera(profile, tungsten, &solution),
+                       tungsten);
+  // Standard light A is 2856 K, slightly above the 2850 K of the tag.
+  EXPECT_NEAR(solution.xy[0], illuminant_a[0], 1e-3f);
+  EXPECT_NEAR(solution.xy[1], illuminant_a[1], 1e-3f);
+  EXPECT_NEAR(solution.weight, 1.f, 0.01f);
+
+  // Between the illuminants both matrices contribute.
+  const std::array<float, 2> d50 = {0.3457f, 0.3585f};
+  const auto mixed = neutral_of(profile.color_matrices[1], d50);
+  expect_maps_to_white(yk::xyz_from_camera(profile, mixed, &solution), mixed);
+  EXPECT_LT(0.f, solution.weight);
+  EXPECT_LT(solution.weight, 1.f);
+  EXPECT_NEAR(solution.temperature, 5000.f, 300.f);
+}
+
+TEST(DngColorTest, TestForwardMatrix) {
+  auto profile = test_profile();
+  // ForwardMatrix maps the white-balanced camera white to D50 XYZ.
+  for (int k = 0; k < 2; k++) {
+    profile.forward_matrices[k] = {{{0.6f, 0.25f, 0.1142f},
+                                    {0.25f, 0.7f, 0.05f},
+                                    {0.02f, 0.1f, 0.7051f}}};
+  }
+  const auto neutral = neutral_of(profile.color_matrices[1], d65);
+  expect_maps_to_white(yk::xyz_from_camera(profile, neutral), neutral);
+}
+
+TEST(DngColorTest, TestBalancedCamera) {
+  const auto profile = test_profile();
+  const auto neutral = neutral_of(profile.color_matrices[1], d65);
+  const auto unbalanced = yk::xyz_from_camera(profile, neutral);
+  EXPECT_EQ(yk::xyz_from_balanced_camera(profile, neutral, {1.f, 1.f, 1.f}),
+            unbalanced);
+  // As-shot gains: balanced data renders as the unbalanced data did.
+  const float peak = std::max({neutral[0], neutral[1], neutral[2]});
+  const std::array<float, 3> gains = {peak / neutral[0], peak / neutral[1],
+                                      peak / neutral[2]};
+  const auto balanced = yk::xyz_from_balanced_camera(profile, neutral, gains);
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 3; j++) {
+      EXPECT_NEAR(balanced[i][j] * gains[j], unbalanced[i][j], 1e-4f);
+    }
+  }
+  // Other gains: the camera color they balance maps to white.
+  const std::array<float, 3> custom = {1.6f, 1.f, 2.2f};
+  const auto m = yk::xyz_from_balanced_camera(profile, neutral, custom);
+  for (int i = 0; i < 3; i++) {
+    EXPECT_NEAR(m[i][0] + m[i][1] + m[i][2], 1.f, 1e-4f) << i;
+  }
+}
+
+TEST(DngColorTest, TestCache) {
+  const auto profile = test_profile();
+  const auto neutral = neutral_of(profile.color_matrices[1], d65);
+  yk::ColorMatrixCache cache;
+  const yk::Matrix3 first = cache.xyz_from_camera(profile, neutral);
+  const yk::Matrix3 second = cache.xyz_from_camera(profile, neutral);
+  EXPECT_EQ(first, second);
+  EXPECT_EQ(first, yk::xyz_from_camera(profile, neutral));
+  cache.xyz_from_camera(profile, {0.5f, 1.f, 0.6f});
+  EXPECT_EQ(cache.hits(), 1u);
+  EXPECT_EQ(cache.misses(), 2u);
+  EXPECT_EQ(cache.size(), 2u);
+  cache.clear();
+  EXPECT_EQ(cache.size(), 0u);
+}
+
+TEST(DngColorTest, TestCacheEvictsLeastRecentlyUsed) {
+  const auto profile = test_profile();
+  yk::ColorMatrixCache cache(2);
+  EXPECT_EQ(cache.capacity(), 2u);
+  const std::array<float, 3> a = {0.5f, 1.f, 0.6f}, b = {0.6f, 1.f, 0.5f},
+                             c = {0.7f, 1.f, 0.4f};
+  cache.xyz_from_camera(profile, a);
+  cache.xyz_from_camera(profile, b);
+  // a is used again, so c replaces b.
+  cache.xyz_from_camera(profile, a);
+  EXPECT_EQ(cache.xyz_from_camera(profile, c),
+            yk::xyz_from_camera(profile, c));
+  EXPECT_EQ(cache.size(), 2u);
+  cache.xyz_from_camera(profile, a);
+  EXPECT_EQ(cache.hits(), 2u);
+  cache.xyz_from_camera(profile, b);
+  EXPECT_EQ(cache.hits(), 2u);
+  EXPECT_EQ(cache.misses(), 4u);
+  EXPECT_EQ(cache.size(), 2u);
+  EXPECT_EQ(yk::ColorMatrixCache::global().capacity(),
+            yk::ColorMatrixCache::default_capacity);
+}
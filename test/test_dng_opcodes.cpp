@@ -0,0 +1,187 @@
+#include "test_common.hpp"
+#include "dng_opcodes.hpp"
+#include "levels.hpp"
+#include "logging.hpp"
+#include "tiff_reader.hpp"
+#include <algorithm>
+#include <cmath>
+#include <gtest/gtest.h>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+// GainMap over the whole image with points at the image corners and
+// centre, stretching from 1 at the top left to 2 at the bottom right.
+yk::GainMap test_gain_map(const std::uint32_t width,
+                          const std::uint32_t height) {
+  yk::GainMap map;
+  map.bottom = height;
+  map.right = width;
+  map.planes = 3;
+  map.points_v = 3;
+  map.points_h = 3;
+  map.spacing_v = map.spacing_h = 0.5;
+  map.map_planes = 1;
+  for (int v = 0; v < 3; v++) {
+    for (int h = 0; h < 3; h++) {
+      map.gains.push_back(1.f + 0.25f * (v + h));
+    }
+  }
+  return map;
+}
+
+Bytes encode_opcode_list(const yk::GainMap &map,
+                         const std::uint32_t skipped_flags = 1) {
+  Bytes params;
+  for (const auto v : {map.top, map.left, map.bottom, map.right, map.plane,
+                       map.planes, map.row_pitch, map.col_pitch,
+                       map.points_v, map.points_h}) {
+    put32(params, v, true);
+  }
+  for (const auto v :
+       {map.spacing_v, map.spacing_h, map.origin_v, map.origin_h}) {
+    put64(params, v, true);
+  }
+  put32(params, map.map_planes, true);
+  for (const float g : map.gains) {
+    putf(params, g, true);
+  }
+  Bytes list;
+  put32(list, 2, true);
+  // An opcode that is not applied, optional by default.
+  put32(list,
+        static_cast<std::uint32_t>(yk::DngOpcode::fix_bad_pixels_constant),
+        true);
+  put32(list, 0x01030000, true);
+  put32(list, skipped_flags, true);
+  put32(list, 8, true);
+  put32(list, 0, true);
+  put32(list, 0, true);
+  put32(list, static_cast<std::uint32_t>(yk::DngOpcode::gain_map), true);
+  put32(list, 0x01030000, true);
+  put32(list, 0, true);
+  put32(list, static_cast<std::uint32_t>(params.size()), true);
+  list.insert(list.end(), params.begin(), params.end());
+  return list;
+}
+
+void put_entry(Bytes &b, const std::uint16_t tag, const std::uint16_t type,
+               const std::uint32_t count, const std::uint32_t value) {
+  put16(b, tag, false);
+  put16(b, type, false);
+  put32(b, count, false);
+  put32(b, value, false);
+}
+
+// Little-endian DNG skeleton: IFD0 (a preview) with one SubIFD that holds
+// the raw image tags and OpcodeList2. Each directory of two entries takes
+// 30 bytes.
+std::string make_dng(const Bytes &opcodes) {
+  Bytes b = {'I', 'I'};
+  put16(b, 42, false);
+  put32(b, 8, false);
+  put16(b, 2, false);
+  put_entry(b, 254, 4, 1, 1);
+  put_entry(b, 330, 4, 1, 38);
+  put32(b, 0, false);
+  put16(b, 2, false);
+  put_entry(b, 254, 4, 1, 0);
+  put_entry(b, yk::opcode_list2_tag, 7,
+            static_cast<std::uint32_t>(opcodes.size()), 68);
+  put32(b, 0, false);
+  b.insert(b.end(), opcodes.begin(), opcodes.end());
+  return std::string(b.begin(), b.end());
+}
+} // namespace
+
+TEST(DngOpcodesTest, TestReadGainMaps) {
+  const auto expected = test_gain_map(64, 48);
+  std::istringstream is(make_dng(encode_opcode_list(expected)));
+  const yk::TiffReader tiff(is);
+  ASSERT_EQ(tiff.ifds().size(), 2u);
+  EXPECT_EQ(&tiff.raw_ifd(), &tiff.ifds()[1]);
+
+  std::vector<std::string> skipped;
+  const auto maps = yk::read_gain_maps(tiff, &skipped);
+  ASSERT_EQ(maps.size(), 1u);
+  EXPECT_EQ(maps[0].right, 64u);
+  EXPECT_EQ(maps[0].bottom, 48u);
+  EXPECT_EQ(maps[0].planes, 3u);
+  EXPECT_EQ(maps[0].spacing_h, 0.5);
+  EXPECT_EQ(maps[0].gains, expected.gains);
+  ASSERT_EQ(skipped.size(), 1u);
+  EXPECT_EQ(skipped[0], "FixBadPixelsConstant");
+}
+
+TEST(DngOpcodesTest, TestWarnRequiredOpcode) {
+  std::vector<std::string> warnings;
+  yk::set_log_sink([&](yk::LogLevel level, const std::string &message) {
+    if (level == yk::LogLevel::warning) {
+      warnings.push_back(message);
+    }
+  });
+  for (const std::uint32_t flags : {1u, 0u}) {
+    warnings.clear();
+    std::istringstream is(
+        make_dng(encode_opcode_list(test_gain_map(8, 8), flags)));
+    const yk::TiffReader tiff(is);
+    EXPECT_EQ(yk::read_gain_maps(tiff).size(), 1u);
+    if (flags & 1) {
+      EXPECT_TRUE(warnings.empty());
+    } else {
+      ASSERT_EQ(warnings.size(), 1u);
+      EXPECT_NE(warnings[0].find("FixBadPixelsConstant"), std::string::npos);
+    }
+  }
+  yk::set_log_sink(nullptr);
+}
+
+TEST(DngOpcodesTest, TestMalformedInput) {
+  std::istringstream not_tiff("PK\x03\x04 not a tiff");
+  EXPECT_THROW(yk::TiffReader{not_tiff}, std::runtime_error);
+  auto list = encode_opcode_list(test_gain_map(8, 8));
+  EXPECT_THROW(yk::parse_opcode_list(list.data(), list.size() - 1),
+               std::runtime_error);
+  const auto ops = yk::parse_opcode_list(list.data(), list.size());
+  EXPECT_TRUE(ops[0].optional());
+  EXPECT_THROW(yk::parse_gain_map(ops[0]), std::invalid_argument);
+}
+
+TEST(DngOpcodesTest, TestNormalizeLevels) {
+  const std::size_t width = 61, height = 37, n = width * height;
+  std::vector<std::uint16_t> src(3 * n);
+  for (std::size_t i = 0; i < src.size(); i++) {
+    src[i] = static_cast<std::uint16_t>((i * 7919) % 8192);
+  }
+  yk::LevelParams params;
+  params.black = {64.f, 32.f, 0.f};
+
+  // Without maps: the scale of raw_adjust() and the black subtraction.
+  std::vector<std::uint16_t> dst(3 * n);
+  yk::normalize_levels(src.data(), dst.data(), width, height, params);
+  for (std::size_t i = 0; i < src.size(); i++) {
+    const float v = std::min(src[i] * 8.f, 65535.f) - params.black[i / n];
+    ASSERT_EQ(dst[i], std::clamp<int>(int(v + 0.5f), 0, 65535)) << i;
+  }
+
+  // With a map: bilinear gains from 1 to 2, in place.
+  const auto map = test_gain_map(width, height);
+  std::vector<std::uint16_t> image = src;
+  yk::normalize_levels(image.data(), image.data(), width, height, params,
+                       {map});
+  for (std::size_t ch = 0; ch < 3; ch++) {
+    for (std::size_t y = 0; y < height; y++) {
+      for (std::size_t x = 0; x < width; x++) {
+        const std::size_t i = ch * n + y * width + x;
+        const double u = std::clamp((x + 0.5) / width, 0., 1.);
+        const double v = std::clamp((y + 0.5) / height, 0., 1.);
+        const double gain = 1 + 0.5 * (u + v);
+        const double value =
+            (std::min(src[i] * 8., 65535.) - params.black[ch]) * gain;
+        ASSERT_NEAR(image[i], std::clamp(value, 0., 65535.), 1.)
+            << ch << " " << y << " " << x;
+      }
+    }
+  }
+}
@@ -0,0 +1,141 @@
+#include "test_common.hpp"
+#include "gain_table_map.hpp"
+#include "parallel.hpp"
+#include <algorithm>
+#include <cmath>
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+Bytes encode(const yk::GainTableMap &map, const bool big_endian) {
+  Bytes b;
+  put32(b, map.points_v, big_endian);
+  put32(b, map.points_h, big_endian);
+  for (const double v :
+       {map.spacing_v, map.spacing_h, map.origin_v, map.origin_h}) {
+    put64(b, v, big_endian);
+  }
+  put32(b, map.points_n, big_endian);
+  for (const float w : map.input_weights) {
+    putf(b, w, big_endian);
+  }
+  for (const float g : map.gains) {
+    putf(b, g, big_endian);
+  }
+  return b;
+}
+
+// 3x4 map points over the image, 5 entries each, weighted by max(R, G, B).
+yk::GainTableMap test_table() {
+  yk::GainTableMap map;
+  map.points_v = 3;
+  map.points_h = 4;
+  map.points_n = 5;
+  map.spacing_v = 0.5;
+  map.spacing_h = 1. / 3;
+  map.input_weights = {0.f, 0.f, 0.f, 0.f, 1.f};
+  for (std::uint32_t v = 0; v < map.points_v; v++) {
+    for (std::uint32_t h = 0; h < map.points_h; h++) {
+      for (std::uint32_t n = 0; n < map.points_n; n++) {
+        map.gains.push_back(1.f + 0.1f * v + 0.05f * h - 0.15f * n);
+      }
+    }
+  }
+  return map;
+}
+
+// Trilinear reference in double.
+double reference_gain(const yk::GainTableMap &map, const double u,
+                      const double v, const double w) {
+  auto axis = [](const double x, const std::uint32_t points, std::uint32_t &k,
+                 double &f) {
+    const double c = std::clamp(x, 0., double(points - 1));
+    k = std::min<std::uint32_t>(std::uint32_t(c), points - 1);
+    const std::uint32_t k1 = std::min(k + 1, points - 1);
+    f = k1 == k ? 0. : c - k;
+  };
+  std::uint32_t kv, kh, kn;
+  double fv, fh, fn;
+  axis((v - map.origin_v) / map.spacing_v, map.points_v, kv, fv);
+  axis((u - map.origin_h) / map.spacing_h, map.points_h, kh, fh);
+  axis(std::clamp(w, 0., 1.) * (map.points_n - 1), map.points_n, kn, fn);
+  double res = 0;
+  for (int i = 0; i < 8; i++) {
+    const std::uint32_t a = std::min(kv + (i & 1), map.points_v - 1);
+    const std::uint32_t b = std::min(kh + (i >> 1 & 1), map.points_h - 1);
+    const std::uint32_t c = std::min(kn + (i >> 2), map.points_n - 1);
+    res += map.gain(a, b, c) * ((i & 1) ? fv : 1 - fv) *
+           ((i >> 1 & 1) ? fh : 1 - fh) * ((i >> 2) ? fn : 1 - fn);
+  }
+  return res;
+}
+} // namespace
+
+TEST(GainTableMapTest, TestParse) {
+  const auto expected = test_table();
+  for (const bool big_endian : {false, true}) {
+    const auto bytes = encode(expected, big_endian);
+    const auto map =
+        yk::parse_gain_table_map(bytes.data(), bytes.size(), big_endian);
+    EXPECT_EQ(map.points_v, 3u);
+    EXPECT_EQ(map.points_h, 4u);
+    EXPECT_EQ(map.points_n, 5u);
+    EXPECT_EQ(map.spacing_h, expected.spacing_h);
+    EXPECT_EQ(map.input_weights, expected.input_weights);
+    EXPECT_EQ(map.gains, expected.gains);
+    EXPECT_THROW(
+        yk::parse_gain_table_map(bytes.data(), bytes.size() - 4, big_endian),
+        std::runtime_error);
+  }
+}
+
+TEST(GainTableMapTest, TestApply) {
+  const std::size_t width = 53, height = 29, n = width * height;
+  const auto map = test_table();
+  std::vector<float> src(3 * n);
+  for (std::size_t i = 0; i < src.size(); i++) {
+    src[i] = float((i * 7919) % 70000);
+  }
+  auto image = src;
+  yk::Histogram luminance;
+  yk::set_num_threads(4);
+  yk::apply_gain_table_map(image.data(), width, height, map, 65535.f,
+                           &luminance);
+  yk::set_num_threads(0);
+
+  yk::Histogram expected_luminance(luminance.size(), 0);
+  for (std::size_t y = 0; y < height; y++) {
+    for (std::size_t x = 0; x < width; x++) {
+      const std::size_t i = y * width + x;
+      const double r = src[i], g = src[n + i], b = src[2 * n + i];
+      const double gain =
+          reference_gain(map, (x + 0.5) / width, (y + 0.5) / height,
+                         std::max({r, g, b}) / 65535.);
+      ASSERT_NEAR(image[i], r * gain, 1e-4 * r + 1e-3) << y << " " << x;
+      ASSERT_NEAR(image[n + i], g * gain, 1e-4 * g + 1e-3);
+      ASSERT_NEAR(image[2 * n + i], b * gain, 1e-4 * b + 1e-3);
+      const float l = yk::sRGB_luminance[0] * image[i] +
+                      yk::sRGB_luminance[1] * image[n + i] +
+                      yk::sRGB_luminance[2] * image[2 * n + i];
+      expected_luminance[yk::ToneCurve::clamp_value(l)]++;
+    }
+  }
+  // FMA contraction can move a luminance across a bin edge; compare the
+  // cumulative counts within two bins.
+  ASSERT_EQ(luminance.size(), expected_luminance.size());
+  EXPECT_EQ(yk::histogram_total(luminance), n);
+  std::vector<std::uint64_t> expected_acc(expected_luminance.size());
+  std::uint64_t acc = 0;
+  for (std::size_t v = 0; v < expected_luminance.size(); v++) {
+    acc += expected_luminance[v];
+    expected_acc[v] = acc;
+  }
+  acc = 0;
+  for (std::size_t v = 0; v < luminance.size(); v++) {
+    acc += luminance[v];
+    const std::size_t hi = std::min(v + 2, expected_acc.size() - 1);
+    ASSERT_GE(acc, v < 2 ? 0 : expected_acc[v - 2]) << v;
+    ASSERT_LE(acc, expected_acc[hi]) << v;
+  }
+}
@@ -0,0 +1,97 @@
+#include "color_transform.hpp"
+#include "half_float.hpp"
+#include "tone_curve.hpp"
+#include <algorithm>
+#include <cmath>
+#include <gtest/gtest.h>
+#include <limits>
+#include <random>
+#include <vector>
+
+TEST(HalfFloatTest, TestScalarConversion) {
+  EXPECT_EQ(yk::to_half(0.f).bits, 0x0000);
+  EXPECT_EQ(yk::to_half(-0.f).bits, 0x8000);
+  EXPECT_EQ(yk::to_half(1.f).bits, 0x3c00);
+  EXPECT_EQ(yk::to_half(-2.f).bits, 0xc000);
+  EXPECT_EQ(yk::to_half(65504.f).bits, 0x7bff);
+  EXPECT_EQ(yk::to_half(65520.f).bits, 0x7c00);
+  EXPECT_EQ(yk::to_half(std::numeric_limits<float>::infinity()).bits, 0x7c00);
+  EXPECT_TRUE(std::isnan(yk::to_float(yk::to_half(std::nanf("")))));
+  // Smallest subnormal and ties to even between 1 and the next Half.
+  EXPECT_EQ(yk::to_half(std::ldexp(1.f, -24)).bits, 0x0001);
+  EXPECT_EQ(yk::to_half(1.f + std::ldexp(1.f, -11)).bits, 0x3c00);
+  EXPECT_EQ(yk::to_half(1.f + 3 * std::ldexp(1.f, -11)).bits, 0x3c02);
+
+  // Every finite Half survives the round trip through float.
+  for (std::uint32_t bits = 0; bits < 0x10000; bits++) {
+    const yk::Half h{static_cast<std::uint16_t>(bits)};
+    if ((bits & 0x7c00) == 0x7c00) {
+      continue;
+    }
+    ASSERT_EQ(yk::to_half(yk::to_float(h)).bits, bits);
+  }
+}
+
+TEST(HalfFloatTest, TestBulkConversionMatchesScalar) {
+  const std::size_t n = 10007;
+  std::mt19937 rng(0);
+  std::uniform_real_distribution<float> dist(-2.f, 70000.f);
+  std::vector<float> src(n);
+  for (auto &v : src) {
+    v = dist(rng);
+  }
+  std::vector<yk::Half> half(n);
+  std::vector<float> back(n);
+  yk::to_half(src.data(), half.data(), n, 1.f / yk::half_unit);
+  yk::to_float(half.data(), back.data(), n, yk::half_unit);
+  for (std::size_t i = 0; i < n; i++) {
+    ASSERT_EQ(half[i].bits, yk::to_half(src[i] / yk::half_unit).bits);
+    // Relative bound for normal Half numbers, absolute for subnormals.
+    EXPECT_NEAR(back[i], src[i],
+                std::max(std::abs(src[i]) * std::ldexp(1.f, -11),
+                         yk::half_unit * std::ldexp(1.f, -25)));
+  }
+}
+
+TEST(HalfFloatTest, TestHalfPipelineAndErrorReport) {
+  const std::size_t n = 50000;
+  std::mt19937 rng(1);
+  std::uniform_int_distribution<int> dist(0, USHRT_MAX);
+  std::vector<std::uint16_t> src(3 * n);
+  for (auto &v : src) {
+    v = dist(rng);
+  }
+  // Saturated primaries push values above white, which Half keeps.
+  const yk::Matrix3 m = {{{1.6f, -0.4f, -0.2f},
+                          {-0.2f, 1.5f, -0.3f},
+                          {0.0f, -0.5f, 1.5f}}};
+  std::vector<float> ref(3 * n);
+  std::vector<yk::Half> half(3 * n);
+  yk::Histogram y_ref, y_half;
+  yk::color_transform(src.data(), ref.data(), n, m, &y_ref);
+  yk::color_transform(src.data(), half.data(), n, m, &y_half);
+  EXPECT_EQ(y_ref, y_half);
+
+  const yk::HalfErrorStats stats = yk::half_error(ref.data(), ref.size());
+  EXPECT_EQ(stats.count, ref.size());
+  EXPECT_LE(stats.max_rel, std::ldexp(1., -11));
+  EXPECT_LE(stats.max_abs, 3 * yk::half_unit * std::ldexp(1., -11));
+  EXPECT_LT(0u, stats.above_white);
+
+  const auto curve = yk::ToneCurve::from_function(
+      [](int v) { return 65535.f * std::sqrt(v / 65535.f); });
+  std::vector<std::uint16_t> out_ref(3 * n), out_half(3 * n), codes(3 * n);
+  yk::apply_tone_curve(ref.data(), out_ref.data(), n, curve);
+  yk::apply_tone_curve(half.data(), out_half.data(), n, curve);
+  yk::half_to_ushort(half.data(), codes.data(), codes.size());
+  std::size_t changed = 0;
+  for (std::size_t i = 0; i < out_ref.size(); i++) {
+    const int ref_code = yk::ToneCurve::clamp_value(ref[i]);
+    EXPECT_LE(std::abs(ref_code - codes[i]), int(stats.max_code_diff));
+    changed += ref_code != codes[i];
+    // The curve sees the truncated codes the report describes.
+    EXPECT_EQ(out_half[i], curve.lut(0)[codes[i]]);
+    EXPECT_EQ(out_ref[i], curve.lut(0)[ref_code]);
+  }
+  EXPECT_EQ(changed, stats.changed_codes);
+}
@@ -0,0 +1,71 @@
+#include "image_stats.hpp"
+#include "test_common.hpp"
+#include <cmath>
+#include <gtest/gtest.h>
+#include <random>
+#include <vector>
+
+namespace {
+template <class T> std::pair<double, double> two_pass(const std::vector<T> &v) {
+  double mean = 0;
+  for (auto x : v) {
+    mean += x;
+  }
+  mean /= v.size();
+  double var = 0;
+  for (auto x : v) {
+    var += (x - mean) * (x - mean);
+  }
+  return {mean, std::sqrt(var / v.size())};
+}
+} // namespace
+
+TEST(ImageStatsTest, TestMatchesTwoPass) {
+  const std::size_t n = 1 << 20;
+  std::mt19937 rng(0);
+  std::uniform_int_distribution<int> dist(0, USHRT_MAX);
+  std::vector<std::uint16_t> data(3 * n);
+  for (auto &v : data) {
+    v = dist(rng);
+  }
+  // Force several chunks so that partial results are merged.
+  yk::set_num_threads(4);
+  auto stats = yk::compute_image_stats(data.data(), n);
+  yk::set_num_threads(0);
+  for (int ch = 0; ch < 3; ch++) {
+    std::vector<std::uint16_t> channel(data.begin() + ch * n,
+                                       data.begin() + (ch + 1) * n);
+    auto [mean, stddev] = two_pass(channel);
+    EXPECT_EQ(stats[ch].count, n);
+    EXPECT_NEAR(stats[ch].mean, mean, 1e-9 * mean);
+    EXPECT_NEAR(stats[ch].stddev(), stddev, 1e-9 * stddev);
+    EXPECT_EQ(stats[ch].min, *std::min_element(channel.begin(), channel.end()));
+    EXPECT_EQ(stats[ch].max, *std::max_element(channel.begin(), channel.end()));
+  }
+  auto [mean, stddev] = two_pass(data);
+  EXPECT_EQ(stats.pooled().count, 3 * n);
+  EXPECT_NEAR(stats.pooled().mean, mean, 1e-9 * mean);
+  EXPECT_NEAR(stats.pooled().stddev(), stddev, 1e-9 * stddev);
+}
+
+TEST(ImageStatsTest, TestLargeOffsetFloat) {
+  // Small variance on a large offset, where sum-of-squares formulas fail.
+  std::vector<float> data(1 << 18);
+  for (std::size_t i = 0; i < data.size(); i++) {
+    data[i] = 1e6f + (i % 2 ? 0.5f : -0.5f);
+  }
+  auto stats = yk::compute_stats(data.data(), data.size());
+  EXPECT_NEAR(stats.mean, 1e6, 1e-6);
+  EXPECT_NEAR(stats.stddev(), 0.5, 1e-9);
+}
+
+TEST(ImageStatsTest, TestStride) {
+  std::vector<std::uint16_t> data(1 << 18);
+  for (std::size_t i = 0; i < data.size(); i++) {
+    data[i] = i % 4 == 0 ? 100 : 0;
+  }
+  auto stats = yk::compute_stats(data.data(), data.size(), 4);
+  EXPECT_EQ(stats.count, data.size() / 4);
+  EXPECT_DOUBLE_EQ(stats.mean, 100);
+  EXPECT_DOUBLE_EQ(stats.stddev(), 0);
+}
@@ -0,0 +1,158 @@
+#include "levels.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include <vector>
+
+TEST(LevelsTest, TestParseWhiteBalance) {
+  using Mode = yk::WhiteBalance::Mode;
+  EXPECT_EQ(yk::parse_white_balance("none").mode, Mode::none);
+  EXPECT_EQ(yk::parse_white_balance("as-shot").mode, Mode::as_shot);
+  EXPECT_EQ(yk::parse_white_balance("auto").mode, Mode::gray_world);
+  const auto wb = yk::parse_white_balance("2.1,1,1.5");
+  EXPECT_EQ(wb.mode, Mode::custom);
+  EXPECT_FLOAT_EQ(wb.multipliers[0], 2.1f);
+  EXPECT_FLOAT_EQ(wb.multipliers[2], 1.5f);
+  EXPECT_THROW(yk::parse_white_balance("daylight"), std::invalid_argument);
+  EXPECT_THROW(yk::parse_white_balance("2,1"), std::invalid_argument);
+  EXPECT_THROW(yk::normalize_gains({2.f, 0.f, 1.f}), std::invalid_argument);
+}
+
+TEST(LevelsTest, TestWhiteBalanceGains) {
+  const std::size_t n = 1000;
+  yk::LevelParams params;
+  params.black = {80.f, 80.f, 80.f};
+  // A gray scene seen through a tint of (0.5, 1, 0.8), plus some pixels
+  // clipped in red that gray world has to leave out.
+  std::vector<std::uint16_t> src(3 * n);
+  for (std::size_t i = 0; i < n; i++) {
+    const float gray = 100.f + i % 500;
+    const bool clipped = i % 10 == 0;
+    src[i] = clipped ? 8191 : std::uint16_t((gray * 0.5f * 8 + 80) / 8);
+    src[n + i] = std::uint16_t((gray * 8 + 80) / 8);
+    src[2 * n + i] = std::uint16_t((gray * 0.8f * 8 + 80) / 8);
+  }
+  const std::array<float, 3> neutral = {0.5f, 1.f, 0.8f};
+
+  yk::WhiteBalance wb;
+  EXPECT_EQ(yk::white_balance_gains(wb, src.data(), n, params, neutral),
+            (std::array<float, 3>{1.f, 1.f, 1.f}));
+  wb.mode = yk::WhiteBalance::Mode::as_shot;
+  auto gains = yk::white_balance_gains(wb, src.data(), n, params, neutral);
+  EXPECT_FLOAT_EQ(gains[0], 2.f);
+  EXPECT_FLOAT_EQ(gains[1], 1.f);
+  EXPECT_FLOAT_EQ(gains[2], 1.25f);
+  wb.mode = yk::WhiteBalance::Mode::gray_world;
+  gains = yk::white_balance_gains(wb, src.data(), n, params, neutral, 1);
+  EXPECT_NEAR(gains[0], 2.f, 0.02f);
+  EXPECT_FLOAT_EQ(gains[1], 1.f);
+  EXPECT_NEAR(gains[2], 1.25f, 0.02f);
+  // A neutral with a missing entry falls back to unit gains.
+  wb.mode = yk::WhiteBalance::Mode::as_shot;
+  EXPECT_EQ(yk::white_balance_gains(wb, src.data(), n, params,
+                                    {0.5f, 0.f, 0.8f}),
+            (std::array<float, 3>{1.f, 1.f, 1.f}));
+  wb = yk::parse_white_balance("1,2,4");
+  EXPECT_EQ(yk::white_balance_gains(wb, src.data(), n, params, neutral),
+            (std::array<float, 3>{1.f, 2.f, 4.f}));
+}
+
+TEST(LevelsTest, TestNormalizeWithGains) {
+  const std::size_t width = 37, height = 11, n = width * height;
+  std::vector<std::uint16_t> src(3 * n);
+  for (std::size_t i = 0; i < src.size(); i++) {
+    src[i] = static_cast<std::uint16_t>((i * 104729) % 8192);
+  }
+  yk::LevelParams params;
+  params.black = {64.f, 32.f, 16.f};
+  params.gains = {2.f, 1.f, 1.5f};
+  std::vector<std::uint16_t> dst(3 * n);
+  // The default white level and one below the range of the data, which
+  // clips after the black level is subtracted.
+  for (const float white : {65535.f, 40000.f}) {
+    params.white = white;
+    yk::normalize_levels(src.data(), dst.data(), width, height, params);
+    for (std::size_t i = 0; i < src.size(); i++) {
+      const std::size_t ch = i / n;
+      const float v = std::min(src[i] * 8.f - params.black[ch],
+                               white - params.black[ch]) *
+                      params.gains[ch];
+      ASSERT_NEAR(dst[i], std::clamp(v, 0.f, 65535.f), 1.f)
+          << white << " " << i;
+    }
+  }
+}
+
+TEST(LevelsTest, TestWhitePointLevels) {
+  // 10-bit Bayer data demosaiced to three channels: a saturated site
+  // reaches full scale in every channel after the as-shot white balance,
+  // so blown highlights stay neutral.
+  const std::size_t n = 3;
+  auto params = yk::white_point_levels(1023.f, {64.f, 60.f, 64.f});
+  params.gains = yk::white_balance_gains(
+      {yk::WhiteBalance::Mode::as_shot}, nullptr, n, params,
+      {0.5f, 1.f, 0.8f});
+  const std::vector<std::uint16_t> src = {1023, 64, 543, 1023, 60, 541,
+                                          1023, 64, 543};
+  std::vector<std::uint16_t> dst(3 * n);
+  yk::normalize_levels(src.data(), dst.data(), n, 1, params);
+  for (int ch = 0; ch < 3; ch++) {
+    EXPECT_EQ(dst[ch * n], 65535) << ch;
+    EXPECT_EQ(dst[ch * n + 1], 0) << ch;
+  }
+  // Mid-gray of the green range is half scale before the gains.
+  EXPECT_NEAR(dst[n + 2], 65535 * 481. / 959., 1.);
+}
+
+TEST(LevelsTest, TestMosaicGainMaps) {
+  // RGGB mosaic with a map over the red sites (pitch 2 from (0, 0)) and a
+  // constant map over the blue sites (pitch 2 from (1, 1)); green sites
+  // and the black level are left alone.
+  const std::size_t width = 20, height = 14, stride = 23;
+  const std::array<float, 4> black = {64.f, 32.f, 32.f, 16.f};
+  std::vector<std::uint16_t> raw(stride * height, 7);
+  for (std::size_t y = 0; y < height; y++) {
+    for (std::size_t x = 0; x < width; x++) {
+      raw[y * stride + x] = static_cast<std::uint16_t>(
+          y == 4 ? black[(y & 1) * 2 + (x & 1)] : 1000 + 50 * x + 30 * y);
+    }
+  }
+  yk::GainMap red;
+  red.bottom = height;
+  red.right = width;
+  red.row_pitch = red.col_pitch = 2;
+  red.points_v = red.points_h = 2;
+  red.gains = {1.f, 2.f, 1.5f, 3.f};
+  yk::GainMap blue = red;
+  blue.top = blue.left = 1;
+  blue.points_v = blue.points_h = 1;
+  blue.gains = {0.5f};
+  auto expected = raw;
+  for (std::size_t y = 0; y < height; y++) {
+    for (std::size_t x = 0; x < width; x++) {
+      const std::size_t site = (y & 1) * 2 + (x & 1);
+      float gain = 1.f;
+      if (site == 0) {
+        const float u = (x + 0.5f) / width, v = (y + 0.5f) / height;
+        gain = (1 - v) * ((1 - u) * 1.f + u * 2.f) +
+               v * ((1 - u) * 1.5f + u * 3.f);
+      } else if (site == 3) {
+        gain = 0.5f;
+      }
+      const float b = black[site];
+      expected[y * stride + x] = static_cast<std::uint16_t>(
+          std::lround(b + (raw[y * stride + x] - b) * gain));
+    }
+  }
+  yk::apply_mosaic_gain_maps(raw.data(), width, height, stride, black,
+                             {red, blue});
+  for (std::size_t i = 0; i < raw.size(); i++) {
+    ASSERT_NEAR(raw[i], expected[i], 1) << i;
+  }
+  // Black pixels stay black and green sites are unchanged.
+  EXPECT_EQ(raw[4 * stride], 64);
+  EXPECT_EQ(raw[4 * stride + 3], 32);
+  EXPECT_EQ(raw[2 * stride + 1], 1000 + 50 + 60);
+}
@@ -0,0 +1,159 @@
+#include "async_log.hpp"
+#include "logging.hpp"
+#include <algorithm>
+#include <atomic>
+#include <gtest/gtest.h>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace {
+// Capture records for the duration of a test.
+struct CaptureSink {
+  std::vector<std::pair<yk::LogLevel, std::string>> records;
+
+  CaptureSink() {
+    yk::set_log_sink([this](yk::LogLevel level, const std::string &message) {
+      records.emplace_back(level, message);
+    });
+  }
+  ~CaptureSink() {
+    yk::set_log_sink(nullptr);
+    yk::set_log_level(yk::LogLevel::info);
+  }
+};
+} // namespace
+
+TEST(LoggingTest, TestLevelFilter) {
+  CaptureSink capture;
+  yk::set_log_level(yk::LogLevel::warning);
+  int evaluated = 0;
+  YK_LOG_INFO("info " << ++evaluated);
+  YK_LOG_ERROR("error " << ++evaluated);
+  // The expression of a disabled statement is not evaluated.
+  EXPECT_EQ(evaluated, 1);
+  ASSERT_EQ(capture.records.size(), 1u);
+  EXPECT_EQ(capture.records[0].first, yk::LogLevel::error);
+  EXPECT_EQ(capture.records[0].second, "error 1");
+}
+
+TEST(LoggingTest, TestLogBuffer) {
+  CaptureSink capture;
+  yk::set_log_level(yk::LogLevel::info);
+  {
+    yk::LogBuffer log(yk::LogLevel::debug);
+    EXPECT_EQ(log.stream(), nullptr);
+  }
+  {
+    yk::LogBuffer log(yk::LogLevel::info, false);
+    EXPECT_EQ(log.stream(), nullptr);
+  }
+  {
+    yk::LogBuffer log(yk::LogLevel::info);
+    ASSERT_NE(log.stream(), nullptr);
+    *log.stream() << "a\n"
+                  << "b\n";
+  }
+  ASSERT_EQ(capture.records.size(), 1u);
+  EXPECT_EQ(capture.records[0].second, "a\nb\n");
+}
+
+TEST(LoggingTest, TestReplacedSinkIsFreed) {
+  auto state = std::make_shared<int>(0);
+  const std::weak_ptr<int> watch = state;
+  yk::set_log_sink([state = std::move(state)](yk::LogLevel,
+                                              const std::string &) {
+    ++*state;
+  });
+  YK_LOG_ERROR("counted");
+  ASSERT_FALSE(watch.expired());
+  EXPECT_EQ(*watch.lock(), 1);
+  yk::set_log_sink(nullptr);
+  EXPECT_TRUE(watch.expired());
+}
+
+TEST(LoggingTest, TestAsyncLoggerKeepsPerThreadOrder) {
+  constexpr int threads = 4, records = 1000;
+  std::vector<std::vector<int>> received(threads);
+  {
+    // Only the writer thread calls the downstream sink, so no lock here.
+    yk::AsyncLogger logger(
+        [&](yk::LogLevel, const std::string &message) {
+          const auto sep = message.find(':');
+          received[std::stoi(message.substr(0, sep))].push_back(
+              std::stoi(message.substr(sep + 1)));
+        },
+        records);
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++) {
+      workers.emplace_back([&logger, t] {
+        for (int i = 0; i < records; i++) {
+          logger.push(yk::LogLevel::info,
+                      std::to_string(t) + ":" + std::to_string(i));
+        }
+      });
+    }
+    for (auto &w : workers) {
+      w.join();
+    }
+    logger.flush();
+    EXPECT_EQ(logger.dropped(), 0u);
+  }
+  for (int t = 0; t < threads; t++) {
+    ASSERT_EQ(received[t].size(), std::size_t(records));
+    for (int i = 0; i < records; i++) {
+      EXPECT_EQ(received[t][i], i);
+    }
+  }
+}
+
+TEST(LoggingTest, TestAsyncLoggerReusesRings) {
+  // Many more short-lived threads than rings, as parallel_for spawns them:
+  // the ring of an exited thread is reused and nothing is dropped.
+  constexpr int threads = 64;
+  std::vector<int> received;
+  {
+    yk::AsyncLogger logger(
+        [&](yk::LogLevel, const std::string &message) {
+          received.push_back(std::stoi(message));
+        },
+        16, 2);
+    for (int t = 0; t < threads; t++) {
+      std::thread([&logger, t] {
+        EXPECT_TRUE(logger.push(yk::LogLevel::info, std::to_string(t)));
+      }).join();
+    }
+    logger.flush();
+    EXPECT_EQ(logger.dropped(), 0u);
+  }
+  // Records of different threads may interleave.
+  std::sort(received.begin(), received.end());
+  ASSERT_EQ(received.size(), std::size_t(threads));
+  for (int t = 0; t < threads; t++) {
+    EXPECT_EQ(received[t], t);
+  }
+}
+
+TEST(LoggingTest, TestAsyncLoggerDropsWhenFull) {
+  std::atomic<bool> blocked{true};
+  std::atomic<int> received{0};
+  yk::AsyncLogger logger(
+      [&](yk::LogLevel, const std::string &) {
+        while (blocked.load()) {
+          std::this_thread::yield();
+        }
+        received++;
+      },
+      4);
+  int accepted = 0;
+  for (int i = 0; i < 100; i++) {
+    accepted += logger.push(yk::LogLevel::info, "record");
+  }
+  blocked = false;
+  logger.flush();
+  EXPECT_LE(accepted, 5);
+  EXPECT_EQ(received.load(), accepted);
+  EXPECT_EQ(logger.dropped(), std::uint64_t(100 - accepted));
+}
@@ -0,0 +1,67 @@
+#include "parallel.hpp"
+#include "perf_counters.hpp"
+#include <cstdint>
+#include <gtest/gtest.h>
+#include <vector>
+
+TEST(PerfCountersTest, TestStageProfiler) {
+  yk::StageProfiler profiler;
+  std::vector<std::uint32_t> data(1 << 20, 1);
+  const auto sum = profiler.measure("sum", data.size() * sizeof(data[0]), [&] {
+    std::uint64_t res = 0;
+    for (auto v : data) {
+      res += v;
+    }
+    return res;
+  });
+  EXPECT_EQ(sum, data.size());
+  profiler.measure("fill", data.size() * sizeof(data[0]), [&] {
+    yk::parallel_for(data.size(), [&](std::size_t begin, std::size_t end,
+                                      std::size_t) {
+      for (std::size_t i = begin; i < end; i++) {
+        data[i] = 2;
+      }
+    });
+  });
+
+  ASSERT_EQ(profiler.reports().size(), 2u);
+  EXPECT_EQ(profiler.reports()[0].name, "sum");
+  EXPECT_EQ(profiler.reports()[1].name, "fill");
+  for (const auto &report : profiler.reports()) {
+    EXPECT_LE(0., report.sample.ms);
+    // Counters may be unavailable, e.g. in containers.
+    EXPECT_EQ(report.sample.valid, profiler.counters_available());
+    if (report.sample.valid) {
+      EXPECT_LT(0u, report.sample.instructions);
+      EXPECT_LT(0., report.sample.ipc());
+    }
+  }
+}
+
+TEST(PerfCountersTest, TestDisabledProfiler) {
+  yk::StageProfiler profiler(false);
+  int calls = 0;
+  EXPECT_EQ(profiler.measure("stage", 0, [&] { return ++calls; }), 1);
+  EXPECT_TRUE(profiler.reports().empty());
+}
+
+TEST(PerfCountersTest, TestMemoryTracker) {
+  using Vector =
+      std::vector<std::uint32_t, yk::TrackingAllocator<std::uint32_t>>;
+  yk::StageProfiler profiler;
+  Vector kept = profiler.measure("alloc", 0, [] {
+    Vector a(1000);
+    Vector b(500);
+    return b;
+  });
+  profiler.measure("free", 0, [&] { Vector().swap(kept); });
+
+  ASSERT_EQ(profiler.reports().size(), 2u);
+  const auto &alloc = profiler.reports()[0].memory;
+  EXPECT_EQ(alloc.allocations, 2u);
+  EXPECT_EQ(alloc.bytes_allocated, 1500 * sizeof(std::uint32_t));
+  EXPECT_EQ(alloc.peak_bytes, 1500 * sizeof(std::uint32_t));
+  const auto &free = profiler.reports()[1].memory;
+  EXPECT_EQ(free.allocations, 0u);
+  EXPECT_EQ(free.peak_bytes, 0u);
+}
@@ -1,4 +1,5 @@
 #include "raw_converter.hpp"
+#include "sequence_converter.hpp"
 #include "test_common.hpp"
 #include <gtest/gtest.h>
 #include <numeric>
@@ -43,6 +44,7 @@ TEST(RawConverterTest, TestAdjustBrightnesInt) {
       static_cast<float>(8 * 10 * 2) / (1 << 16); // 20 bins (160 values)
   if (yk::DEBUG) {
     std::cout << "thresh: " << std::to_string(thresh) << std::endl;
+    yk::set_log_level(yk::LogLevel::debug);
   }
   auto &&outf = rc.adjust_brightness(data, thresh, yk::DEBUG);
   auto &&out = xt::clip(xt::floor(std::move(outf)), 0, USHRT_MAX);
@@ -57,10 +59,6 @@ TEST(RawConverterTest, TestAdjustBrightnesInt) {
     ans(0, i) = ans(1, i) = ans(2, i) = std::min<int>(
         USHRT_MAX, std::max<int>(0, static_cast<float>(i) * alpha + beta));
   }
-  if (yk::DEBUG) {
-    std::cout << rc.debug_message.str() << std::endl;
-    rc.debug_message.str("");
-  }
   EXPECT_EQ(xt::amax(ans)(), xt::amax(out)());
   EXPECT_EQ(xt::amin(ans)(), xt::amin(out)());
 
@@ -77,6 +75,7 @@ TEST(RawConverterTest, TestAdjustBrightnesFloat) {
   float thresh = 0.5;
   if (yk::DEBUG) {
     std::cout << "thresh: " << std::to_string(thresh) << std::endl;
+    yk::set_log_level(yk::LogLevel::debug);
   }
   auto &&outf = rc.adjust_brightness(data, thresh, yk::DEBUG);
   auto &&out = xt::clip(xt::floor(std::move(outf)), 0, USHRT_MAX);
@@ -91,11 +90,32 @@ TEST(RawConverterTest, TestAdjustBrightnesFloat) {
     ans(0, i) = ans(1, i) = ans(2, i) =
         std::min<int>(USHRT_MAX, std::max<int>(0, data(0, i) * alpha + beta));
   }
-  if (yk::DEBUG) {
-    std::cout << rc.debug_message.str() << std::endl;
-    rc.debug_message.str("");
-  }
   EXPECT_EQ(xt::amax(ans)(), xt::amax(out)());
   EXPECT_EQ(xt::amin(ans)(), xt::amin(out)());
   CLOSE_ALL(out, ans);
-}
\ No newline at end of file
+}
+
+TEST(RawConverterTest, TestSequenceSmoothing) {
+  yk::SequenceParams params;
+  params.tone_mapper = "minmax";
+  params.smoothing = 0.5;
+  params.sample_stride = 1;
+  params.gamma = false;
+  yk::SequenceConverter sequence(params);
+  const yk::Matrix3 identity = {{{1, 0, 0}, {0, 1, 0}, {0, 0, 1}}};
+
+  xt::xtensor<ushort, 2> frame0({3, 2001}), frame1({3, 2001});
+  for (int i = 0; i < 2001; i++) {
+    for (int ch = 0; ch < 3; ch++) {
+      frame0(ch, i) = i / 2;
+      frame1(ch, i) = i;
+    }
+  }
+  auto &&out0 = sequence.process(frame0, identity);
+  // First frame: [0, 1000] is stretched to the full range.
+  EXPECT_NEAR(out0(1, 2000), USHRT_MAX, 100);
+  auto &&out1 = sequence.process(frame1, identity);
+  // Second frame: halfway between the curves of frame 0 and frame 1.
+  EXPECT_NEAR(out1(1, 1000), (USHRT_MAX + USHRT_MAX / 2) / 2, 100);
+  EXPECT_EQ(sequence.reports().size(), 2);
+}
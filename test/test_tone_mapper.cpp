@@ -0,0 +1,274 @@
+#include "test_common.hpp"
+#include "local_tone_map.hpp"
+#include "tone_mapper.hpp"
+#include <gtest/gtest.h>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+// (3, 1 << 16) image where every channel holds 0, 1, ..., USHRT_MAX.
+std::vector<std::uint16_t> ramp_image() {
+  std::vector<std::uint16_t> data(3 << 16);
+  for (int ch = 0; ch < 3; ch++) {
+    std::iota(data.begin() + (ch << 16), data.begin() + ((ch + 1) << 16), 0);
+  }
+  return data;
+}
+} // namespace
+
+TEST(ToneMapperTest, TestApplyLutUshort) {
+  yk::ToneCurve curve = yk::ToneCurve::from_function(
+      [](int v) { return float(USHRT_MAX - v); });
+  auto src = ramp_image();
+  std::vector<std::uint16_t> dst(src.size());
+  yk::apply_tone_curve(src.data(), dst.data(), 1 << 16, curve);
+  for (std::size_t i = 0; i < dst.size(); i++) {
+    EXPECT_EQ(dst[i], USHRT_MAX - src[i]);
+  }
+}
+
+TEST(ToneMapperTest, TestApplyLutFloatClamps) {
+  yk::ToneCurve curve;
+  std::vector<float> src = {-1.1, 0.5, 3.9, 255, 65534.9, 65535, 65536.3,
+                            1e9, 7, 8, 9};
+  std::vector<std::uint16_t> dst(src.size());
+  yk::apply_lut(src.data(), dst.data(), src.size(), curve.lut(0));
+  std::vector<std::uint16_t> ans = {0,     0,     3,        255, 65534, 65535,
+                                    65535, 65535, 7,        8,   9};
+  EXPECT_EQ(dst, ans);
+}
+
+TEST(ToneMapperTest, TestPerChannelCurve) {
+  auto curve = yk::ToneCurve::from_channel_function(
+      [](int ch, int v) { return float(v + ch); });
+  auto src = ramp_image();
+  yk::apply_tone_curve(src.data(), src.data(), 1 << 16, curve);
+  for (int ch = 0; ch < 3; ch++) {
+    EXPECT_EQ(src[(ch << 16) + 100], 100 + ch);
+    EXPECT_EQ(src[(ch << 16) + USHRT_MAX], USHRT_MAX);
+  }
+}
+
+TEST(ToneMapperTest, TestStretchCurve) {
+  auto data = ramp_image();
+  const yk::ImageView view{data.data(), 1 << 16};
+  auto mapper = yk::ToneMapperRegistry::instance().create(
+      "stretch", {{"stretch_rate", 160.f / (1 << 16)}});
+  auto curve = mapper->build_curve(view);
+  float alpha = static_cast<float>(USHRT_MAX) / (((1 << 13) - 10 - 1) * 8 - 80);
+  float beta = -8 * 10 * alpha;
+  for (int v = 0; v < (1 << 16); v++) {
+    EXPECT_EQ(curve.lut(0)[v],
+              std::min<int>(USHRT_MAX,
+                            std::max<int>(0, static_cast<float>(v) * alpha +
+                                                 beta)));
+  }
+}
+
+TEST(ToneMapperTest, TestEqualizationOfUniformImage) {
+  auto data = ramp_image();
+  const yk::ImageView view{data.data(), 1 << 16};
+  auto curve = yk::HistogramEqualization{}.build_curve(view);
+  // A uniform histogram is already equalised.
+  for (int v = 0; v < (1 << 16); v += 257) {
+    EXPECT_NEAR(curve.lut(0)[v], v, 1);
+  }
+}
+
+TEST(ToneMapperTest, TestRegistry) {
+  auto &registry = yk::ToneMapperRegistry::instance();
+  for (auto name : {"stretch", "piecewise", "equalize", "mean_stddev",
+                    "stddev", "minmax"}) {
+    EXPECT_TRUE(registry.contains(name));
+  }
+  EXPECT_THROW(registry.create("no_such_mapper"), std::invalid_argument);
+
+  registry.add("invert", [](const yk::ToneMapParams &) {
+    struct Invert : yk::ToneMapper {
+      yk::ToneCurve
+      build_curve_from_histogram(const yk::Histogram &,
+                                 std::ostream *) const override {
+        return yk::ToneCurve::from_function(
+            [](int v) { return float(USHRT_MAX - v); });
+      }
+    };
+    return std::make_unique<Invert>();
+  });
+  auto data = ramp_image();
+  const yk::ImageView view{data.data(), 1 << 16};
+  EXPECT_EQ(registry.create("invert")->build_curve(view).lut(0)[0],
+            USHRT_MAX);
+}
+
+TEST(ToneMapperTest, TestHistogram) {
+  std::mt19937 rng(0);
+  std::uniform_int_distribution<int> dist(0, USHRT_MAX);
+  std::vector<std::uint16_t> data(1 << 20);
+  for (auto &v : data) {
+    v = dist(rng) >> (rng() % 5);
+  }
+  yk::Histogram ans(1 << 16, 0);
+  for (auto v : data) {
+    ans[v]++;
+  }
+  yk::set_num_threads(3);
+  auto histogram = yk::compute_histogram(data.data(), data.size());
+  yk::set_num_threads(0);
+  EXPECT_EQ(histogram, ans);
+}
+
+TEST(ToneMapperTest, TestInclusiveScan) {
+  std::vector<std::uint32_t> data(1001);
+  std::iota(data.begin(), data.end(), 1);
+  std::vector<std::uint32_t> ans(data.size());
+  std::partial_sum(data.begin(), data.end(), ans.begin());
+  yk::inclusive_scan(data.data(), data.size());
+  EXPECT_EQ(data, ans);
+}
+
+TEST(ToneMapperTest, TestEqualizationMatchesFloatReference) {
+  std::mt19937 rng(1);
+  std::normal_distribution<float> dist(20000, 5000);
+  std::vector<std::uint16_t> data(3 << 16);
+  for (auto &v : data) {
+    v = std::clamp<int>(dist(rng), 0, USHRT_MAX);
+  }
+  const yk::ImageView view{data.data(), 1 << 16};
+  auto curve = yk::HistogramEqualization{}.build_curve(view);
+
+  std::vector<double> cdf(1 << 16, 0.);
+  for (std::size_t i = 0; i < view.size; i++) {
+    cdf[view.channel(1)[i]] += double(USHRT_MAX) / view.size;
+  }
+  std::partial_sum(cdf.begin(), cdf.end(), cdf.begin());
+  for (int v = 0; v < (1 << 16); v++) {
+    EXPECT_NEAR(curve.lut(0)[v], cdf[v], 1.);
+  }
+}
+
+TEST(ToneMapperTest, TestLocalEqualizationSingleTile) {
+  // One unclipped tile is plain histogram equalisation of a uniform image.
+  auto data = ramp_image();
+  std::vector<std::uint16_t> dst(data.size());
+  yk::LocalToneMapParams params;
+  params.tiles_x = params.tiles_y = 1;
+  params.clip_limit = 0;
+  yk::local_equalization({data.data(), 1 << 16}, 256, 256, dst.data(),
+                         params);
+  for (std::size_t i = 0; i < dst.size(); i += 97) {
+    EXPECT_NEAR(dst[i], data[i], 16);
+  }
+}
+
+TEST(ToneMapperTest, TestLocalEqualizationAdaptsPerTile) {
+  // Left half dark, right half bright, both with the same texture.
+  const std::size_t width = 256, height = 128, n = width * height;
+  std::vector<std::uint16_t> data(3 * n);
+  for (std::size_t y = 0; y < height; y++) {
+    for (std::size_t x = 0; x < width; x++) {
+      const int texture = (x * 7 + y * 13) % 1024;
+      const int v = x < width / 2 ? 1000 + texture : 50000 + texture;
+      for (int ch = 0; ch < 3; ch++) {
+        data[ch * n + y * width + x] = v;
+      }
+    }
+  }
+  std::vector<std::uint16_t> dst(data.size());
+  yk::LocalToneMapParams params;
+  params.tiles_x = 4;
+  params.tiles_y = 2;
+  params.clip_limit = 0;
+  yk::set_num_threads(4);
+  yk::local_equalization({data.data(), n}, width, height, dst.data(), params);
+  yk::set_num_threads(0);
+  // Far from the seam both halves are stretched over most of the range.
+  for (std::size_t x : {std::size_t(10), width - 10}) {
+    int minv = USHRT_MAX, maxv = 0;
+    for (std::size_t y = 0; y < height; y++) {
+      for (std::size_t dx = 0; dx < 16; dx++) {
+        const int v = dst[n + y * width + x - 5 + dx];
+        minv = std::min(minv, v);
+        maxv = std::max(maxv, v);
+      }
+    }
+    EXPECT_LT(minv, USHRT_MAX / 8);
+    EXPECT_GT(maxv, USHRT_MAX / 8 * 7);
+  }
+}
+
+TEST(ToneMapperTest, TestLocalEqualizationUniformTiles) {
+  // Tiles with the same histogram blend to the single-tile result at every
+  // column, including the runs at the borders and between tile centres.
+  const std::size_t width = 64, height = 32, n = width * height;
+  std::vector<std::uint16_t> data(3 * n);
+  for (std::size_t i = 0; i < data.size(); i++) {
+    data[i] = i * 40503 % USHRT_MAX;
+  }
+  for (std::size_t y = 0; y < height; y++) {
+    for (std::size_t x = 0; x < width; x++) {
+      data[n + y * width + x] = (x % 8 + y % 8 * 8) * 1024;
+    }
+  }
+  yk::LocalToneMapParams params;
+  params.tiles_x = params.tiles_y = 1;
+  params.clip_limit = 0;
+  std::vector<std::uint16_t> expected(data.size());
+  yk::local_equalization({data.data(), n}, width, height, expected.data(),
+                         params);
+  params.tiles_x = 8;
+  params.tiles_y = 4;
+  yk::set_num_threads(3);
+  yk::local_equalization({data.data(), n}, width, height, data.data(),
+                         params);
+  yk::set_num_threads(0);
+  for (std::size_t i = 0; i < data.size(); i++) {
+    ASSERT_NEAR(data[i], expected[i], 1) << i;
+  }
+}
+
+TEST(ToneMapperTest, TestLocalEqualizationEmpty) {
+  std::vector<std::uint16_t> dst(3, 7);
+  yk::local_equalization({nullptr, 0}, 0, 0, dst.data());
+  yk::local_equalization({nullptr, 0}, 5, 0, dst.data());
+  yk::local_equalization({nullptr, 0}, 0, 5, dst.data());
+  EXPECT_EQ(dst, std::vector<std::uint16_t>(3, 7));
+}
+
+TEST(ToneMapperTest, TestClipLimitBoundsSlope) {
+  // A narrow histogram peak is stretched over the full range without
+  // clipping, but only up to clip_limit times the identity slope with it.
+  yk::Histogram histogram(1 << 12, 0);
+  for (int b = 1000; b < 1010; b++) {
+    histogram[b] = 1000;
+  }
+  auto unclipped = yk::clipped_equalization_curve(histogram, 0, 12);
+  auto clipped = yk::clipped_equalization_curve(histogram, 4, 12);
+  auto range = [](const yk::ToneCurve &c) {
+    return c.lut(0)[1010 << 4] - c.lut(0)[1000 << 4];
+  };
+  EXPECT_GT(range(unclipped), USHRT_MAX * 0.8);
+  EXPECT_LE(range(clipped), (4 + 1) * (10 << 4));
+}
+
+TEST(ToneMapperTest, TestEqualizationRejectsBinMismatch) {
+  const yk::Histogram histogram(1 << 10, 1);
+  EXPECT_NO_THROW(yk::clipped_equalization_curve(histogram, 4, 10));
+  EXPECT_THROW(yk::clipped_equalization_curve(histogram, 4, 12),
+               std::invalid_argument);
+  EXPECT_THROW(yk::clipped_equalization_curve(histogram, 4, 0),
+               std::invalid_argument);
+}
+
+TEST(ToneMapperTest, TestCompose) {
+  auto half = yk::ToneCurve::from_function([](int v) { return v / 2.f; });
+  auto offset = yk::ToneCurve::from_channel_function(
+      [](int ch, int v) { return float(v + ch); });
+  auto curve = yk::compose(half, offset);
+  EXPECT_TRUE(curve.per_channel());
+  for (int ch = 0; ch < 3; ch++) {
+    EXPECT_EQ(curve.lut(ch)[1000], 500 + ch);
+  }
+}
@@ -0,0 +1,83 @@
+#include "transfer_function.hpp"
+#include <cmath>
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+constexpr yk::TransferFunction all_transfer_functions[] = {
+    yk::TransferFunction::linear, yk::TransferFunction::sRGB,
+    yk::TransferFunction::rec709, yk::TransferFunction::prophoto,
+    yk::TransferFunction::pq, yk::TransferFunction::hlg};
+}
+
+TEST(TransferFunctionTest, TestReferenceCurves) {
+  using yk::TransferFunction;
+  EXPECT_NEAR(yk::transfer_reference(TransferFunction::sRGB, 1.), 1., 1e-9);
+  EXPECT_NEAR(yk::transfer_reference(TransferFunction::sRGB, 0.18), 0.46135,
+              1e-5);
+  EXPECT_NEAR(yk::transfer_reference(TransferFunction::rec709, 1.), 1., 1e-9);
+  // ROMM RGB: gamma 1.8, continuous with the linear segment at 1/512.
+  EXPECT_NEAR(yk::transfer_reference(TransferFunction::prophoto, 0.18),
+              std::pow(0.18, 1. / 1.8), 1e-12);
+  EXPECT_NEAR(yk::transfer_reference(TransferFunction::prophoto, 1. / 512),
+              16. / 512, 1e-12);
+  // Diffuse white at 203 nits is 58% PQ and 75% HLG (ITU-R BT.2408).
+  EXPECT_NEAR(yk::transfer_reference(TransferFunction::pq, 1.), 0.5807, 1e-4);
+  EXPECT_NEAR(yk::transfer_reference(TransferFunction::pq, 1e3), 1., 1e-9);
+  EXPECT_NEAR(yk::transfer_reference(TransferFunction::hlg, 1.), 0.75, 1e-6);
+  // Highlights and negatives are not clipped by the SDR curves.
+  EXPECT_LT(1., yk::transfer_reference(TransferFunction::sRGB, 4.));
+  EXPECT_LT(1., yk::transfer_reference(TransferFunction::hlg, 4.));
+  EXPECT_NEAR(yk::transfer_reference(TransferFunction::sRGB, -0.5),
+              -yk::transfer_reference(TransferFunction::sRGB, 0.5), 1e-12);
+  EXPECT_EQ(yk::transfer_reference(TransferFunction::pq, -1.),
+            yk::transfer_reference(TransferFunction::pq, 0.));
+}
+
+TEST(TransferFunctionTest, TestEncodeErrorBound) {
+  const std::size_t n = 1 << 20;
+  std::vector<float> src(n), dst(n);
+  for (std::size_t i = 0; i < n; i++) {
+    // Dense near black, where the curves are steepest.
+    const double u = double(i) / n;
+    src[i] = float((i % 2 ? -64 : 64) * u * u * u);
+  }
+  for (const auto tf : all_transfer_functions) {
+    yk::transfer_encode(tf, src.data(), dst.data(), n);
+    double max_error = 0;
+    for (std::size_t i = 0; i < n; i++) {
+      max_error = std::max(
+          max_error, std::abs(dst[i] - yk::transfer_reference(tf, src[i])));
+    }
+    EXPECT_LE(max_error, yk::transfer_max_error) << yk::to_string(tf);
+  }
+}
+
+TEST(TransferFunctionTest, TestApplyTransferWithScale) {
+  const std::size_t n = 100000;
+  std::vector<float> src(3 * n), dst(3 * n);
+  for (std::size_t i = 0; i < src.size(); i++) {
+    src[i] = float(i % 70000);
+  }
+  const float scale = 2.f / 65535;
+  yk::apply_transfer(yk::TransferFunction::pq, src.data(), dst.data(), n,
+                     scale);
+  for (std::size_t i = 0; i < src.size(); i += 97) {
+    EXPECT_NEAR(dst[i],
+                yk::transfer_reference(yk::TransferFunction::pq,
+                                       double(src[i]) * scale),
+                yk::transfer_max_error);
+  }
+  // In place.
+  yk::apply_transfer(yk::TransferFunction::linear, src.data(), src.data(), n,
+                     0.5f);
+  EXPECT_EQ(src[3], 1.5f);
+}
+
+TEST(TransferFunctionTest, TestParseNames) {
+  for (const auto tf : all_transfer_functions) {
+    EXPECT_EQ(yk::parse_transfer_function(yk::to_string(tf)), tf);
+  }
+  EXPECT_THROW(yk::parse_transfer_function("gamma22"), std::invalid_argument);
+}